@@ -0,0 +1,79 @@
+#include "allocation.h"
+#include <stddef.h>
+
+
+static unsigned long long allocation_count;
+static unsigned long long allocated_bytes;
+
+/* Set once before any thread starts, the wrappers only count while it is 1
+ * so a run without --stats pays a load and a branch per allocation */
+static int counting;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* pointer, size_t size);
+void* __real_reallocarray(void* pointer, size_t count, size_t size);
+void* __real_aligned_alloc(size_t alignment, size_t size);
+
+static inline void Allocation_add(size_t size)
+{
+    if (counting) {
+        __atomic_fetch_add(&allocation_count, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&allocated_bytes, size, __ATOMIC_RELAXED);
+    }
+}
+
+void* __wrap_malloc(size_t size)
+{
+    Allocation_add(size);
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size)
+{
+    Allocation_add(count * size);
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* pointer, size_t size)
+{
+    Allocation_add(size);
+    return __real_realloc(pointer, size);
+}
+
+void* __wrap_reallocarray(void* pointer, size_t count, size_t size)
+{
+    Allocation_add(count * size);
+    return __real_reallocarray(pointer, count, size);
+}
+
+void* __wrap_aligned_alloc(size_t alignment, size_t size)
+{
+    Allocation_add(size);
+    return __real_aligned_alloc(alignment, size);
+}
+
+/* Count the allocations from now on, call it before starting any thread */
+extern void Allocation_enable(void)
+{
+    counting = 1;
+}
+
+/* Start counting from 0 again */
+extern void Allocation_reset(void)
+{
+    __atomic_store_n(&allocation_count, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&allocated_bytes, 0, __ATOMIC_RELAXED);
+}
+
+/* Allocations made since the start or the last reset */
+extern unsigned long long Allocation_count(void)
+{
+    return __atomic_load_n(&allocation_count, __ATOMIC_RELAXED);
+}
+
+/* Bytes requested by those allocations */
+extern unsigned long long Allocation_bytes(void)
+{
+    return __atomic_load_n(&allocated_bytes, __ATOMIC_RELAXED);
+}
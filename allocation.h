@@ -0,0 +1,16 @@
+#ifndef ALLOCATION_H
+#define ALLOCATION_H
+
+/* This module counts the allocations of the process. Linked with
+ * -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=reallocarray,--wrap=aligned_alloc
+ * every call to the allocation functions goes through its wrappers, so the
+ * allocations are counted without a custom allocator. Nothing is counted
+ * until Allocation_enable is called, which --stats does.
+ * It is linked into the assembler for --stats and into bench/bench */
+
+extern void               Allocation_enable(void);
+extern void               Allocation_reset (void);
+extern unsigned long long Allocation_count (void);
+extern unsigned long long Allocation_bytes (void);
+
+#endif
@@ -0,0 +1,173 @@
+#include "arena.h"
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* Add a new block to the front of the arena that can hold at least min_size bytes
+ * Return 0 on success
+ * Return -1 on failure, errno will be set */
+static int Arena_addBlock(Arena* arena, size_t min_size)
+{
+    size_t capacity = arena->block_size;
+
+    // Oversized allocations get a block of their own
+    if (capacity < min_size) {
+        capacity = min_size;
+    }
+
+    struct StructArenaBlock* block = malloc(sizeof(struct StructArenaBlock) + capacity);
+    if (block == NULL) {
+        return -1;
+    }
+
+    block->next = arena->head;
+    block->capacity = capacity;
+    block->used = 0;
+
+    arena->head = block;
+
+    return 0;
+}
+
+/* Carve size bytes aligned to alignment out of the arena
+ * alignment must be a power of 2
+ * Return a pointer to the memory on success
+ * Return NULL on failure, errno will be set */
+static void* Arena_allocAligned(Arena* arena, size_t size, size_t alignment)
+{
+    struct StructArenaBlock* block = arena->head;
+
+    // Guard the size computations below
+    if (size > SIZE_MAX / 2) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (block != NULL) {
+
+        uintptr_t start = (uintptr_t) &block->data[block->used];
+        size_t padding = (size_t) (-start & (alignment - 1));
+
+        if (block->capacity - block->used >= padding + size) {
+            block->used += padding + size;
+            return (void*) (start + padding);
+        }
+    }
+
+    // Doesn't fit, the rest of the current block is wasted
+    if (Arena_addBlock(arena, size + alignment) < 0) {
+        return NULL;
+    }
+
+    block = arena->head;
+
+    uintptr_t start = (uintptr_t) &block->data[0];
+    size_t padding = (size_t) (-start & (alignment - 1));
+
+    block->used = padding + size;
+    return (void*) (start + padding);
+}
+
+
+/* Create an arena, block_size is the size of the blocks memory is carved from
+ * No memory is allocated until the first allocation
+ * Return 0 on success
+ * Return -1 on failure, errno will be set */
+extern int Arena_create(Arena* arena, size_t block_size)
+{
+    if (arena != NULL &&
+        block_size > 0) {
+
+        arena->head = NULL;
+        arena->block_size = block_size;
+
+        return 0;
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/* Release every allocation made from the arena at once */
+extern void Arena_free(Arena* arena)
+{
+    if (arena != NULL) {
+
+        struct StructArenaBlock* block = arena->head;
+
+        while (block != NULL) {
+            struct StructArenaBlock* next = block->next;
+            free(block);
+            block = next;
+        }
+
+        arena->head = NULL;
+    }
+}
+
+/* Release every allocation made from the arena but keep
+ * the most recent block, so the arena can be reused without calling malloc */
+extern void Arena_reset(Arena* arena)
+{
+    if (arena != NULL &&
+        arena->head != NULL) {
+
+        struct StructArenaBlock* block = arena->head->next;
+
+        while (block != NULL) {
+            struct StructArenaBlock* next = block->next;
+            free(block);
+            block = next;
+        }
+
+        arena->head->next = NULL;
+        arena->head->used = 0;
+    }
+}
+
+/* Allocate size bytes suitably aligned for any type
+ * The memory lives until the arena is freed
+ * Return a pointer to the memory on success
+ * Return NULL on failure, errno will be set */
+extern void* Arena_alloc(Arena* arena, size_t size)
+{
+    if (arena != NULL) {
+        return Arena_allocAligned(arena, size, _Alignof(max_align_t));
+    }
+
+    else {
+        errno = EINVAL;
+        return NULL;
+    }
+}
+
+/* Copy the first length characters of str into the arena
+ * and null terminate the copy
+ * Return the copy on success
+ * Return NULL on failure, errno will be set */
+extern char* Arena_strndup(Arena* arena, const char* str, size_t length)
+{
+    if (arena != NULL &&
+        str != NULL) {
+
+        char* copy = Arena_allocAligned(arena, length + 1, 1);
+        if (copy == NULL) {
+            return NULL;
+        }
+
+        memcpy(copy, str, length);
+        copy[length] = '\0';
+
+        return copy;
+    }
+
+    else {
+        errno = EINVAL;
+        return NULL;
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/* This module contains a bump allocator, memory is carved out of large
+ * blocks and is only ever released all at once */
+
+struct StructArenaBlock {
+    struct StructArenaBlock* next;   // Previously filled block
+    size_t capacity;                 // How many bytes data can hold
+    size_t used;                     // How many bytes of data are handed out
+    char   data[];
+};
+
+struct StructArena {
+    struct StructArenaBlock* head;   // Block allocations are carved from
+    size_t block_size;               // Default capacity of a new block
+};
+
+typedef struct StructArena Arena;
+
+extern int   Arena_create   (Arena*, size_t);
+extern void  Arena_free     (Arena*);
+extern void  Arena_reset    (Arena*);
+extern void* Arena_alloc    (Arena*, size_t);
+extern char* Arena_strndup  (Arena*, const char*, size_t);
+
+#endif
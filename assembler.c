@@ -0,0 +1,736 @@
+#include "assembler.h"
+#include "backpatch.h"
+#include "parallel.h"
+#include "window.h"
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+
+static void logParseError(AssemblerReport* report, Parser* parser, int error_num, const char* message);
+static void flushOutput(void* context);
+static int  parseCommands(Parser* parser,
+                          SymbolTable* symbol_table,
+                          CommandArray* command_array,
+                          Stats* stats,
+                          DebugInfo* debug,
+                          AssemblerReport* report);
+static int resolveSymbols(SymbolTable* symbol_table,
+                          CommandArray* command_array,
+                          Stats* stats,
+                          DebugInfo* debug,
+                          AssemblerReport* report);
+static int generateCode(SymbolTable* symbol_table,
+                        CommandArray* command_array,
+                        Output*       output,
+                        Stats*        stats,
+                        DebugInfo*    debug,
+                        AssemblerReport* report);
+static int assembleTwoPass(Parser* parser,
+                           SymbolTable* symbol_table,
+                           CommandArray* command_array,
+                           Output* output,
+                           Stats* stats,
+                           DebugInfo* debug,
+                           int optimize,
+                           AssemblerReport* report);
+static int assembleSinglePass(Parser* parser,
+                              SymbolTable* symbol_table,
+                              Arena* arena,
+                              Output* output,
+                              Stats* stats,
+                              AssemblerReport* report);
+
+/* Hand everything written so far to the output file, before a streamed parser blocks */
+static void flushOutput(void* context)
+{
+    Output* output = context;
+
+    // A failure shows up again on the final flush
+    if (Output_flush(output) == 0) {
+        fflush(output->file);
+    }
+}
+
+/* Record an error of the command the parser is on, with its line */
+static void logParseError(AssemblerReport* report, Parser* parser, int error_num, const char* message)
+{
+    if (report->error == 0) {
+        Assembler_logError(report, error_num, message);
+        report->line = Parser_lineNumber(parser);
+    }
+}
+
+/* Parse every command, the labels get their address and the A and C
+ * commands are stored encoded in command_array. When debug isn't NULL
+ * the labels and the source line of every instruction are recorded in it
+ * Return 0 on success
+ * Return -1 on failure, the error is recorded in report */
+static int  parseCommands(Parser* parser,
+                          SymbolTable* symbol_table,
+                          CommandArray* command_array,
+                          Stats* stats,
+                          DebugInfo* debug,
+                          AssemblerReport* report)
+{
+    int error = 0;
+    size_t instruction_counter = 0;
+
+    // Parse the commands and generate the symbols
+    while (Parser_hasMoreCommands(parser)) {
+        error = Parser_advance(parser);
+
+        // error
+        if (error < 0) {
+            logParseError(report, parser, errno, "Failed to parse instruction");
+            return -1;
+        }
+
+        // no new command read
+        else if (error == 1) {
+            break;
+        }
+
+
+        /* If its an L command add it to the symbol table
+         * Otherwise just add it to the command Array */
+
+        enum Command command_type = Parser_commandType(parser);
+
+        // Give the label its address, the symbol table only holds the predefined symbols
+        if (command_type == L_COMMAND) {
+            StringView symbol = Parser_symbolView(parser);
+
+            // A predefined symbol
+            int defined = SymbolTable_containsN(symbol_table, symbol.data, symbol.length);
+            if (defined != 0) {
+                logParseError(report, parser, (defined > 0) ? EEXIST : errno, "Duplicate or invalid symbol found");
+                return -1;
+            }
+
+            int64_t id = CommandArray_addLabel(command_array, symbol, (int) instruction_counter);
+
+            // Defined twice
+            if (id < 0 && errno == EEXIST) {
+                logParseError(report, parser, errno, "Duplicate or invalid symbol found");
+                return -1;
+            }
+
+            // Failure to add the label
+            else if (id < 0) {
+                logParseError(report, parser, errno, "Failed to add entry to symbol table");
+                return -1;
+            }
+
+            // The interned name lives as long as the program
+            if (debug != NULL &&
+                DebugInfo_addLabel(debug, command_array->symbols.names[id], (int) instruction_counter) < 0) {
+                logParseError(report, parser, errno, "Failed to record debug info");
+                return -1;
+            }
+
+            if (stats != NULL) {
+                stats->labels += 1;
+            }
+        }
+
+        // Add to command array
+        else {
+            // copy the command
+            error = CommandArray_copyCommand(command_array, parser);
+            if (error < 0) {
+                logParseError(report, parser, errno, "Failed to copy command");
+                return -1;
+            }
+
+            if (debug != NULL &&
+                DebugInfo_addLine(debug, Parser_lineNumber(parser)) < 0) {
+                logParseError(report, parser, errno, "Failed to record debug info");
+                return -1;
+            }
+
+            instruction_counter += 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Substitute the address of every symbol in the encoded commands,
+ * unknown symbols are variables allocated from address 16 in order of first use,
+ * they are recorded in debug when it isn't NULL.
+ * The labels already have their address, every other distinct symbol is looked
+ * up once, the instructions then only index the address table with their symbol ID
+ * Return 0 on success
+ * Return -1 on failure, the error is recorded in report */
+static int resolveSymbols(SymbolTable* symbol_table,
+                          CommandArray* command_array,
+                          Stats* stats,
+                          DebugInfo* debug,
+                          AssemblerReport* report)
+{
+    const Interner* symbols = &command_array->symbols;
+    int* addresses = command_array->addresses;
+
+    // Predefined symbols
+    for (size_t id = 0; id < symbols->count; id++) {
+
+        if (addresses[id] != COMMAND_UNASSIGNED) {
+            continue;
+        }
+
+        StringView symbol = symbols->names[id];
+        int symbol_address = SymbolTable_getAddressN(symbol_table, symbol.data, symbol.length);
+
+        if (symbol_address >= 0) {
+            addresses[id] = symbol_address;
+        }
+
+        else if (errno != 0) {
+            Assembler_logError(report, errno, "Failed generate A instruction");
+            return -1;
+        }
+    }
+
+    uint16_t* words = command_array->words;
+    const uint32_t* symbol_ids = command_array->symbol_ids;
+
+    size_t next_variable_address = 16;
+    for (size_t index = 0; index < command_array->size; index++) {
+
+        // A instruction referencing a symbol
+        if (symbol_ids[index] != COMMAND_NO_SYMBOL) {
+
+            uint32_t id = symbol_ids[index];
+
+            // Is an unknown symbol used for the first time, a variable
+            if (addresses[id] == COMMAND_UNASSIGNED) {
+
+                StringView symbol = symbols->names[id];
+
+                if (SymbolTable_addEntryN(symbol_table, symbol.data, symbol.length, next_variable_address) < 0) {
+                    Assembler_logError(report, errno, "Failed to create variable");
+                    return -1;
+                }
+
+                if (debug != NULL &&
+                    DebugInfo_addVariable(debug, symbol, (int) next_variable_address) < 0) {
+                    Assembler_logError(report, errno, "Failed to record debug info");
+                    return -1;
+                }
+
+                if (stats != NULL) {
+                    stats->variables += 1;
+                }
+
+                addresses[id] = (int) next_variable_address;
+                next_variable_address += 1;
+            }
+
+            words[index] = (uint16_t) addresses[id];
+        }
+    }
+
+    return 0;
+}
+
+static int generateCode(SymbolTable* symbol_table,
+                        CommandArray* command_array,
+                        Output*       output,
+                        Stats*        stats,
+                        DebugInfo*    debug,
+                        AssemblerReport* report)
+{
+
+    /* Substitue symbols in all the encoded commands
+     * write the words in one batch */
+    Stats_begin(stats);
+    int error = resolveSymbols(symbol_table, command_array, stats, debug, report);
+    Stats_end(stats, STATS_RESOLVE);
+    if (error < 0) {
+        return -1;
+    }
+
+    Stats_begin(stats);
+
+    error = Output_writeHeader(output, command_array->size);
+    if (error < 0) {
+        Assembler_logError(report, errno, "Failed to write to output file");
+        return -1;
+    }
+
+    // By this point every word is resolved
+    error = Output_writeWords(output, command_array->words, command_array->size);
+    Stats_end(stats, STATS_WRITE);
+    if (error < 0) {
+        Assembler_logError(report, errno, "Failed to write to output file");
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Assemble in two passes, the first stores the encoded program and
+ * collects the labels, the second resolves the symbols and writes it.
+ * In between the program is optimized at the OptimizerLevel optimize
+ * command_array must be empty
+ * Return 0 on success
+ * Return -1 on failure, the error is recorded in report */
+static int assembleTwoPass(Parser* parser,
+                           SymbolTable* symbol_table,
+                           CommandArray* command_array,
+                           Output* output,
+                           Stats* stats,
+                           DebugInfo* debug,
+                           int optimize,
+                           AssemblerReport* report)
+{
+    // Parse the commands and insert labels into the symbol table
+    Stats_begin(stats);
+    int error = parseCommands(parser,
+                              symbol_table,
+                              command_array,
+                              stats,
+                              debug,
+                              report);
+    Stats_end(stats, STATS_PARSE);
+
+    // Shrink the program while the labels can still move
+    if (error == 0 && optimize != OPTIMIZER_NONE) {
+        size_t removed = 0;
+
+        Stats_begin(stats);
+        error = Optimizer_peephole(command_array, debug, &removed);
+
+        // The dataflow pass leaves new windows for the peephole rules
+        if (error == 0 && optimize >= OPTIMIZER_DATAFLOW) {
+            size_t dataflow_removed = 0;
+            size_t peephole_removed = 0;
+
+            error = Optimizer_dataflow(command_array, debug, &dataflow_removed);
+            if (error == 0 && dataflow_removed > 0) {
+                error = Optimizer_peephole(command_array, debug, &peephole_removed);
+            }
+
+            removed += dataflow_removed + peephole_removed;
+        }
+        Stats_end(stats, STATS_OPTIMIZE);
+
+        if (error < 0) {
+            Assembler_logError(report, errno, "Failed to optimize the program");
+        }
+
+        if (stats != NULL) {
+            stats->instructions_removed += removed;
+        }
+    }
+
+    // Generate code fromo the parsed commands
+    if (error == 0) {
+        error = generateCode(symbol_table, command_array, output, stats, debug, report);
+    }
+
+    return error;
+}
+
+/* Assemble in a single pass, every instruction is written as soon as it is parsed.
+ * References to symbols that aren't defined yet are written as 0 and recorded,
+ * they are patched when the label is defined or, for variables, at the end of the input.
+ * Memory is proportional to the pending references, not to the program.
+ * An output that can't be sought, a pipe, can't be patched: the words from the
+ * oldest pending reference on are held in a Window and written once it is resolved.
+ * A streamed parser has the output flushed every time it waits for more input
+ * Return 0 on success
+ * Return -1 on failure, the error is recorded in report */
+static int assembleSinglePass(Parser* parser,
+                              SymbolTable* symbol_table,
+                              Arena* arena,
+                              Output* output,
+                              Stats* stats,
+                              AssemblerReport* report)
+{
+    Backpatch backpatch;
+    int error = Backpatch_create(&backpatch, arena);
+    if (error < 0) {
+        Assembler_logError(report, errno, "Failed to create the fixup list");
+        return -1;
+    }
+
+    Window window;
+    Window_create(&window);
+
+    Window* held = NULL;
+    if (output->start_offset < 0) {
+
+        // The header holds the word count, only known at the end
+        if (output->options.format == OUTPUT_BINARY && output->options.header == 1) {
+            Assembler_logError(report, ESPIPE, "The binary header needs a seekable output file");
+            Backpatch_free(&backpatch);
+            Window_free(&window);
+            return -1;
+        }
+
+        held = &window;
+        Backpatch_setWindow(&backpatch, held);
+    }
+
+    if (parser->stream_fd >= 0) {
+        Parser_setStreamWait(parser, flushOutput, output);
+    }
+
+    // The word count is only known at the end
+    error = Output_writeHeader(output, 0);
+    if (error < 0) {
+        Assembler_logError(report, errno, "Failed to write to output file");
+        Backpatch_free(&backpatch);
+        Window_free(&window);
+        return -1;
+    }
+
+    size_t instruction_counter = 0;
+
+    // Parsing and writing are interleaved, they are timed together as parsing
+    Stats_begin(stats);
+
+    while (Parser_hasMoreCommands(parser)) {
+        error = Parser_advance(parser);
+
+        // error
+        if (error < 0) {
+            logParseError(report, parser, errno, "Failed to parse instruction");
+            Backpatch_free(&backpatch);
+            Window_free(&window);
+            return -1;
+        }
+
+        // no new command read
+        else if (error == 1) {
+            break;
+        }
+
+        enum Command command_type = Parser_commandType(parser);
+        uint16_t word = 0;
+        int pending = 0;
+
+        // Define the label and patch its earlier references
+        if (command_type == L_COMMAND) {
+            StringView symbol = Parser_symbolView(parser);
+
+            // Defined already or a predefined symbol
+            int defined = SymbolTable_containsN(symbol_table, symbol.data, symbol.length);
+            if (defined != 0) {
+                logParseError(report, parser, (defined > 0) ? EEXIST : errno, "Duplicate or invalid symbol found");
+                Backpatch_free(&backpatch);
+                Window_free(&window);
+                return -1;
+            }
+
+            if (SymbolTable_addEntryN(symbol_table, symbol.data, symbol.length, instruction_counter) < 0) {
+                logParseError(report, parser, errno, "Failed to add entry to symbol table");
+                Backpatch_free(&backpatch);
+                Window_free(&window);
+                return -1;
+            }
+
+            if (Backpatch_resolveLabel(&backpatch, symbol.data, symbol.length, instruction_counter, output) < 0 ||
+                (held != NULL && Window_release(held, output) < 0)) {
+                logParseError(report, parser, errno, "Failed to patch the references to a label");
+                Backpatch_free(&backpatch);
+                Window_free(&window);
+                return -1;
+            }
+
+            if (stats != NULL) {
+                stats->labels += 1;
+            }
+
+            continue;
+        }
+
+        // The parser encoded the word, only a symbol needs to be looked up
+        else if (command_type == A_COMMAND && Parser_needsSymbol(parser) == 1) {
+            StringView symbol = Parser_symbolView(parser);
+
+            int symbol_address = SymbolTable_getAddressN(symbol_table, symbol.data, symbol.length);
+
+            // Known symbol
+            if (symbol_address >= 0) {
+                word = (uint16_t) symbol_address;
+            }
+
+            // Not defined yet, a forward label reference or a variable
+            else if (errno == 0) {
+                error = Backpatch_addReference(&backpatch, symbol.data, symbol.length, instruction_counter);
+                pending = 1;
+            }
+
+            else {
+                error = -1;
+            }
+
+            if (error < 0) {
+                logParseError(report, parser, errno, "Failed generate A instruction");
+                Backpatch_free(&backpatch);
+                Window_free(&window);
+                return -1;
+            }
+        }
+
+        // C commands and constant A commands
+        else {
+            word = Parser_word(parser);
+        }
+
+        error = (held != NULL) ? Window_push(held, output, word, pending) : Output_writeWord(output, word);
+        if (error < 0) {
+            logParseError(report, parser, errno, "Failed to write to output file");
+            Backpatch_free(&backpatch);
+            Window_free(&window);
+            return -1;
+        }
+
+        instruction_counter += 1;
+    }
+
+    Stats_end(stats, STATS_PARSE);
+
+    // Everything still pending is a variable
+    Stats_begin(stats);
+    size_t symbol_count = symbol_table->size;
+
+    error = Backpatch_resolveVariables(&backpatch, symbol_table, 16, output);
+    if (error == 0 && held != NULL) {
+        error = Window_release(held, output);
+    }
+    if (error == 0) {
+        error = Output_patchHeader(output, instruction_counter);
+    }
+
+    if (stats != NULL) {
+        stats->variables += symbol_table->size - symbol_count;
+        stats->symbol_lookups += backpatch.pending_index.lookups;
+    }
+
+    Stats_end(stats, STATS_RESOLVE);
+
+    if (error < 0) {
+        Assembler_logError(report, errno, "Failed to resolve the remaining symbols");
+    }
+
+    Parser_setStreamWait(parser, NULL, NULL);
+    Backpatch_free(&backpatch);
+    Window_free(&window);
+
+    return error;
+}
+
+/* Fill options with the defaults, text output assembled in two passes on one thread */
+extern void Assembler_defaultOptions(AssemblerOptions* options)
+{
+    if (options != NULL) {
+        Output_defaultOptions(&options->output);
+        options->single_pass = 0;
+        options->thread_count = 1;
+        options->optimize = OPTIMIZER_NONE;
+    }
+}
+
+/* Create an assembler, ready to assemble any number of programs
+ * Return 0 on success
+ * Return -1 on failure, errno will be set */
+extern int Assembler_create(Assembler* assembler)
+{
+    if (assembler != NULL) {
+
+        // create the arena all the symbol names are carved from
+        if (Arena_create(&assembler->arena, 64 * 1024) < 0) {
+            return -1;
+        }
+
+        // create the symbol table
+        if (SymbolTable_create(&assembler->symbol_table, 128) < 0) {
+            return -1;
+        }
+
+        // create the command array
+        if (CommandArray_create(&assembler->command_array, 128, &assembler->arena) < 0) {
+            SymbolTable_free(&assembler->symbol_table);
+            return -1;
+        }
+
+        assembler->stats = NULL;
+        assembler->debug = NULL;
+
+        // Done :)
+        return 0;
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/* Free an assembler, every symbol name goes with the arena */
+extern void Assembler_free(Assembler* assembler)
+{
+    if (assembler != NULL) {
+        CommandArray_free(&assembler->command_array);
+        SymbolTable_free(&assembler->symbol_table);
+        Arena_free(&assembler->arena);
+    }
+}
+
+/* Assemble the program read by parser and write it to output_file.
+ * The output is flushed but output_file is left open
+ * Return 0 on success
+ * Return -1 on failure, the error is recorded in report */
+extern int Assembler_assemble(Assembler* assembler,
+                              Parser* parser,
+                              FILE* output_file,
+                              const AssemblerOptions* options,
+                              AssemblerReport* report)
+{
+    if (assembler == NULL ||
+        parser == NULL ||
+        output_file == NULL ||
+        options == NULL ||
+        report == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // Forget the previous program
+    Arena_reset(&assembler->arena);
+    CommandArray_reset(&assembler->command_array);
+    int error = SymbolTable_reset(&assembler->symbol_table);
+    if (error < 0) {
+        Assembler_logError(report, errno, "Failed to create symbol table");
+        return -1;
+    }
+
+    Output* output = &assembler->output;
+    Output_create(output, output_file, &options->output);
+
+    // The debug info is collected and the program optimized by the two pass path, which needs the whole source
+    if (assembler->debug != NULL || options->optimize != OPTIMIZER_NONE) {
+        DebugInfo_reset(assembler->debug);
+
+        if (parser->stream_fd >= 0) {
+            Assembler_logError(report, EINVAL, (assembler->debug != NULL) ? "Debug info needs an input file"
+                                                                          : "Optimizing needs an input file");
+            return -1;
+        }
+
+        error = assembleTwoPass(parser, &assembler->symbol_table, &assembler->command_array, output,
+                                assembler->stats, assembler->debug, options->optimize, report);
+    }
+    // Only a source in memory can be split between threads
+    else if (options->thread_count > 1 && parser->mapped != 0 && parser->stream_fd < 0) {
+        const char* error_message = NULL;
+        size_t error_line = 0;
+        error = Parallel_assemble(parser->mapped_source, parser->mapped_length, options->thread_count,
+                                  &assembler->symbol_table, output, assembler->stats, &error_message, &error_line);
+        if (error < 0) {
+            Assembler_logError(report, errno, error_message);
+            report->line = error_line;
+        }
+    }
+    // The views of a stream don't outlive the next command, it is always assembled in one pass
+    else if (options->single_pass == 1 || parser->stream_fd >= 0) {
+        error = assembleSinglePass(parser, &assembler->symbol_table, &assembler->arena, output, assembler->stats, report);
+    }
+    else {
+        error = assembleTwoPass(parser, &assembler->symbol_table, &assembler->command_array, output,
+                                assembler->stats, NULL, OPTIMIZER_NONE, report);
+    }
+
+    if (error < 0) {
+        return -1;
+    }
+
+    Stats_begin(assembler->stats);
+    error = Output_flush(output);
+    if (error == 0) {
+        error = fflush(output_file);
+    }
+    // An earlier flush of a stream may have failed
+    if (error == 0 && ferror(output_file) != 0) {
+        errno = EIO;
+        error = -1;
+    }
+    Stats_end(assembler->stats, STATS_WRITE);
+
+    if (error != 0) {
+        Assembler_logError(report, errno, "Failed to flush output to output file");
+        return -1;
+    }
+
+    if (assembler->stats != NULL) {
+        assembler->stats->files += 1;
+        assembler->stats->instructions += output->word_count;
+        assembler->stats->bytes_written += output->flushed_bytes;
+        // The parallel path never advances the parser, it counts its own lines
+        assembler->stats->lines += Parser_lineNumber(parser);
+        // Both were reset for this program, the parallel path adds the lookups of its chunks
+        assembler->stats->symbol_lookups += assembler->symbol_table.lookups +
+                                            assembler->command_array.symbols.lookups;
+    }
+
+    return 0;
+}
+
+/* Assemble the program read by parser without writing it anywhere,
+ * the resolved words are left in the command array of assembler
+ * and stay valid until its next program
+ * Return 0 on success
+ * Return -1 on failure, the error is recorded in report */
+extern int Assembler_assembleWords(Assembler* assembler,
+                                   Parser* parser,
+                                   AssemblerReport* report)
+{
+    if (assembler == NULL ||
+        parser == NULL ||
+        report == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // Forget the previous program
+    Arena_reset(&assembler->arena);
+    CommandArray_reset(&assembler->command_array);
+    if (SymbolTable_reset(&assembler->symbol_table) < 0) {
+        Assembler_logError(report, errno, "Failed to create symbol table");
+        return -1;
+    }
+
+    int error = parseCommands(parser, &assembler->symbol_table, &assembler->command_array, NULL, NULL, report);
+    if (error == 0) {
+        error = resolveSymbols(&assembler->symbol_table, &assembler->command_array, NULL, NULL, report);
+    }
+
+    return error;
+}
+
+/* Clear a report before assembling a program */
+extern void Assembler_clearReport(AssemblerReport* report)
+{
+    if (report != NULL) {
+        report->error = 0;
+        report->error_number = 0;
+        report->message = NULL;
+        report->line = 0;
+    }
+}
+
+/* Record an error in a report, only the first one is kept */
+extern void Assembler_logError(AssemblerReport* report, int error_num, const char* message)
+{
+    if (report != NULL &&
+        report->error == 0) {
+        report->error = -1;
+        report->error_number = error_num;
+        report->message = message;
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+#include "parser.h"
+#include "util.h"
+#include "symbol.h"
+#include "arena.h"
+#include "output.h"
+#include "stats.h"
+#include "debug.h"
+#include "optimizer.h"
+
+#include <stdio.h>
+
+/* This module assembles one program at a time. An Assembler keeps its arena,
+ * symbol table, command array and output buffer from one program to the next,
+ * so a warm assembler only resets them instead of allocating them again */
+
+/* How a program is assembled */
+struct StructAssemblerOptions {
+    OutputOptions output;
+    int           single_pass;     // 1 to assemble in one pass, patching forward references
+    int           thread_count;    // Threads assembling the program, 1 assembles sequentially
+    int           optimize;        // An OptimizerLevel, anything but OPTIMIZER_NONE assembles in two passes
+};
+
+typedef struct StructAssemblerOptions AssemblerOptions;
+
+/* The first error of a program */
+struct StructAssemblerReport {
+    int         error;             // -1 if the program failed
+    int         error_number;
+    const char* message;
+    size_t      line;              // Line of the source that failed, 0 if not tied to a line
+};
+
+typedef struct StructAssemblerReport AssemblerReport;
+
+struct StructAssembler {
+    Arena        arena;            // Symbol names of the current program
+    SymbolTable  symbol_table;
+    CommandArray command_array;
+    Output       output;
+    Stats*       stats;            // Collects the statistics of every program, NULL when off
+    DebugInfo*   debug;            // Collects the debug info of the current program, NULL when off
+};
+
+typedef struct StructAssembler Assembler;
+
+extern void Assembler_defaultOptions (AssemblerOptions*);
+extern int  Assembler_create         (Assembler*);
+extern void Assembler_free           (Assembler*);
+extern int  Assembler_assemble       (Assembler*, Parser*, FILE*, const AssemblerOptions*, AssemblerReport*);
+extern int  Assembler_assembleWords  (Assembler*, Parser*, AssemblerReport*);
+extern void Assembler_clearReport    (AssemblerReport*);
+extern void Assembler_logError       (AssemblerReport*, int, const char*);
+
+#endif
@@ -0,0 +1,286 @@
+#include "backpatch.h"
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* Patch every word referencing the pending symbol with address
+ * and return its fixups to the free list
+ * Return 0 on success
+ * Return -1 on failure, set errno */
+static int Backpatch_patch(Backpatch* backpatch, struct StructPendingSymbol* symbol, int address, Output* output)
+{
+    uint32_t fixup = symbol->first_fixup;
+
+    while (fixup != FIXUP_NONE) {
+
+        struct StructFixup* current = &backpatch->fixups[fixup];
+        uint32_t next = current->next;
+
+        int error = (backpatch->window != NULL)
+                  ? Window_patch(backpatch->window, current->word_index, (uint16_t) address)
+                  : Output_patchWord(output, current->word_index, (uint16_t) address);
+        if (error < 0) {
+            return -1;
+        }
+
+        // Release the fixup
+        current->next = backpatch->free_fixup;
+        backpatch->free_fixup = fixup;
+
+        fixup = next;
+    }
+
+    symbol->first_fixup = FIXUP_NONE;
+    symbol->resolved = 1;
+
+    return 0;
+}
+
+/* Take a fixup from the free list or the end of the pool
+ * Return its index on success
+ * Return -1 on failure, set errno */
+static int64_t Backpatch_allocateFixup(Backpatch* backpatch)
+{
+    if (backpatch->free_fixup != FIXUP_NONE) {
+        uint32_t fixup = backpatch->free_fixup;
+        backpatch->free_fixup = backpatch->fixups[fixup].next;
+        return fixup;
+    }
+
+    if (backpatch->fixup_count == backpatch->fixup_capacity) {
+
+        size_t new_capacity = (backpatch->fixup_capacity > 0) ? backpatch->fixup_capacity * 2 : 64;
+
+        // Indices must stay below FIXUP_NONE
+        if (new_capacity >= FIXUP_NONE) {
+            errno = ERANGE;
+            return -1;
+        }
+
+        errno = 0;
+        struct StructFixup* new_fixups = reallocarray(backpatch->fixups, new_capacity, sizeof(struct StructFixup));
+        if (errno != 0) {
+            return -1;
+        }
+
+        backpatch->fixups = new_fixups;
+        backpatch->fixup_capacity = new_capacity;
+    }
+
+    backpatch->fixup_count += 1;
+
+    return (int64_t) backpatch->fixup_count - 1;
+}
+
+/* Add a symbol to the pending symbols
+ * Return its index on success
+ * Return -1 on failure, set errno */
+static int64_t Backpatch_addPending(Backpatch* backpatch, const char* symbol, size_t length)
+{
+    if (backpatch->pending_count == backpatch->pending_capacity) {
+
+        size_t new_capacity = (backpatch->pending_capacity > 0) ? backpatch->pending_capacity * 2 : 64;
+
+        errno = 0;
+        struct StructPendingSymbol* new_pending = reallocarray(backpatch->pending, new_capacity, sizeof(struct StructPendingSymbol));
+        if (errno != 0) {
+            return -1;
+        }
+
+        backpatch->pending = new_pending;
+        backpatch->pending_capacity = new_capacity;
+    }
+
+    size_t index = backpatch->pending_count;
+
+    // The index is stored as the address of the name, bounded by the symbol table
+    if (SymbolTable_addEntryN(&backpatch->pending_index, symbol, length, (int) index) < 0) {
+        return -1;
+    }
+
+    char* name = Arena_strndup(backpatch->arena, symbol, length);
+    if (name == NULL) {
+        return -1;
+    }
+
+    struct StructPendingSymbol* pending = &backpatch->pending[index];
+    pending->name.data = name;
+    pending->name.length = length;
+    pending->first_fixup = FIXUP_NONE;
+    pending->resolved = 0;
+
+    backpatch->pending_count += 1;
+
+    return (int64_t) index;
+}
+
+
+/* Create an empty set of pending symbols
+ * the names are carved from arena, which must outlive it
+ * Return 0 on success
+ * Return -1 on failure, set errno */
+extern int Backpatch_create(Backpatch* backpatch, Arena* arena)
+{
+    if (backpatch != NULL &&
+        arena != NULL) {
+
+        backpatch->pending = NULL;
+        backpatch->pending_count = 0;
+        backpatch->pending_capacity = 0;
+        backpatch->fixups = NULL;
+        backpatch->fixup_count = 0;
+        backpatch->fixup_capacity = 0;
+        backpatch->free_fixup = FIXUP_NONE;
+        backpatch->arena = arena;
+        backpatch->window = NULL;
+
+        // Predefined symbols in the index are never looked up,
+        // they always resolve through the main symbol table
+        return SymbolTable_create(&backpatch->pending_index, 64);
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/* Free the pending symbols and fixups */
+extern void Backpatch_free(Backpatch* backpatch)
+{
+    if (backpatch != NULL) {
+
+        SymbolTable_free(&backpatch->pending_index);
+        free(backpatch->pending);
+        free(backpatch->fixups);
+
+        backpatch->pending = NULL;
+        backpatch->pending_count = 0;
+        backpatch->pending_capacity = 0;
+        backpatch->fixups = NULL;
+        backpatch->fixup_count = 0;
+        backpatch->fixup_capacity = 0;
+        backpatch->free_fixup = FIXUP_NONE;
+    }
+}
+
+/* Patch the words held in window instead of the output,
+ * for an output that can't be sought. NULL patches the output again */
+extern void Backpatch_setWindow(Backpatch* backpatch, Window* window)
+{
+    if (backpatch != NULL) {
+        backpatch->window = window;
+    }
+}
+
+/* Record that the output word at word_index references a symbol that has no address yet
+ * The first reference of a symbol fixes its place in the variable order
+ * Return 0 on success
+ * Return -1 on failure, set errno */
+extern int Backpatch_addReference(Backpatch* backpatch, const char* symbol, size_t length, size_t word_index)
+{
+    if (backpatch != NULL &&
+        symbol != NULL) {
+
+        int64_t index = SymbolTable_getAddressN(&backpatch->pending_index, symbol, length);
+
+        // First reference
+        if (index < 0 && errno == 0) {
+            index = Backpatch_addPending(backpatch, symbol, length);
+        }
+
+        if (index < 0) {
+            return -1;
+        }
+
+        int64_t fixup = Backpatch_allocateFixup(backpatch);
+        if (fixup < 0) {
+            return -1;
+        }
+
+        // Push the fixup on the symbol's chain, patch order doesn't matter
+        struct StructPendingSymbol* pending = &backpatch->pending[index];
+
+        backpatch->fixups[fixup].word_index = word_index;
+        backpatch->fixups[fixup].next = pending->first_fixup;
+        pending->first_fixup = (uint32_t) fixup;
+
+        return 0;
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/* A label got defined, patch the words that referenced it before
+ * Does nothing if the label wasn't referenced yet
+ * Return 0 on success
+ * Return -1 on failure, set errno */
+extern int Backpatch_resolveLabel(Backpatch* backpatch, const char* symbol, size_t length, int address, Output* output)
+{
+    if (backpatch != NULL &&
+        symbol != NULL &&
+        output != NULL) {
+
+        int index = SymbolTable_getAddressN(&backpatch->pending_index, symbol, length);
+
+        // Not referenced before
+        if (index < 0 && errno == 0) {
+            return 0;
+        }
+
+        else if (index < 0) {
+            return -1;
+        }
+
+        return Backpatch_patch(backpatch, &backpatch->pending[index], address, output);
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/* The input ended, every symbol still pending is a variable.
+ * They get addresses starting at first_address in order of first use,
+ * are added to symbol_table and their references are patched
+ * Return 0 on success
+ * Return -1 on failure, set errno */
+extern int Backpatch_resolveVariables(Backpatch* backpatch, SymbolTable* symbol_table, int first_address, Output* output)
+{
+    if (backpatch != NULL &&
+        symbol_table != NULL &&
+        output != NULL) {
+
+        int next_variable_address = first_address;
+
+        for (size_t index = 0; index < backpatch->pending_count; index++) {
+
+            struct StructPendingSymbol* pending = &backpatch->pending[index];
+
+            if (pending->resolved == 1) {
+                continue;
+            }
+
+            if (SymbolTable_addEntryN(symbol_table, pending->name.data, pending->name.length, next_variable_address) < 0 ||
+                Backpatch_patch(backpatch, pending, next_variable_address, output) < 0) {
+                return -1;
+            }
+
+            next_variable_address += 1;
+        }
+
+        return 0;
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
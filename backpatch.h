@@ -0,0 +1,56 @@
+#ifndef BACKPATCH_H
+#define BACKPATCH_H
+
+#include "parser.h"
+#include "symbol.h"
+#include "arena.h"
+#include "output.h"
+#include "window.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* This module tracks references to symbols that aren't defined yet while
+ * assembling in a single pass, and patches the output once they are */
+
+/* Marks the end of a fixup chain */
+#define FIXUP_NONE  UINT32_MAX
+
+/* A word of the output that references a pending symbol */
+struct StructFixup {
+    size_t   word_index;     // Index of the word in the output
+    uint32_t next;           // Next fixup of the same symbol or of the free list
+};
+
+/* A referenced symbol that has no address yet */
+struct StructPendingSymbol {
+    StringView name;         // Copied into the arena
+    uint32_t   first_fixup;  // Chain of the words referencing it
+    int        resolved;     // 1 once the symbol got an address
+};
+
+struct StructBackpatch {
+    SymbolTable pending_index;                // Maps a name to its index in pending
+    struct StructPendingSymbol* pending;      // In order of first use
+    size_t pending_count;
+    size_t pending_capacity;
+
+    struct StructFixup* fixups;               // Pool of fixups, released ones are reused
+    size_t fixup_count;
+    size_t fixup_capacity;
+    uint32_t free_fixup;                      // Head of the released fixups
+
+    Arena* arena;                             // Names are carved from here
+    Window* window;                           // Patches go to the held words instead of the output, may be NULL
+};
+
+typedef struct StructBackpatch Backpatch;
+
+extern int  Backpatch_create            (Backpatch*, Arena*);
+extern void Backpatch_free              (Backpatch*);
+extern void Backpatch_setWindow         (Backpatch*, Window*);
+extern int  Backpatch_addReference      (Backpatch*, const char*, size_t, size_t);
+extern int  Backpatch_resolveLabel      (Backpatch*, const char*, size_t, int, Output*);
+extern int  Backpatch_resolveVariables  (Backpatch*, SymbolTable*, int, Output*);
+
+#endif
@@ -0,0 +1,246 @@
+#include "../assembler.h"
+#include "../parser.h"
+#include "../allocation.h"
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+
+/* End to end throughput harness. Every input is assembled in a child process,
+ * so its peak RSS is its own, as many times as fit in BENCH_MIN_SECONDS.
+ * A run is the whole pipeline of one file: creating the assembler, mapping and
+ * parsing the source, resolving the symbols and writing the output to /dev/null.
+ * The allocations the assembler makes are counted by allocation.c, which wraps
+ * the allocation functions at link time (-Wl,--wrap) */
+
+#define BENCH_MIN_SECONDS   0.5
+#define BENCH_MIN_RUNS      3
+
+
+static double now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double) time.tv_sec + (double) time.tv_nsec / 1e9;
+}
+
+/* Count the lines and bytes of the file at path
+ * Return 0 on success
+ * Return -1 on failure, errno will be set */
+static int measureInput(const char* path, unsigned long long* lines, unsigned long long* bytes)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return -1;
+    }
+
+    static char buffer[64 * 1024];
+    size_t read_bytes = 0;
+    char last = '\n';
+
+    *lines = 0;
+    *bytes = 0;
+
+    while ((read_bytes = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        for (size_t index = 0; index < read_bytes; index++) {
+            *lines += (buffer[index] == '\n');
+        }
+        *bytes += read_bytes;
+        last = buffer[read_bytes - 1];
+    }
+
+    // A last line without a newline
+    *lines += (last != '\n');
+
+    fclose(file);
+
+    return 0;
+}
+
+/* Assemble the file at path once
+ * Return the number of instructions on success
+ * Return -1 on failure, an error was printed */
+static long long runOnce(const char* path, FILE* sink, const AssemblerOptions* options)
+{
+    static Assembler assembler;
+
+    if (Assembler_create(&assembler) < 0) {
+        fprintf(stderr, "%s: failed to create the assembler: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    Parser parser;
+    if (Parser_createFromPath(&parser, path) < 0) {
+        fprintf(stderr, "%s: failed to open: %s\n", path, strerror(errno));
+        Assembler_free(&assembler);
+        return -1;
+    }
+
+    AssemblerReport report;
+    Assembler_clearReport(&report);
+
+    rewind(sink);
+    int error = Assembler_assemble(&assembler, &parser, sink, options, &report);
+    long long word_count = (long long) assembler.output.word_count;
+
+    Parser_free(&parser);
+    Assembler_free(&assembler);
+
+    if (error < 0) {
+        fprintf(stderr, "%s: line %zu: %s: %s\n", path, report.line, report.message, strerror(report.error_number));
+        return -1;
+    }
+
+    return word_count;
+}
+
+/* Benchmark one input and print its row, runs in the child process
+ * Return 0 on success
+ * Return -1 on failure, an error was printed */
+static int benchmarkInput(const char* path, const AssemblerOptions* options)
+{
+    unsigned long long lines = 0;
+    unsigned long long bytes = 0;
+
+    if (measureInput(path, &lines, &bytes) < 0) {
+        fprintf(stderr, "%s: failed to read: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    FILE* sink = fopen("/dev/null", "wb");
+    if (sink == NULL) {
+        fprintf(stderr, "failed to open /dev/null: %s\n", strerror(errno));
+        return -1;
+    }
+
+    double best = 0;
+    double total = 0;
+    int runs = 0;
+    long long instructions = 0;
+    unsigned long long run_allocations = 0;
+    unsigned long long run_bytes = 0;
+
+    while (runs < BENCH_MIN_RUNS || total < BENCH_MIN_SECONDS) {
+
+        Allocation_reset();
+
+        double start = now();
+        instructions = runOnce(path, sink, options);
+        double elapsed = now() - start;
+
+        if (instructions < 0) {
+            fclose(sink);
+            return -1;
+        }
+
+        run_allocations = Allocation_count();
+        run_bytes = Allocation_bytes();
+
+        if (runs == 0 || elapsed < best) {
+            best = elapsed;
+        }
+
+        total += elapsed;
+        runs += 1;
+    }
+
+    fclose(sink);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    const char* name = strrchr(path, '/');
+    name = (name != NULL) ? name + 1 : path;
+
+    printf("%-22s %10llu %11llu %10lld %6d %11.3f %13.0f %9.1f %10llu %12llu %9ld\n",
+           name, lines, bytes, instructions, runs, best * 1e3,
+           (double) lines / best, (double) bytes / best / 1e6,
+           run_allocations, run_bytes, usage.ru_maxrss);
+
+    return 0;
+}
+
+static void printUsage(FILE* stream, const char* program)
+{
+    fprintf(stream,
+            "Usage: %s [options] input.asm...\n"
+            "Reports the end to end throughput of assembling every input\n"
+            "\n"
+            "Options:\n"
+            "  -s                  assemble in a single pass\n"
+            "  -t N                assemble on N threads\n"
+            "  -h                  show this message\n",
+            program);
+}
+
+int main(int argc, char** argv)
+{
+    AssemblerOptions options;
+    Assembler_defaultOptions(&options);
+
+    int option = 0;
+    while ((option = getopt(argc, argv, "st:h")) != -1) {
+        switch (option) {
+
+            case 's':
+                options.single_pass = 1;
+                break;
+
+            case 't':
+                options.thread_count = atoi(optarg);
+                if (options.thread_count < 1) {
+                    fprintf(stderr, "Invalid thread count: %s\n", optarg);
+                    return -1;
+                }
+                break;
+
+            case 'h':
+                printUsage(stdout, argv[0]);
+                return 0;
+
+            default:
+                printUsage(stderr, argv[0]);
+                return -1;
+        }
+    }
+
+    if (optind == argc) {
+        printUsage(stderr, argv[0]);
+        return -1;
+    }
+
+    Allocation_enable();
+
+    printf("%-22s %10s %11s %10s %6s %11s %13s %9s %10s %12s %9s\n",
+           "program", "lines", "bytes", "instrs", "runs", "best ms",
+           "lines/s", "MB/s", "allocs", "alloc bytes", "RSS KB");
+    fflush(stdout);
+
+    int error = 0;
+
+    for (int index = optind; index < argc; index++) {
+
+        pid_t child = fork();
+
+        if (child == 0) {
+            int result = benchmarkInput(argv[index], &options);
+            fflush(stdout);
+            _exit((result < 0) ? 1 : 0);
+        }
+
+        int status = 0;
+        if (child < 0 || waitpid(child, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            error = -1;
+        }
+    }
+
+    return (error < 0) ? 1 : 0;
+}
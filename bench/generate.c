@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+/* Generates a seeded synthetic Hack program for the benchmark.
+ * The same options and seed always produce the same program.
+ * Lines are blank, comments, labels or instructions in the given proportions,
+ * instructions reference constants, predefined symbols, variables and labels
+ * defined before or after them, some carry a trailing comment.
+ * A label must fit a 15 bit A instruction, so labels are only defined in the
+ * first LABEL_ADDRESS_LIMIT instructions, the code after them only references them */
+
+#define LABEL_ADDRESS_LIMIT     32000
+
+struct StructGeneratorOptions {
+    unsigned long long line_count;
+    unsigned long long seed;
+    unsigned int label_percent;      // Lines that define a label
+    unsigned int comment_percent;    // Lines that are or end with a comment
+    unsigned int blank_percent;      // Blank lines
+    unsigned int variable_count;     // Distinct variables referenced
+};
+
+typedef struct StructGeneratorOptions GeneratorOptions;
+
+static const char* DESTINATIONS[] = { "M", "D", "MD", "A", "AM", "AD", "AMD" };
+static const char* COMPUTATIONS[] = { "0", "1", "-1", "D", "A", "!D", "!A", "-D", "-A", "D+1",
+                                      "A+1", "D-1", "A-1", "D+A", "D-A", "A-D", "D&A", "D|A",
+                                      "M", "!M", "-M", "M+1", "M-1", "D+M", "D-M", "M-D", "D&M", "D|M" };
+static const char* JUMPS[] = { "JGT", "JEQ", "JGE", "JLT", "JNE", "JLE", "JMP" };
+static const char* PREDEFINED[] = { "SP", "LCL", "ARG", "THIS", "THAT", "R0", "R1", "R2", "R3",
+                                    "R13", "R14", "R15", "SCREEN", "KBD" };
+
+#define COUNT(array) (sizeof(array) / sizeof((array)[0]))
+
+
+/* xorshift64*, good enough for a corpus and identical everywhere */
+static uint64_t nextRandom(uint64_t* state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545f4914f6cdd1dULL;
+}
+
+/* Uniform number in [0, bound) */
+static uint64_t randomBelow(uint64_t* state, uint64_t bound)
+{
+    return (nextRandom(state) >> 11) % bound;
+}
+
+static void printUsage(FILE* stream, const char* program)
+{
+    fprintf(stream,
+            "Usage: %s [options]\n"
+            "Writes a synthetic Hack program to stdout\n"
+            "\n"
+            "Options:\n"
+            "  -n LINES            lines to generate, default 1000000\n"
+            "  -s SEED             random seed, default 1\n"
+            "  -l PERCENT          lines defining a label, default 5\n"
+            "  -c PERCENT          lines that are or end with a comment, default 10\n"
+            "  -b PERCENT          blank lines, default 5\n"
+            "  -v COUNT            distinct variables, default 200\n"
+            "  -h                  show this message\n",
+            program);
+}
+
+/* Parse the command line into options
+ * Return 0 on success
+ * Return 1 if the program should exit successfully, usage was printed
+ * Return -1 on invalid arguments, an error was printed */
+static int parseArguments(int argc, char** argv, GeneratorOptions* options)
+{
+    options->line_count = 1000000;
+    options->seed = 1;
+    options->label_percent = 5;
+    options->comment_percent = 10;
+    options->blank_percent = 5;
+    options->variable_count = 200;
+
+    int option = 0;
+    while ((option = getopt(argc, argv, "n:s:l:c:b:v:h")) != -1) {
+
+        char* end = NULL;
+        unsigned long long value = (optarg != NULL) ? strtoull(optarg, &end, 10) : 0;
+
+        if (optarg != NULL && (*optarg == '\0' || *end != '\0')) {
+            fprintf(stderr, "Invalid number: %s\n", optarg);
+            return -1;
+        }
+
+        switch (option) {
+            case 'n': options->line_count = value; break;
+            case 's': options->seed = value; break;
+            case 'l': options->label_percent = (unsigned int) value; break;
+            case 'c': options->comment_percent = (unsigned int) value; break;
+            case 'b': options->blank_percent = (unsigned int) value; break;
+            case 'v': options->variable_count = (unsigned int) value; break;
+
+            case 'h':
+                printUsage(stdout, argv[0]);
+                return 1;
+
+            default:
+                printUsage(stderr, argv[0]);
+                return -1;
+        }
+    }
+
+    if (options->label_percent + options->comment_percent + options->blank_percent > 100 ||
+        options->variable_count == 0) {
+        fprintf(stderr, "The percentages must add up to at most 100 and there must be a variable\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Write one instruction, without the newline */
+static void writeInstruction(FILE* out, uint64_t* state, const GeneratorOptions* options,
+                             unsigned long long planned_labels)
+{
+    if (randomBelow(state, 2) == 0) {
+
+        uint64_t kind = randomBelow(state, 100);
+
+        if (kind < 40) {
+            fprintf(out, "@%u", (unsigned int) randomBelow(state, 32768));
+        }
+        else if (kind < 65 && planned_labels > 0) {
+            fprintf(out, "@LABEL_%llu", (unsigned long long) randomBelow(state, planned_labels));
+        }
+        else if (kind < 90) {
+            fprintf(out, "@var_%u", (unsigned int) randomBelow(state, options->variable_count));
+        }
+        else {
+            fprintf(out, "@%s", PREDEFINED[randomBelow(state, COUNT(PREDEFINED))]);
+        }
+
+        return;
+    }
+
+    // Jumps mostly go without a destination, like in compiled code
+    int has_jump = randomBelow(state, 4) == 0;
+    int has_destination = !has_jump || randomBelow(state, 8) == 0;
+
+    if (has_destination) {
+        fprintf(out, "%s=", DESTINATIONS[randomBelow(state, COUNT(DESTINATIONS))]);
+    }
+
+    fputs(COMPUTATIONS[randomBelow(state, COUNT(COMPUTATIONS))], out);
+
+    if (has_jump) {
+        fprintf(out, ";%s", JUMPS[randomBelow(state, COUNT(JUMPS))]);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    GeneratorOptions options;
+    int error = parseArguments(argc, argv, &options);
+    if (error != 0) {
+        return (error > 0) ? 0 : -1;
+    }
+
+    // A zero state would stay zero
+    uint64_t state = options.seed * 0x9e3779b97f4a7c15ULL + 1;
+
+    static char buffer[1 << 20];
+    setvbuf(stdout, buffer, _IOFBF, sizeof(buffer));
+
+    // Label references are drawn from every label, so some are forward references
+    unsigned long long planned_labels = options.line_count * options.label_percent / 100;
+    unsigned long long defined_labels = 0;
+    unsigned long long instruction_count = 0;
+
+    for (unsigned long long line = 0; line < options.line_count; line++) {
+
+        // Every referenced label has to be defined while it still has an address
+        if (instruction_count == LABEL_ADDRESS_LIMIT) {
+            for (; defined_labels < planned_labels; defined_labels++) {
+                fprintf(stdout, "(LABEL_%llu)\n", defined_labels);
+            }
+        }
+
+        uint64_t kind = randomBelow(&state, 100);
+        const char* indent = (randomBelow(&state, 2) == 0) ? "" : "    ";
+
+        if (kind < options.blank_percent) {
+            fputc('\n', stdout);
+        }
+
+        else if (kind < options.blank_percent + options.comment_percent / 2) {
+            fprintf(stdout, "%s// comment %llu\n", indent, line);
+        }
+
+        else if (kind < options.blank_percent + options.comment_percent / 2 + options.label_percent &&
+                 defined_labels < planned_labels) {
+            fprintf(stdout, "(LABEL_%llu)\n", defined_labels);
+            defined_labels += 1;
+        }
+
+        else {
+            fputs(indent, stdout);
+            writeInstruction(stdout, &state, &options, planned_labels);
+
+            if (randomBelow(&state, 100) < options.comment_percent - options.comment_percent / 2) {
+                fputs("    // trailing comment", stdout);
+            }
+
+            fputc('\n', stdout);
+            instruction_count += 1;
+        }
+    }
+
+    // Every referenced label has to be defined
+    for (; defined_labels < planned_labels; defined_labels++) {
+        fprintf(stdout, "(LABEL_%llu)\n", defined_labels);
+    }
+
+    return (fflush(stdout) == 0) ? 0 : -1;
+}
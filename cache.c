@@ -0,0 +1,248 @@
+#include "cache.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/* Multipliers of the hash lanes */
+#define CACHE_PRIME_A   0x9e3779b185ebca87ULL
+#define CACHE_PRIME_B   0xc2b2ae3d27d4eb4fULL
+
+/* Size of the buffer entries are copied through */
+#define CACHE_COPY_SIZE (64 * 1024)
+
+
+static uint64_t Cache_rotate(uint64_t value, int count)
+{
+    return (value << count) | (value >> (64 - count));
+}
+
+/* Final avalanche so every input bit affects every output bit */
+static uint64_t Cache_mix(uint64_t value)
+{
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+
+    return value;
+}
+
+/* Fold 16 bytes into the two lanes */
+static void Cache_round(uint64_t* lane_a, uint64_t* lane_b, const char* data)
+{
+    uint64_t word_a = 0;
+    uint64_t word_b = 0;
+
+    memcpy(&word_a, data, sizeof(uint64_t));
+    memcpy(&word_b, data + sizeof(uint64_t), sizeof(uint64_t));
+
+    *lane_a = Cache_rotate(*lane_a + word_a * CACHE_PRIME_B, 31) * CACHE_PRIME_A ^ word_b;
+    *lane_b = Cache_rotate(*lane_b + word_b * CACHE_PRIME_A, 27) * CACHE_PRIME_B ^ word_a;
+}
+
+/* 128 bit hash of length bytes, 16 bytes a round.
+ * Fast rather than cryptographic, the cache trusts the files it hashes */
+static void Cache_hash(const char* data, size_t length, uint64_t seed, CacheKey* key)
+{
+    uint64_t lane_a = seed ^ CACHE_PRIME_A;
+    uint64_t lane_b = Cache_rotate(seed, 32) ^ CACHE_PRIME_B;
+
+    size_t index = 0;
+    for (; index + 16 <= length; index += 16) {
+        Cache_round(&lane_a, &lane_b, &data[index]);
+    }
+
+    // The tail is padded with zeroes, the length tells the paddings apart
+    char tail[16] = {0};
+    if (index < length) {
+        memcpy(tail, &data[index], length - index);
+    }
+    Cache_round(&lane_a, &lane_b, tail);
+
+    lane_a ^= (uint64_t) length;
+    lane_b ^= (uint64_t) length * CACHE_PRIME_A;
+
+    key->high = Cache_mix(lane_a + lane_b);
+    key->low = Cache_mix(lane_b ^ key->high);
+}
+
+/* Write the path of the entry for key into path, which holds PATH_MAX bytes
+ * Return 0 on success
+ * Return -1 if the path is too long, errno will be set */
+static int Cache_entryPath(const char* directory, const CacheKey* key, char* path)
+{
+    int length = snprintf(path, PATH_MAX, "%s/%016llx%016llx",
+                          directory, (unsigned long long) key->high, (unsigned long long) key->low);
+
+    if (length < 0 || length >= PATH_MAX) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Create the cache directory if it doesn't exist yet
+ * Return 0 on success
+ * Return -1 on failure, errno will be set */
+extern int Cache_createDirectory(const char* directory)
+{
+    if (directory != NULL) {
+
+        if (mkdir(directory, 0777) < 0 && errno != EEXIST) {
+            return -1;
+        }
+
+        return 0;
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/* Compute the key of the output of the length bytes at source assembled with options
+ * at the optimization level optimize */
+extern void Cache_computeKey(const char* source, size_t length, const OutputOptions* options, int optimize, CacheKey* key)
+{
+    // Text output doesn't depend on the binary options
+    char prefix[sizeof(CACHE_ASSEMBLER_VERSION) + 4] = CACHE_ASSEMBLER_VERSION;
+    prefix[sizeof(CACHE_ASSEMBLER_VERSION) + 0] = (char) options->format;
+    prefix[sizeof(CACHE_ASSEMBLER_VERSION) + 1] = (options->format == OUTPUT_BINARY) ? (char) options->byte_order : 0;
+    prefix[sizeof(CACHE_ASSEMBLER_VERSION) + 2] = (options->format == OUTPUT_BINARY) ? (char) options->header : 0;
+    prefix[sizeof(CACHE_ASSEMBLER_VERSION) + 3] = (char) optimize;
+
+    CacheKey seed;
+    Cache_hash(prefix, sizeof(prefix), 0, &seed);
+    Cache_hash(source, length, seed.high ^ seed.low, key);
+}
+
+/* Copy the entry for key to destination
+ * Return 1 on a hit, the entry was copied
+ * Return 0 on a miss, nothing was written
+ * Return -1 on failure, errno will be set */
+extern int Cache_fetch(const char* directory, const CacheKey* key, FILE* destination)
+{
+    if (directory == NULL ||
+        key == NULL ||
+        destination == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    char path[PATH_MAX];
+    if (Cache_entryPath(directory, key, path) < 0) {
+        return -1;
+    }
+
+    FILE* entry = fopen(path, "rb");
+    if (entry == NULL) {
+        return (errno == ENOENT) ? 0 : -1;
+    }
+
+    static _Thread_local char buffer[CACHE_COPY_SIZE];
+    size_t bytes = 0;
+    int error = 0;
+
+    while (error == 0 && (bytes = fread(buffer, 1, sizeof(buffer), entry)) > 0) {
+        if (fwrite(buffer, 1, bytes, destination) != bytes) {
+            error = -1;
+        }
+    }
+
+    if (ferror(entry)) {
+        error = -1;
+    }
+
+    int saved_errno = errno;
+    fclose(entry);
+    errno = saved_errno;
+
+    return (error < 0) ? -1 : 1;
+}
+
+/* Publish the file at output_path as the entry for key.
+ * It is copied to a temporary file in the cache directory and renamed into place
+ * Return 0 on success
+ * Return -1 on failure, errno will be set, no entry is left behind */
+extern int Cache_store(const char* directory, const CacheKey* key, const char* output_path)
+{
+    if (directory == NULL ||
+        key == NULL ||
+        output_path == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    char path[PATH_MAX];
+    char temporary_path[PATH_MAX];
+    if (Cache_entryPath(directory, key, path) < 0) {
+        return -1;
+    }
+
+    int length = snprintf(temporary_path, sizeof(temporary_path), "%s/.tmp-XXXXXX", directory);
+    if (length < 0 || length >= (int) sizeof(temporary_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    FILE* source = fopen(output_path, "rb");
+    if (source == NULL) {
+        return -1;
+    }
+
+    int descriptor = mkstemp(temporary_path);
+    if (descriptor < 0) {
+        int saved_errno = errno;
+        fclose(source);
+        errno = saved_errno;
+        return -1;
+    }
+
+    static _Thread_local char buffer[CACHE_COPY_SIZE];
+    size_t bytes = 0;
+    int error = 0;
+
+    while (error == 0 && (bytes = fread(buffer, 1, sizeof(buffer), source)) > 0) {
+        if (write(descriptor, buffer, bytes) != (ssize_t) bytes) {
+            error = -1;
+        }
+    }
+
+    if (ferror(source)) {
+        error = -1;
+    }
+
+    // Entries are never modified once published
+    if (error == 0) {
+        error = fchmod(descriptor, 0444);
+    }
+
+    if (close(descriptor) < 0) {
+        error = -1;
+    }
+
+    if (error == 0) {
+        error = rename(temporary_path, path);
+    }
+
+    int saved_errno = errno;
+    fclose(source);
+    if (error < 0) {
+        unlink(temporary_path);
+    }
+    errno = saved_errno;
+
+    return error;
+}
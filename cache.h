@@ -0,0 +1,32 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "output.h"
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* This module is a content addressed cache of assembled outputs.
+ * An entry is keyed by a hash of the source, the assembler version and the
+ * output options, and is stored as one file named after the key in the cache directory.
+ * Entries are published atomically, written to a temporary file and renamed into place,
+ * so concurrent runs sharing a directory only ever see complete entries */
+
+/* Change whenever the generated code changes, so older entries are never used */
+#define CACHE_ASSEMBLER_VERSION     "hack-assembler 1"
+
+/* An entry is named after its key in 32 hex digits */
+struct StructCacheKey {
+    uint64_t high;
+    uint64_t low;
+};
+
+typedef struct StructCacheKey CacheKey;
+
+extern int  Cache_createDirectory (const char*);
+extern void Cache_computeKey      (const char*, size_t, const OutputOptions*, int, CacheKey*);
+extern int  Cache_fetch           (const char*, const CacheKey*, FILE*);
+extern int  Cache_store           (const char*, const CacheKey*, const char*);
+
+#endif
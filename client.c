@@ -0,0 +1,410 @@
+#include "protocol.h"
+#include "output.h"
+
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+
+/* This program is a thin client of the assembler server started with -S.
+ * It takes the same inputs and output options as the assembler and has every
+ * file assembled by the server, over one connection */
+
+/* Command line options */
+struct StructOptions {
+    char**        input_paths;
+    size_t        input_count;
+    const char*   output_path;     // NULL means derived from the input path
+    const char*   socket_path;
+    OutputOptions output;
+    int           single_pass;
+    int           inline_files;    // 1 to send the source and receive the output over the socket
+};
+
+typedef struct StructOptions Options;
+
+static void printUsage(FILE* stream, const char* program);
+static int  parseArguments(int argc, char** argv, Options* options);
+static char* makeAbsolutePath(const char* path);
+static int  connectToServer(const char* socket_path);
+static int  assembleRemote(int connection, const Options* options,
+                           const char* input_path, const char* output_path);
+
+int main(int argc, char** argv) {
+    /* Parse the command line
+     * Connect to the server
+     * Send one request per input and wait for its reply
+     * Report the errors in the order the files were given */
+
+
+    int error = 0;
+
+    Options options;
+    error = parseArguments(argc, argv, &options);
+    if (error != 0) {
+        return (error > 0) ? 0 : -1;
+    }
+
+    static char* default_inputs[] = { "test.asm" };
+    if (options.input_count == 0) {
+        options.input_paths = default_inputs;
+        options.input_count = 1;
+    }
+
+    if (options.output_path != NULL && options.input_count != 1) {
+        fprintf(stderr, "-o can only be used with a single input file\n");
+        return -1;
+    }
+
+    int connection = connectToServer(options.socket_path);
+    if (connection < 0) {
+        fprintf(stderr, "ERROR: %s\nMessage: Failed to connect to the server at %s\n",
+                strerror(errno), options.socket_path);
+        return -1;
+    }
+
+    for (size_t index = 0; index < options.input_count; index++) {
+
+        const char* input_path = options.input_paths[index];
+        char* output_path = NULL;
+
+        if (options.output_path == NULL) {
+            output_path = Output_makePath(input_path);
+            if (output_path == NULL) {
+                fprintf(stderr, "ERROR: %s\nMessage: Failed to create the output path\n", strerror(errno));
+                close(connection);
+                return -1;
+            }
+        }
+
+        int file_error = assembleRemote(connection, &options, input_path,
+                                        (output_path != NULL) ? output_path : options.output_path);
+        free(output_path);
+
+        // The connection is gone, the rest of the files can't be sent
+        if (file_error < -1) {
+            close(connection);
+            return -1;
+        }
+
+        if (file_error < 0) {
+            error = -1;
+        }
+    }
+
+    close(connection);
+
+    return (error < 0) ? -1 : 0;
+}
+
+static void printUsage(FILE* stream, const char* program)
+{
+    fprintf(stream,
+            "Usage: %s [options] [input.asm...]\n"
+            "Has the assembler server assemble every input.asm, test.asm if none are given\n"
+            "\n"
+            "Options:\n"
+            "  -S SOCKET           Unix socket of the server, default " PROTOCOL_DEFAULT_SOCKET "\n"
+            "  -o FILE             write the output to FILE, default is input with .hack\n"
+            "                      only allowed with a single input\n"
+            "  -f text|binary      output format, default text\n"
+            "  -e little|big       byte order of binary output, default little\n"
+            "  -H                  start binary output with a header holding the word count\n"
+            "  -s                  assemble in a single pass\n"
+            "  -i                  send the source and receive the output over the socket,\n"
+            "                      for a server that can't reach the files\n"
+            "  -h                  show this message\n",
+            program);
+}
+
+/* Parse the command line into options
+ * Return 0 on success
+ * Return 1 if the program should exit successfully, usage was printed
+ * Return -1 on invalid arguments, an error was printed */
+static int parseArguments(int argc, char** argv, Options* options)
+{
+    options->input_paths = NULL;
+    options->input_count = 0;
+    options->output_path = NULL;
+    options->socket_path = PROTOCOL_DEFAULT_SOCKET;
+    options->single_pass = 0;
+    options->inline_files = 0;
+    Output_defaultOptions(&options->output);
+
+    int option = 0;
+    while ((option = getopt(argc, argv, "S:o:f:e:Hsih")) != -1) {
+
+        switch (option) {
+
+            case 'S':
+                options->socket_path = optarg;
+                break;
+
+            case 'o':
+                options->output_path = optarg;
+                break;
+
+            case 'f':
+                if (strcmp(optarg, "text") == 0) {
+                    options->output.format = OUTPUT_TEXT;
+                }
+                else if (strcmp(optarg, "binary") == 0) {
+                    options->output.format = OUTPUT_BINARY;
+                }
+                else {
+                    fprintf(stderr, "Unknown output format: %s\n", optarg);
+                    return -1;
+                }
+                break;
+
+            case 'e':
+                if (strcmp(optarg, "little") == 0) {
+                    options->output.byte_order = OUTPUT_LITTLE_ENDIAN;
+                }
+                else if (strcmp(optarg, "big") == 0) {
+                    options->output.byte_order = OUTPUT_BIG_ENDIAN;
+                }
+                else {
+                    fprintf(stderr, "Unknown byte order: %s\n", optarg);
+                    return -1;
+                }
+                break;
+
+            case 'H':
+                options->output.header = 1;
+                break;
+
+            case 's':
+                options->single_pass = 1;
+                break;
+
+            case 'i':
+                options->inline_files = 1;
+                break;
+
+            case 'h':
+                printUsage(stdout, argv[0]);
+                return 1;
+
+            default:
+                printUsage(stderr, argv[0]);
+                return -1;
+        }
+    }
+
+    options->input_paths = &argv[optind];
+    options->input_count = (size_t) (argc - optind);
+
+    return 0;
+}
+
+/* The server has its own working directory, so relative paths are made absolute
+ * Return the newly allocated path on success
+ * Return NULL on failure, errno will be set */
+static char* makeAbsolutePath(const char* path)
+{
+    if (path[0] == '/') {
+        return strdup(path);
+    }
+
+    char* directory = getcwd(NULL, 0);
+    if (directory == NULL) {
+        return NULL;
+    }
+
+    char* absolute_path = malloc(strlen(directory) + strlen(path) + 2);
+    if (absolute_path != NULL) {
+        sprintf(absolute_path, "%s/%s", directory, path);
+    }
+
+    free(directory);
+
+    return absolute_path;
+}
+
+/* Connect to the server listening at socket_path
+ * Return the connected socket on success
+ * Return -1 on failure, errno will be set */
+static int connectToServer(const char* socket_path)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    strcpy(address.sun_path, socket_path);
+
+    int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connection < 0) {
+        return -1;
+    }
+
+    if (connect(connection, (struct sockaddr*) &address, sizeof(address)) < 0) {
+        int saved_errno = errno;
+        close(connection);
+        errno = saved_errno;
+        return -1;
+    }
+
+    return connection;
+}
+
+/* Write length bytes of data to the file at path */
+static int writeFile(const char* path, const char* data, size_t length)
+{
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        return -1;
+    }
+
+    int error = 0;
+    if (fwrite(data, 1, length, file) != length || fflush(file) != 0) {
+        error = -1;
+    }
+
+    int saved_errno = errno;
+    fclose(file);
+    errno = saved_errno;
+
+    return error;
+}
+
+/* Have the server assemble input_path into output_path and print its error, if any
+ * Return 0 on success
+ * Return -1 if the file failed
+ * Return -2 if the connection failed */
+static int assembleRemote(int connection, const Options* options,
+                          const char* input_path, const char* output_path)
+{
+    ProtocolRequest request;
+    memset(&request, 0, sizeof(request));
+
+    request.magic = PROTOCOL_REQUEST_MAGIC;
+    request.format = (uint8_t) options->output.format;
+    request.byte_order = (uint8_t) options->output.byte_order;
+    request.header = (uint8_t) options->output.header;
+    request.flags = (options->single_pass != 0) ? PROTOCOL_SINGLE_PASS : 0;
+
+    const char* failure = NULL;
+
+    // Inline requests carry the mapped source, path requests carry absolute paths
+    char* input = NULL;
+    char* output = NULL;
+    size_t input_length = 0;
+    void* mapped = NULL;
+
+    if (options->inline_files != 0) {
+        request.flags |= PROTOCOL_INLINE_INPUT | PROTOCOL_INLINE_OUTPUT;
+
+        int descriptor = open(input_path, O_RDONLY);
+        struct stat input_stat;
+
+        if (descriptor < 0 || fstat(descriptor, &input_stat) < 0) {
+            failure = "Failed to open source file";
+        }
+
+        else if (input_stat.st_size > PROTOCOL_MAX_INPUT) {
+            errno = EFBIG;
+            failure = "Failed to open source file";
+        }
+
+        else if (input_stat.st_size > 0) {
+            mapped = mmap(NULL, (size_t) input_stat.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (mapped == MAP_FAILED) {
+                mapped = NULL;
+                failure = "Failed to open source file";
+            }
+            else {
+                input = mapped;
+                input_length = (size_t) input_stat.st_size;
+            }
+        }
+
+        if (descriptor >= 0) {
+            close(descriptor);
+        }
+    }
+
+    else {
+        input = makeAbsolutePath(input_path);
+        output = makeAbsolutePath(output_path);
+        if (input == NULL || output == NULL) {
+            failure = "Failed to create the output path";
+        }
+        else {
+            input_length = strlen(input);
+            request.output_length = (uint32_t) strlen(output);
+        }
+    }
+
+    if (failure != NULL) {
+        fprintf(stderr, "ERROR: %s\nFile: %s\nMessage: %s\n", strerror(errno), input_path, failure);
+        if (options->inline_files == 0) {
+            free(input);
+            free(output);
+        }
+        return -1;
+    }
+
+    request.input_length = (uint32_t) input_length;
+
+    int sent = Protocol_writeFull(connection, &request, sizeof(request)) == 0 &&
+               Protocol_writeFull(connection, input, input_length) == 0 &&
+               Protocol_writeFull(connection, output, request.output_length) == 0;
+
+    if (mapped != NULL) {
+        munmap(mapped, input_length);
+    }
+    else {
+        free(input);
+    }
+    free(output);
+
+    ProtocolReply reply;
+    if (sent == 0 ||
+        Protocol_readFull(connection, &reply, sizeof(reply)) <= 0 ||
+        reply.magic != PROTOCOL_REPLY_MAGIC) {
+        fprintf(stderr, "ERROR: %s\nMessage: Lost the connection to the server\n", strerror(errno));
+        return -2;
+    }
+
+    // Message and output follow the reply
+    char* payload = malloc((size_t) reply.message_length + reply.output_length + 1);
+    if (payload == NULL ||
+        Protocol_readFull(connection, payload, (size_t) reply.message_length + reply.output_length) < 0) {
+        fprintf(stderr, "ERROR: %s\nMessage: Lost the connection to the server\n", strerror(errno));
+        free(payload);
+        return -2;
+    }
+
+    int error = 0;
+
+    if (reply.error < 0) {
+        fprintf(stderr, "ERROR: %s\nFile: %s\nMessage: %.*s\n",
+                strerror(reply.error_number), input_path, (int) reply.message_length, payload);
+        error = -1;
+    }
+
+    else if (options->inline_files != 0 &&
+             writeFile(output_path, &payload[reply.message_length], reply.output_length) < 0) {
+        fprintf(stderr, "ERROR: %s\nFile: %s\nMessage: Failed to write to output file\n",
+                strerror(errno), input_path);
+        error = -1;
+    }
+
+    free(payload);
+
+    return error;
+}
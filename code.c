@@ -1,6 +1,7 @@
 #include "code.h"
 #include "util.h"
 #include <errno.h>
+#include <ctype.h>
 #include <stddef.h>
 #include <string.h>
 #include <stdint.h>
@@ -9,101 +10,216 @@
 
 /* Constants */
 
-/* Computation mneumonic array mappings to simplify translation */
-static const size_t TOTAL_COMPUTATIONS = 8 + 10 + 10; // 8 that dont act on A or M, 10 that Act on A, and 10 that Act on M
-static const char* const COMPUTATION_MNEUMONICS[28] = 
-{ "0", "1",  "-1", "D",   "!D",  "-D",  "D+1", "D-1",                        // Computations that Dont act on A or M
-  "A", "!A", "-A", "A+1", "A-1", "D+A", "D-A", "A-D", "D&A", "D|A",          // Computations that Act on A
-  "M", "!M", "-M", "M+1", "M-1", "D+M", "D-M", "M-D", "D&M", "D|M" };        // Computations that Act on M
-
-const char* const COMPUTATION_BINARY[28] =
-{ COMP_0, COMP_1,     COMP_NEG_1, COMP_D,        COMP_NOT_D,     COMP_NEG_D,    COMP_D_PLUS_1,  COMP_D_MINUS_1,                              // Computations that dont act on A or M
-  COMP_A, COMP_NOT_A, COMP_NEG_A, COMP_A_PLUS_1, COMP_A_MINUS_1, COMP_D_PLUS_A, COMP_D_MINUS_A, COMP_A_MINUS_D, COMP_D_AND_A, COMP_D_OR_A,   // Computations that act on A
-  COMP_M, COMP_NOT_M, COMP_NEG_M, COMP_M_PLUS_1, COMP_M_MINUS_1, COMP_D_PLUS_M, COMP_D_MINUS_M, COMP_M_MINUS_D, COMP_D_AND_M, COMP_D_OR_M }; // Computations that act on M
+/* Perfect hash over every comp, dest and jump mneumonic.
+ * A mneumonic is at most 3 characters, so it is packed into an integer key
+ * and a multiplicative hash maps each of the 40 distinct keys to its own slot
+ * of a 128 entry table, the multiplier was found by a brute force search */
+#define MNEUMONIC_KEY(a, b, c)  ((uint32_t) (uint8_t) (a)         | \
+                                 ((uint32_t) (uint8_t) (b) << 8)  | \
+                                 ((uint32_t) (uint8_t) (c) << 16))
+#define MNEUMONIC_SLOT(key)     ((uint32_t) ((uint32_t) (key) * 0xfc2222d3u) >> 25)
+#define MNEUMONIC_TABLE_SIZE    128
+
+/* Key that no mneumonic packs to, used for strings longer than 3 characters */
+#define MNEUMONIC_INVALID_KEY   0xffffffffu
+
+/* Which fields a table entry is valid for */
+#define KIND_COMP   0x1
+#define KIND_DEST   0x2
+#define KIND_JUMP   0x4
+
+struct MneumonicEntry {
+    uint32_t key;
+    uint8_t  comp;
+    uint8_t  dest;
+    uint8_t  jump;
+    uint8_t  kinds;
+};
+
+#define COMP_ENTRY(a, b, c, bits) \
+    [MNEUMONIC_SLOT(MNEUMONIC_KEY(a, b, c))] = { MNEUMONIC_KEY(a, b, c), (bits), 0, 0, KIND_COMP }
+#define DEST_ENTRY(a, b, c, bits) \
+    [MNEUMONIC_SLOT(MNEUMONIC_KEY(a, b, c))] = { MNEUMONIC_KEY(a, b, c), 0, (bits), 0, KIND_DEST }
+#define JUMP_ENTRY(a, b, c, bits) \
+    [MNEUMONIC_SLOT(MNEUMONIC_KEY(a, b, c))] = { MNEUMONIC_KEY(a, b, c), 0, 0, (bits), KIND_JUMP }
+
+static const struct MneumonicEntry MNEUMONIC_TABLE[MNEUMONIC_TABLE_SIZE] =
+{
+    // Computations that dont act on A or M
+    COMP_ENTRY('0', 0,   0,   COMP_BITS_0),
+    COMP_ENTRY('1', 0,   0,   COMP_BITS_1),
+    COMP_ENTRY('-', '1', 0,   COMP_BITS_NEG_1),
+    COMP_ENTRY('!', 'D', 0,   COMP_BITS_NOT_D),
+    COMP_ENTRY('-', 'D', 0,   COMP_BITS_NEG_D),
+    COMP_ENTRY('D', '+', '1', COMP_BITS_D_PLUS_1),
+    COMP_ENTRY('D', '-', '1', COMP_BITS_D_MINUS_1),
+
+    // Computations that act on A
+    COMP_ENTRY('!', 'A', 0,   COMP_BITS_NOT_A),
+    COMP_ENTRY('-', 'A', 0,   COMP_BITS_NEG_A),
+    COMP_ENTRY('A', '+', '1', COMP_BITS_A_PLUS_1),
+    COMP_ENTRY('A', '-', '1', COMP_BITS_A_MINUS_1),
+    COMP_ENTRY('D', '+', 'A', COMP_BITS_D_PLUS_A),
+    COMP_ENTRY('D', '-', 'A', COMP_BITS_D_MINUS_A),
+    COMP_ENTRY('A', '-', 'D', COMP_BITS_A_MINUS_D),
+    COMP_ENTRY('D', '&', 'A', COMP_BITS_D_AND_A),
+    COMP_ENTRY('D', '|', 'A', COMP_BITS_D_OR_A),
+
+    // Computations that act on M
+    COMP_ENTRY('!', 'M', 0,   COMP_BITS_NOT_M),
+    COMP_ENTRY('-', 'M', 0,   COMP_BITS_NEG_M),
+    COMP_ENTRY('M', '+', '1', COMP_BITS_M_PLUS_1),
+    COMP_ENTRY('M', '-', '1', COMP_BITS_M_MINUS_1),
+    COMP_ENTRY('D', '+', 'M', COMP_BITS_D_PLUS_M),
+    COMP_ENTRY('D', '-', 'M', COMP_BITS_D_MINUS_M),
+    COMP_ENTRY('M', '-', 'D', COMP_BITS_M_MINUS_D),
+    COMP_ENTRY('D', '&', 'M', COMP_BITS_D_AND_M),
+    COMP_ENTRY('D', '|', 'M', COMP_BITS_D_OR_M),
+
+    // Registers are both computations and destinations
+    [MNEUMONIC_SLOT(MNEUMONIC_KEY('D', 0, 0))] = { MNEUMONIC_KEY('D', 0, 0), COMP_BITS_D, DEST_BITS_D, 0, KIND_COMP | KIND_DEST },
+    [MNEUMONIC_SLOT(MNEUMONIC_KEY('A', 0, 0))] = { MNEUMONIC_KEY('A', 0, 0), COMP_BITS_A, DEST_BITS_A, 0, KIND_COMP | KIND_DEST },
+    [MNEUMONIC_SLOT(MNEUMONIC_KEY('M', 0, 0))] = { MNEUMONIC_KEY('M', 0, 0), COMP_BITS_M, DEST_BITS_M, 0, KIND_COMP | KIND_DEST },
+
+    // Destinations
+    DEST_ENTRY('M', 'D', 0,   DEST_BITS_MD),
+    DEST_ENTRY('A', 'M', 0,   DEST_BITS_AM),
+    DEST_ENTRY('A', 'D', 0,   DEST_BITS_AD),
+    DEST_ENTRY('A', 'M', 'D', DEST_BITS_AMD),
+
+    // Jumps
+    JUMP_ENTRY('J', 'G', 'T', JUMP_BITS_JGT),
+    JUMP_ENTRY('J', 'E', 'Q', JUMP_BITS_JEQ),
+    JUMP_ENTRY('J', 'G', 'E', JUMP_BITS_JGE),
+    JUMP_ENTRY('J', 'L', 'T', JUMP_BITS_JLT),
+    JUMP_ENTRY('J', 'N', 'E', JUMP_BITS_JNE),
+    JUMP_ENTRY('J', 'L', 'E', JUMP_BITS_JLE),
+    JUMP_ENTRY('J', 'M', 'P', JUMP_BITS_JMP),
+
+    // The empty mneumonic is the null destination and the null jump
+    [MNEUMONIC_SLOT(0)] = { 0, 0, DEST_BITS_NULL, JUMP_BITS_NULL, KIND_DEST | KIND_JUMP }
+};
+
+
+/* Pack a mneumonic of the given length into its integer key
+ * Returns MNEUMONIC_INVALID_KEY if it is longer than 3 characters */
+static uint32_t packMneumonic(const char* mneumonic, size_t length)
+{
+    uint32_t key = 0;
 
+    if (length > 3) {
+        return MNEUMONIC_INVALID_KEY;
+    }
 
+    for (size_t index = 0; index < length; index++) {
 
-/* Destination field array mappings, this makes it easier to translate */
-static const size_t TOTAL_DESTINATIONS = 8;
-static const char* const DESTINATION_MNEUMONICS[8] = { "M",    "D",    "MD",    "A",    "AM",    "AD",    "AMD",    "" };
-static const char* const DESTINATION_BINARY[8] =     { DEST_M, DEST_D, DEST_MD, DEST_A, DEST_AM, DEST_AD, DEST_AMD, DEST_NULL };
+        // A null character would alias a shorter mneumonic
+        if (mneumonic[index] == '\0') {
+            return MNEUMONIC_INVALID_KEY;
+        }
 
-/* Jump field array mappings, this makes it easier to translate */
-static const size_t TOTAL_JUMPS = 8;
-static const char* const JUMP_MNEUMONICS[8] = { "JGT",    "JEQ",    "JGE",    "JLT",    "JNE",    "JLE",    "JMP",    "" };
-static const char* const JUMP_BINARY[8] =     { JUMP_JGT, JUMP_JEQ, JUMP_JGE, JUMP_JLT, JUMP_JNE, JUMP_JLE, JUMP_JMP, JUMP_NULL };
+        key |= (uint32_t) (uint8_t) mneumonic[index] << (8 * index);
+    }
 
+    return key;
+}
 
-/* Determine if the given string is a known mneumonic
- * Return 1 = yes
- * Return 0 = no
- * Note if passed a NULL ptr 0 will be retured */
-extern int isMneumonic(const char* mneumonic)
+/* Look up the table entry of a mneumonic of the given length
+ * Return the entry if it is a mneumonic of one of the given kinds
+ * Return NULL otherwise */
+static const struct MneumonicEntry* findMneumonic(const char* mneumonic, size_t length, uint8_t kinds)
 {
-    if (mneumonic != NULL) {
+    uint32_t key = packMneumonic(mneumonic, length);
+    const struct MneumonicEntry* entry = &MNEUMONIC_TABLE[MNEUMONIC_SLOT(key)];
 
-        // Check all the Computation mneumonics
-        for (size_t index = 0; index < TOTAL_COMPUTATIONS; index++) {
+    if (entry->key == key && (entry->kinds & kinds) != 0) {
+        return entry;
+    }
 
-            if (strcmp(mneumonic, COMPUTATION_MNEUMONICS[index]) == 0) {
-                return 1;
-            }
-        }
+    return NULL;
+}
 
-        // Check all the destination mneumonics
-        for (size_t index = 0; index < TOTAL_DESTINATIONS; index++) {
+/* Write the mneumonic that encodes to the value of a field of the given kind
+ * into name_out, which must hold at least 3 characters, it isn't null terminated
+ * Return the length of the mneumonic on success, 0 for the null destination and jump
+ * Return -1 if no mneumonic encodes to bits, set errno */
+static int decodeMneumonic(uint8_t kind, uint8_t bits, char* name_out)
+{
+    if (name_out != NULL) {
+
+        for (size_t slot = 0; slot < MNEUMONIC_TABLE_SIZE; slot++) {
 
-            if (strcmp(mneumonic, DESTINATION_MNEUMONICS[index]) == 0) {
-                return 1;
+            const struct MneumonicEntry* entry = &MNEUMONIC_TABLE[slot];
+            if ((entry->kinds & kind) == 0) {
+                continue;
             }
-        }
 
-        // Check all the jump mneumonics
-        for (size_t index = 0; index < TOTAL_JUMPS; index++) {
+            uint8_t entry_bits = (kind == KIND_COMP) ? entry->comp :
+                                 (kind == KIND_DEST) ? entry->dest : entry->jump;
+            if (entry_bits != bits) {
+                continue;
+            }
 
-            if (strcmp(mneumonic, JUMP_MNEUMONICS[index]) == 0) {
-                return 1;
+            // Unpack the characters of the key, a null character ends it
+            int length = 0;
+            for (uint32_t key = entry->key; key != 0; key >>= 8) {
+                name_out[length] = (char) (key & 0xff);
+                length += 1;
             }
-        }
 
-        // No matches found
-        return 0;
+            return length;
+        }
     }
 
-    else {
-        return 0;
-    }
+    errno = EINVAL;
+    return -1;
 }
 
+/* Find the computation mneumonic of the 7 bit comp field, a bit included
+ * name_out must hold at least 3 characters, it isn't null terminated
+ * Return its length on success
+ * Return -1 if the field isn't a known computation, set errno */
+extern int decodeComp(uint8_t bits, char* name_out)
+{
+    return decodeMneumonic(KIND_COMP, bits, name_out);
+}
 
-/* Translate the given destination mneumonic into binary
- * and outputs it into binary_out. binary_out is assumed to
- * have a length >= 4
- * Return 0 on success, binary_out will be written to
- * Return -1 on error, set errno, binary_out will be untouched
- */
-static int  dest(const char* mneumonic, char* binary_out)
+/* Find the destination mneumonic of the 3 bit dest field
+ * name_out must hold at least 3 characters, it isn't null terminated
+ * Return its length on success, 0 for no destination
+ * Return -1 if the field isn't a destination, set errno */
+extern int decodeDest(uint8_t bits, char* name_out)
 {
-    if (mneumonic != NULL &&
-        binary_out != NULL) {
+    return decodeMneumonic(KIND_DEST, bits, name_out);
+}
 
-        // Loop through the mneumonics and try to find a match
-        for (int mneumonic_index = 0; mneumonic_index < TOTAL_DESTINATIONS; mneumonic_index++) {
+/* Find the jump mneumonic of the 3 bit jump field
+ * name_out must hold at least 3 characters, it isn't null terminated
+ * Return its length on success, 0 for no jump
+ * Return -1 if the field isn't a jump, set errno */
+extern int decodeJump(uint8_t bits, char* name_out)
+{
+    return decodeMneumonic(KIND_JUMP, bits, name_out);
+}
 
-            // If we find a match get its binary counterpart
-            if (strcmp(mneumonic, DESTINATION_MNEUMONICS[mneumonic_index]) == 0) {
 
-                // Copy into the buffer
-                strcpy(binary_out, DESTINATION_BINARY[mneumonic_index]);
+/* Translate the given destination mneumonic of the given length into its field value
+ * Return the 3 bit field on success
+ * Return -1 on error, set errno
+ */
+static int  dest(const char* mneumonic, size_t length)
+{
+    if (mneumonic != NULL) {
 
-                // Yay :)
-                return 0;
-            }
-        }
+        const struct MneumonicEntry* entry = findMneumonic(mneumonic, length, KIND_DEST);
 
         // Couldn't find a valid mnuemonic, so return an error
-        errno = EINVAL;
-        return -1;
+        if (entry == NULL) {
+            errno = EINVAL;
+            return -1;
+        }
+
+        return entry->dest;
     }
 
     else {
@@ -112,34 +228,23 @@ static int  dest(const char* mneumonic, char* binary_out)
     }
 }
 
-/* Translate the given computation mneumonic into binary
- * and outputs it into binary_out. binary_out is assumed to
- * have a length >= 8
- * Return 0 on success, binary_out will be written to
- * Return -1 on error, set errno, binary_out will be untouched
+/* Translate the given computation mneumonic of the given length into its field value
+ * Return the 7 bit field on success
+ * Return -1 on error, set errno
  */
-static int comp(const char* mneumonic, char* binary_out)
+static int comp(const char* mneumonic, size_t length)
 {
-    if (mneumonic != NULL &&
-        binary_out != NULL) {
-
-        // Loop through the mneumonics and try to find a match
-        for (int mneumonic_index = 0; mneumonic_index < TOTAL_COMPUTATIONS; mneumonic_index++) {
-
-            // If we find a match get its binary counterpart
-            if (strcmp(mneumonic, COMPUTATION_MNEUMONICS[mneumonic_index]) == 0) {
+    if (mneumonic != NULL) {
 
-                // Copy into the buffer
-                strcpy(binary_out, COMPUTATION_BINARY[mneumonic_index]);
+        const struct MneumonicEntry* entry = findMneumonic(mneumonic, length, KIND_COMP);
 
-                // Yay :)
-                return 0;
-            }
+        // Couldn't find a valid mnuemonic, so return an error
+        if (entry == NULL) {
+            errno = EINVAL;
+            return -1;
         }
 
-        // Couldn't find a valid mnuemonic, so return an error
-        errno = EINVAL;
-        return -1;
+        return entry->comp;
     }
 
     else {
@@ -148,34 +253,23 @@ static int comp(const char* mneumonic, char* binary_out)
     }
 }
 
-/* Translate the given jump mneumonic into binary
- * and outputs it into binary_out. binary_out is assumed to
- * have a length >= 4
- * Return 0 on success, binary_out will be written to
- * Return -1 on error, set errno, binary_out will be untouched
+/* Translate the given jump mneumonic of the given length into its field value
+ * Return the 3 bit field on success
+ * Return -1 on error, set errno
  */
-static int jump(const char* mneumonic, char* binary_out)
+static int jump(const char* mneumonic, size_t length)
 {
-    if (mneumonic != NULL &&
-        binary_out != NULL) {
-
-        // Loop through the mneumonics and try to find a match
-        for (int mneumonic_index = 0; mneumonic_index < TOTAL_JUMPS; mneumonic_index++) {
-
-            // If we find a match get its binary counterpart
-            if (strcmp(mneumonic, JUMP_MNEUMONICS[mneumonic_index]) == 0) {
+    if (mneumonic != NULL) {
 
-                // Copy into the buffer
-                strcpy(binary_out, JUMP_BINARY[mneumonic_index]);
+        const struct MneumonicEntry* entry = findMneumonic(mneumonic, length, KIND_JUMP);
 
-                // Yay :)
-                return 0;
-            }
+        // Couldn't find a valid mnuemonic, so return an error
+        if (entry == NULL) {
+            errno = EINVAL;
+            return -1;
         }
 
-        // Couldn't find a valid mnuemonic, so return an error
-        errno = EINVAL;
-        return -1;
+        return entry->jump;
     }
 
     else {
@@ -185,136 +279,77 @@ static int jump(const char* mneumonic, char* binary_out)
 }
 
 
-/* Convert a numeric string to a binary string
- * binary_out is assumed to be pre-allocated and its
- * length >= 16, 15 binary digits, 1 null terminator
- * the max decimal number that can be translated is 32767, (2^15) - 1
- * any number higher than this will result in an error.
- * unsigned numbers only, no negatives
- * Return 0 on success and binary_out will have the bits written to it
- * Return -1 on error, binary_out is untouched */
-static int numToBinary(const char* num_str, char* binary_out)
+/* Parse an A instruction operand as a decimal constant
+ * Return 1 = it is a constant, value_out will be set
+ * Return 0 = it isn't a constant, it is a symbol
+ * Return -1 = it is a constant that doesn't fit in 15 bits, errno will be set */
+extern int parseAConstant(StringView operand, uint16_t* value_out)
 {
-    if (num_str != NULL &&
-        binary_out != NULL &&
-        isNum(num_str) == 1) {
+    const uint32_t max_value = 32767;
+    uint32_t value = 0;
 
-        const uint16_t max_value = 32767;
-        uint16_t decimal_num = (uint16_t) atoi(num_str);
+    for (size_t index = 0; index < operand.length; index++) {
 
-        // Overflow protection
-        if (decimal_num > max_value) {
-            errno = EINVAL;
-            return -1;
+        if (isdigit((unsigned char) operand.data[index]) == 0) {
+            return 0;
         }
 
-        // translate to binary
-        for (int binary_index = 14; binary_index >= 0; binary_index--) {
+        value = value * 10 + (uint32_t) (operand.data[index] - '0');
 
-            char binary_digit = ((decimal_num >> binary_index) & 1) ? '1' : '0';
-
-            binary_out[14 - binary_index] = binary_digit;
+        // Overflow protection
+        if (value > max_value) {
+            errno = EINVAL;
+            return -1;
         }
-
-        // set the null terminator
-        binary_out[15] = '\0';
-
-        // Success :)
-        return 0;
     }
 
-    else {
-        errno = EINVAL;
-        return -1;
-    }
+    *value_out = (uint16_t) value;
+    return 1;
 }
 
-/* generate an A instruction given the symbol
- * binary_out is assumed to have a length >= 17
- * 16 binary characters, 1 null terminator
- * Return 0 on success, and binary_out will be filled
+/* encode a C instruction given views of its fields
+ * a view with NULL data is an absent field, the computation must be present
+ * and at least one of the destination and jump, a present field can't be empty
+ * Return 0 on success, and word_out will hold the instruction
  * Return -1 on failure, set errno */
-extern int generateAInstruction(const char* symbol, char* binary_out)
+extern int encodeCInstructionView(StringView destination, StringView computation, StringView jmp, uint16_t* word_out)
 {
-    if (symbol != NULL &&
-        binary_out != NULL) {
+    if (computation.data != NULL &&
+        (destination.data != NULL || jmp.data != NULL) &&
+        word_out != NULL) {
 
-        int error = 0;
-
-        // convert the symbol to a number
-        error = numToBinary(symbol, binary_out + 1);
-        if (error < 0) {
+        int comp_bits = comp(computation.data, computation.length);
+        if (comp_bits < 0) {
             return -1;
         }
 
-        // set the first bit to 0 to indicate its an A instruction
-        binary_out[0] = '0';
-
-        binary_out[16] = '\0';
-
-        // Done :)
-        return 0;
-    }
-
-    else {
-        errno = EINVAL;
-        return -1;
-    }
-}
-
-
-/* generate an C instruction given appropriate parameters
- * binary_out is assumed to have a length >= 17
- * 16 binary characters, 1 null terminator
- * Return 0 on success, and binary_out will be filled
- * Return -1 on failure, set errno */
-extern int generateCInstruction(const char* destination, const char* computation, const char* jmp, char* binary_out)
-{
-    if (computation != NULL &&
-        (destination != NULL || jmp != NULL) &&
-        binary_out != NULL) {
-
-        // NULL dest means a jump
-        // NULL jump means a regular C instruction
-        // Maybe they both can be set, ill design it in a way so it will still work
-        
-        int error = 0;
-
-        // fill the beginning field to indicate its a C instruction
-        binary_out[0] = '1';
-        binary_out[1] = '1';
-        binary_out[2] = '1';
-
-        // computation field starts 3 bits in
-        error = comp(computation, binary_out + 3);
-        if (error < 0) {
+        // The empty mneumonic is only there to decode the null fields
+        if ((destination.data != NULL && destination.length == 0) ||
+            (jmp.data != NULL && jmp.length == 0)) {
+            errno = EINVAL;
             return -1;
         }
 
-        // destination field starts 10 bits in
-        if (destination != NULL) {
-            error = dest(destination, binary_out + 10);
-            if (error < 0) {
+        int dest_bits = DEST_BITS_NULL;
+        if (destination.data != NULL) {
+            dest_bits = dest(destination.data, destination.length);
+            if (dest_bits < 0) {
                 return -1;
             }
         }
-        else {
-            strcpy(binary_out + 10, DEST_NULL);
-        }
 
-
-        // jump field starts 13 bits in
-        if (jmp != NULL) {
-            error = jump(jmp, binary_out + 13);
-            if (error < 0) {
+        int jump_bits = JUMP_BITS_NULL;
+        if (jmp.data != NULL) {
+            jump_bits = jump(jmp.data, jmp.length);
+            if (jump_bits < 0) {
                 return -1;
             }
         }
-        else {
-            strcpy(binary_out + 13, JUMP_NULL);
-        }
 
-        binary_out[16] = '\0';
+        *word_out = (uint16_t) (C_INSTRUCTION_PREFIX         |
+                                (comp_bits << COMP_SHIFT)    |
+                                (dest_bits << DEST_SHIFT)    |
+                                (jump_bits << JUMP_SHIFT));
 
         // Done :)
         return 0;
@@ -2,76 +2,75 @@
 #define CODE_H
 
 #include <stddef.h>
-/* This module holds the functions and declarations needed to translate mneumonics to binary code */
-
-/* These computations don't act on A or M */
-#define COMP_0          "0101010"
-#define COMP_1          "0111111"
-#define COMP_NEG_1      "0111010"
-#define COMP_D          "0001100"
-#define COMP_NOT_D      "0001101"
-#define COMP_NEG_D      "0001111"
-#define COMP_D_PLUS_1   "0011111"
-#define COMP_D_MINUS_1  "0001110"
-
-/* These computations Act on A */
-#define COMP_A          "0110000"
-#define COMP_NOT_A      "0110001"
-#define COMP_NEG_A      "0110011"
-#define COMP_A_PLUS_1   "0110111"
-#define COMP_A_MINUS_1  "0110010"
-#define COMP_D_PLUS_A   "0000010"
-#define COMP_D_MINUS_A  "0010011"
-#define COMP_A_MINUS_D  "0000111"
-#define COMP_D_AND_A    "0000000"
-#define COMP_D_OR_A     "0010101"
-
-
-/* These computations Act on M */
-#define COMP_M          "1110000"
-#define COMP_NOT_M      "1110001"
-#define COMP_NEG_M      "1110011"
-#define COMP_M_PLUS_1   "1110111"
-#define COMP_M_MINUS_1  "1110010"
-#define COMP_D_PLUS_M   "1000010"
-#define COMP_D_MINUS_M  "1010011"
-#define COMP_M_MINUS_D  "1000111"
-#define COMP_D_AND_M    "1000000"
-#define COMP_D_OR_M     "1010101"
-
+#include <stdint.h>
 
+#include "parser.h"
+/* This module holds the functions and declarations needed to translate mneumonics to binary code */
 
-/* Destination field binary translations */
-#define DEST_NULL       "000"
-#define DEST_M          "001"
-#define DEST_D          "010"
-#define DEST_MD         "011"
-#define DEST_A          "100"
-#define DEST_AM         "101"
-#define DEST_AD         "110"
-#define DEST_AMD        "111"
+/* Values of the comp, dest and jump fields, used to build whole instruction words */
+#define COMP_BITS_0              0x2a
+#define COMP_BITS_1              0x3f
+#define COMP_BITS_NEG_1          0x3a
+#define COMP_BITS_D              0x0c
+#define COMP_BITS_NOT_D          0x0d
+#define COMP_BITS_NEG_D          0x0f
+#define COMP_BITS_D_PLUS_1       0x1f
+#define COMP_BITS_D_MINUS_1      0x0e
+#define COMP_BITS_A              0x30
+#define COMP_BITS_NOT_A          0x31
+#define COMP_BITS_NEG_A          0x33
+#define COMP_BITS_A_PLUS_1       0x37
+#define COMP_BITS_A_MINUS_1      0x32
+#define COMP_BITS_D_PLUS_A       0x02
+#define COMP_BITS_D_MINUS_A      0x13
+#define COMP_BITS_A_MINUS_D      0x07
+#define COMP_BITS_D_AND_A        0x00
+#define COMP_BITS_D_OR_A         0x15
+#define COMP_BITS_M              0x70
+#define COMP_BITS_NOT_M          0x71
+#define COMP_BITS_NEG_M          0x73
+#define COMP_BITS_M_PLUS_1       0x77
+#define COMP_BITS_M_MINUS_1      0x72
+#define COMP_BITS_D_PLUS_M       0x42
+#define COMP_BITS_D_MINUS_M      0x53
+#define COMP_BITS_M_MINUS_D      0x47
+#define COMP_BITS_D_AND_M        0x40
+#define COMP_BITS_D_OR_M         0x55
 
+#define DEST_BITS_NULL           0x00
+#define DEST_BITS_M              0x01
+#define DEST_BITS_D              0x02
+#define DEST_BITS_MD             0x03
+#define DEST_BITS_A              0x04
+#define DEST_BITS_AM             0x05
+#define DEST_BITS_AD             0x06
+#define DEST_BITS_AMD            0x07
 
-/* Jump field binary translations */
-#define JUMP_NULL       "000"
-#define JUMP_JGT        "001"
-#define JUMP_JEQ        "010"
-#define JUMP_JGE        "011"
-#define JUMP_JLT        "100"
-#define JUMP_JNE        "101"
-#define JUMP_JLE        "110"
-#define JUMP_JMP        "111"
+#define JUMP_BITS_NULL           0x00
+#define JUMP_BITS_JGT            0x01
+#define JUMP_BITS_JEQ            0x02
+#define JUMP_BITS_JGE            0x03
+#define JUMP_BITS_JLT            0x04
+#define JUMP_BITS_JNE            0x05
+#define JUMP_BITS_JLE            0x06
+#define JUMP_BITS_JMP            0x07
 
+/* Bit positions of the fields within a C instruction word */
+#define C_INSTRUCTION_PREFIX    0xe000
+#define COMP_SHIFT              6
+#define DEST_SHIFT              3
+#define JUMP_SHIFT              0
 
 
 /* For reference
-static int  dest(const char*, char*);
-static int  comp(const char*, char*);
-static int  jump(const char*, char*);
-static int  numToBinary(const char*, char*);
+static int  dest(const char*, size_t);
+static int  comp(const char*, size_t);
+static int  jump(const char*, size_t);
 */
-extern int generateAInstruction(const char*, char*);
-extern int generateCInstruction(const char*, const char*, const char*, char*);
-extern int isMneumonic(const char*);
+extern int encodeCInstructionView(StringView, StringView, StringView, uint16_t*);
+extern int parseAConstant(StringView, uint16_t*);
+extern int decodeComp(uint8_t, char*);
+extern int decodeDest(uint8_t, char*);
+extern int decodeJump(uint8_t, char*);
 
 #endif
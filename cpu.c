@@ -0,0 +1,530 @@
+#include "cpu.h"
+#include "code.h"
+#include "symbol.h"
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* The PC and jump targets are 15 bits */
+#define CPU_ADDRESS_MASK    0x7fff
+
+/* The bits the assembler sets in every C instruction, the CPU ignores the two unused ones */
+#define CPU_C_MASK          0xe000
+
+/* A whole C instruction word from its fields */
+#define CPU_C_WORD(comp, dest, jump)  ((uint16_t) (C_INSTRUCTION_PREFIX         | \
+                                                   ((comp) << COMP_SHIFT)       | \
+                                                   ((dest) << DEST_SHIFT)       | \
+                                                   ((jump) << JUMP_SHIFT)))
+
+/* The memory word at A */
+#define CPU_M   ram[a]
+
+/* Every named computation, its comp field and how it is evaluated from d, a and CPU_M */
+#define CPU_COMPUTATIONS(X)                         \
+    X(ZERO,         COMP_BITS_0,        0)          \
+    X(ONE,          COMP_BITS_1,        1)          \
+    X(NEG_ONE,      COMP_BITS_NEG_1,    -1)         \
+    X(D,            COMP_BITS_D,        d)          \
+    X(NOT_D,        COMP_BITS_NOT_D,    ~d)         \
+    X(NEG_D,        COMP_BITS_NEG_D,    -d)         \
+    X(D_PLUS_1,     COMP_BITS_D_PLUS_1, d + 1)      \
+    X(D_MINUS_1,    COMP_BITS_D_MINUS_1, d - 1)     \
+    X(A,            COMP_BITS_A,        a)          \
+    X(NOT_A,        COMP_BITS_NOT_A,    ~a)         \
+    X(NEG_A,        COMP_BITS_NEG_A,    -a)         \
+    X(A_PLUS_1,     COMP_BITS_A_PLUS_1, a + 1)      \
+    X(A_MINUS_1,    COMP_BITS_A_MINUS_1, a - 1)     \
+    X(D_PLUS_A,     COMP_BITS_D_PLUS_A, d + a)      \
+    X(D_MINUS_A,    COMP_BITS_D_MINUS_A, d - a)     \
+    X(A_MINUS_D,    COMP_BITS_A_MINUS_D, a - d)     \
+    X(D_AND_A,      COMP_BITS_D_AND_A,  d & a)      \
+    X(D_OR_A,       COMP_BITS_D_OR_A,   d | a)      \
+    X(M,            COMP_BITS_M,        CPU_M)      \
+    X(NOT_M,        COMP_BITS_NOT_M,    ~CPU_M)     \
+    X(NEG_M,        COMP_BITS_NEG_M,    -CPU_M)     \
+    X(M_PLUS_1,     COMP_BITS_M_PLUS_1, CPU_M + 1)  \
+    X(M_MINUS_1,    COMP_BITS_M_MINUS_1, CPU_M - 1) \
+    X(D_PLUS_M,     COMP_BITS_D_PLUS_M, d + CPU_M)  \
+    X(D_MINUS_M,    COMP_BITS_D_MINUS_M, d - CPU_M) \
+    X(M_MINUS_D,    COMP_BITS_M_MINUS_D, CPU_M - d) \
+    X(D_AND_M,      COMP_BITS_D_AND_M,  d & CPU_M)  \
+    X(D_OR_M,       COMP_BITS_D_OR_M,   d | CPU_M)
+
+/* Every @X pair fused into one handler, the word that follows @X and the handler */
+#define CPU_FUSED(X)                                                                        \
+    X(LOAD_D_M,         CPU_C_WORD(COMP_BITS_M, DEST_BITS_D, JUMP_BITS_NULL))               \
+    X(LOAD_D_A,         CPU_C_WORD(COMP_BITS_A, DEST_BITS_D, JUMP_BITS_NULL))               \
+    X(LOAD_M_D,         CPU_C_WORD(COMP_BITS_D, DEST_BITS_M, JUMP_BITS_NULL))               \
+    X(LOAD_A_M,         CPU_C_WORD(COMP_BITS_M, DEST_BITS_A, JUMP_BITS_NULL))               \
+    X(LOAD_M_M_PLUS_1,  CPU_C_WORD(COMP_BITS_M_PLUS_1, DEST_BITS_M, JUMP_BITS_NULL))        \
+    X(LOAD_AM_M_MINUS_1, CPU_C_WORD(COMP_BITS_M_MINUS_1, DEST_BITS_AM, JUMP_BITS_NULL))     \
+    X(LOAD_D_D_PLUS_A,  CPU_C_WORD(COMP_BITS_D_PLUS_A, DEST_BITS_D, JUMP_BITS_NULL))        \
+    X(LOAD_D_D_PLUS_M,  CPU_C_WORD(COMP_BITS_D_PLUS_M, DEST_BITS_D, JUMP_BITS_NULL))        \
+    X(LOAD_D_D_MINUS_M, CPU_C_WORD(COMP_BITS_D_MINUS_M, DEST_BITS_D, JUMP_BITS_NULL))       \
+    X(LOAD_JMP,         CPU_C_WORD(COMP_BITS_0, DEST_BITS_NULL, JUMP_BITS_JMP))             \
+    X(LOAD_D_JGT,       CPU_C_WORD(COMP_BITS_D, DEST_BITS_NULL, JUMP_BITS_JGT))             \
+    X(LOAD_D_JEQ,       CPU_C_WORD(COMP_BITS_D, DEST_BITS_NULL, JUMP_BITS_JEQ))             \
+    X(LOAD_D_JGE,       CPU_C_WORD(COMP_BITS_D, DEST_BITS_NULL, JUMP_BITS_JGE))             \
+    X(LOAD_D_JLT,       CPU_C_WORD(COMP_BITS_D, DEST_BITS_NULL, JUMP_BITS_JLT))             \
+    X(LOAD_D_JNE,       CPU_C_WORD(COMP_BITS_D, DEST_BITS_NULL, JUMP_BITS_JNE))             \
+    X(LOAD_D_JLE,       CPU_C_WORD(COMP_BITS_D, DEST_BITS_NULL, JUMP_BITS_JLE))
+
+/* Position of every computation */
+#define CPU_COMPUTATION_POSITION(NAME, BITS, EXPRESSION)  CPU_POSITION_##NAME,
+enum {
+    CPU_COMPUTATIONS(CPU_COMPUTATION_POSITION)
+    CPU_COMPUTATION_COUNT
+};
+
+/* Handlers, each computation has one for every destination without a jump,
+ * in order of the dest field, then one for every jump without a destination */
+#define CPU_DEST_OPCODES(NAME, BITS, EXPRESSION) \
+    CPU_##NAME##_M, CPU_##NAME##_D, CPU_##NAME##_MD, CPU_##NAME##_A, CPU_##NAME##_AM, CPU_##NAME##_AD, CPU_##NAME##_AMD,
+#define CPU_JUMP_OPCODES(NAME, BITS, EXPRESSION) \
+    CPU_##NAME##_JGT, CPU_##NAME##_JEQ, CPU_##NAME##_JGE, CPU_##NAME##_JLT, CPU_##NAME##_JNE, CPU_##NAME##_JLE, CPU_##NAME##_JMP,
+#define CPU_FUSED_OPCODES(NAME, WORD)   CPU_##NAME,
+
+enum CpuOpcode {
+    CPU_LOAD,                   // @value
+    CPU_COMPUTATIONS(CPU_DEST_OPCODES)
+    CPU_COMPUTATIONS(CPU_JUMP_OPCODES)
+    CPU_GENERIC,                // Any other C instruction, through the ALU
+    CPU_FUSED(CPU_FUSED_OPCODES)
+    CPU_HALT,                   // @X 0;JMP at address X
+    CPU_WRAP,                   // Past the last ROM word
+    CPU_OPCODE_COUNT
+};
+
+#define CPU_FIRST_DEST  (CPU_LOAD + 1)
+#define CPU_FIRST_JUMP  (CPU_FIRST_DEST + 7 * CPU_COMPUTATION_COUNT)
+
+/* Position of a comp field + 1, 0 for a computation without a name */
+#define CPU_COMPUTATION_ENTRY(NAME, BITS, EXPRESSION)  [BITS] = CPU_POSITION_##NAME + 1,
+static const uint8_t CPU_COMPUTATION_INDEX[128] = {
+    CPU_COMPUTATIONS(CPU_COMPUTATION_ENTRY)
+};
+
+
+/* Evaluate any comp field like the Hack ALU, zx nx zy ny f no from the
+ * highest bit, y is A or M */
+static uint16_t Cpu_alu(uint16_t control, uint16_t x, uint16_t y)
+{
+    if (control & 0x20) {
+        x = 0;
+    }
+    if (control & 0x10) {
+        x = (uint16_t) ~x;
+    }
+    if (control & 0x08) {
+        y = 0;
+    }
+    if (control & 0x04) {
+        y = (uint16_t) ~y;
+    }
+
+    uint16_t out = (control & 0x02) ? (uint16_t) (x + y) : (uint16_t) (x & y);
+
+    if (control & 0x01) {
+        out = (uint16_t) ~out;
+    }
+
+    return out;
+}
+
+/* Find the handler of a C instruction on its own */
+static uint16_t Cpu_decodeC(uint16_t word)
+{
+    uint8_t position = CPU_COMPUTATION_INDEX[(word >> COMP_SHIFT) & 0x7f];
+    uint16_t dest = (word >> DEST_SHIFT) & 0x7;
+    uint16_t jump = (word >> JUMP_SHIFT) & 0x7;
+
+    if ((word & CPU_C_MASK) != C_INSTRUCTION_PREFIX || position == 0) {
+        return CPU_GENERIC;
+    }
+
+    if (dest != DEST_BITS_NULL && jump == JUMP_BITS_NULL) {
+        return (uint16_t) (CPU_FIRST_DEST + 7 * (position - 1) + (dest - 1));
+    }
+
+    if (dest == DEST_BITS_NULL && jump != JUMP_BITS_NULL) {
+        return (uint16_t) (CPU_FIRST_JUMP + 7 * (position - 1) + (jump - 1));
+    }
+
+    return CPU_GENERIC;
+}
+
+/* Decode the ROM word at address, an @X is fused with the next word if it is common
+ * Return the opcode of its handler */
+static uint16_t Cpu_decode(const uint16_t* rom, uint32_t address)
+{
+    uint16_t word = rom[address];
+
+    if ((word & 0x8000) != 0) {
+        return Cpu_decodeC(word);
+    }
+
+    if (address + 1 >= CPU_ROM_SIZE) {
+        return CPU_LOAD;
+    }
+
+    uint16_t next = rom[address + 1];
+
+    // The end of a program jumps to itself forever
+    if (next == CPU_C_WORD(COMP_BITS_0, DEST_BITS_NULL, JUMP_BITS_JMP) && word == address) {
+        return CPU_HALT;
+    }
+
+    #define CPU_FUSED_CASE(NAME, WORD)  case WORD: return CPU_##NAME;
+    switch (next) {
+        CPU_FUSED(CPU_FUSED_CASE)
+        default: return CPU_LOAD;
+    }
+    #undef CPU_FUSED_CASE
+}
+
+
+/* Create a CPU with an empty ROM, every word of which is @0
+ * Return 0 on success
+ * Return -1 on failure, errno will be set */
+extern int Cpu_create(Cpu* cpu)
+{
+    if (cpu != NULL) {
+
+        cpu->rom = calloc(CPU_ROM_SIZE + 1, sizeof(CpuInstruction));
+        cpu->ram = calloc(CPU_RAM_SIZE, sizeof(uint16_t));
+
+        if (cpu->rom == NULL || cpu->ram == NULL) {
+            free(cpu->rom);
+            free(cpu->ram);
+            return -1;
+        }
+
+        cpu->rom[CPU_ROM_SIZE].opcode = CPU_WRAP;
+        cpu->threaded = 0;
+        Cpu_reset(cpu);
+
+        // Done :)
+        return 0;
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/* Free the memories of a CPU */
+extern void Cpu_free(Cpu* cpu)
+{
+    if (cpu != NULL) {
+        free(cpu->rom);
+        free(cpu->ram);
+        cpu->rom = NULL;
+        cpu->ram = NULL;
+    }
+}
+
+/* Decode a program of count words into the ROM and reset the CPU,
+ * the rest of the ROM is @0
+ * Return 0 on success
+ * Return -1 on failure, errno is EFBIG if the program doesn't fit in the ROM */
+extern int Cpu_load(Cpu* cpu, const uint16_t* words, size_t count)
+{
+    if (cpu == NULL ||
+        (words == NULL && count > 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (count > CPU_ROM_SIZE) {
+        errno = EFBIG;
+        return -1;
+    }
+
+    uint16_t* rom = calloc(CPU_ROM_SIZE, sizeof(uint16_t));
+    if (rom == NULL) {
+        return -1;
+    }
+
+    if (count > 0) {
+        memcpy(rom, words, count * sizeof(uint16_t));
+    }
+
+    for (uint32_t address = 0; address < CPU_ROM_SIZE; address++) {
+        CpuInstruction* instruction = &cpu->rom[address];
+
+        instruction->handler = NULL;
+        instruction->value = rom[address];
+        instruction->word = rom[address];
+        instruction->opcode = Cpu_decode(rom, address);
+    }
+
+    free(rom);
+
+    // The handlers are set by the next run
+    cpu->threaded = 0;
+    Cpu_reset(cpu);
+
+    return 0;
+}
+
+/* Clear the registers and the RAM, the program is kept */
+extern void Cpu_reset(Cpu* cpu)
+{
+    if (cpu != NULL) {
+        memset(cpu->ram, 0, CPU_RAM_SIZE * sizeof(uint16_t));
+        cpu->a = 0;
+        cpu->d = 0;
+        cpu->pc = 0;
+        cpu->instructions = 0;
+    }
+}
+
+/* Run the program until it halts or has executed at least limit more instructions,
+ * a fused pair counts as 2 instructions and is never split
+ * Return CPU_HALTED if it reached @X 0;JMP at address X, the PC is left on it
+ * Return CPU_LIMIT otherwise */
+extern enum CpuStatus Cpu_run(Cpu* cpu, uint64_t limit)
+{
+    #define CPU_DEST_HANDLER_TABLE(NAME, BITS, EXPRESSION)                              \
+        [CPU_##NAME##_M] = &&NAME##_M,     [CPU_##NAME##_D] = &&NAME##_D,               \
+        [CPU_##NAME##_MD] = &&NAME##_MD,   [CPU_##NAME##_A] = &&NAME##_A,               \
+        [CPU_##NAME##_AM] = &&NAME##_AM,   [CPU_##NAME##_AD] = &&NAME##_AD,             \
+        [CPU_##NAME##_AMD] = &&NAME##_AMD,
+    #define CPU_JUMP_HANDLER_TABLE(NAME, BITS, EXPRESSION)                              \
+        [CPU_##NAME##_JGT] = &&NAME##_JGT, [CPU_##NAME##_JEQ] = &&NAME##_JEQ,           \
+        [CPU_##NAME##_JGE] = &&NAME##_JGE, [CPU_##NAME##_JLT] = &&NAME##_JLT,           \
+        [CPU_##NAME##_JNE] = &&NAME##_JNE, [CPU_##NAME##_JLE] = &&NAME##_JLE,           \
+        [CPU_##NAME##_JMP] = &&NAME##_JMP,
+    #define CPU_FUSED_HANDLER_TABLE(NAME, WORD)  [CPU_##NAME] = &&NAME,
+
+    static const void* const HANDLERS[CPU_OPCODE_COUNT] = {
+        [CPU_LOAD] = &&LOAD,
+        CPU_COMPUTATIONS(CPU_DEST_HANDLER_TABLE)
+        CPU_COMPUTATIONS(CPU_JUMP_HANDLER_TABLE)
+        [CPU_GENERIC] = &&GENERIC,
+        CPU_FUSED(CPU_FUSED_HANDLER_TABLE)
+        [CPU_HALT] = &&HALT,
+        [CPU_WRAP] = &&WRAP
+    };
+
+    CpuInstruction* rom = cpu->rom;
+
+    // Thread the ROM once per program
+    if (cpu->threaded == 0) {
+        for (uint32_t address = 0; address <= CPU_ROM_SIZE; address++) {
+            rom[address].handler = HANDLERS[rom[address].opcode];
+        }
+        cpu->threaded = 1;
+    }
+
+    uint16_t* ram = cpu->ram;
+    uint16_t a = cpu->a;
+    uint16_t d = cpu->d;
+    uint16_t value = 0;
+    const CpuInstruction* ip = &rom[cpu->pc];
+    uint64_t executed = 0;
+    enum CpuStatus status = CPU_LIMIT;
+
+    if (limit == 0) {
+        return CPU_LIMIT;
+    }
+
+    // Count the instructions, stop once enough ran, then run the next one
+    #define CPU_DISPATCH(count)                 \
+        do {                                    \
+            executed += (count);                \
+            if (executed >= limit) {            \
+                goto stop;                      \
+            }                                   \
+            goto *ip->handler;                  \
+        } while (0)
+
+    #define CPU_NEXT(count)                     \
+        do {                                    \
+            ip += (count);                      \
+            CPU_DISPATCH(count);                \
+        } while (0)
+
+    // A jump without a destination, A is unchanged
+    #define CPU_BRANCH(condition)                                       \
+        do {                                                            \
+            ip = (condition) ? &rom[a & CPU_ADDRESS_MASK] : ip + 1;     \
+            CPU_DISPATCH(1);                                            \
+        } while (0)
+
+    // The value is computed before anything is written, M is written at the old A
+    #define CPU_DEST_HANDLERS(NAME, BITS, EXPRESSION)                                           \
+        NAME##_M:   CPU_M = (uint16_t) (EXPRESSION); CPU_NEXT(1);                               \
+        NAME##_D:   d = (uint16_t) (EXPRESSION); CPU_NEXT(1);                                   \
+        NAME##_MD:  value = (uint16_t) (EXPRESSION); CPU_M = value; d = value; CPU_NEXT(1);     \
+        NAME##_A:   a = (uint16_t) (EXPRESSION); CPU_NEXT(1);                                   \
+        NAME##_AM:  value = (uint16_t) (EXPRESSION); CPU_M = value; a = value; CPU_NEXT(1);     \
+        NAME##_AD:  value = (uint16_t) (EXPRESSION); a = value; d = value; CPU_NEXT(1);         \
+        NAME##_AMD: value = (uint16_t) (EXPRESSION); CPU_M = value; a = value; d = value; CPU_NEXT(1);
+
+    #define CPU_JUMP_HANDLERS(NAME, BITS, EXPRESSION)                                   \
+        NAME##_JGT: value = (uint16_t) (EXPRESSION); CPU_BRANCH((int16_t) value > 0);   \
+        NAME##_JEQ: value = (uint16_t) (EXPRESSION); CPU_BRANCH(value == 0);            \
+        NAME##_JGE: value = (uint16_t) (EXPRESSION); CPU_BRANCH((int16_t) value >= 0);  \
+        NAME##_JLT: value = (uint16_t) (EXPRESSION); CPU_BRANCH((int16_t) value < 0);   \
+        NAME##_JNE: value = (uint16_t) (EXPRESSION); CPU_BRANCH(value != 0);            \
+        NAME##_JLE: value = (uint16_t) (EXPRESSION); CPU_BRANCH((int16_t) value <= 0);  \
+        NAME##_JMP: CPU_BRANCH(1);
+
+    // A fused jump loads its target into A first
+    #define CPU_FUSED_BRANCH(condition)                                 \
+        do {                                                            \
+            a = ip->value;                                              \
+            ip = (condition) ? &rom[a] : ip + 2;                        \
+            CPU_DISPATCH(2);                                            \
+        } while (0)
+
+    goto *ip->handler;
+
+LOAD:
+    a = ip->value;
+    CPU_NEXT(1);
+
+    CPU_COMPUTATIONS(CPU_DEST_HANDLERS)
+    CPU_COMPUTATIONS(CPU_JUMP_HANDLERS)
+
+GENERIC: {
+        uint16_t word = ip->word;
+        uint16_t address = a;
+
+        value = Cpu_alu((word >> COMP_SHIFT) & 0x3f, d, (word & 0x1000) ? CPU_M : a);
+
+        if (word & (DEST_BITS_M << DEST_SHIFT)) {
+            ram[address] = value;
+        }
+        if (word & (DEST_BITS_D << DEST_SHIFT)) {
+            d = value;
+        }
+        if (word & (DEST_BITS_A << DEST_SHIFT)) {
+            a = value;
+        }
+
+        // The jump bits are less than, equal and greater than zero, the target is the old A
+        int16_t result = (int16_t) value;
+        int jump = ((word & JUMP_BITS_JLT) && result < 0) ||
+                   ((word & JUMP_BITS_JEQ) && result == 0) ||
+                   ((word & JUMP_BITS_JGT) && result > 0);
+
+        ip = (jump) ? &rom[address & CPU_ADDRESS_MASK] : ip + 1;
+        CPU_DISPATCH(1);
+    }
+
+LOAD_D_M:
+    a = ip->value;
+    d = CPU_M;
+    CPU_NEXT(2);
+
+LOAD_D_A:
+    a = ip->value;
+    d = a;
+    CPU_NEXT(2);
+
+LOAD_M_D:
+    a = ip->value;
+    CPU_M = d;
+    CPU_NEXT(2);
+
+LOAD_A_M:
+    a = ram[ip->value];
+    CPU_NEXT(2);
+
+LOAD_M_M_PLUS_1:
+    a = ip->value;
+    CPU_M = (uint16_t) (CPU_M + 1);
+    CPU_NEXT(2);
+
+LOAD_AM_M_MINUS_1:
+    value = (uint16_t) (ram[ip->value] - 1);
+    ram[ip->value] = value;
+    a = value;
+    CPU_NEXT(2);
+
+LOAD_D_D_PLUS_A:
+    a = ip->value;
+    d = (uint16_t) (d + a);
+    CPU_NEXT(2);
+
+LOAD_D_D_PLUS_M:
+    a = ip->value;
+    d = (uint16_t) (d + CPU_M);
+    CPU_NEXT(2);
+
+LOAD_D_D_MINUS_M:
+    a = ip->value;
+    d = (uint16_t) (d - CPU_M);
+    CPU_NEXT(2);
+
+LOAD_JMP:
+    CPU_FUSED_BRANCH(1);
+
+LOAD_D_JGT:
+    CPU_FUSED_BRANCH((int16_t) d > 0);
+
+LOAD_D_JEQ:
+    CPU_FUSED_BRANCH(d == 0);
+
+LOAD_D_JGE:
+    CPU_FUSED_BRANCH((int16_t) d >= 0);
+
+LOAD_D_JLT:
+    CPU_FUSED_BRANCH((int16_t) d < 0);
+
+LOAD_D_JNE:
+    CPU_FUSED_BRANCH(d != 0);
+
+LOAD_D_JLE:
+    CPU_FUSED_BRANCH((int16_t) d <= 0);
+
+HALT:
+    // Run the loop once, it would only repeat itself
+    a = ip->value;
+    executed += 2;
+    status = CPU_HALTED;
+    goto stop;
+
+WRAP:
+    ip = rom;
+    goto *ip->handler;
+
+stop:
+    cpu->a = a;
+    cpu->d = d;
+    cpu->pc = (uint16_t) ((ip - rom) & CPU_ADDRESS_MASK);
+    cpu->instructions += executed;
+
+    return status;
+
+    #undef CPU_DEST_HANDLER_TABLE
+    #undef CPU_JUMP_HANDLER_TABLE
+    #undef CPU_FUSED_HANDLER_TABLE
+    #undef CPU_DISPATCH
+    #undef CPU_NEXT
+    #undef CPU_BRANCH
+    #undef CPU_DEST_HANDLERS
+    #undef CPU_JUMP_HANDLERS
+    #undef CPU_FUSED_BRANCH
+}
+
+/* Set the key held down, the value of the KBD register, 0 for none */
+extern void Cpu_setKeyboard(Cpu* cpu, uint16_t key)
+{
+    if (cpu != NULL) {
+        cpu->ram[SYMBOL_KBD] = key;
+    }
+}
+
+/* Get the screen memory, 256 rows of 32 words, the lowest bit of a word is its leftmost pixel */
+extern const uint16_t* Cpu_screen(const Cpu* cpu)
+{
+    return (cpu != NULL) ? &cpu->ram[SYMBOL_SCREEN] : NULL;
+}
@@ -0,0 +1,52 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* This module runs Hack machine code. Every ROM word is decoded once, when the
+ * program is loaded, into the address of the code that executes it and its
+ * operand, so running an instruction is a single indirect jump to its handler.
+ * An @X followed by one of the most common instructions, D=M, M=D, 0;JMP and
+ * the like, is fused into one handler that executes both */
+
+#define CPU_ROM_SIZE    32768
+#define CPU_RAM_SIZE    65536   // Past KBD too, so no address computed in A needs a bound check
+
+/* Why Cpu_run returned */
+enum CpuStatus {
+    CPU_HALTED,         // Reached @X 0;JMP at address X, the end of a Hack program
+    CPU_LIMIT           // Executed as many instructions as it was allowed
+};
+
+/* A decoded ROM word */
+struct StructCpuInstruction {
+    const void* handler;        // Code that executes it, set on the first run
+    uint16_t    value;          // The constant of an A instruction or of a fused pair
+    uint16_t    word;           // The ROM word, for the handler of uncommon instructions
+    uint16_t    opcode;         // Which handler
+};
+
+typedef struct StructCpuInstruction CpuInstruction;
+
+struct StructCpu {
+    CpuInstruction* rom;        // CPU_ROM_SIZE + 1, the last one wraps the PC to 0
+    uint16_t* ram;
+    uint16_t  a;
+    uint16_t  d;
+    uint16_t  pc;
+    uint64_t  instructions;     // Executed since the program was loaded
+    int       threaded;         // 1 once the handlers of the ROM are set
+};
+
+typedef struct StructCpu Cpu;
+
+extern int             Cpu_create      (Cpu*);
+extern void            Cpu_free        (Cpu*);
+extern int             Cpu_load        (Cpu*, const uint16_t*, size_t);
+extern void            Cpu_reset       (Cpu*);
+extern enum CpuStatus  Cpu_run         (Cpu*, uint64_t);
+extern void            Cpu_setKeyboard (Cpu*, uint16_t);
+extern const uint16_t* Cpu_screen      (const Cpu*);
+
+#endif
@@ -0,0 +1,641 @@
+#include "debug.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/* Append a symbol to a list of entries
+ * Return 0 on success
+ * Return -1 on failure, set errno */
+static int DebugInfo_addEntry(struct StructDebugEntry** entries, size_t* count, size_t* capacity,
+                              StringView name, int address)
+{
+    if (address < 0 || name.data == NULL || *count >= UINT32_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (*count == *capacity) {
+
+        size_t new_capacity = (*capacity > 0) ? *capacity * 2 : 64;
+
+        errno = 0;
+        struct StructDebugEntry* new_entries = reallocarray(*entries, new_capacity, sizeof(struct StructDebugEntry));
+        if (errno != 0) {
+            return -1;
+        }
+
+        *entries = new_entries;
+        *capacity = new_capacity;
+    }
+
+    struct StructDebugEntry* entry = &(*entries)[*count];
+    entry->name = name;
+    entry->address = (uint32_t) address;
+    entry->order = (uint32_t) *count;
+
+    *count += 1;
+
+    return 0;
+}
+
+/* Order two names by their bytes, a name sorts before the longer names it starts */
+static int DebugInfo_compareNames(const char* first, size_t first_length,
+                                  const char* second, size_t second_length)
+{
+    size_t length = (first_length < second_length) ? first_length : second_length;
+
+    int order = memcmp(first, second, length);
+    if (order != 0) {
+        return order;
+    }
+
+    return (first_length > second_length) - (first_length < second_length);
+}
+
+/* qsort comparator of entries by name */
+static int DebugInfo_compareEntries(const void* first, const void* second)
+{
+    const struct StructDebugEntry* first_entry = first;
+    const struct StructDebugEntry* second_entry = second;
+
+    return DebugInfo_compareNames(first_entry->name.data, first_entry->name.length,
+                                  second_entry->name.data, second_entry->name.length);
+}
+
+/* Write the symbols of entries, their names follow each other in the strings
+ * starting at name_offset, which is advanced past them
+ * Return 0 on success
+ * Return -1 on failure, set errno */
+static int DebugInfo_writeSymbols(const struct StructDebugEntry* entries, size_t count,
+                                  uint32_t* name_offset, FILE* file)
+{
+    for (size_t index = 0; index < count; index++) {
+
+        DebugSymbol symbol;
+        symbol.name_offset = *name_offset;
+        symbol.name_length = (uint32_t) entries[index].name.length;
+        symbol.address = entries[index].address;
+
+        if (fwrite(&symbol, sizeof(DebugSymbol), 1, file) != 1) {
+            return -1;
+        }
+
+        *name_offset += symbol.name_length;
+    }
+
+    return 0;
+}
+
+/* Write the names of entries back to back
+ * Return 0 on success
+ * Return -1 on failure, set errno */
+static int DebugInfo_writeNames(const struct StructDebugEntry* entries, size_t count, FILE* file)
+{
+    for (size_t index = 0; index < count; index++) {
+        if (fwrite(entries[index].name.data, 1, entries[index].name.length, file) != entries[index].name.length) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Find the section of count elements of the given size at offset
+ * Return a pointer to it if it lies in the file and is 4 byte aligned
+ * Return NULL otherwise */
+static const void* DebugMap_section(const DebugMap* map, uint32_t offset, uint32_t count, size_t size)
+{
+    if (offset % 4 != 0 ||
+        offset > map->size ||
+        (uint64_t) count * size > map->size - offset) {
+        return NULL;
+    }
+
+    return map->data + offset;
+}
+
+/* Binary search symbols sorted by name
+ * Return the address of the symbol on success
+ * Return -1 if it isn't there */
+static int DebugMap_searchSymbols(const DebugMap* map, const DebugSymbol* symbols, uint32_t count,
+                                  const char* name, size_t length)
+{
+    const char* strings = (const char*) map->data + map->header->strings_offset;
+
+    uint32_t low = 0;
+    uint32_t high = count;
+
+    while (low < high) {
+
+        uint32_t middle = low + (high - low) / 2;
+        const DebugSymbol* symbol = &symbols[middle];
+
+        int order = DebugInfo_compareNames(&strings[symbol->name_offset], symbol->name_length, name, length);
+
+        if (order == 0) {
+            return (int) symbol->address;
+        }
+
+        else if (order < 0) {
+            low = middle + 1;
+        }
+
+        else {
+            high = middle;
+        }
+    }
+
+    return -1;
+}
+
+/* Check that every name of symbols lies in the strings
+ * Return 1 if they do, 0 otherwise */
+static int DebugMap_checkNames(const DebugHeader* header, const DebugSymbol* symbols, uint32_t count)
+{
+    for (uint32_t index = 0; index < count; index++) {
+        if (symbols[index].name_offset > header->strings_size ||
+            symbols[index].name_length > header->strings_size - symbols[index].name_offset) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+/* Create an empty debug info, nothing is allocated until something is added */
+extern void DebugInfo_create(DebugInfo* debug)
+{
+    if (debug != NULL) {
+        memset(debug, 0, sizeof(DebugInfo));
+    }
+}
+
+/* Free the collected debug info */
+extern void DebugInfo_free(DebugInfo* debug)
+{
+    if (debug != NULL) {
+        free(debug->labels);
+        free(debug->variables);
+        free(debug->lines);
+        memset(debug, 0, sizeof(DebugInfo));
+    }
+}
+
+/* Forget the previous program, the arrays are kept */
+extern void DebugInfo_reset(DebugInfo* debug)
+{
+    if (debug != NULL) {
+        debug->label_count = 0;
+        debug->variable_count = 0;
+        debug->line_count = 0;
+    }
+}
+
+/* Record the label name defined at address, labels must be added in order of address.
+ * name must stay valid until the debug info is written
+ * Return 0 on success
+ * Return -1 on failure, set errno */
+extern int DebugInfo_addLabel(DebugInfo* debug, StringView name, int address)
+{
+    if (debug != NULL) {
+        return DebugInfo_addEntry(&debug->labels, &debug->label_count, &debug->label_capacity, name, address);
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/* Record the variable name allocated at address
+ * name must stay valid until the debug info is written
+ * Return 0 on success
+ * Return -1 on failure, set errno */
+extern int DebugInfo_addVariable(DebugInfo* debug, StringView name, int address)
+{
+    if (debug != NULL) {
+        return DebugInfo_addEntry(&debug->variables, &debug->variable_count, &debug->variable_capacity, name, address);
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/* Record the source line of the next instruction
+ * Return 0 on success
+ * Return -1 on failure, set errno */
+extern int DebugInfo_addLine(DebugInfo* debug, size_t line)
+{
+    if (debug != NULL &&
+        line <= UINT32_MAX) {
+
+        if (debug->line_count == debug->line_capacity) {
+
+            size_t new_capacity = (debug->line_capacity > 0) ? debug->line_capacity * 2 : 1024;
+
+            errno = 0;
+            uint32_t* new_lines = reallocarray(debug->lines, new_capacity, sizeof(uint32_t));
+            if (errno != 0) {
+                return -1;
+            }
+
+            debug->lines = new_lines;
+            debug->line_capacity = new_capacity;
+        }
+
+        debug->lines[debug->line_count] = (uint32_t) line;
+        debug->line_count += 1;
+
+        return 0;
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/* Move the labels and the lines to the addresses of a program shrunk by the optimizer.
+ * new_addresses holds the new address of every old address and of the end, an
+ * instruction that was removed has the address of the next one that was kept
+ * Return 0 on success
+ * Return -1 on failure, set errno */
+extern int DebugInfo_remap(DebugInfo* debug, const uint32_t* new_addresses)
+{
+    if (debug != NULL &&
+        new_addresses != NULL) {
+
+        for (size_t index = 0; index < debug->label_count; index++) {
+            debug->labels[index].address = new_addresses[debug->labels[index].address];
+        }
+
+        // Kept instructions only move down
+        for (size_t address = 0; address < debug->line_count; address++) {
+            if (new_addresses[address] != new_addresses[address + 1]) {
+                debug->lines[new_addresses[address]] = debug->lines[address];
+            }
+        }
+        debug->line_count = new_addresses[debug->line_count];
+
+        return 0;
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/* Write the debug info of a program assembled from source_name to file.
+ * The labels and variables are sorted in place
+ * Return 0 on success
+ * Return -1 on failure, errno will be set */
+extern int DebugInfo_write(DebugInfo* debug, FILE* file, const char* source_name)
+{
+    if (debug == NULL ||
+        file == NULL ||
+        source_name == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    size_t source_length = strlen(source_name);
+
+    // Every offset must fit in 32 bits
+    uint64_t strings_size = source_length;
+    for (size_t index = 0; index < debug->label_count; index++) {
+        strings_size += debug->labels[index].name.length;
+    }
+    for (size_t index = 0; index < debug->variable_count; index++) {
+        strings_size += debug->variables[index].name.length;
+    }
+
+    uint64_t strings_offset = sizeof(DebugHeader) +
+                              (uint64_t) debug->label_count * (sizeof(DebugSymbol) + sizeof(uint32_t)) +
+                              (uint64_t) debug->variable_count * sizeof(DebugSymbol) +
+                              sizeof(DebugFile) +
+                              (uint64_t) debug->line_count * sizeof(uint32_t);
+
+    if (strings_offset + strings_size > UINT32_MAX) {
+        errno = ERANGE;
+        return -1;
+    }
+
+    DebugHeader header;
+    memset(&header, 0, sizeof(DebugHeader));
+    memcpy(header.magic, DEBUG_MAGIC, sizeof(header.magic));
+    header.version = DEBUG_VERSION;
+    header.byte_order = DEBUG_BYTE_ORDER;
+    header.instruction_count = (uint32_t) debug->line_count;
+    header.label_count = (uint32_t) debug->label_count;
+    header.variable_count = (uint32_t) debug->variable_count;
+    header.file_count = 1;
+    header.labels_offset = sizeof(DebugHeader);
+    header.label_addresses_offset = header.labels_offset + header.label_count * sizeof(DebugSymbol);
+    header.variables_offset = header.label_addresses_offset + header.label_count * sizeof(uint32_t);
+    header.files_offset = header.variables_offset + header.variable_count * sizeof(DebugSymbol);
+    header.lines_offset = header.files_offset + header.file_count * sizeof(DebugFile);
+    header.strings_offset = (uint32_t) strings_offset;
+    header.strings_size = (uint32_t) strings_size;
+
+    // The labels were added in order of address, remember where each one is sorted to
+    uint32_t* label_addresses = malloc((debug->label_count + 1) * sizeof(uint32_t));
+    if (label_addresses == NULL) {
+        return -1;
+    }
+
+    // A program without symbols never allocated the arrays
+    if (debug->label_count > 0) {
+        qsort(debug->labels, debug->label_count, sizeof(struct StructDebugEntry), DebugInfo_compareEntries);
+    }
+    if (debug->variable_count > 0) {
+        qsort(debug->variables, debug->variable_count, sizeof(struct StructDebugEntry), DebugInfo_compareEntries);
+    }
+
+    for (size_t index = 0; index < debug->label_count; index++) {
+        label_addresses[debug->labels[index].order] = (uint32_t) index;
+    }
+
+    // The names are written in the same order as the tables
+    uint32_t name_offset = 0;
+    int error = 0;
+
+    if (fwrite(&header, sizeof(DebugHeader), 1, file) != 1 ||
+        DebugInfo_writeSymbols(debug->labels, debug->label_count, &name_offset, file) < 0 ||
+        fwrite(label_addresses, sizeof(uint32_t), debug->label_count, file) != debug->label_count ||
+        DebugInfo_writeSymbols(debug->variables, debug->variable_count, &name_offset, file) < 0) {
+        error = -1;
+    }
+
+    free(label_addresses);
+
+    DebugFile source_file;
+    source_file.name_offset = name_offset;
+    source_file.name_length = (uint32_t) source_length;
+    source_file.first_address = 0;
+
+    if (error < 0 ||
+        fwrite(&source_file, sizeof(DebugFile), 1, file) != 1 ||
+        fwrite(debug->lines, sizeof(uint32_t), debug->line_count, file) != debug->line_count ||
+        DebugInfo_writeNames(debug->labels, debug->label_count, file) < 0 ||
+        DebugInfo_writeNames(debug->variables, debug->variable_count, file) < 0 ||
+        fwrite(source_name, 1, source_length, file) != source_length) {
+        return -1;
+    }
+
+    // Done :)
+    return 0;
+}
+
+
+/* Map the debug info file at path and check that every table lies in it
+ * Return 0 on success
+ * Return -1 on failure, errno will be set, EINVAL if it isn't a valid debug info file */
+extern int DebugMap_open(DebugMap* map, const char* path)
+{
+    if (map != NULL &&
+        path != NULL) {
+
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            return -1;
+        }
+
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) < 0) {
+            close(fd);
+            return -1;
+        }
+
+        size_t size = (size_t) file_stat.st_size;
+        if (size < sizeof(DebugHeader)) {
+            close(fd);
+            errno = EINVAL;
+            return -1;
+        }
+
+        void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        // The mapping keeps the file alive
+        close(fd);
+
+        if (mapping == MAP_FAILED) {
+            return -1;
+        }
+
+        map->data = mapping;
+        map->size = size;
+        map->header = mapping;
+
+        const DebugHeader* header = map->header;
+
+        const DebugSymbol* labels = DebugMap_section(map, header->labels_offset, header->label_count, sizeof(DebugSymbol));
+        const uint32_t* label_addresses = DebugMap_section(map, header->label_addresses_offset, header->label_count, sizeof(uint32_t));
+        const DebugSymbol* variables = DebugMap_section(map, header->variables_offset, header->variable_count, sizeof(DebugSymbol));
+        const DebugFile* files = DebugMap_section(map, header->files_offset, header->file_count, sizeof(DebugFile));
+
+        int valid = (memcmp(header->magic, DEBUG_MAGIC, sizeof(header->magic)) == 0 &&
+                     header->version == DEBUG_VERSION &&
+                     header->byte_order == DEBUG_BYTE_ORDER &&
+                     labels != NULL &&
+                     label_addresses != NULL &&
+                     variables != NULL &&
+                     files != NULL &&
+                     DebugMap_section(map, header->lines_offset, header->instruction_count, sizeof(uint32_t)) != NULL &&
+                     header->strings_offset <= size &&
+                     header->strings_size <= size - header->strings_offset &&
+                     DebugMap_checkNames(header, labels, header->label_count) &&
+                     DebugMap_checkNames(header, variables, header->variable_count));
+
+        for (uint32_t index = 0; valid && index < header->label_count; index++) {
+            valid = (label_addresses[index] < header->label_count);
+        }
+
+        for (uint32_t index = 0; valid && index < header->file_count; index++) {
+            valid = (files[index].name_offset <= header->strings_size &&
+                     files[index].name_length <= header->strings_size - files[index].name_offset);
+        }
+
+        if (valid == 0) {
+            DebugMap_close(map);
+            errno = EINVAL;
+            return -1;
+        }
+
+        return 0;
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/* Unmap a debug info file */
+extern void DebugMap_close(DebugMap* map)
+{
+    if (map != NULL && map->data != NULL) {
+        munmap((void*) map->data, map->size);
+        map->data = NULL;
+        map->size = 0;
+        map->header = NULL;
+    }
+}
+
+/* Find the address of the label or variable name of the given length
+ * Return the address on success
+ * Return -1 if there is no such symbol */
+extern int DebugMap_findSymbol(const DebugMap* map, const char* name, size_t length)
+{
+    if (map == NULL || map->header == NULL || name == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const DebugHeader* header = map->header;
+
+    int address = DebugMap_searchSymbols(map, (const DebugSymbol*) (map->data + header->labels_offset),
+                                         header->label_count, name, length);
+    if (address < 0) {
+        address = DebugMap_searchSymbols(map, (const DebugSymbol*) (map->data + header->variables_offset),
+                                         header->variable_count, name, length);
+    }
+
+    return address;
+}
+
+/* Find the last label at or before a ROM address, the one whose code holds it.
+ * name is set to the name of the label if it isn't NULL
+ * Return the address of the label on success
+ * Return -1 if there is no label before address */
+extern int DebugMap_findLabel(const DebugMap* map, uint32_t address, StringView* name)
+{
+    if (map == NULL || map->header == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const DebugHeader* header = map->header;
+    const DebugSymbol* labels = (const DebugSymbol*) (map->data + header->labels_offset);
+    const uint32_t* by_address = (const uint32_t*) (map->data + header->label_addresses_offset);
+
+    // Count the labels at or before address
+    uint32_t low = 0;
+    uint32_t high = header->label_count;
+
+    while (low < high) {
+
+        uint32_t middle = low + (high - low) / 2;
+
+        if (labels[by_address[middle]].address <= address) {
+            low = middle + 1;
+        }
+
+        else {
+            high = middle;
+        }
+    }
+
+    if (low == 0) {
+        return -1;
+    }
+
+    const DebugSymbol* label = &labels[by_address[low - 1]];
+
+    if (name != NULL) {
+        name->data = (const char*) map->data + header->strings_offset + label->name_offset;
+        name->length = label->name_length;
+    }
+
+    return (int) label->address;
+}
+
+/* Get a label in order of address, index counts from 0.
+ * name is set to the name of the label if it isn't NULL
+ * Return the address of the label on success
+ * Return -1 if index is past the last label */
+extern int DebugMap_labelAt(const DebugMap* map, uint32_t index, StringView* name)
+{
+    if (map == NULL || map->header == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const DebugHeader* header = map->header;
+
+    if (index >= header->label_count) {
+        return -1;
+    }
+
+    const DebugSymbol* labels = (const DebugSymbol*) (map->data + header->labels_offset);
+    const uint32_t* by_address = (const uint32_t*) (map->data + header->label_addresses_offset);
+    const DebugSymbol* label = &labels[by_address[index]];
+
+    if (name != NULL) {
+        name->data = (const char*) map->data + header->strings_offset + label->name_offset;
+        name->length = label->name_length;
+    }
+
+    return (int) label->address;
+}
+
+/* Find the source line of the instruction at a ROM address.
+ * file is set to the name of its source file if it isn't NULL
+ * Return the line, counting from 1, on success
+ * Return -1 if address is past the program */
+extern long DebugMap_findLine(const DebugMap* map, uint32_t address, StringView* file)
+{
+    if (map == NULL || map->header == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const DebugHeader* header = map->header;
+
+    if (address >= header->instruction_count) {
+        return -1;
+    }
+
+    const uint32_t* lines = (const uint32_t*) (map->data + header->lines_offset);
+
+    if (file != NULL) {
+        const DebugFile* files = (const DebugFile*) (map->data + header->files_offset);
+
+        // The last file starting at or before address
+        uint32_t low = 0;
+        uint32_t high = header->file_count;
+
+        while (low < high) {
+
+            uint32_t middle = low + (high - low) / 2;
+
+            if (files[middle].first_address <= address) {
+                low = middle + 1;
+            }
+
+            else {
+                high = middle;
+            }
+        }
+
+        file->data = NULL;
+        file->length = 0;
+
+        if (low > 0) {
+            file->data = (const char*) map->data + header->strings_offset + files[low - 1].name_offset;
+            file->length = files[low - 1].name_length;
+        }
+    }
+
+    return (long) lines[address];
+}
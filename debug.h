@@ -0,0 +1,111 @@
+#ifndef DEBUG_H
+#define DEBUG_H
+
+#include "parser.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* This module collects the debug info of a program while it is assembled and
+ * writes it to a sidecar file that tools map and search in place, without parsing.
+ * The file holds the labels and the variables sorted by name, the labels sorted
+ * by address, and the source line of every ROM address.
+ *
+ * Layout, every field is a 32 bit integer in the byte order of the writer:
+ *   DebugHeader
+ *   DebugSymbol[label_count]       labels sorted by name
+ *   uint32_t[label_count]          indexes of the labels sorted by address
+ *   DebugSymbol[variable_count]    variables sorted by name
+ *   DebugFile[file_count]          source files sorted by first address
+ *   uint32_t[instruction_count]    source line of every ROM address, from 1
+ *   char[strings_size]             names, referenced by offset and length */
+
+#define DEBUG_MAGIC         "HACKDBG"       // Includes the null terminator, 8 bytes
+#define DEBUG_VERSION       1
+#define DEBUG_BYTE_ORDER    0x01020304u     // Reads differently on a host of the other byte order
+
+struct StructDebugHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t instruction_count;
+    uint32_t label_count;
+    uint32_t variable_count;
+    uint32_t file_count;
+    uint32_t labels_offset;            // Offsets from the start of the file
+    uint32_t label_addresses_offset;
+    uint32_t variables_offset;
+    uint32_t files_offset;
+    uint32_t lines_offset;
+    uint32_t strings_offset;
+    uint32_t strings_size;
+    uint32_t reserved;                 // 0, keeps the header a multiple of 8 bytes
+};
+
+struct StructDebugSymbol {
+    uint32_t name_offset;              // Into the strings
+    uint32_t name_length;
+    uint32_t address;
+};
+
+struct StructDebugFile {
+    uint32_t name_offset;
+    uint32_t name_length;
+    uint32_t first_address;            // The file covers the addresses up to the next file
+};
+
+typedef struct StructDebugHeader DebugHeader;
+typedef struct StructDebugSymbol DebugSymbol;
+typedef struct StructDebugFile   DebugFile;
+
+/* A symbol collected while assembling, the name is owned by the assembler */
+struct StructDebugEntry {
+    StringView name;
+    uint32_t   address;
+    uint32_t   order;                  // Position in the order of definition
+};
+
+/* The debug info of the program being assembled */
+struct StructDebugInfo {
+    struct StructDebugEntry* labels;   // In order of definition, so also of address
+    size_t    label_count;
+    size_t    label_capacity;
+
+    struct StructDebugEntry* variables;
+    size_t    variable_count;
+    size_t    variable_capacity;
+
+    uint32_t* lines;                   // Source line of every instruction
+    size_t    line_count;
+    size_t    line_capacity;
+};
+
+typedef struct StructDebugInfo DebugInfo;
+
+/* A debug info file mapped in memory */
+struct StructDebugMap {
+    const uint8_t*     data;
+    size_t             size;
+    const DebugHeader* header;
+};
+
+typedef struct StructDebugMap DebugMap;
+
+extern void DebugInfo_create      (DebugInfo*);
+extern void DebugInfo_free        (DebugInfo*);
+extern void DebugInfo_reset       (DebugInfo*);
+extern int  DebugInfo_addLabel    (DebugInfo*, StringView, int);
+extern int  DebugInfo_addVariable (DebugInfo*, StringView, int);
+extern int  DebugInfo_addLine     (DebugInfo*, size_t);
+extern int  DebugInfo_remap       (DebugInfo*, const uint32_t*);
+extern int  DebugInfo_write       (DebugInfo*, FILE*, const char*);
+
+extern int  DebugMap_open         (DebugMap*, const char*);
+extern void DebugMap_close        (DebugMap*);
+extern int  DebugMap_findSymbol   (const DebugMap*, const char*, size_t);
+extern int  DebugMap_findLabel    (const DebugMap*, uint32_t, StringView*);
+extern int  DebugMap_labelAt      (const DebugMap*, uint32_t, StringView*);
+extern long DebugMap_findLine     (const DebugMap*, uint32_t, StringView*);
+
+#endif
@@ -0,0 +1,318 @@
+#include "disassembler.h"
+#include "debug.h"
+#include "output.h"
+
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+/* This program turns Hack machine code, .hack text or packed binary,
+ * back into assembly. With the debug info written by the assembler's -g
+ * the labels are restored as well */
+
+/* Command line options */
+struct StructOptions {
+    const char*   input_path;      // - reads standard input
+    const char*   output_path;     // NULL or - writes standard output
+    const char*   debug_path;      // Debug info to take the labels from, NULL for none
+    enum DisassemblerFormat format;
+    enum OutputByteOrder    byte_order;   // Of binary input without a header
+};
+
+typedef struct StructOptions Options;
+
+/* The machine code, mapped from a file or read from standard input */
+struct StructInput {
+    uint8_t* data;
+    size_t   length;
+    int      mapped;               // 1 to unmap the data, 0 to free it
+};
+
+typedef struct StructInput Input;
+
+static void printUsage(FILE* stream, const char* program);
+static int  parseArguments(int argc, char** argv, Options* options);
+static int  readInput(const char* path, Input* input);
+static void freeInput(Input* input);
+
+int main(int argc, char** argv) {
+    /* Parse the command line
+     * Read the machine code and decode it into words
+     * Write the text of every word, with the labels of the debug info if given */
+
+
+    Options options;
+    int error = parseArguments(argc, argv, &options);
+    if (error != 0) {
+        return (error > 0) ? 0 : -1;
+    }
+
+    Input input;
+    if (readInput(options.input_path, &input) < 0) {
+        fprintf(stderr, "ERROR: %s\nFile: %s\nMessage: Failed to open source file\n", strerror(errno), options.input_path);
+        return -1;
+    }
+
+    // A word takes at least 2 bytes in either format
+    uint16_t* words = malloc((input.length / 2 + 1) * sizeof(uint16_t));
+    if (words == NULL) {
+        fprintf(stderr, "ERROR: %s\nMessage: Failed to allocate the words\n", strerror(errno));
+        freeInput(&input);
+        return -1;
+    }
+
+    size_t word_count = 0;
+    size_t line = 0;
+    error = Disassembler_decode(input.data, input.length, options.format, options.byte_order,
+                                words, &word_count, &line);
+    freeInput(&input);
+
+    if (error < 0) {
+        fprintf(stderr, "ERROR: %s\nFile: %s\n", strerror(errno), options.input_path);
+        if (line > 0) {
+            fprintf(stderr, "Line: %zu\n", line);
+        }
+        fprintf(stderr, "Message: Not Hack machine code\n");
+        free(words);
+        return -1;
+    }
+
+    DebugMap debug;
+    if (options.debug_path != NULL && DebugMap_open(&debug, options.debug_path) < 0) {
+        fprintf(stderr, "ERROR: %s\nFile: %s\nMessage: Failed to open the debug info\n", strerror(errno), options.debug_path);
+        free(words);
+        return -1;
+    }
+
+    int to_stdout = (options.output_path == NULL || strcmp(options.output_path, "-") == 0);
+    FILE* output_file = (to_stdout) ? stdout : fopen(options.output_path, "wb");
+    if (output_file == NULL) {
+        fprintf(stderr, "ERROR: %s\nFile: %s\nMessage: Failed to open destination file\n", strerror(errno), options.output_path);
+        if (options.debug_path != NULL) {
+            DebugMap_close(&debug);
+        }
+        free(words);
+        return -1;
+    }
+
+    // Holds a 64 KB buffer, keep it off the stack
+    Disassembler* disassembler = malloc(sizeof(Disassembler));
+    error = -1;
+
+    if (disassembler != NULL &&
+        Disassembler_create(disassembler, output_file, (options.debug_path != NULL) ? &debug : NULL) == 0) {
+
+        error = Disassembler_writeProgram(disassembler, words, word_count);
+        if (error == 0) {
+            error = Disassembler_flush(disassembler);
+        }
+        if (error == 0 && fflush(output_file) != 0) {
+            error = -1;
+        }
+
+        Disassembler_free(disassembler);
+    }
+
+    if (error < 0) {
+        fprintf(stderr, "ERROR: %s\nMessage: Failed to write the assembly\n", strerror(errno));
+    }
+
+    free(disassembler);
+    free(words);
+    if (options.debug_path != NULL) {
+        DebugMap_close(&debug);
+    }
+    if (to_stdout == 0) {
+        fclose(output_file);
+    }
+
+    return (error < 0) ? -1 : 0;
+}
+
+static void printUsage(FILE* stream, const char* program)
+{
+    fprintf(stream,
+            "Usage: %s [options] input.hack\n"
+            "Disassembles Hack machine code, - reads standard input\n"
+            "\n"
+            "Options:\n"
+            "  -o FILE             write the assembly to FILE, default standard output\n"
+            "  -f text|binary      input format, by default binary unless the input starts\n"
+            "                      with 16 '0'/'1' characters\n"
+            "  -e little|big       byte order of binary input without a header, default little\n"
+            "  -g FILE             restore the labels from FILE, the debug info written by\n"
+            "                      the assembler's -g\n"
+            "  -h                  show this message\n",
+            program);
+}
+
+/* Parse the command line into options
+ * Return 0 on success
+ * Return 1 if the program should exit successfully, usage was printed
+ * Return -1 on invalid arguments, an error was printed */
+static int parseArguments(int argc, char** argv, Options* options)
+{
+    options->input_path = NULL;
+    options->output_path = NULL;
+    options->debug_path = NULL;
+    options->format = DISASSEMBLER_DETECT;
+    options->byte_order = OUTPUT_LITTLE_ENDIAN;
+
+    int option = 0;
+    while ((option = getopt(argc, argv, "o:f:e:g:h")) != -1) {
+
+        switch (option) {
+
+            case 'o':
+                options->output_path = optarg;
+                break;
+
+            case 'f':
+                if (strcmp(optarg, "text") == 0) {
+                    options->format = DISASSEMBLER_TEXT;
+                }
+                else if (strcmp(optarg, "binary") == 0) {
+                    options->format = DISASSEMBLER_BINARY;
+                }
+                else {
+                    fprintf(stderr, "Unknown input format: %s\n", optarg);
+                    return -1;
+                }
+                break;
+
+            case 'e':
+                if (strcmp(optarg, "little") == 0) {
+                    options->byte_order = OUTPUT_LITTLE_ENDIAN;
+                }
+                else if (strcmp(optarg, "big") == 0) {
+                    options->byte_order = OUTPUT_BIG_ENDIAN;
+                }
+                else {
+                    fprintf(stderr, "Unknown byte order: %s\n", optarg);
+                    return -1;
+                }
+                break;
+
+            case 'g':
+                options->debug_path = optarg;
+                break;
+
+            case 'h':
+                printUsage(stdout, argv[0]);
+                return 1;
+
+            default:
+                printUsage(stderr, argv[0]);
+                return -1;
+        }
+    }
+
+    if (argc - optind != 1) {
+        printUsage(stderr, argv[0]);
+        return -1;
+    }
+
+    options->input_path = argv[optind];
+
+    return 0;
+}
+
+/* Map the file at path, or read all of standard input for -
+ * Return 0 on success
+ * Return -1 on failure, errno will be set */
+static int readInput(const char* path, Input* input)
+{
+    input->data = NULL;
+    input->length = 0;
+    input->mapped = 0;
+
+    if (strcmp(path, "-") == 0) {
+
+        size_t capacity = 0;
+
+        for (;;) {
+
+            if (input->length == capacity) {
+                size_t new_capacity = (capacity > 0) ? capacity * 2 : 64 * 1024;
+
+                uint8_t* new_data = realloc(input->data, new_capacity);
+                if (new_data == NULL) {
+                    free(input->data);
+                    return -1;
+                }
+
+                input->data = new_data;
+                capacity = new_capacity;
+            }
+
+            ssize_t received = read(STDIN_FILENO, &input->data[input->length], capacity - input->length);
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+            if (received < 0) {
+                int saved_errno = errno;
+                free(input->data);
+                errno = saved_errno;
+                return -1;
+            }
+            if (received == 0) {
+                return 0;
+            }
+
+            input->length += (size_t) received;
+        }
+    }
+
+    int descriptor = open(path, O_RDONLY);
+    if (descriptor < 0) {
+        return -1;
+    }
+
+    struct stat input_stat;
+    if (fstat(descriptor, &input_stat) < 0) {
+        int saved_errno = errno;
+        close(descriptor);
+        errno = saved_errno;
+        return -1;
+    }
+
+    // An empty file can't be mapped, it is an empty program
+    if (input_stat.st_size > 0) {
+        void* mapped = mmap(NULL, (size_t) input_stat.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (mapped == MAP_FAILED) {
+            int saved_errno = errno;
+            close(descriptor);
+            errno = saved_errno;
+            return -1;
+        }
+
+        input->data = mapped;
+        input->length = (size_t) input_stat.st_size;
+        input->mapped = 1;
+    }
+
+    close(descriptor);
+
+    return 0;
+}
+
+/* Release the machine code */
+static void freeInput(Input* input)
+{
+    if (input->mapped != 0) {
+        munmap(input->data, input->length);
+    }
+    else {
+        free(input->data);
+    }
+
+    input->data = NULL;
+    input->length = 0;
+}
@@ -0,0 +1,501 @@
+#include "disassembler.h"
+#include "code.h"
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define DISASSEMBLER_WORD_COUNT     65536
+
+/* Words that start a C instruction, the assembler always sets both unused bits */
+#define C_INSTRUCTION_MASK          0xe000
+
+/* Append the decimal value to text
+ * Return the number of characters written */
+static size_t Disassembler_formatNumber(uint16_t value, char* text)
+{
+    char digits[5];
+    size_t count = 0;
+
+    do {
+        digits[count] = (char) ('0' + value % 10);
+        value /= 10;
+        count += 1;
+    } while (value != 0);
+
+    for (size_t index = 0; index < count; index++) {
+        text[index] = digits[count - 1 - index];
+    }
+
+    return count;
+}
+
+/* Fill the text of a word no instruction assembles to, a comment holding its value */
+static void Disassembler_formatUnknown(uint16_t word, struct StructDisassemblyEntry* entry)
+{
+    static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+    memcpy(entry->text, "// 0x", 5);
+    for (int index = 0; index < 4; index++) {
+        entry->text[5 + index] = HEX_DIGITS[(word >> (12 - 4 * index)) & 0xf];
+    }
+    entry->text[9] = '\n';
+    entry->length = 10;
+}
+
+/* Fill the text of every word.
+ * A words are @ and their value, C words are built from the names of
+ * their fields, the words the assembler can't produce become comments */
+static void Disassembler_buildTable(struct StructDisassemblyEntry* table)
+{
+    char comp_names[128][3];
+    int  comp_lengths[128];
+    char dest_names[8][3];
+    int  dest_lengths[8];
+    char jump_names[8][3];
+    int  jump_lengths[8];
+
+    for (uint8_t bits = 0; bits < 128; bits++) {
+        comp_lengths[bits] = decodeComp(bits, comp_names[bits]);
+    }
+
+    for (uint8_t bits = 0; bits < 8; bits++) {
+        dest_lengths[bits] = decodeDest(bits, dest_names[bits]);
+        jump_lengths[bits] = decodeJump(bits, jump_names[bits]);
+    }
+
+    for (uint32_t word = 0; word < DISASSEMBLER_WORD_COUNT; word++) {
+
+        struct StructDisassemblyEntry* entry = &table[word];
+        memset(entry, 0, sizeof(struct StructDisassemblyEntry));
+
+        // A instruction
+        if ((word & 0x8000) == 0) {
+            entry->text[0] = '@';
+            size_t length = 1 + Disassembler_formatNumber((uint16_t) word, &entry->text[1]);
+            entry->text[length] = '\n';
+            entry->length = (uint8_t) (length + 1);
+            continue;
+        }
+
+        uint8_t comp = (uint8_t) ((word >> COMP_SHIFT) & 0x7f);
+        uint8_t dest = (uint8_t) ((word >> DEST_SHIFT) & 0x7);
+        uint8_t jump = (uint8_t) ((word >> JUMP_SHIFT) & 0x7);
+
+        // A C instruction needs a known computation and a destination or a jump
+        if ((word & C_INSTRUCTION_MASK) != C_INSTRUCTION_PREFIX ||
+            comp_lengths[comp] < 0 ||
+            (dest == DEST_BITS_NULL && jump == JUMP_BITS_NULL)) {
+            Disassembler_formatUnknown((uint16_t) word, entry);
+            continue;
+        }
+
+        size_t length = 0;
+
+        if (dest != DEST_BITS_NULL) {
+            memcpy(&entry->text[length], dest_names[dest], (size_t) dest_lengths[dest]);
+            length += (size_t) dest_lengths[dest];
+            entry->text[length] = '=';
+            length += 1;
+        }
+
+        memcpy(&entry->text[length], comp_names[comp], (size_t) comp_lengths[comp]);
+        length += (size_t) comp_lengths[comp];
+
+        if (jump != JUMP_BITS_NULL) {
+            entry->text[length] = ';';
+            length += 1;
+            memcpy(&entry->text[length], jump_names[jump], (size_t) jump_lengths[jump]);
+            length += (size_t) jump_lengths[jump];
+        }
+
+        entry->text[length] = '\n';
+        entry->length = (uint8_t) (length + 1);
+    }
+}
+
+/* Write text of any length through the buffer
+ * Return 0 on success
+ * Return -1 on failure, errno will be set */
+static int Disassembler_writeText(Disassembler* disassembler, const char* text, size_t length)
+{
+    if (DISASSEMBLER_BUFFER_SIZE - disassembler->buffer_used < length &&
+        Disassembler_flush(disassembler) < 0) {
+        return -1;
+    }
+
+    // Longer than the whole buffer
+    if (length > DISASSEMBLER_BUFFER_SIZE) {
+        if (fwrite(text, 1, length, disassembler->file) != length) {
+            return -1;
+        }
+        return 0;
+    }
+
+    memcpy(&disassembler->buffer[disassembler->buffer_used], text, length);
+    disassembler->buffer_used += length;
+
+    return 0;
+}
+
+/* Write the definition of a label, (name) on its own line
+ * Return 0 on success
+ * Return -1 on failure, errno will be set */
+static int Disassembler_writeLabel(Disassembler* disassembler, StringView name)
+{
+    if (Disassembler_writeText(disassembler, "(", 1) < 0 ||
+        Disassembler_writeText(disassembler, name.data, name.length) < 0 ||
+        Disassembler_writeText(disassembler, ")\n", 2) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Write a program with the labels of the debug map. Labels are defined before
+ * the instruction at their address, and an A instruction loading the address of
+ * a label right before a jump loads the label instead
+ * Return 0 on success
+ * Return -1 on failure, errno will be set */
+static int Disassembler_writeLabeled(Disassembler* disassembler, const uint16_t* words, size_t count)
+{
+    const struct StructDisassemblyEntry* table = disassembler->table;
+
+    uint32_t label_index = 0;
+    StringView label_name;
+    int label_address = DebugMap_labelAt(disassembler->debug, label_index, &label_name);
+
+    for (size_t address = 0; address <= count; address++) {
+
+        while (label_address >= 0 && (size_t) label_address == address) {
+            if (Disassembler_writeLabel(disassembler, label_name) < 0) {
+                return -1;
+            }
+
+            label_index += 1;
+            label_address = DebugMap_labelAt(disassembler->debug, label_index, &label_name);
+        }
+
+        if (address == count) {
+            break;
+        }
+
+        uint16_t word = words[address];
+
+        if ((word & 0x8000) == 0 &&
+            address + 1 < count &&
+            (words[address + 1] & C_INSTRUCTION_MASK) == C_INSTRUCTION_PREFIX &&
+            ((words[address + 1] >> JUMP_SHIFT) & 0x7) != JUMP_BITS_NULL) {
+
+            StringView target;
+            if (DebugMap_findLabel(disassembler->debug, word, &target) == (int) word) {
+
+                if (Disassembler_writeText(disassembler, "@", 1) < 0 ||
+                    Disassembler_writeText(disassembler, target.data, target.length) < 0 ||
+                    Disassembler_writeText(disassembler, "\n", 1) < 0) {
+                    return -1;
+                }
+
+                continue;
+            }
+        }
+
+        if (Disassembler_writeText(disassembler, table[word].text, table[word].length) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/* Create a disassembler writing to file, the text of every word is built now.
+ * debug holds the labels to print, NULL for none, it must outlive the disassembler
+ * Return 0 on success
+ * Return -1 on failure, errno will be set */
+extern int Disassembler_create(Disassembler* disassembler, FILE* file, const DebugMap* debug)
+{
+    if (disassembler != NULL &&
+        file != NULL) {
+
+        // 1 MB, every entry on its own 16 bytes
+        disassembler->table = aligned_alloc(64, DISASSEMBLER_WORD_COUNT * sizeof(struct StructDisassemblyEntry));
+        if (disassembler->table == NULL) {
+            return -1;
+        }
+
+        Disassembler_buildTable(disassembler->table);
+
+        disassembler->file = file;
+        disassembler->debug = debug;
+        disassembler->buffer_used = 0;
+
+        // Done :)
+        return 0;
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/* Free the table of a disassembler, the file is left open */
+extern void Disassembler_free(Disassembler* disassembler)
+{
+    if (disassembler != NULL) {
+        free(disassembler->table);
+        disassembler->table = NULL;
+    }
+}
+
+/* Decode the .hack text of length characters, 16 '0'/'1' characters per line.
+ * words_out must hold at least length / 16 words
+ * Return 0 on success, count_out is the number of words
+ * Return -1 if a line isn't a word, errno is EINVAL and line_out its line */
+extern int Disassembler_decodeText(const char* source, size_t length,
+                                   uint16_t* words_out, size_t* count_out, size_t* line_out)
+{
+    if ((source == NULL && length > 0) ||
+        words_out == NULL ||
+        count_out == NULL ||
+        line_out == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    size_t count = 0;
+    size_t position = 0;
+
+    while (position < length) {
+
+        // The line must hold 16 bits then \n, \r\n or the end of the text
+        if (length - position < 16) {
+            break;
+        }
+
+        size_t line_start = position;
+        uint16_t word = 0;
+        uint8_t invalid = 0;
+
+        for (size_t index = 0; index < 16; index++) {
+            uint8_t bit = (uint8_t) (source[position + index] - '0');
+            invalid |= bit;
+            word = (uint16_t) ((word << 1) | (bit & 1));
+        }
+
+        position += 16;
+
+        if (position < length && source[position] == '\r') {
+            position += 1;
+        }
+
+        // A bad last line would otherwise look fully read
+        if ((invalid & ~1) != 0 ||
+            (position < length && source[position] != '\n')) {
+            position = line_start;
+            break;
+        }
+
+        position += 1;
+
+        words_out[count] = word;
+        count += 1;
+    }
+
+    *count_out = count;
+
+    if (position < length) {
+        *line_out = count + 1;
+        errno = EINVAL;
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Decode packed 16 bit words of length bytes. Output with a header is read in
+ * the byte order of the header, without one in byte_order.
+ * words_out must hold at least length / 2 words
+ * Return 0 on success, count_out is the number of words
+ * Return -1 if it isn't packed words or the header doesn't match, errno is EINVAL */
+extern int Disassembler_decodeBinary(const uint8_t* data, size_t length, enum OutputByteOrder byte_order,
+                                     uint16_t* words_out, size_t* count_out)
+{
+    if ((data == NULL && length > 0) ||
+        words_out == NULL ||
+        count_out == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (length >= OUTPUT_HEADER_SIZE && memcmp(data, OUTPUT_HEADER_MAGIC, 4) == 0) {
+
+        // The version is 1 in the byte order of the words
+        if (data[4] == OUTPUT_HEADER_VERSION && data[5] == 0) {
+            byte_order = OUTPUT_LITTLE_ENDIAN;
+        }
+        else if (data[4] == 0 && data[5] == OUTPUT_HEADER_VERSION) {
+            byte_order = OUTPUT_BIG_ENDIAN;
+        }
+        else {
+            errno = EINVAL;
+            return -1;
+        }
+
+        uint32_t word_count = 0;
+        uint16_t flags = 0;
+        if (byte_order == OUTPUT_LITTLE_ENDIAN) {
+            flags = (uint16_t) (data[6] | (data[7] << 8));
+            word_count = (uint32_t) data[8] | ((uint32_t) data[9] << 8) |
+                         ((uint32_t) data[10] << 16) | ((uint32_t) data[11] << 24);
+        }
+        else {
+            flags = (uint16_t) ((data[6] << 8) | data[7]);
+            word_count = ((uint32_t) data[8] << 24) | ((uint32_t) data[9] << 16) |
+                         ((uint32_t) data[10] << 8) | (uint32_t) data[11];
+        }
+
+        if (((flags & OUTPUT_HEADER_BIG_ENDIAN) != 0) != (byte_order == OUTPUT_BIG_ENDIAN) ||
+            (uint64_t) word_count * 2 != length - OUTPUT_HEADER_SIZE) {
+            errno = EINVAL;
+            return -1;
+        }
+
+        data += OUTPUT_HEADER_SIZE;
+        length -= OUTPUT_HEADER_SIZE;
+    }
+
+    if (length % 2 != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    size_t count = length / 2;
+
+    if (byte_order == OUTPUT_LITTLE_ENDIAN) {
+        for (size_t index = 0; index < count; index++) {
+            words_out[index] = (uint16_t) (data[2 * index] | (data[2 * index + 1] << 8));
+        }
+    }
+    else {
+        for (size_t index = 0; index < count; index++) {
+            words_out[index] = (uint16_t) ((data[2 * index] << 8) | data[2 * index + 1]);
+        }
+    }
+
+    *count_out = count;
+
+    return 0;
+}
+
+/* Decode machine code of length bytes in the given format, see the decode functions.
+ * DISASSEMBLER_DETECT reads text if it starts with 16 '0'/'1' characters and no header.
+ * words_out must hold at least length / 2 words
+ * Return 0 on success, count_out is the number of words
+ * Return -1 on failure, errno is EINVAL, line_out is the failed line of text or 0 */
+extern int Disassembler_decode(const uint8_t* data, size_t length, enum DisassemblerFormat format,
+                               enum OutputByteOrder byte_order, uint16_t* words_out,
+                               size_t* count_out, size_t* line_out)
+{
+    if ((data == NULL && length > 0) ||
+        line_out == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *line_out = 0;
+
+    if (format == DISASSEMBLER_DETECT) {
+        format = DISASSEMBLER_TEXT;
+
+        if (length < 16 || memcmp(data, OUTPUT_HEADER_MAGIC, 4) == 0) {
+            format = DISASSEMBLER_BINARY;
+        }
+
+        for (size_t index = 0; index < 16 && format == DISASSEMBLER_TEXT; index++) {
+            if (data[index] != '0' && data[index] != '1') {
+                format = DISASSEMBLER_BINARY;
+            }
+        }
+
+        // An empty file is an empty program in both
+    }
+
+    if (format == DISASSEMBLER_TEXT) {
+        return Disassembler_decodeText((const char*) data, length, words_out, count_out, line_out);
+    }
+
+    return Disassembler_decodeBinary(data, length, byte_order, words_out, count_out);
+}
+
+/* Write the assembly of a whole program, its first word is at address 0
+ * Return 0 on success
+ * Return -1 on failure, errno will be set */
+extern int Disassembler_writeProgram(Disassembler* disassembler, const uint16_t* words, size_t count)
+{
+    if (disassembler == NULL ||
+        disassembler->table == NULL ||
+        (words == NULL && count > 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (disassembler->debug != NULL) {
+        return Disassembler_writeLabeled(disassembler, words, count);
+    }
+
+    const struct StructDisassemblyEntry* table = disassembler->table;
+    size_t index = 0;
+
+    while (index < count) {
+
+        // Every entry is copied whole, so only as many words as leave room for one
+        size_t room = (DISASSEMBLER_BUFFER_SIZE - disassembler->buffer_used) / sizeof(struct StructDisassemblyEntry);
+        if (room == 0) {
+            if (Disassembler_flush(disassembler) < 0) {
+                return -1;
+            }
+            continue;
+        }
+
+        size_t end = (count - index < room) ? count : index + room;
+        char* buffer = disassembler->buffer;
+        size_t used = disassembler->buffer_used;
+
+        for (; index < end; index++) {
+            const struct StructDisassemblyEntry* entry = &table[words[index]];
+            memcpy(&buffer[used], entry, sizeof(struct StructDisassemblyEntry));
+            used += entry->length;
+        }
+
+        disassembler->buffer_used = used;
+    }
+
+    return 0;
+}
+
+/* Hand the buffered text to the file
+ * Return 0 on success
+ * Return -1 on failure, errno will be set */
+extern int Disassembler_flush(Disassembler* disassembler)
+{
+    if (disassembler != NULL) {
+
+        if (disassembler->buffer_used > 0 &&
+            fwrite(disassembler->buffer, 1, disassembler->buffer_used, disassembler->file) != disassembler->buffer_used) {
+            return -1;
+        }
+
+        disassembler->buffer_used = 0;
+
+        return 0;
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef DISASSEMBLER_H
+#define DISASSEMBLER_H
+
+#include "output.h"
+#include "debug.h"
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* This module turns Hack machine code back into assembly. The text of all
+ * 65536 words is built once from the mneumonic table of code.c, so a word is
+ * disassembled by copying its entry into the output buffer */
+
+/* Longest line of an instruction, AMD=D|M;JMP and a newline */
+#define DISASSEMBLER_LINE_SIZE      15
+
+/* The text of one word, entries are 16 bytes so one is copied with a single move */
+struct StructDisassemblyEntry {
+    char    text[DISASSEMBLER_LINE_SIZE];  // Ends with a newline, not null terminated
+    uint8_t length;
+};
+
+#define DISASSEMBLER_BUFFER_SIZE    (64 * 1024)
+
+struct StructDisassembler {
+    struct StructDisassemblyEntry* table;  // Indexed by word
+    FILE*           file;
+    const DebugMap* debug;                 // Labels to print, NULL without
+    size_t          buffer_used;
+    char            buffer[DISASSEMBLER_BUFFER_SIZE];
+};
+
+typedef struct StructDisassembler Disassembler;
+
+/* Input formats */
+enum DisassemblerFormat {
+    DISASSEMBLER_DETECT,    // Binary if it starts with a header or not with 16 '0'/'1' characters
+    DISASSEMBLER_TEXT,      // The .hack format
+    DISASSEMBLER_BINARY     // Packed 16 bit words, optionally after an output header
+};
+
+extern int  Disassembler_create       (Disassembler*, FILE*, const DebugMap*);
+extern void Disassembler_free         (Disassembler*);
+extern int  Disassembler_decodeText   (const char*, size_t, uint16_t*, size_t*, size_t*);
+extern int  Disassembler_decodeBinary (const uint8_t*, size_t, enum OutputByteOrder, uint16_t*, size_t*);
+extern int  Disassembler_decode       (const uint8_t*, size_t, enum DisassemblerFormat, enum OutputByteOrder,
+                                       uint16_t*, size_t*, size_t*);
+extern int  Disassembler_writeProgram (Disassembler*, const uint16_t*, size_t);
+extern int  Disassembler_flush        (Disassembler*);
+
+#endif
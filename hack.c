@@ -0,0 +1,167 @@
+#include "hack.h"
+#include "assembler.h"
+#include "parser.h"
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* A warm assembler, kept from one program to the next */
+struct StructHackAssembler {
+    Assembler assembler;
+};
+
+
+/* Fill error, error may be NULL */
+static void HackAssembler_setError(HackError* error, enum HackStatus status,
+                                   int error_number, size_t line, const char* message)
+{
+    if (error != NULL) {
+        error->status = status;
+        error->error_number = error_number;
+        error->line = line;
+        error->message = message;
+    }
+}
+
+
+/* Create an assembler
+ * Return the assembler on success
+ * Return NULL if memory couldn't be allocated */
+extern HackAssembler* HackAssembler_create(void)
+{
+    HackAssembler* hack_assembler = malloc(sizeof(HackAssembler));
+    if (hack_assembler == NULL) {
+        return NULL;
+    }
+
+    if (Assembler_create(&hack_assembler->assembler) < 0) {
+        free(hack_assembler);
+        return NULL;
+    }
+
+    return hack_assembler;
+}
+
+/* Free an assembler, NULL is ignored */
+extern void HackAssembler_free(HackAssembler* hack_assembler)
+{
+    if (hack_assembler != NULL) {
+        Assembler_free(&hack_assembler->assembler);
+        free(hack_assembler);
+    }
+}
+
+/* Assemble the length bytes at source, words points to the resolved words
+ * and stays valid until the next program assembled with hack_assembler
+ * Return 0 on success, word_count holds the number of words
+ * Return -1 on failure, error describes it */
+extern int HackAssembler_assembleView(HackAssembler* hack_assembler,
+                                      const char* source,
+                                      size_t length,
+                                      const uint16_t** words,
+                                      size_t* word_count,
+                                      HackError* error)
+{
+    if (hack_assembler == NULL ||
+        (source == NULL && length > 0) ||
+        words == NULL ||
+        word_count == NULL) {
+        HackAssembler_setError(error, HACK_ERROR_ARGUMENT, EINVAL, 0, "Invalid argument");
+        return -1;
+    }
+
+    Parser parser;
+    if (Parser_createFromBuffer(&parser, source, length) < 0) {
+        HackAssembler_setError(error, HACK_ERROR_ARGUMENT, errno, 0, "Invalid argument");
+        return -1;
+    }
+
+    AssemblerReport report;
+    Assembler_clearReport(&report);
+
+    int failed = Assembler_assembleWords(&hack_assembler->assembler, &parser, &report);
+
+    Parser_free(&parser);
+
+    if (failed < 0) {
+        HackAssembler_setError(error,
+                               (report.error_number == ENOMEM) ? HACK_ERROR_MEMORY : HACK_ERROR_SOURCE,
+                               report.error_number,
+                               report.line,
+                               (report.message != NULL) ? report.message : "Failed to assemble");
+        return -1;
+    }
+
+    *words = hack_assembler->assembler.command_array.words;
+    *word_count = hack_assembler->assembler.command_array.size;
+
+    HackAssembler_setError(error, HACK_OK, 0, 0, "Success");
+
+    return 0;
+}
+
+/* Assemble the length bytes at source into the capacity words at words
+ * Return 0 on success, word_count holds the number of words written
+ * Return -1 on failure, error describes it. If words is too small
+ * the status is HACK_ERROR_BUFFER and word_count holds the number of words needed */
+extern int HackAssembler_assemble(HackAssembler* hack_assembler,
+                                  const char* source,
+                                  size_t length,
+                                  uint16_t* words,
+                                  size_t capacity,
+                                  size_t* word_count,
+                                  HackError* error)
+{
+    if ((words == NULL && capacity > 0) ||
+        word_count == NULL) {
+        HackAssembler_setError(error, HACK_ERROR_ARGUMENT, EINVAL, 0, "Invalid argument");
+        return -1;
+    }
+
+    const uint16_t* assembled = NULL;
+    size_t assembled_count = 0;
+
+    if (HackAssembler_assembleView(hack_assembler, source, length, &assembled, &assembled_count, error) < 0) {
+        return -1;
+    }
+
+    *word_count = assembled_count;
+
+    if (assembled_count > capacity) {
+        HackAssembler_setError(error, HACK_ERROR_BUFFER, ERANGE, 0, "Output buffer too small");
+        return -1;
+    }
+
+    if (assembled_count > 0) {
+        memcpy(words, assembled, assembled_count * sizeof(uint16_t));
+    }
+
+    return 0;
+}
+
+/* Assemble the length bytes at source into the capacity words at words
+ * with an assembler created for the call, see HackAssembler_assemble
+ * Return 0 on success
+ * Return -1 on failure, error describes it */
+extern int assemble(const char* source,
+                    size_t length,
+                    uint16_t* words,
+                    size_t capacity,
+                    size_t* word_count,
+                    HackError* error)
+{
+    HackAssembler* hack_assembler = HackAssembler_create();
+    if (hack_assembler == NULL) {
+        HackAssembler_setError(error, HACK_ERROR_MEMORY, ENOMEM, 0, "Failed to create the assembler");
+        return -1;
+    }
+
+    int result = HackAssembler_assemble(hack_assembler, source, length, words, capacity, word_count, error);
+
+    HackAssembler_free(hack_assembler);
+
+    return result;
+}
@@ -0,0 +1,52 @@
+#ifndef HACK_H
+#define HACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* This is the interface of the assembler library. It assembles a source held in
+ * memory into instruction words in memory. It keeps no global state, does no file
+ * I/O and prints nothing, every failure is described by a HackError.
+ * A HackAssembler can be used by one thread at a time, use one per thread */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Only the functions below are exported by the shared library */
+#define HACK_API __attribute__((visibility("default")))
+
+enum HackStatus {
+    HACK_OK,
+    HACK_ERROR_ARGUMENT,        // An argument is invalid
+    HACK_ERROR_MEMORY,          // Memory couldn't be allocated
+    HACK_ERROR_SOURCE,          // The source isn't a valid program
+    HACK_ERROR_BUFFER           // The output buffer is too small
+};
+
+struct StructHackError {
+    enum HackStatus status;
+    int             error_number;  // errno of the failure, 0 if there is none
+    size_t          line;          // Line of the source that failed, 0 if not tied to a line
+    const char*     message;       // Static description of the failure, never NULL
+};
+
+typedef struct StructHackError HackError;
+
+typedef struct StructHackAssembler HackAssembler;
+
+HACK_API extern HackAssembler* HackAssembler_create       (void);
+HACK_API extern void           HackAssembler_free         (HackAssembler*);
+HACK_API extern int            HackAssembler_assemble     (HackAssembler*, const char*, size_t,
+                                                           uint16_t*, size_t, size_t*, HackError*);
+HACK_API extern int            HackAssembler_assembleView (HackAssembler*, const char*, size_t,
+                                                           const uint16_t**, size_t*, HackError*);
+
+HACK_API extern int            assemble                   (const char*, size_t,
+                                                           uint16_t*, size_t, size_t*, HackError*);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef HACK_HPP
+#define HACK_HPP
+
+#include "hack.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if __cplusplus >= 202002L && __has_include(<span>)
+#include <span>
+#define HACK_HAS_SPAN 1
+#endif
+
+/* Header only C++ wrapper of the assembler library, see hack.h */
+
+namespace hack {
+
+/* Thrown when a program can't be assembled */
+class Error : public std::runtime_error {
+public:
+    explicit Error(const HackError& error)
+        : std::runtime_error(describe(error)),
+          status_(error.status),
+          error_number_(error.error_number),
+          line_(error.line)
+    {
+    }
+
+    HackStatus  status() const noexcept      { return status_; }
+    int         errorNumber() const noexcept { return error_number_; }
+    std::size_t line() const noexcept        { return line_; }   // 0 if not tied to a line
+
+private:
+    static std::string describe(const HackError& error)
+    {
+        std::string text = error.message;
+        if (error.line > 0) {
+            text += " at line " + std::to_string(error.line);
+        }
+        return text;
+    }
+
+    HackStatus  status_;
+    int         error_number_;
+    std::size_t line_;
+};
+
+/* Owns a warm HackAssembler, one thread may use it at a time */
+class Assembler {
+public:
+    Assembler()
+        : assembler_(HackAssembler_create())
+    {
+        if (assembler_ == nullptr) {
+            throw std::bad_alloc();
+        }
+    }
+
+    ~Assembler() { HackAssembler_free(assembler_); }
+
+    Assembler(const Assembler&) = delete;
+    Assembler& operator=(const Assembler&) = delete;
+
+    Assembler(Assembler&& other) noexcept
+        : assembler_(std::exchange(other.assembler_, nullptr))
+    {
+    }
+
+    Assembler& operator=(Assembler&& other) noexcept
+    {
+        if (this != &other) {
+            HackAssembler_free(assembler_);
+            assembler_ = std::exchange(other.assembler_, nullptr);
+        }
+        return *this;
+    }
+
+    /* Assemble source into a copy of its words, throws Error on failure */
+    std::vector<std::uint16_t> assemble(std::string_view source)
+    {
+        std::size_t count = 0;
+        const std::uint16_t* words = assembleInto(source, count);
+        return std::vector<std::uint16_t>(words, words + count);
+    }
+
+#ifdef HACK_HAS_SPAN
+    /* Assemble source without copying its words, throws Error on failure.
+     * The words stay valid until the next program assembled by this assembler */
+    std::span<const std::uint16_t> assembleView(std::string_view source)
+    {
+        std::size_t count = 0;
+        const std::uint16_t* words = assembleInto(source, count);
+        return std::span<const std::uint16_t>(words, count);
+    }
+#endif
+
+private:
+    const std::uint16_t* assembleInto(std::string_view source, std::size_t& count)
+    {
+        const std::uint16_t* words = nullptr;
+        HackError error;
+
+        if (HackAssembler_assembleView(assembler_, source.data(), source.size(), &words, &count, &error) < 0) {
+            throw Error(error);
+        }
+
+        return words;
+    }
+
+    HackAssembler* assembler_;
+};
+
+} // namespace hack
+
+#endif
@@ -0,0 +1,197 @@
+#include "interner.h"
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* Hash a name of the given length, 64 bit FNV-1a folded to 32 bits.
+ * The low bits mix poorly for names that only differ in their last
+ * characters, LABEL_1 and LABEL_2, so the low 7 bits are dropped */
+static uint32_t Interner_hash(const char* name, size_t length)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (size_t index = 0; index < length; index++) {
+        hash ^= (uint8_t) name[index];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return (uint32_t) (hash >> 7);
+}
+
+/* Double the index and reinsert every slot using its cached hash
+ * Return 0 on success
+ * Return -1 on failure, set errno, the old index is kept */
+static int Interner_growIndex(Interner* interner)
+{
+    size_t new_capacity = (interner->index_capacity > 0) ? interner->index_capacity * 2 : 64;
+
+    struct StructInternerSlot* new_index = calloc(new_capacity, sizeof(struct StructInternerSlot));
+    if (new_index == NULL) {
+        return -1;
+    }
+
+    for (size_t old_slot = 0; old_slot < interner->index_capacity; old_slot++) {
+
+        if (interner->index[old_slot].id == 0) {
+            continue;
+        }
+
+        size_t slot = interner->index[old_slot].hash & (new_capacity - 1);
+        while (new_index[slot].id != 0) {
+            slot = (slot + 1) & (new_capacity - 1);
+        }
+
+        new_index[slot] = interner->index[old_slot];
+    }
+
+    free(interner->index);
+
+    interner->index = new_index;
+    interner->index_capacity = new_capacity;
+
+    return 0;
+}
+
+/* Make room for one more name
+ * Return 0 on success
+ * Return -1 on failure, set errno */
+static int Interner_grow(Interner* interner)
+{
+    if (interner->count == INTERNER_MAX_SYMBOLS) {
+        errno = ERANGE;
+        return -1;
+    }
+
+    if (interner->count == interner->capacity) {
+
+        size_t new_capacity = (interner->capacity > 0) ? interner->capacity * 2 : 16;
+
+        errno = 0;
+        StringView* new_names = reallocarray(interner->names, new_capacity, sizeof(StringView));
+        if (errno != 0) {
+            return -1;
+        }
+
+        interner->names = new_names;
+        interner->capacity = new_capacity;
+    }
+
+    // Keep the index at most half full so the probe sequences stay short
+    if ((interner->count + 1) * 2 > interner->index_capacity) {
+        return Interner_growIndex(interner);
+    }
+
+    return 0;
+}
+
+
+/* Create an empty interner copying its names into arena,
+ * nothing is allocated until the first name is interned */
+extern void Interner_create(Interner* interner, Arena* arena)
+{
+    if (interner != NULL) {
+        memset(interner, 0, sizeof(Interner));
+        interner->arena = arena;
+    }
+}
+
+/* Free the arrays of the interner, the names are released with the arena */
+extern void Interner_free(Interner* interner)
+{
+    if (interner != NULL) {
+        free(interner->names);
+        free(interner->index);
+
+        Arena* arena = interner->arena;
+        memset(interner, 0, sizeof(Interner));
+        interner->arena = arena;
+    }
+}
+
+/* Forget every name so the IDs start from 0 again, the arrays are kept.
+ * The names must be released by resetting the arena */
+extern void Interner_reset(Interner* interner)
+{
+    if (interner != NULL) {
+        if (interner->index != NULL) {
+            memset(interner->index, 0, interner->index_capacity * sizeof(struct StructInternerSlot));
+        }
+
+        interner->count = 0;
+        interner->lookups = 0;
+    }
+}
+
+/* Find the ID of the name that is length characters long, it doesn't need to be
+ * null terminated. A name seen for the first time is copied and gets the next ID
+ * Return the ID on success
+ * Return -1 on failure, errno will be set */
+extern int64_t Interner_intern(Interner* interner, const char* name, size_t length)
+{
+    if (interner != NULL &&
+        interner->arena != NULL &&
+        name != NULL) {
+
+        uint32_t hash = Interner_hash(name, length);
+        interner->lookups += 1;
+
+        if (interner->index_capacity > 0) {
+
+            size_t slot = hash & (interner->index_capacity - 1);
+
+            // Linear probing, an empty slot ends the sequence
+            while (interner->index[slot].id != 0) {
+
+                if (interner->index[slot].hash == hash) {
+
+                    uint32_t id = interner->index[slot].id - 1;
+
+                    if (interner->names[id].length == length &&
+                        memcmp(interner->names[id].data, name, length) == 0) {
+
+                        // Seen before
+                        return id;
+                    }
+                }
+
+                slot = (slot + 1) & (interner->index_capacity - 1);
+            }
+        }
+
+        // A new name
+        if (Interner_grow(interner) < 0) {
+            return -1;
+        }
+
+        char* copy = Arena_strndup(interner->arena, name, length);
+        if (copy == NULL) {
+            return -1;
+        }
+
+        size_t id = interner->count;
+
+        interner->names[id].data = copy;
+        interner->names[id].length = length;
+        interner->count += 1;
+
+        // The index may have grown, probe again for the empty slot
+        size_t slot = hash & (interner->index_capacity - 1);
+        while (interner->index[slot].id != 0) {
+            slot = (slot + 1) & (interner->index_capacity - 1);
+        }
+
+        interner->index[slot].hash = hash;
+        interner->index[slot].id = (uint32_t) id + 1;
+
+        // Done :)
+        return (int64_t) id;
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef INTERNER_H
+#define INTERNER_H
+
+#include "parser.h"
+#include "arena.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* This module gives every distinct symbol name a dense 32 bit ID, in order
+ * of first appearance. Each name is hashed once when it is lexed, afterwards
+ * the symbol is only handled through its ID, so anything known about it can
+ * be kept in a plain array indexed by the ID */
+
+/* Highest number of distinct symbols, IDs stay below UINT32_MAX */
+#define INTERNER_MAX_SYMBOLS    (UINT32_MAX - 1)
+
+/* One slot of the index, the hash is kept beside the ID so a probe only
+ * reads the name of a symbol whose hash matches */
+struct StructInternerSlot {
+    uint32_t    hash;
+    uint32_t    id;             // ID + 1, 0 marks an empty slot
+};
+
+struct StructInterner {
+    StringView* names;          // Name of every symbol, indexed by ID
+    size_t      count;          // How many distinct symbols were interned
+    size_t      capacity;       // How many names the array can hold
+
+    struct StructInternerSlot* index; // Open addressing table of the IDs
+    size_t      index_capacity; // Always a power of 2, at least twice count
+
+    Arena*      arena;          // The names are copied here
+
+    size_t      lookups;        // Searches of the index since the interner was created or reset
+};
+
+typedef struct StructInterner Interner;
+
+extern void    Interner_create  (Interner*, Arena*);
+extern void    Interner_free    (Interner*);
+extern void    Interner_reset   (Interner*);
+extern int64_t Interner_intern  (Interner*, const char*, size_t);
+
+#endif
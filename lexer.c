@@ -0,0 +1,394 @@
+#include "lexer.h"
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+/* Character classes, every byte not listed is part of a token */
+enum LexerClass {
+    CLASS_TOKEN,
+    CLASS_SPACE,
+    CLASS_NEWLINE,
+    CLASS_SLASH,
+    CLASS_AT,
+    CLASS_OPEN,
+    CLASS_CLOSE,
+    CLASS_EQUALS,
+    CLASS_SEMICOLON,
+    CLASS_COUNT
+};
+
+/* States of the DFA, a missing transition leads to STATE_ERROR.
+ * The two final states come first so one comparison ends the loop */
+enum LexerState {
+    STATE_ERROR,
+    STATE_DONE,             // The line of a command ended
+    STATE_START,            // Between commands, at the start of a line or on a blank one
+    STATE_START_SLASH,      // A '/' that must start a comment line
+    STATE_COMMENT,          // A comment line
+    STATE_A,                // The symbol of an A command
+    STATE_L,                // The symbol of a label, before the ')'
+    STATE_L_CLOSED,         // After the ')' of a label
+    STATE_C_FIRST,          // The dest of a C command, or its comp if no '=' follows
+    STATE_C_COMP,           // The comp of a C command, after the '='
+    STATE_C_JUMP,           // The jump of a C command, after the ';'
+    STATE_TAIL_SLASH,       // A '/' after a command, that must start a comment
+    STATE_TAIL_COMMENT,     // A comment after a command
+    STATE_COUNT
+};
+
+/* Spans recorded while lexing, token bytes of states without a field go to FIELD_NONE */
+enum LexerField {
+    FIELD_NONE,
+    FIELD_SYMBOL,
+    FIELD_FIRST,
+    FIELD_COMP,
+    FIELD_JUMP,
+    FIELD_COUNT
+};
+
+static const uint8_t LEXER_CLASSES[256] = {
+    [' ']  = CLASS_SPACE,
+    ['\t'] = CLASS_SPACE,
+    ['\r'] = CLASS_SPACE,
+    ['\v'] = CLASS_SPACE,
+    ['\f'] = CLASS_SPACE,
+    ['\n'] = CLASS_NEWLINE,
+    ['/']  = CLASS_SLASH,
+    ['@']  = CLASS_AT,
+    ['(']  = CLASS_OPEN,
+    [')']  = CLASS_CLOSE,
+    ['=']  = CLASS_EQUALS,
+    [';']  = CLASS_SEMICOLON,
+};
+
+static const uint8_t LEXER_TRANSITIONS[STATE_COUNT][CLASS_COUNT] = {
+    [STATE_START] = {
+        [CLASS_TOKEN]     = STATE_C_FIRST,
+        [CLASS_SPACE]     = STATE_START,
+        [CLASS_NEWLINE]   = STATE_START,
+        [CLASS_SLASH]     = STATE_START_SLASH,
+        [CLASS_AT]        = STATE_A,
+        [CLASS_OPEN]      = STATE_L,
+        [CLASS_EQUALS]    = STATE_C_COMP,
+        [CLASS_SEMICOLON] = STATE_C_JUMP,
+    },
+    [STATE_START_SLASH] = {
+        [CLASS_SLASH]     = STATE_COMMENT,
+    },
+    [STATE_COMMENT] = {
+        [CLASS_TOKEN]     = STATE_COMMENT,
+        [CLASS_SPACE]     = STATE_COMMENT,
+        [CLASS_NEWLINE]   = STATE_START,
+        [CLASS_SLASH]     = STATE_COMMENT,
+        [CLASS_AT]        = STATE_COMMENT,
+        [CLASS_OPEN]      = STATE_COMMENT,
+        [CLASS_CLOSE]     = STATE_COMMENT,
+        [CLASS_EQUALS]    = STATE_COMMENT,
+        [CLASS_SEMICOLON] = STATE_COMMENT,
+    },
+    [STATE_A] = {
+        [CLASS_TOKEN]     = STATE_A,
+        [CLASS_SPACE]     = STATE_A,
+        [CLASS_NEWLINE]   = STATE_DONE,
+        [CLASS_SLASH]     = STATE_TAIL_SLASH,
+    },
+    [STATE_L] = {
+        [CLASS_TOKEN]     = STATE_L,
+        [CLASS_SPACE]     = STATE_L,
+        [CLASS_CLOSE]     = STATE_L_CLOSED,
+    },
+    [STATE_L_CLOSED] = {
+        [CLASS_SPACE]     = STATE_L_CLOSED,
+        [CLASS_NEWLINE]   = STATE_DONE,
+        [CLASS_SLASH]     = STATE_TAIL_SLASH,
+    },
+    [STATE_C_FIRST] = {
+        [CLASS_TOKEN]     = STATE_C_FIRST,
+        [CLASS_SPACE]     = STATE_C_FIRST,
+        [CLASS_NEWLINE]   = STATE_DONE,
+        [CLASS_SLASH]     = STATE_TAIL_SLASH,
+        [CLASS_EQUALS]    = STATE_C_COMP,
+        [CLASS_SEMICOLON] = STATE_C_JUMP,
+    },
+    [STATE_C_COMP] = {
+        [CLASS_TOKEN]     = STATE_C_COMP,
+        [CLASS_SPACE]     = STATE_C_COMP,
+        [CLASS_NEWLINE]   = STATE_DONE,
+        [CLASS_SLASH]     = STATE_TAIL_SLASH,
+        [CLASS_SEMICOLON] = STATE_C_JUMP,
+    },
+    [STATE_C_JUMP] = {
+        [CLASS_TOKEN]     = STATE_C_JUMP,
+        [CLASS_SPACE]     = STATE_C_JUMP,
+        [CLASS_NEWLINE]   = STATE_DONE,
+        [CLASS_SLASH]     = STATE_TAIL_SLASH,
+    },
+    [STATE_TAIL_SLASH] = {
+        [CLASS_SLASH]     = STATE_TAIL_COMMENT,
+    },
+    [STATE_TAIL_COMMENT] = {
+        [CLASS_TOKEN]     = STATE_TAIL_COMMENT,
+        [CLASS_SPACE]     = STATE_TAIL_COMMENT,
+        [CLASS_NEWLINE]   = STATE_DONE,
+        [CLASS_SLASH]     = STATE_TAIL_COMMENT,
+        [CLASS_AT]        = STATE_TAIL_COMMENT,
+        [CLASS_OPEN]      = STATE_TAIL_COMMENT,
+        [CLASS_CLOSE]     = STATE_TAIL_COMMENT,
+        [CLASS_EQUALS]    = STATE_TAIL_COMMENT,
+        [CLASS_SEMICOLON] = STATE_TAIL_COMMENT,
+    },
+};
+
+static const uint8_t LEXER_FIELDS[STATE_COUNT] = {
+    [STATE_A]       = FIELD_SYMBOL,
+    [STATE_L]       = FIELD_SYMBOL,
+    [STATE_C_FIRST] = FIELD_FIRST,
+    [STATE_C_COMP]  = FIELD_COMP,
+    [STATE_C_JUMP]  = FIELD_JUMP,
+};
+
+/* Skip spaces, tabs, carriage returns and newlines from position, counting the newlines
+ * Return the position of the first other byte, length if there is none */
+static size_t Lexer_skipBlank(const char* source, size_t position, size_t length, size_t* newlines)
+{
+#ifdef __SSE2__
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i carriage_return = _mm_set1_epi8('\r');
+    const __m128i newline = _mm_set1_epi8('\n');
+
+    while (position + 16 <= length) {
+
+        __m128i bytes = _mm_loadu_si128((const __m128i*) (source + position));
+
+        __m128i is_newline = _mm_cmpeq_epi8(bytes, newline);
+        __m128i is_blank = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, space), _mm_cmpeq_epi8(bytes, tab)),
+                                        _mm_or_si128(_mm_cmpeq_epi8(bytes, carriage_return), is_newline));
+
+        unsigned blank_mask = (unsigned) _mm_movemask_epi8(is_blank);
+        unsigned newline_mask = (unsigned) _mm_movemask_epi8(is_newline);
+
+        // 16 blank bytes
+        if (blank_mask == 0xFFFF) {
+            *newlines += (size_t) __builtin_popcount(newline_mask);
+            position += 16;
+            continue;
+        }
+
+        // Count the newlines before the first other byte
+        unsigned stop = (unsigned) __builtin_ctz(~blank_mask);
+        *newlines += (size_t) __builtin_popcount(newline_mask & ((1u << stop) - 1));
+
+        return position + stop;
+    }
+#endif
+
+    while (position < length) {
+
+        char byte = source[position];
+
+        if (byte == '\n') {
+            *newlines += 1;
+        }
+        else if (byte != ' ' && byte != '\t' && byte != '\r') {
+            break;
+        }
+
+        position += 1;
+    }
+
+    return position;
+}
+
+/* Make a view of a recorded span, empty if no token byte was recorded */
+static StringView makeSpan(const char* begin, const char* end)
+{
+    StringView view = { begin, (begin != NULL) ? (size_t) (end - begin) : 0 };
+    return view;
+}
+
+
+/* Lex the next command of the length bytes at source, starting at *position.
+ * Blank lines, whitespace and // comments are skipped, the command is classified
+ * and its fields are returned as views into source with the surrounding whitespace removed.
+ * *position is moved past the line of the command and *newlines counts the newlines
+ * passed, command->line is computed from it. The end of source ends the last line
+ * Return 0 = lexed a command
+ * Return 1 = end of source reached and no command lexed, command->line is the last line
+ * Return -1 = malformed command, errno is set to EINVAL and command->line is its line */
+extern int Lexer_next(const char* source, size_t length, size_t* position, size_t* newlines, LexedCommand* command)
+{
+    if ((source == NULL && length > 0) ||
+        position == NULL ||
+        newlines == NULL ||
+        command == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    static const StringView empty_view = { NULL, 0 };
+
+    command->type = NONE_COMMAND;
+    command->symbol = empty_view;
+    command->destination = empty_view;
+    command->computation = empty_view;
+    command->jump = empty_view;
+
+    const char* span_begin[FIELD_COUNT] = { NULL };
+    const char* span_end[FIELD_COUNT] = { NULL };
+    const char* equals = NULL;
+    const char* semicolon = NULL;
+    const char* command_begin = NULL;
+
+    size_t current = *position;
+    size_t newline_count = *newlines;
+    uint8_t state = STATE_START;
+
+    while (current < length) {
+
+        // Skip blank lines in bulk, the command starts at the next byte
+        if (state == STATE_START) {
+            current = Lexer_skipBlank(source, current, length, &newline_count);
+            if (current == length) {
+                break;
+            }
+            command_begin = source + current;
+        }
+
+        // Skip a comment line to its newline
+        else if (state == STATE_COMMENT) {
+            const char* newline = memchr(source + current, '\n', length - current);
+            if (newline == NULL) {
+                current = length;
+                break;
+            }
+            current = (size_t) (newline - source) + 1;
+            newline_count += 1;
+            state = STATE_START;
+            continue;
+        }
+
+        // Skip a comment after a command, its newline ends the command
+        else if (state == STATE_TAIL_COMMENT) {
+            const char* newline = memchr(source + current, '\n', length - current);
+            if (newline == NULL) {
+                current = length;
+                break;
+            }
+            current = (size_t) (newline - source);
+        }
+
+        uint8_t class = LEXER_CLASSES[(unsigned char) source[current]];
+        state = LEXER_TRANSITIONS[state][class];
+
+        // The newline of the command's line or a byte that can't be there
+        if (state <= STATE_DONE) {
+            current += 1;
+            break;
+        }
+
+        /* Extend the span of the field the byte belongs to.
+         * Tokens don't change the state of a field, the whole run is taken at once */
+        if (class == CLASS_TOKEN) {
+            uint8_t field = LEXER_FIELDS[state];
+            size_t run_end = current + 1;
+
+            while (run_end < length && LEXER_CLASSES[(unsigned char) source[run_end]] == CLASS_TOKEN) {
+                run_end += 1;
+            }
+
+            if (span_begin[field] == NULL) {
+                span_begin[field] = source + current;
+            }
+            span_end[field] = source + run_end;
+
+            current = run_end;
+            continue;
+        }
+
+        // The separators of C commands, not the ones in comments
+        else if (class == CLASS_EQUALS && state == STATE_C_COMP) {
+            equals = source + current;
+        }
+        else if (class == CLASS_SEMICOLON && state == STATE_C_JUMP) {
+            semicolon = source + current;
+        }
+
+        current += 1;
+    }
+
+    *position = current;
+
+    // The end of the source ends the last line
+    if (state > STATE_DONE) {
+        state = LEXER_TRANSITIONS[state][CLASS_NEWLINE];
+    }
+
+    if (state == STATE_START) {
+        // A last line without a newline still counts
+        *newlines = newline_count;
+        command->line = newline_count + ((current > 0 && source[current - 1] != '\n') ? 1 : 0);
+        return 1;
+    }
+
+    command->line = newline_count + 1;
+
+    if (state == STATE_ERROR) {
+        *newlines = newline_count;
+        errno = EINVAL;
+        return -1;
+    }
+
+    // Count the newline that ended the line, the end of the source has none
+    if (source[current - 1] == '\n') {
+        newline_count += 1;
+    }
+    *newlines = newline_count;
+
+    // Classify the command by its first byte
+    if (command_begin[0] == '@') {
+        command->type = A_COMMAND;
+        command->symbol = makeSpan(span_begin[FIELD_SYMBOL], span_end[FIELD_SYMBOL]);
+    }
+
+    // A label always reaches its ')', or it is an error
+    else if (command_begin[0] == '(') {
+        command->type = L_COMMAND;
+        command->symbol = makeSpan(span_begin[FIELD_SYMBOL], span_end[FIELD_SYMBOL]);
+    }
+
+    // C commands need a '=' or a ';'
+    else if (equals != NULL || semicolon != NULL) {
+        command->type = C_COMMAND;
+
+        if (equals != NULL) {
+            command->destination = makeSpan(span_begin[FIELD_FIRST], span_end[FIELD_FIRST]);
+            command->computation = makeSpan(span_begin[FIELD_COMP], span_end[FIELD_COMP]);
+        }
+        else {
+            command->computation = makeSpan(span_begin[FIELD_FIRST], span_end[FIELD_FIRST]);
+        }
+
+        command->jump = makeSpan(span_begin[FIELD_JUMP], span_end[FIELD_JUMP]);
+    }
+
+    /* A command without its symbol, a C command without a comp or without '=' and ';',
+     * or with nothing before its '=' or after its ';', like "=M" or "D;" */
+    if (command->type == NONE_COMMAND ||
+        (command->type != C_COMMAND && command->symbol.length == 0) ||
+        (command->type == C_COMMAND && (command->computation.length == 0 ||
+                                        (equals != NULL && command->destination.length == 0) ||
+                                        (semicolon != NULL && command->jump.length == 0)))) {
+        command->type = NONE_COMMAND;
+        errno = EINVAL;
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include "parser.h"
+
+#include <stddef.h>
+
+/* This module splits Hack source into commands in a single pass over the bytes.
+ * A table driven DFA skips whitespace and // comments, classifies the command
+ * and records the spans of its fields, the source is never modified or copied.
+ * Runs of blank lines are skipped 16 bytes at a time with SSE2 and comments
+ * are skipped to the next newline with memchr */
+
+/* A command found by the lexer, the views point into the source */
+struct StructLexedCommand {
+    enum Command type;         // NONE_COMMAND if the end of the source was reached
+    StringView   symbol;       // A and L commands
+    StringView   destination;  // C commands, the views of absent fields are empty
+    StringView   computation;
+    StringView   jump;
+    size_t       line;         // Line of the command or of the error, counting from 1
+};
+
+typedef struct StructLexedCommand LexedCommand;
+
+extern int Lexer_next(const char*, size_t, size_t*, size_t*, LexedCommand*);
+
+#endif
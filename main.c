@@ -1,282 +1,740 @@
+#include "assembler.h"
 #include "parser.h"
 #include "util.h"
-#include "code.h"
-#include "symbol.h"
+#include "arena.h"
+#include "output.h"
+#include "parallel.h"
+#include "pool.h"
+#include "server.h"
+#include "cache.h"
+#include "stats.h"
+#include "debug.h"
+#ifdef STATS_COUNT_ALLOCATIONS
+#include "allocation.h"
+#endif
 
 
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+
+/* Command line options */
+struct StructOptions {
+    char**        input_paths;     // Input files given on the command line
+    size_t        input_count;
+    const char*   manifest_path;   // File listing more inputs, NULL if not given
+    const char*   output_path;     // NULL means derived from the input path
+    AssemblerOptions assembler;
+    int           worker_count;    // Files assembled at the same time
+    const char*   cache_directory; // Directory of the output cache, NULL to not cache
+    const char*   socket_path;     // Serve requests on this Unix socket, NULL to assemble the inputs
+    int           stats;           // 1 to print statistics once every file is done
+    enum StatsFormat stats_format;
+    int           debug_info;      // 1 to write the debug info of every output beside it
+};
+
+typedef struct StructOptions Options;
+
+/* How the output of a file was produced */
+enum CacheResult {
+    CACHE_UNUSED,           // Assembled without the cache
+    CACHE_HIT,              // Copied from the cache
+    CACHE_MISS,             // Assembled and published to the cache
+    CACHE_NOT_STORED        // Assembled, but couldn't be published
+};
+
+/* One file to assemble */
+struct StructJob {
+    const char*      input_path;
+    const char*      output_path;
+    AssemblerReport  report;           // Reported once every file is done
+    enum CacheResult cache_result;
+};
+
+typedef struct StructJob Job;
+
+/* What a worker keeps from one file to the next */
+struct StructWorker {
+    int       ready;               // 1 once the assembler is created
+    Assembler assembler;
+    Stats     stats;               // Of every file the worker assembled
+    DebugInfo debug;               // Of the file being assembled, when asked for
+};
+
+typedef struct StructWorker Worker;
+
+/* Shared by every task of a batch */
+struct StructBatch {
+    const Options* options;
+    Job*           jobs;
+    Worker*        workers;
+};
+
+typedef struct StructBatch Batch;
+
+static void printUsage(FILE* stream, const char* program);
+static int  parseArguments(int argc, char** argv, Options* options);
+static char* makeDebugPath(const char* output_path);
+static int  writeDebugInfo(DebugInfo* debug, const char* source_path, const char* output_path);
+static int  addJob(Job** jobs, size_t* job_count, size_t* job_capacity,
+                   const char* input_path, const char* output_path);
+static int  readManifest(const char* path, Arena* arena,
+                         Job** jobs, size_t* job_count, size_t* job_capacity);
+static void assembleTask(void* context, int worker_index, size_t job_index);
+static int  assembleFile(Assembler* assembler, Job* job, const Options* options);
+
+int main(int argc, char** argv) {
+    /* Parse the command line
+     * Collect the files to assemble, from the command line and the manifest
+     * Assemble them on a pool of workers, each keeps its own parser state
+     * and symbol table from one file to the next
+     * Report the errors in the order the files were given */
 
 
-static void logError(int error_num, const char* message);
-static int  parseCommands(Parser* parser,
-                          SymbolTable* symbol_table,
-                          CommandArray* command_array);
-static int generateCode(SymbolTable* symbol_table,
-                        CommandArray* command_array,
-                        FILE*         output_file);
+    int error = 0;
+    double start_wall = Stats_wallTime();
 
-int main() {
-    /* Open the input file
-     * Open the output file
-     * create the parser
-     * step through the file, converting instructions as we go
-     * write instructions to the output
-     * repeat until done */
+    Options options;
+    error = parseArguments(argc, argv, &options);
+    if (error != 0) {
+        return (error > 0) ? 0 : -1;
+    }
 
+#ifdef STATS_COUNT_ALLOCATIONS
+    // The allocations are only counted for --stats, the workers aren't started yet
+    if (options.stats != 0) {
+        Allocation_enable();
+    }
+#endif
+
+    // Serve until interrupted, one warm assembler per worker
+    if (options.socket_path != NULL) {
+        error = Server_run(options.socket_path, options.worker_count);
+        if (error < 0) {
+            fprintf(stderr, "ERROR: %s\nMessage: Failed to run the server\n", strerror(errno));
+            return -1;
+        }
+        return 0;
+    }
+
+    // The manifest paths and the derived output paths live in this arena
+    Arena path_arena;
+    Arena_create(&path_arena, 16 * 1024);
+
+    Job* jobs = NULL;
+    size_t job_count = 0;
+    size_t job_capacity = 0;
+
+    for (size_t index = 0; index < options.input_count && error == 0; index++) {
+        error = addJob(&jobs, &job_count, &job_capacity, options.input_paths[index], NULL);
+    }
 
-    // Open the input file
-    FILE* source_file = fopen("test.asm", "r");
-    if (source_file == NULL) {
-        logError(errno, "Failed to open source file");
+    if (error == 0 && options.manifest_path != NULL) {
+        error = readManifest(options.manifest_path, &path_arena, &jobs, &job_count, &job_capacity);
+    }
+
+    else if (error == 0 && job_count == 0) {
+        error = addJob(&jobs, &job_count, &job_capacity, "test.asm", NULL);
+    }
+
+    if (error < 0) {
+        fprintf(stderr, "ERROR: %s\nMessage: Failed to collect the input files\n", strerror(errno));
+        free(jobs);
+        Arena_free(&path_arena);
         return -1;
     }
 
-    // Open the output file
-    FILE* output_file = fopen("test.hack", "w");
-    if (output_file == NULL) {
-        logError(errno, "Failed to open destination file");
-        fclose(source_file);
+    if (options.output_path != NULL && job_count != 1) {
+        fprintf(stderr, "-o can only be used with a single input file\n");
+        free(jobs);
+        Arena_free(&path_arena);
         return -1;
     }
 
+    // Fill in the output paths
+    for (size_t index = 0; index < job_count; index++) {
 
-    int error = 0;
+        if (jobs[index].output_path != NULL) {
+            continue;
+        }
 
-    // create the parser
-    Parser parser;
-    error = Parser_create(&parser, source_file);
-    if (error < 0) {
-        logError(errno, "Failed to create assembly parser");
-        fclose(source_file);
-        fclose(output_file);
+        if (options.output_path != NULL) {
+            jobs[index].output_path = options.output_path;
+            continue;
+        }
+
+        // Standard input goes to standard output
+        if (strcmp(jobs[index].input_path, "-") == 0) {
+            jobs[index].output_path = "-";
+            continue;
+        }
+
+        char* output_path = Output_makePath(jobs[index].input_path);
+        if (output_path == NULL) {
+            fprintf(stderr, "ERROR: %s\nMessage: Failed to create the output path\n", strerror(errno));
+            free(jobs);
+            Arena_free(&path_arena);
+            return -1;
+        }
+
+        jobs[index].output_path = Arena_strndup(&path_arena, output_path, strlen(output_path));
+        free(output_path);
+
+        if (jobs[index].output_path == NULL) {
+            fprintf(stderr, "ERROR: %s\nMessage: Failed to create the output path\n", strerror(errno));
+            free(jobs);
+            Arena_free(&path_arena);
+            return -1;
+        }
+    }
+
+    // Workers hold large output buffers, keep them off the stack
+    int worker_count = options.worker_count;
+    if ((size_t) worker_count > job_count) {
+        worker_count = (int) job_count;
+    }
+
+    if (options.cache_directory != NULL && Cache_createDirectory(options.cache_directory) < 0) {
+        fprintf(stderr, "ERROR: %s\nMessage: Failed to create the cache directory\n", strerror(errno));
+        free(jobs);
+        Arena_free(&path_arena);
         return -1;
     }
 
-    // create the command array
-    CommandArray command_array;
-    error = CommandArray_create(&command_array, 128);
-    if (error < 0) {
-        logError(errno, "Failed to create the command array");
-        Parser_free(&parser);
-        fclose(output_file);
+    Worker* workers = calloc((size_t) worker_count, sizeof(Worker));
+    if (workers == NULL) {
+        fprintf(stderr, "ERROR: %s\nMessage: Failed to create the workers\n", strerror(errno));
+        free(jobs);
+        Arena_free(&path_arena);
         return -1;
     }
 
-    // create the symbol table
-    SymbolTable symbol_table;
-    error = SymbolTable_create(&symbol_table, 128);
+    Batch batch;
+    batch.options = &options;
+    batch.jobs = jobs;
+    batch.workers = workers;
+
+    error = Pool_run(job_count, worker_count, assembleTask, &batch);
     if (error < 0) {
-        logError(errno, "Failed to create symbol table");
-        Parser_free(&parser);
-        CommandArray_free(&command_array);
-        fclose(output_file);
+        fprintf(stderr, "ERROR: %s\nMessage: Failed to start the workers\n", strerror(errno));
+    }
+
+    // Free the workers, keeping their statistics
+    Stats stats;
+    Stats_clear(&stats);
+
+    for (int index = 0; index < worker_count; index++) {
+        Stats_merge(&stats, &workers[index].stats);
+        if (workers[index].ready != 0) {
+            Assembler_free(&workers[index].assembler);
+            DebugInfo_free(&workers[index].debug);
+        }
+    }
+    free(workers);
+
+    // Report in input order
+    size_t cache_counts[CACHE_NOT_STORED + 1] = {0};
+    for (size_t index = 0; index < job_count; index++) {
+
+        AssemblerReport* report = &jobs[index].report;
+        cache_counts[jobs[index].cache_result] += 1;
+
+        if (report->error < 0) {
+            fprintf(stderr, "ERROR: %s\nFile: %s\n", strerror(report->error_number), jobs[index].input_path);
+            if (report->line > 0) {
+                fprintf(stderr, "Line: %zu\n", report->line);
+            }
+            fprintf(stderr, "Message: %s\n", report->message);
+            error = -1;
+        }
+    }
+
+    if (options.cache_directory != NULL) {
+        fprintf(stderr, "Cache: %zu hits, %zu misses",
+                cache_counts[CACHE_HIT], cache_counts[CACHE_MISS] + cache_counts[CACHE_NOT_STORED]);
+        if (cache_counts[CACHE_NOT_STORED] > 0) {
+            fprintf(stderr, ", %zu not stored", cache_counts[CACHE_NOT_STORED]);
+        }
+        fprintf(stderr, "\n");
+    }
+
+    if (options.stats != 0) {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        double total_cpu = (double) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+                           (double) (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+
+        Stats_print(&stats, stderr, options.stats_format, Stats_wallTime() - start_wall, total_cpu);
+    }
+
+    free(jobs);
+    Arena_free(&path_arena);
+
+    return (error < 0) ? -1 : 0;
+}
+
+/* Assemble one job of a batch on the given worker, creating the worker on its first job */
+static void assembleTask(void* context, int worker_index, size_t job_index)
+{
+    Batch* batch = context;
+    Worker* worker = &batch->workers[worker_index];
+    Job* job = &batch->jobs[job_index];
+
+    if (worker->ready == 0) {
+
+        if (Assembler_create(&worker->assembler) < 0) {
+            Assembler_logError(&job->report, errno, "Failed to create the assembler");
+            return;
+        }
+
+        // Collect statistics only when asked, the assembler skips them on NULL
+        if (batch->options->stats != 0) {
+            worker->assembler.stats = &worker->stats;
+        }
+
+        // Likewise for the debug info
+        DebugInfo_create(&worker->debug);
+        if (batch->options->debug_info != 0) {
+            worker->assembler.debug = &worker->debug;
+        }
+
+        worker->ready = 1;
+    }
+
+    assembleFile(&worker->assembler, job, batch->options);
+}
+
+/* Assemble the input file of job into its output file
+ * Return 0 on success
+ * Return -1 on failure, the error is recorded in the report of job */
+static int assembleFile(Assembler* assembler, Job* job, const Options* options)
+{
+    AssemblerReport* report = &job->report;
+    int error = 0;
+
+    // - reads standard input as it arrives instead of a file
+    int streamed = (strcmp(job->input_path, "-") == 0);
+    int to_stdout = (strcmp(job->output_path, "-") == 0);
+
+    // The debug info is written beside the output
+    if (options->debug_info != 0 && to_stdout) {
+        Assembler_logError(report, EINVAL, "Debug info needs an output file");
         return -1;
     }
 
-    // Parse the commands and insert labels into the symbol table
-    error = parseCommands(&parser,
-                          &symbol_table,
-                          &command_array);
+    // create the parser, it maps the input file
+    Parser parser;
+    if (streamed) {
+        error = Parser_createFromStream(&parser, STDIN_FILENO);
+    }
+    else {
+        error = Parser_createFromPath(&parser, job->input_path);
+    }
 
     if (error < 0) {
+        Assembler_logError(report, errno, "Failed to open source file");
+        return -1;
+    }
+
+    // Open the output file
+    FILE* output_file = (to_stdout) ? stdout : fopen(job->output_path, "wb");
+    if (output_file == NULL) {
+        Assembler_logError(report, errno, "Failed to open destination file");
         Parser_free(&parser);
-        CommandArray_free(&command_array);
-        fclose(output_file);
         return -1;
     }
 
-    // Parser isn't needed anymore
-    Parser_free(&parser);
+    // An unchanged source is copied from the cache without assembling it,
+    // a stream can't be hashed before it is read. The cache holds no debug info
+    CacheKey cache_key;
+    int cached = (options->cache_directory != NULL && streamed == 0 && to_stdout == 0 && options->debug_info == 0);
+    if (cached) {
+        Cache_computeKey(parser.mapped_source, parser.mapped_length, &options->assembler.output,
+                         options->assembler.optimize, &cache_key);
+
+        error = Cache_fetch(options->cache_directory, &cache_key, output_file);
+        if (error != 0) {
+            Parser_free(&parser);
+
+            if (error < 0 || fflush(output_file) != 0) {
+                Assembler_logError(report, errno, "Failed to copy the output from the cache");
+                fclose(output_file);
+                return -1;
+            }
 
+            job->cache_result = CACHE_HIT;
+            fclose(output_file);
+            return 0;
+        }
+    }
 
-    // Generate code fromo the parsed commands
-    error = generateCode(&symbol_table, &command_array, output_file);
-    if (error < 0) {
-        Parser_free(&parser);
-        CommandArray_free(&command_array);
+    error = Assembler_assemble(assembler, &parser, output_file, &options->assembler, report);
+
+    Parser_free(&parser);
+    if (to_stdout == 0) {
         fclose(output_file);
+    }
+
+    if (error < 0) {
         return -1;
     }
 
-    // Free resources
-    CommandArray_free(&command_array);
-    SymbolTable_free(&symbol_table);
+    if (options->debug_info != 0 &&
+        writeDebugInfo(assembler->debug, job->input_path, job->output_path) < 0) {
+        Assembler_logError(report, errno, "Failed to write the debug info");
+        return -1;
+    }
 
-    error = fflush(output_file);
-    if (error != 0) {
-            logError(errno, "Failed to flush output to output file");
-            fclose(output_file);
-            return -1;
+    // Publish the output, only regular files can be read back
+    if (cached) {
+        struct stat output_stat;
+        job->cache_result = CACHE_NOT_STORED;
+
+        if (stat(job->output_path, &output_stat) == 0 && S_ISREG(output_stat.st_mode) &&
+            Cache_store(options->cache_directory, &cache_key, job->output_path) == 0) {
+            job->cache_result = CACHE_MISS;
+        }
     }
-    
-    fclose(output_file);
 
     return 0;
 }
 
-static void logError(int error_num, const char* message)
+static void printUsage(FILE* stream, const char* program)
 {
-    fprintf(stderr, "ERROR: %s\nMessage: %s\n", strerror(error_num), message);
+    fprintf(stream,
+            "Usage: %s [options] [input.asm...]\n"
+            "Assembles every input.asm, test.asm if none are given, into Hack machine code\n"
+            "An input of - streams standard input to standard output\n"
+            "\n"
+            "Options:\n"
+            "  -o FILE             write the output to FILE, - for standard output,\n"
+            "                      default is input with .hack\n"
+            "                      only allowed with a single input\n"
+            "  -f text|binary      output format, default text\n"
+            "                      text writes 16 '0'/'1' characters per line\n"
+            "                      binary writes packed 16 bit words\n"
+            "  -e little|big       byte order of binary output, default little\n"
+            "  -H                  start binary output with a header holding the word count\n"
+            "  -s                  assemble in a single pass, forward references are patched\n"
+            "                      in a seekable output file, or held back until resolved\n"
+            "                      when writing to a pipe, see Streaming in README.md\n"
+            "  -t N                assemble each file on N threads, default 1\n"
+            "  -j N                assemble N files at the same time, default 1\n"
+            "  -m FILE             also assemble the files listed in FILE, one per line,\n"
+            "                      optionally followed by the output path\n"
+            "  -c DIR              cache outputs in DIR, an unchanged source with the same\n"
+            "                      options is copied from the cache instead of assembled\n"
+            "  -O[LEVEL]           optimize the program, drop the instructions that have no\n"
+            "                      effect, needs an input file. LEVEL 1, the default,\n"
+            "                      rewrites adjacent instructions, 2 also tracks A and D\n"
+            "                      across jumps\n"
+            "  -g                  also write the labels, variables and source line of every\n"
+            "                      instruction to the output path with .dbg instead of .hack,\n"
+            "                      needs an input and an output file\n"
+            "  -S SOCKET           serve assemble requests on the Unix socket SOCKET with\n"
+            "                      -j workers until interrupted, see hack-client\n"
+            "  --stats[=FORMAT]    print the time of each phase, counters of the work done,\n"
+            "                      allocations and peak memory to stderr once every file\n"
+            "                      is done, FORMAT is human, the default, or json\n"
+            "  -h                  show this message\n",
+            program);
 }
-       
-static int  parseCommands(Parser* parser,
-                          SymbolTable* symbol_table,
-                          CommandArray* command_array)
+
+/* Parse the command line into options
+ * Return 0 on success
+ * Return 1 if the program should exit successfully, usage was printed
+ * Return -1 on invalid arguments, an error was printed */
+static int parseArguments(int argc, char** argv, Options* options)
 {
-    int error = 0;
-    size_t instruction_counter = 0;
+    options->input_paths = NULL;
+    options->input_count = 0;
+    options->manifest_path = NULL;
+    options->output_path = NULL;
+    Assembler_defaultOptions(&options->assembler);
+    options->worker_count = 1;
+    options->cache_directory = NULL;
+    options->socket_path = NULL;
+    options->stats = 0;
+    options->stats_format = STATS_HUMAN;
+    options->debug_info = 0;
+
+    // Long options without a short form are numbered past the characters
+    enum { OPTION_STATS = 256 };
+    static const struct option long_options[] = {
+        { "stats", optional_argument, NULL, OPTION_STATS },
+        { "help",  no_argument,       NULL, 'h' },
+        { NULL,    0,                 NULL, 0 }
+    };
+
+    int option = 0;
+    while ((option = getopt_long(argc, argv, "o:f:e:Hst:j:m:c:O::gS:h", long_options, NULL)) != -1) {
+
+        switch (option) {
+
+            case OPTION_STATS:
+                options->stats = 1;
+                if (optarg == NULL || strcmp(optarg, "human") == 0) {
+                    options->stats_format = STATS_HUMAN;
+                }
+                else if (strcmp(optarg, "json") == 0) {
+                    options->stats_format = STATS_JSON;
+                }
+                else {
+                    fprintf(stderr, "Unknown statistics format: %s\n", optarg);
+                    return -1;
+                }
+                break;
 
-    // Parse the commands and generate the symbols
-    while (Parser_hasMoreCommands(parser)) {
-        error = Parser_advance(parser);
+            case 'o':
+                options->output_path = optarg;
+                break;
 
-        // error
-        if (error < 0) {
-            logError(errno, "Failed to parse instruction");
-            return -1;
-        }
+            case 'f':
+                if (strcmp(optarg, "text") == 0) {
+                    options->assembler.output.format = OUTPUT_TEXT;
+                }
+                else if (strcmp(optarg, "binary") == 0) {
+                    options->assembler.output.format = OUTPUT_BINARY;
+                }
+                else {
+                    fprintf(stderr, "Unknown output format: %s\n", optarg);
+                    return -1;
+                }
+                break;
 
-        // no new command read
-        else if (error == 1) {
-            break;
-        }
+            case 'e':
+                if (strcmp(optarg, "little") == 0) {
+                    options->assembler.output.byte_order = OUTPUT_LITTLE_ENDIAN;
+                }
+                else if (strcmp(optarg, "big") == 0) {
+                    options->assembler.output.byte_order = OUTPUT_BIG_ENDIAN;
+                }
+                else {
+                    fprintf(stderr, "Unknown byte order: %s\n", optarg);
+                    return -1;
+                }
+                break;
 
+            case 'H':
+                options->assembler.output.header = 1;
+                break;
 
-        /* If its an L command add it to the symbol table
-         * Otherwise just add it to the command Array */
+            case 's':
+                options->assembler.single_pass = 1;
+                break;
 
-        enum Command command_type = Parser_commandType(parser);
+            case 't': {
+                char* end = NULL;
+                long thread_count = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || thread_count < 1 || thread_count > PARALLEL_MAX_THREADS) {
+                    fprintf(stderr, "Invalid thread count: %s\n", optarg);
+                    return -1;
+                }
+                options->assembler.thread_count = (int) thread_count;
+                break;
+            }
 
-        // Add to symbol table
-        if (command_type == L_COMMAND) {
-            const char* symbol = Parser_symbol(parser);
+            case 'j': {
+                char* end = NULL;
+                long worker_count = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || worker_count < 1 || worker_count > POOL_MAX_WORKERS) {
+                    fprintf(stderr, "Invalid job count: %s\n", optarg);
+                    return -1;
+                }
+                options->worker_count = (int) worker_count;
+                break;
+            }
 
-            // If the symbol isn't in the table, add it
-            if (SymbolTable_contains(symbol_table, symbol) == 0) {
+            case 'm':
+                options->manifest_path = optarg;
+                break;
 
-                error = SymbolTable_addEntry(symbol_table, symbol, instruction_counter);
+            case 'c':
+                options->cache_directory = optarg;
+                break;
 
-                // Failure to add to the table
-                if (error < 0) {
-                    logError(errno, "Failed to add entry to symbol table");
+            case 'O':
+                if (optarg == NULL || strcmp(optarg, "1") == 0) {
+                    options->assembler.optimize = OPTIMIZER_PEEPHOLE;
+                }
+                else if (strcmp(optarg, "2") == 0) {
+                    options->assembler.optimize = OPTIMIZER_DATAFLOW;
+                }
+                else if (strcmp(optarg, "0") == 0) {
+                    options->assembler.optimize = OPTIMIZER_NONE;
+                }
+                else {
+                    fprintf(stderr, "Unknown optimization level: %s\n", optarg);
                     return -1;
                 }
-            }
+                break;
+
+            case 'g':
+                options->debug_info = 1;
+                break;
 
-            else {
-                logError(errno, "Duplicate or invalid symbol found");
+            case 'S':
+                options->socket_path = optarg;
+                break;
+
+            case 'h':
+                printUsage(stdout, argv[0]);
+                return 1;
+
+            default:
+                printUsage(stderr, argv[0]);
                 return -1;
-            }
         }
+    }
 
-        // Add to command array
-        else {
-            // copy the command
-            error = CommandArray_copyCommand(command_array, parser);
-            if (error < 0) {
-                logError(errno, "Failed to copy command");
-                return -1;
-            }
+    options->input_paths = &argv[optind];
+    options->input_count = (size_t) (argc - optind);
+
+    return 0;
+}
+
+/* Make the path of the debug info, the output path with
+ * its .hack extension replaced by .dbg
+ * Return the newly allocated path on success
+ * Return NULL on failure, errno will be set */
+static char* makeDebugPath(const char* output_path)
+{
+    size_t length = strlen(output_path);
+
+    // Drop the .hack extension
+    if (length >= 5 && strcmp(&output_path[length - 5], ".hack") == 0) {
+        length -= 5;
+    }
+
+    char* debug_path = malloc(length + sizeof(".dbg"));
+    if (debug_path == NULL) {
+        return NULL;
+    }
+
+    memcpy(debug_path, output_path, length);
+    strcpy(&debug_path[length], ".dbg");
+
+    return debug_path;
+}
+
+/* Write the debug info of the program assembled from source_path beside output_path
+ * Return 0 on success
+ * Return -1 on failure, errno will be set */
+static int writeDebugInfo(DebugInfo* debug, const char* source_path, const char* output_path)
+{
+    char* debug_path = makeDebugPath(output_path);
+    if (debug_path == NULL) {
+        return -1;
+    }
+
+    FILE* debug_file = fopen(debug_path, "wb");
+    free(debug_path);
+
+    if (debug_file == NULL) {
+        return -1;
+    }
+
+    int error = DebugInfo_write(debug, debug_file, source_path);
+
+    // Keep the first error
+    int saved_errno = errno;
+    if (fclose(debug_file) != 0 && error == 0) {
+        return -1;
+    }
+    errno = saved_errno;
+
+    return error;
+}
+
+/* Append a job to the list of jobs, output_path NULL means derived from the input path
+ * Return 0 on success
+ * Return -1 on failure, errno will be set */
+static int addJob(Job** jobs, size_t* job_count, size_t* job_capacity,
+                  const char* input_path, const char* output_path)
+{
+    if (*job_count == *job_capacity) {
+
+        size_t new_capacity = (*job_capacity > 0) ? *job_capacity * 2 : 16;
 
-            instruction_counter += 1;
+        errno = 0;
+        Job* new_jobs = reallocarray(*jobs, new_capacity, sizeof(Job));
+        if (errno != 0) {
+            return -1;
         }
+
+        *jobs = new_jobs;
+        *job_capacity = new_capacity;
     }
 
+    Job* job = &(*jobs)[*job_count];
+    job->input_path = input_path;
+    job->output_path = output_path;
+    Assembler_clearReport(&job->report);
+    job->cache_result = CACHE_UNUSED;
+
+    *job_count += 1;
+
     return 0;
 }
 
-static int generateCode(SymbolTable* symbol_table,
-                        CommandArray* command_array,
-                        FILE*         output_file)
+/* Add a job for every line of the manifest at path.
+ * A line holds an input path, optionally followed by whitespace and the output path,
+ * empty lines and lines starting with // are skipped. The paths are copied into arena
+ * Return 0 on success
+ * Return -1 on failure, errno will be set */
+static int readManifest(const char* path, Arena* arena,
+                        Job** jobs, size_t* job_count, size_t* job_capacity)
 {
+    FILE* manifest = fopen(path, "r");
+    if (manifest == NULL) {
+        return -1;
+    }
 
-    /* Iterate through all the parsed commands
-     * substitue symbols as needed
-     * generate code */
+    char* line = NULL;
+    size_t line_size = 0;
     int error = 0;
 
-    size_t next_variable_address = 16;
-    for (size_t index = 0; index < command_array->size; index++) {
-
-        ParsedCommand* current_command = &command_array->commands[index];
-        char binary_instruction[18] = "0000000000000000\n\0";
-
-        if (current_command->type == A_COMMAND) {
-
-            // Is a mnuemonic
-           if (isMneumonic(current_command->symbol) == 1) {
-               error = generateAInstruction(current_command->symbol, &binary_instruction[0]);
-
-               if (error < 0) {
-                   logError(errno, "Failed generate A instruction");
-                   return -1;
-               }
-           } 
-
-           // Is a known symbol
-           else if (SymbolTable_contains(symbol_table, current_command->symbol) == 1) {
-               size_t symbol_address = SymbolTable_getAddress(symbol_table, current_command->symbol);
-               char num_str[6];
-               sprintf(&num_str[0], "%ld", symbol_address);
-
-               error = generateAInstruction(&num_str[0], &binary_instruction[0]);
-               if (error < 0) {
-                   logError(errno, "Failed generate A instruction");
-                   return -1;
-               }
-           }
-
-           // Is an unknown symbol, a variable
-           else {
-               error = SymbolTable_addEntry(symbol_table, current_command->symbol, next_variable_address); 
-               if (error < 0) {
-                   logError(errno, "Failed to create variable");
-                   return -1;
-               }
-
-               char num_str[6];
-               sprintf(&num_str[0], "%ld", next_variable_address);
-
-               error = generateAInstruction(&num_str[0], &binary_instruction[0]);
-               if (error < 0) {
-                   logError(errno, "Failed generate A instruction");
-                   return -1;
-               }
-
-               next_variable_address += 1;
-           }
+    errno = 0;
+    while (error == 0 && getline(&line, &line_size, manifest) != -1) {
+
+        char* input_path = strtok(line, " \t\r\n");
+        if (input_path == NULL || strncmp(input_path, "//", 2) == 0) {
+            continue;
         }
 
-        else if (current_command->type == C_COMMAND) {
+        char* output_path = strtok(NULL, " \t\r\n");
 
+        const char* input_copy = Arena_strndup(arena, input_path, strlen(input_path));
+        const char* output_copy = NULL;
+        if (output_path != NULL) {
+            output_copy = Arena_strndup(arena, output_path, strlen(output_path));
+        }
 
-            error = generateCInstruction(current_command->destination, current_command->computation, current_command->jump, &binary_instruction[0]);
-            if (error < 0) {
-                logError(errno, "Failed to generate C instruction");
-                return -1;
-            }
+        if (input_copy == NULL || (output_path != NULL && output_copy == NULL)) {
+            error = -1;
         }
-        // Unknown command
         else {
-            if (error < 0) {
-                logError(errno, "Unknown command encountered during code generation");
-                return -1;
-            }
+            error = addJob(jobs, job_count, job_capacity, input_copy, output_copy);
         }
 
-        // By this point we should a valid command to write
-        binary_instruction[16] = '\n';
-        binary_instruction[17] = '\0';
-
-        size_t bytes_written = fwrite(&binary_instruction[0], sizeof(char), 17, output_file);
+        errno = 0;
+    }
 
-        // not enough bytes were written and there was an error
-        if (bytes_written != (sizeof(char) * 17) && ferror(output_file) != 0) {
-            logError(errno, "Failed to write to output file");
-            return -1;
-        }
+    // getline failed for another reason than the end of the file
+    if (error == 0 && errno != 0) {
+        error = -1;
     }
+
+    int saved_errno = errno;
+    free(line);
+    fclose(manifest);
+    errno = saved_errno;
+
+    return error;
 }
@@ -0,0 +1,1044 @@
+#include "optimizer.h"
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+
+/* Fields of a C instruction, 111a cccc ccdd djjj */
+#define OPTIMIZER_C_BIT         0x8000
+#define OPTIMIZER_COMP(word)    (((word) >> 6) & 0x7f)
+#define OPTIMIZER_DEST(word)    (((word) >> 3) & 0x7)
+#define OPTIMIZER_JUMP(word)    ((word) & 0x7)
+
+#define OPTIMIZER_DEST_A        0x4
+#define OPTIMIZER_DEST_D        0x2
+#define OPTIMIZER_DEST_M        0x1
+
+/* comp bits, the y input of the ALU is A, or M when the a bit is set */
+#define OPTIMIZER_COMP_ZY       0x08     // y is zeroed, A isn't read
+#define OPTIMIZER_COMP_D        0x0c     // D
+#define OPTIMIZER_COMP_A        0x30     // A
+#define OPTIMIZER_COMP_M        0x70     // M
+
+/* Per instruction flags of a pass */
+#define OPTIMIZER_TARGET        0x1      // A label points at it, it can be reached from elsewhere
+#define OPTIMIZER_REMOVED       0x2
+#define OPTIMIZER_FIRST_USE     0x4      // First reference to a symbol that isn't a label
+#define OPTIMIZER_LEADER        0x8      // Starts a basic block
+#define OPTIMIZER_TAKEN         0x10     // Its address is used as data, a computed jump may land on it
+
+/* A register that could hold anything */
+static const OptimizerValue OPTIMIZER_UNKNOWN = { COMMAND_NO_SYMBOL, 0, 0 };
+
+
+/* Return 1 if the instruction at index is an A instruction */
+static inline int Optimizer_isAddress(const CommandArray* command_array, size_t index)
+{
+    return command_array->symbol_ids[index] != COMMAND_NO_SYMBOL ||
+           (command_array->words[index] & OPTIMIZER_C_BIT) == 0;
+}
+
+/* Return 1 if the A instructions at first and second load the same value.
+ * A symbol and a constant are never the same, the labels still move */
+static inline int Optimizer_sameAddress(const CommandArray* command_array, size_t first, size_t second)
+{
+    return command_array->symbol_ids[first] == command_array->symbol_ids[second] &&
+           command_array->words[first] == command_array->words[second];
+}
+
+/* Return 1 if the C instruction word depends on the value of A,
+ * it computes with A or M, writes M or jumps */
+static inline int Optimizer_readsAddress(uint16_t word)
+{
+    return (OPTIMIZER_COMP(word) & OPTIMIZER_COMP_ZY) == 0 ||
+           (OPTIMIZER_DEST(word) & OPTIMIZER_DEST_M) != 0 ||
+           OPTIMIZER_JUMP(word) != 0;
+}
+
+/* Return 1 if the C instruction word has no effect */
+static inline int Optimizer_isNoop(uint16_t word)
+{
+    if (OPTIMIZER_JUMP(word) != 0) {
+        return 0;
+    }
+
+    switch (OPTIMIZER_DEST(word)) {
+        case 0:                 return 1;
+        case OPTIMIZER_DEST_D:  return OPTIMIZER_COMP(word) == OPTIMIZER_COMP_D;
+        case OPTIMIZER_DEST_A:  return OPTIMIZER_COMP(word) == OPTIMIZER_COMP_A;
+        case OPTIMIZER_DEST_M:  return OPTIMIZER_COMP(word) == OPTIMIZER_COMP_M;
+        default:                return 0;
+    }
+}
+
+/* Return 1 if the value of A isn't read from the instruction at index on,
+ * before A is loaded or written again. A jump reads it, the program end doesn't */
+static int Optimizer_addressDead(const CommandArray* command_array, size_t index)
+{
+    for (; index < command_array->size; index++) {
+        uint16_t word = command_array->words[index];
+
+        if (Optimizer_isAddress(command_array, index)) {
+            return 1;
+        }
+        if (Optimizer_readsAddress(word)) {
+            return 0;
+        }
+        if ((OPTIMIZER_DEST(word) & OPTIMIZER_DEST_A) != 0) {
+            return 1;
+        }
+    }
+
+    return 1;
+}
+
+/* Return the A instruction that loads the target of the jump at index, found
+ * by going back until A is written. An instruction flagged stop can be reached
+ * from elsewhere, A isn't known there
+ * Return SIZE_MAX if the target isn't loaded in a straight line, the jump is computed */
+static size_t Optimizer_jumpLoad(const CommandArray* command_array, const uint8_t* flags,
+                                 size_t index, uint8_t stop)
+{
+    for (; index > 0 && (flags[index] & stop) == 0; index--) {
+
+        if (Optimizer_isAddress(command_array, index - 1)) {
+            return index - 1;
+        }
+        if ((OPTIMIZER_DEST(command_array->words[index - 1]) & OPTIMIZER_DEST_A) != 0) {
+            break;
+        }
+    }
+
+    return SIZE_MAX;
+}
+
+/* Return 1 if a jump may go to a constant address: one loaded right before it,
+ * or any constant inside the program when a jump is computed and could land on
+ * it. Removing an instruction moves the code under the constant and it can't
+ * follow, like a label does */
+static int Optimizer_jumpsToConstant(const CommandArray* command_array, const uint8_t* flags)
+{
+    const uint16_t* words = command_array->words;
+    const uint32_t* symbol_ids = command_array->symbol_ids;
+    size_t size = command_array->size;
+
+    int constant = 0;
+    int computed = 0;
+    for (size_t index = 0; index < size; index++) {
+
+        if (Optimizer_isAddress(command_array, index)) {
+            constant |= (symbol_ids[index] == COMMAND_NO_SYMBOL && words[index] < size);
+            continue;
+        }
+        if (OPTIMIZER_JUMP(words[index]) == 0) {
+            continue;
+        }
+
+        size_t load = Optimizer_jumpLoad(command_array, flags, index, OPTIMIZER_TARGET);
+        if (load == SIZE_MAX) {
+            computed = 1;
+        }
+        else if (symbol_ids[load] == COMMAND_NO_SYMBOL) {
+            return 1;
+        }
+    }
+
+    return constant && computed;
+}
+
+/* Flag every instruction a label points at, the labels are the
+ * only symbols that have an address before they are resolved.
+ * Variables get their address in order of first use, so the first
+ * reference to every other symbol is flagged to keep that order */
+static void Optimizer_markInstructions(const CommandArray* command_array, uint8_t* flags, uint8_t* seen)
+{
+    const int* addresses = command_array->addresses;
+    const uint32_t* symbol_ids = command_array->symbol_ids;
+
+    for (size_t index = 0; index <= command_array->size; index++) {
+        flags[index] = 0;
+    }
+
+    for (size_t id = 0; id < command_array->symbols.count; id++) {
+        seen[id] = 0;
+        if (addresses[id] != COMMAND_UNASSIGNED) {
+            flags[addresses[id]] |= OPTIMIZER_TARGET;
+        }
+    }
+
+    for (size_t index = 0; index < command_array->size; index++) {
+        uint32_t id = symbol_ids[index];
+
+        if (id != COMMAND_NO_SYMBOL && addresses[id] == COMMAND_UNASSIGNED && seen[id] == 0) {
+            flags[index] |= OPTIMIZER_FIRST_USE;
+            seen[id] = 1;
+        }
+    }
+}
+
+/* Apply the first rule that matches at every instruction, flagging the removed ones.
+ * A match skips the whole window it looked at, so no two rewrites of a pass overlap
+ * Return the number of instructions removed or rewritten */
+static size_t Optimizer_peepholePass(CommandArray* command_array, uint8_t* flags)
+{
+    uint16_t* words = command_array->words;
+    const int* addresses = command_array->addresses;
+    size_t size = command_array->size;
+    size_t changes = 0;
+
+    size_t index = 0;
+    while (index < size) {
+
+        uint16_t word = words[index];
+        int address = Optimizer_isAddress(command_array, index);
+
+        /* @LABEL
+         * D;JGT
+         * (LABEL)      goes to the next instruction either way, the jump is dropped.
+         *              The load goes too unless A is read before it is written again */
+        if (address && index + 2 <= size &&
+            command_array->symbol_ids[index] != COMMAND_NO_SYMBOL &&
+            addresses[command_array->symbol_ids[index]] == (int) (index + 2) &&
+            Optimizer_isAddress(command_array, index + 1) == 0 &&
+            OPTIMIZER_DEST(words[index + 1]) == 0 &&
+            OPTIMIZER_JUMP(words[index + 1]) != 0 &&
+            (flags[index + 1] & OPTIMIZER_TARGET) == 0) {
+
+            flags[index + 1] |= OPTIMIZER_REMOVED;
+            changes += 1;
+
+            if (Optimizer_addressDead(command_array, index + 2)) {
+                flags[index] |= OPTIMIZER_REMOVED;
+                changes += 1;
+            }
+
+            index += 2;
+            continue;
+        }
+
+        // D=D, A=A, M=M or nothing at all
+        if (address == 0 && Optimizer_isNoop(word)) {
+            flags[index] |= OPTIMIZER_REMOVED;
+            changes += 1;
+            index += 1;
+            continue;
+        }
+
+        /* A=M          A is written and loaded again right away,
+         * @X           the write is dropped */
+        if (index + 1 < size && Optimizer_isAddress(command_array, index + 1) &&
+            (flags[index] & OPTIMIZER_FIRST_USE) == 0 &&
+            (address || ((OPTIMIZER_DEST(word) & OPTIMIZER_DEST_A) != 0 && OPTIMIZER_JUMP(word) == 0))) {
+
+            // M is written at the old A, the other destinations don't need it
+            if (address || OPTIMIZER_DEST(word) == OPTIMIZER_DEST_A) {
+                flags[index] |= OPTIMIZER_REMOVED;
+            }
+            else {
+                words[index] &= (uint16_t) ~(OPTIMIZER_DEST_A << 3);
+            }
+
+            changes += 1;
+            index += 2;
+            continue;
+        }
+
+        /* @SP
+         * M=M+1        A isn't written and nothing jumps in between,
+         * @SP          the second load is dropped */
+        if (address) {
+            size_t end = index + 1;
+            int matched = 0;
+
+            while (end < size && end < index + OPTIMIZER_WINDOW &&
+                   (flags[end] & OPTIMIZER_TARGET) == 0) {
+
+                if (Optimizer_isAddress(command_array, end)) {
+                    matched = Optimizer_sameAddress(command_array, index, end);
+                    break;
+                }
+
+                if ((OPTIMIZER_DEST(words[end]) & OPTIMIZER_DEST_A) != 0) {
+                    break;
+                }
+
+                end += 1;
+            }
+
+            if (matched) {
+                flags[end] |= OPTIMIZER_REMOVED;
+                changes += 1;
+                index = end + 1;
+                continue;
+            }
+        }
+
+        index += 1;
+    }
+
+    return changes;
+}
+
+/* Drop the instructions flagged removed and move the labels after them
+ * new_addresses gets the new address of every old address and of the end
+ * Return the number of instructions dropped */
+static size_t Optimizer_compact(CommandArray* command_array, const uint8_t* flags, uint32_t* new_addresses)
+{
+    uint16_t* words = command_array->words;
+    uint32_t* symbol_ids = command_array->symbol_ids;
+    size_t size = command_array->size;
+
+    size_t kept = 0;
+    for (size_t index = 0; index < size; index++) {
+
+        new_addresses[index] = (uint32_t) kept;
+
+        if ((flags[index] & OPTIMIZER_REMOVED) == 0) {
+            words[kept] = words[index];
+            symbol_ids[kept] = symbol_ids[index];
+            kept += 1;
+        }
+    }
+    new_addresses[size] = (uint32_t) kept;
+
+    for (size_t id = 0; id < command_array->symbols.count; id++) {
+        if (command_array->addresses[id] != COMMAND_UNASSIGNED) {
+            command_array->addresses[id] = (int) new_addresses[command_array->addresses[id]];
+        }
+    }
+
+    command_array->size = kept;
+
+    return size - kept;
+}
+
+/* Return the value the A instruction at index loads */
+static inline OptimizerValue Optimizer_loadValue(const CommandArray* command_array, size_t index)
+{
+    OptimizerValue value;
+    value.symbol = command_array->symbol_ids[index];
+    value.offset = (value.symbol == COMMAND_NO_SYMBOL) ? command_array->words[index] : 0;
+    value.known = 1;
+
+    return value;
+}
+
+/* Return the known value constant */
+static inline OptimizerValue Optimizer_constant(uint16_t constant)
+{
+    OptimizerValue value = { COMMAND_NO_SYMBOL, constant, 1 };
+    return value;
+}
+
+/* Return value plus constant, 16 bit arithmetic wraps like the ALU */
+static inline OptimizerValue Optimizer_add(OptimizerValue value, uint16_t constant)
+{
+    value.offset = (uint16_t) (value.offset + constant);
+    return value;
+}
+
+/* Return 1 if first and second are known to be equal */
+static inline int Optimizer_sameValue(OptimizerValue first, OptimizerValue second)
+{
+    return first.known && second.known &&
+           first.symbol == second.symbol &&
+           first.offset == second.offset;
+}
+
+/* Return 1 if value is a known constant */
+static inline int Optimizer_isConstant(OptimizerValue value)
+{
+    return value.known && value.symbol == COMMAND_NO_SYMBOL;
+}
+
+/* Return what the comp of the C instruction word computes from d and a.
+ * Constants go through the ALU, a symbol is only followed through
+ * copies, increments and additions of a constant. M is never known */
+static OptimizerValue Optimizer_evaluate(uint16_t word, OptimizerValue d, OptimizerValue a)
+{
+    unsigned comp = OPTIMIZER_COMP(word);
+    int memory = (comp & 0x40) != 0;
+
+    // x is D and y is A or M, unless zeroed by zx or zy
+    OptimizerValue x = ((comp & 0x20) != 0) ? Optimizer_constant(0) : d;
+    OptimizerValue y = ((comp & OPTIMIZER_COMP_ZY) != 0) ? Optimizer_constant(0)
+                     : (memory) ? OPTIMIZER_UNKNOWN : a;
+
+    if (Optimizer_isConstant(x) && Optimizer_isConstant(y)) {
+        uint16_t x_value = ((comp & 0x10) != 0) ? (uint16_t) ~x.offset : x.offset;
+        uint16_t y_value = ((comp & 0x04) != 0) ? (uint16_t) ~y.offset : y.offset;
+        uint16_t result = ((comp & 0x02) != 0) ? (uint16_t) (x_value + y_value) : (uint16_t) (x_value & y_value);
+
+        return Optimizer_constant(((comp & 0x01) != 0) ? (uint16_t) ~result : result);
+    }
+
+    if (x.known == 0 && y.known == 0) {
+        return OPTIMIZER_UNKNOWN;
+    }
+
+    switch (comp) {
+        case OPTIMIZER_COMP_D:  return d;
+        case OPTIMIZER_COMP_A:  return a;
+        case 0x1f:              return Optimizer_add(d, 1);         // D+1
+        case 0x37:              return Optimizer_add(a, 1);         // A+1
+        case 0x0e:              return Optimizer_add(d, 0xffff);    // D-1
+        case 0x32:              return Optimizer_add(a, 0xffff);    // A-1
+
+        case 0x02:              // D+A
+            if (Optimizer_isConstant(d) && a.known) {
+                return Optimizer_add(a, d.offset);
+            }
+            if (Optimizer_isConstant(a) && d.known) {
+                return Optimizer_add(d, a.offset);
+            }
+            return OPTIMIZER_UNKNOWN;
+
+        case 0x13:              // D-A
+            if (Optimizer_isConstant(a) && d.known) {
+                return Optimizer_add(d, (uint16_t) -a.offset);
+            }
+            if (a.known && d.known && a.symbol == d.symbol) {
+                return Optimizer_constant((uint16_t) (d.offset - a.offset));
+            }
+            return OPTIMIZER_UNKNOWN;
+
+        case 0x07:              // A-D
+            if (Optimizer_isConstant(d) && a.known) {
+                return Optimizer_add(a, (uint16_t) -d.offset);
+            }
+            if (a.known && d.known && a.symbol == d.symbol) {
+                return Optimizer_constant((uint16_t) (a.offset - d.offset));
+            }
+            return OPTIMIZER_UNKNOWN;
+
+        default:
+            return OPTIMIZER_UNKNOWN;
+    }
+}
+
+/* Run the instruction at index on the registers a and d */
+static inline void Optimizer_execute(const CommandArray* command_array, size_t index,
+                                     OptimizerValue* a, OptimizerValue* d)
+{
+    if (Optimizer_isAddress(command_array, index)) {
+        *a = Optimizer_loadValue(command_array, index);
+        return;
+    }
+
+    uint16_t word = command_array->words[index];
+    OptimizerValue result = Optimizer_evaluate(word, *d, *a);
+
+    if ((OPTIMIZER_DEST(word) & OPTIMIZER_DEST_A) != 0) {
+        *a = result;
+    }
+    if ((OPTIMIZER_DEST(word) & OPTIMIZER_DEST_D) != 0) {
+        *d = result;
+    }
+}
+
+/* Return the registers live before the instruction at index given those live after it */
+static inline uint8_t Optimizer_liveBefore(const CommandArray* command_array, size_t index, uint8_t live)
+{
+    if (Optimizer_isAddress(command_array, index)) {
+        return live & (uint8_t) ~OPTIMIZER_LIVE_A;
+    }
+
+    uint16_t word = command_array->words[index];
+    uint8_t reads = 0;
+    uint8_t writes = 0;
+
+    if (Optimizer_readsAddress(word)) {
+        reads |= OPTIMIZER_LIVE_A;
+    }
+    if ((OPTIMIZER_COMP(word) & 0x20) == 0) {
+        reads |= OPTIMIZER_LIVE_D;
+    }
+    if ((OPTIMIZER_DEST(word) & OPTIMIZER_DEST_A) != 0) {
+        writes |= OPTIMIZER_LIVE_A;
+    }
+    if ((OPTIMIZER_DEST(word) & OPTIMIZER_DEST_D) != 0) {
+        writes |= OPTIMIZER_LIVE_D;
+    }
+
+    return (live & (uint8_t) ~writes) | reads;
+}
+
+/* Return 1 if the instruction at index is @X of the @X 0;JMP at address X
+ * that ends a program, simulators stop there so it is kept as written */
+static inline int Optimizer_isHalt(const CommandArray* command_array, size_t index)
+{
+    if (index + 1 >= command_array->size ||
+        Optimizer_isAddress(command_array, index + 1) ||
+        OPTIMIZER_JUMP(command_array->words[index + 1]) != 0x7) {
+        return 0;
+    }
+
+    uint32_t id = command_array->symbol_ids[index];
+    int target = (id != COMMAND_NO_SYMBOL) ? command_array->addresses[id] : command_array->words[index];
+
+    return target == (int) index;
+}
+
+/* Flag the instructions that start a basic block: the entry, the label targets,
+ * the instructions after a jump and the constant addresses jumped to. The labels
+ * and constants whose value is used other than by a jump of the same block are
+ * flagged taken, they become blocks too. exit_taken is set when such an address
+ * is past the program
+ * Return 0 on success
+ * Return 1 if a jump goes to a symbol that isn't a label, its target is unknown,
+ * or may go to a constant, see Optimizer_jumpsToConstant */
+static int Optimizer_markBlocks(const CommandArray* command_array, uint8_t* flags, uint8_t* exit_taken)
+{
+    const uint16_t* words = command_array->words;
+    const uint32_t* symbol_ids = command_array->symbol_ids;
+    const int* addresses = command_array->addresses;
+    size_t size = command_array->size;
+
+    enum { USE_NONE, USE_JUMP, USE_TAKEN };
+
+    if (Optimizer_jumpsToConstant(command_array, flags)) {
+        return 1;
+    }
+
+    flags[0] |= OPTIMIZER_LEADER;
+    for (size_t index = 0; index < size; index++) {
+
+        if ((flags[index] & OPTIMIZER_TARGET) != 0) {
+            flags[index] |= OPTIMIZER_LEADER;
+        }
+        if (Optimizer_isAddress(command_array, index) == 0 && OPTIMIZER_JUMP(words[index]) != 0) {
+            flags[index + 1] |= OPTIMIZER_LEADER;
+        }
+    }
+
+    *exit_taken = 0;
+
+    // A new leader ends the blocks before it, which can make more addresses taken
+    int added = 1;
+    while (added) {
+        added = 0;
+
+        for (size_t index = 0; index < size; index++) {
+
+            if (Optimizer_isAddress(command_array, index) == 0) {
+                continue;
+            }
+
+            // Follow the loaded value until it is overwritten, jumped to or read
+            int use = USE_TAKEN;
+            for (size_t next = index + 1; next < size && (flags[next] & OPTIMIZER_LEADER) == 0; next++) {
+
+                uint16_t word = words[next];
+
+                if (Optimizer_isAddress(command_array, next)) {
+                    use = USE_NONE;
+                    break;
+                }
+                // comp reads A itself, not M
+                if ((OPTIMIZER_COMP(word) & (0x40 | OPTIMIZER_COMP_ZY)) == 0) {
+                    break;
+                }
+                if (OPTIMIZER_JUMP(word) != 0) {
+                    use = USE_JUMP;
+                    break;
+                }
+                if ((OPTIMIZER_DEST(word) & OPTIMIZER_DEST_A) != 0) {
+                    use = USE_NONE;
+                    break;
+                }
+            }
+
+            uint32_t id = symbol_ids[index];
+            int label = (id != COMMAND_NO_SYMBOL && addresses[id] != COMMAND_UNASSIGNED);
+
+            // Variables and predefined symbols are data, but a jump to one can't be followed
+            if (use == USE_NONE || (id != COMMAND_NO_SYMBOL && label == 0)) {
+                if (use == USE_JUMP) {
+                    return 1;
+                }
+                continue;
+            }
+
+            size_t target = (label) ? (size_t) addresses[id] : words[index];
+            if (target >= size) {
+                *exit_taken |= (use == USE_TAKEN);
+                continue;
+            }
+
+            if ((flags[target] & OPTIMIZER_LEADER) == 0) {
+                flags[target] |= OPTIMIZER_LEADER;
+                added = 1;
+            }
+            if (use == USE_TAKEN) {
+                flags[target] |= OPTIMIZER_TAKEN;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* Split the program into the basic blocks flagged by Optimizer_markBlocks and link them.
+ * The target of a jump is the A instruction before it in its block, without one
+ * the jump is computed. block_of gets the block of every instruction
+ * Return the number of blocks */
+static uint32_t Optimizer_buildBlocks(const CommandArray* command_array, const uint8_t* flags,
+                                      OptimizerBlock* blocks, uint32_t* block_of)
+{
+    const uint16_t* words = command_array->words;
+    const uint32_t* symbol_ids = command_array->symbol_ids;
+    const int* addresses = command_array->addresses;
+    size_t size = command_array->size;
+
+    uint32_t count = 0;
+    for (size_t index = 0; index < size; index++) {
+
+        if ((flags[index] & OPTIMIZER_LEADER) != 0) {
+            if (count > 0) {
+                blocks[count - 1].end = (uint32_t) index;
+            }
+            blocks[count].start = (uint32_t) index;
+            blocks[count].taken = (flags[index] & OPTIMIZER_TAKEN) != 0;
+            count += 1;
+        }
+
+        block_of[index] = count - 1;
+    }
+    if (count > 0) {
+        blocks[count - 1].end = (uint32_t) size;
+    }
+
+    for (uint32_t block = 0; block < count; block++) {
+
+        OptimizerBlock* current = &blocks[block];
+        uint32_t last = current->end - 1;
+
+        current->fall = (block + 1 < count) ? block + 1 : OPTIMIZER_EXIT;
+        current->target = OPTIMIZER_NO_BLOCK;
+
+        if (Optimizer_isAddress(command_array, last) || OPTIMIZER_JUMP(words[last]) == 0) {
+            continue;
+        }
+
+        // JMP never falls through
+        if (OPTIMIZER_JUMP(words[last]) == 0x7) {
+            current->fall = OPTIMIZER_NO_BLOCK;
+        }
+
+        current->target = OPTIMIZER_COMPUTED;
+        for (uint32_t index = last; index > current->start; index--) {
+
+            if (Optimizer_isAddress(command_array, index - 1)) {
+                uint32_t id = symbol_ids[index - 1];
+                size_t target = (id != COMMAND_NO_SYMBOL) ? (size_t) addresses[id] : words[index - 1];
+
+                current->target = (target < size) ? block_of[target] : OPTIMIZER_EXIT;
+                break;
+            }
+
+            if ((OPTIMIZER_DEST(words[index - 1]) & OPTIMIZER_DEST_A) != 0) {
+                break;
+            }
+        }
+    }
+
+    return count;
+}
+
+/* Merge the registers from into those at the start of a block, a register
+ * stays known only if every path agrees on it
+ * Return 1 if into changed, 0 otherwise */
+static int Optimizer_meet(OptimizerRegisters* into, const OptimizerRegisters* from)
+{
+    if (into->reached == 0) {
+        *into = *from;
+        return 1;
+    }
+
+    int changed = 0;
+
+    if (into->a.known && Optimizer_sameValue(into->a, from->a) == 0) {
+        into->a = OPTIMIZER_UNKNOWN;
+        changed = 1;
+    }
+    if (into->d.known && Optimizer_sameValue(into->d, from->d) == 0) {
+        into->d = OPTIMIZER_UNKNOWN;
+        changed = 1;
+    }
+
+    return changed;
+}
+
+/* Find the registers at the start of every block reached from the entry,
+ * until no block changes. The computed jumps are merged once and go to every taken block */
+static void Optimizer_forward(const CommandArray* command_array, OptimizerBlock* blocks, uint32_t count)
+{
+    for (uint32_t block = 0; block < count; block++) {
+        blocks[block].in.reached = 0;
+    }
+
+    blocks[0].in.a = OPTIMIZER_UNKNOWN;
+    blocks[0].in.d = OPTIMIZER_UNKNOWN;
+    blocks[0].in.reached = 1;
+
+    OptimizerRegisters computed;
+    computed.reached = 0;
+
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+
+        for (uint32_t block = 0; block < count; block++) {
+
+            if (blocks[block].in.reached == 0) {
+                continue;
+            }
+
+            OptimizerRegisters out = blocks[block].in;
+            for (uint32_t index = blocks[block].start; index < blocks[block].end; index++) {
+                Optimizer_execute(command_array, index, &out.a, &out.d);
+            }
+
+            if (blocks[block].fall < count) {
+                changed |= Optimizer_meet(&blocks[blocks[block].fall].in, &out);
+            }
+            if (blocks[block].target < count) {
+                changed |= Optimizer_meet(&blocks[blocks[block].target].in, &out);
+            }
+            else if (blocks[block].target == OPTIMIZER_COMPUTED) {
+                changed |= Optimizer_meet(&computed, &out);
+            }
+        }
+
+        for (uint32_t block = 0; block < count && computed.reached; block++) {
+            if (blocks[block].taken) {
+                changed |= Optimizer_meet(&blocks[block].in, &computed);
+            }
+        }
+    }
+}
+
+/* Drop every @X where A already holds X and every C instruction that only
+ * writes A or D with the value it already holds, in the blocks reached
+ * Return the number of instructions removed */
+static size_t Optimizer_dropReloads(const CommandArray* command_array, uint8_t* flags,
+                                    const OptimizerBlock* blocks, uint32_t count)
+{
+    const uint16_t* words = command_array->words;
+    size_t changes = 0;
+
+    for (uint32_t block = 0; block < count; block++) {
+
+        if (blocks[block].in.reached == 0) {
+            continue;
+        }
+
+        OptimizerValue a = blocks[block].in.a;
+        OptimizerValue d = blocks[block].in.d;
+
+        for (uint32_t index = blocks[block].start; index < blocks[block].end; index++) {
+
+            int removable = 0;
+
+            if (Optimizer_isAddress(command_array, index)) {
+                removable = Optimizer_sameValue(a, Optimizer_loadValue(command_array, index)) &&
+                            (flags[index] & OPTIMIZER_FIRST_USE) == 0 &&
+                            Optimizer_isHalt(command_array, index) == 0;
+            }
+            else {
+                uint16_t word = words[index];
+                unsigned dest = OPTIMIZER_DEST(word);
+                OptimizerValue result = Optimizer_evaluate(word, d, a);
+
+                removable = OPTIMIZER_JUMP(word) == 0 && dest != 0 &&
+                            (dest & OPTIMIZER_DEST_M) == 0 &&
+                            ((dest & OPTIMIZER_DEST_A) == 0 || Optimizer_sameValue(a, result)) &&
+                            ((dest & OPTIMIZER_DEST_D) == 0 || Optimizer_sameValue(d, result));
+            }
+
+            // The registers are the same either way
+            if (removable) {
+                flags[index] |= OPTIMIZER_REMOVED;
+                changes += 1;
+                continue;
+            }
+
+            Optimizer_execute(command_array, index, &a, &d);
+        }
+    }
+
+    return changes;
+}
+
+/* Return the registers live at the end of block. Leaving the program keeps both */
+static inline uint8_t Optimizer_liveOut(const OptimizerBlock* blocks, uint32_t count, uint32_t block, uint8_t taken_live)
+{
+    uint32_t edges[2] = { blocks[block].fall, blocks[block].target };
+    uint8_t live = 0;
+
+    for (int edge = 0; edge < 2; edge++) {
+        if (edges[edge] < count) {
+            live |= blocks[edges[edge]].live_in;
+        }
+        else if (edges[edge] == OPTIMIZER_EXIT) {
+            live |= OPTIMIZER_LIVE_A | OPTIMIZER_LIVE_D;
+        }
+        else if (edges[edge] == OPTIMIZER_COMPUTED) {
+            live |= taken_live;
+        }
+    }
+
+    return live;
+}
+
+/* Return the registers live at the start of any taken block, a computed jump may go there */
+static uint8_t Optimizer_takenLive(const OptimizerBlock* blocks, uint32_t count, uint8_t exit_taken)
+{
+    uint8_t live = (exit_taken) ? (OPTIMIZER_LIVE_A | OPTIMIZER_LIVE_D) : 0;
+
+    for (uint32_t block = 0; block < count; block++) {
+        if (blocks[block].taken) {
+            live |= blocks[block].live_in;
+        }
+    }
+
+    return live;
+}
+
+/* Find the registers live at the start of every block, until no block changes */
+static void Optimizer_backward(const CommandArray* command_array, OptimizerBlock* blocks, uint32_t count, uint8_t exit_taken)
+{
+    for (uint32_t block = 0; block < count; block++) {
+        blocks[block].live_in = 0;
+    }
+
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+
+        uint8_t taken_live = Optimizer_takenLive(blocks, count, exit_taken);
+
+        for (uint32_t block = count; block-- > 0;) {
+
+            uint8_t live = Optimizer_liveOut(blocks, count, block, taken_live);
+            for (uint32_t index = blocks[block].end; index-- > blocks[block].start;) {
+                live = Optimizer_liveBefore(command_array, index, live);
+            }
+
+            if (live != blocks[block].live_in) {
+                blocks[block].live_in = live;
+                changed = 1;
+            }
+        }
+    }
+}
+
+/* Drop the writes to A and D that are overwritten before they are read,
+ * a C instruction left without destination or jump is removed
+ * Return the number of instructions removed or rewritten */
+static size_t Optimizer_dropDeadWrites(CommandArray* command_array, uint8_t* flags,
+                                       const OptimizerBlock* blocks, uint32_t count, uint8_t exit_taken)
+{
+    uint16_t* words = command_array->words;
+    uint8_t taken_live = Optimizer_takenLive(blocks, count, exit_taken);
+    size_t changes = 0;
+
+    for (uint32_t block = 0; block < count; block++) {
+
+        uint8_t live = Optimizer_liveOut(blocks, count, block, taken_live);
+
+        for (uint32_t index = blocks[block].end; index-- > blocks[block].start;) {
+
+            if (Optimizer_isAddress(command_array, index)) {
+                if ((live & OPTIMIZER_LIVE_A) == 0 && (flags[index] & OPTIMIZER_FIRST_USE) == 0) {
+                    flags[index] |= OPTIMIZER_REMOVED;
+                    changes += 1;
+                    continue;
+                }
+            }
+            else {
+                unsigned dest = OPTIMIZER_DEST(words[index]);
+                unsigned dead = 0;
+
+                if ((dest & OPTIMIZER_DEST_A) != 0 && (live & OPTIMIZER_LIVE_A) == 0) {
+                    dead |= OPTIMIZER_DEST_A;
+                }
+                if ((dest & OPTIMIZER_DEST_D) != 0 && (live & OPTIMIZER_LIVE_D) == 0) {
+                    dead |= OPTIMIZER_DEST_D;
+                }
+
+                if (dead != 0 && (dest & ~dead) == 0 && OPTIMIZER_JUMP(words[index]) == 0) {
+                    flags[index] |= OPTIMIZER_REMOVED;
+                    changes += 1;
+                    continue;
+                }
+                if (dead != 0) {
+                    words[index] &= (uint16_t) ~(dead << 3);
+                    changes += 1;
+                }
+            }
+
+            live = Optimizer_liveBefore(command_array, index, live);
+        }
+    }
+
+    return changes;
+}
+
+/* Rewrite the parsed program with peephole rules until none matches:
+ * jumps to the next instruction, no-ops like D=D, writes to A that are
+ * loaded again right away, and loads of the value A already holds.
+ * Nothing is done if a jump may go to a constant address. The labels, and the debug info when it isn't NULL, follow the instructions,
+ * the number of instructions removed is stored in removed
+ * Return 0 on success
+ * Return -1 on failure, errno will be set */
+extern int Optimizer_peephole(CommandArray* command_array, DebugInfo* debug, size_t* removed)
+{
+    if (command_array == NULL ||
+        removed == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *removed = 0;
+
+    size_t size = command_array->size;
+    if (size == 0) {
+        return 0;
+    }
+
+    // One more for the labels at the end of the program
+    uint8_t* flags = malloc(size + 1);
+    uint32_t* new_addresses = malloc((size + 1) * sizeof(uint32_t));
+    uint8_t* seen = malloc(command_array->symbols.count + 1);
+    if (flags == NULL || new_addresses == NULL || seen == NULL) {
+        free(flags);
+        free(new_addresses);
+        free(seen);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    // A rewrite can make a new window match, stop once a pass changes nothing
+    size_t changes = 1;
+    while (changes > 0) {
+
+        Optimizer_markInstructions(command_array, flags, seen);
+        if (Optimizer_jumpsToConstant(command_array, flags)) {
+            break;
+        }
+
+        changes = Optimizer_peepholePass(command_array, flags);
+
+        size_t dropped = Optimizer_compact(command_array, flags, new_addresses);
+        if (dropped > 0 && debug != NULL &&
+            DebugInfo_remap(debug, new_addresses) < 0) {
+            free(flags);
+            free(new_addresses);
+            free(seen);
+            return -1;
+        }
+
+        *removed += dropped;
+    }
+
+    free(flags);
+    free(new_addresses);
+    free(seen);
+
+    // Done :)
+    return 0;
+}
+
+/* Optimize the parsed program across basic blocks until nothing changes.
+ * A forward pass tracks the constant or symbol in A and D at every instruction
+ * and drops the loads of values already held, a backward pass drops the writes
+ * to registers that are never read. Nothing is done if a jump goes to a
+ * variable, a predefined symbol or a constant. The labels, and the debug info when it isn't
+ * NULL, follow the instructions, the number of instructions removed is stored in removed
+ * Return 0 on success
+ * Return -1 on failure, errno will be set */
+extern int Optimizer_dataflow(CommandArray* command_array, DebugInfo* debug, size_t* removed)
+{
+    if (command_array == NULL ||
+        removed == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *removed = 0;
+
+    size_t size = command_array->size;
+    if (size == 0) {
+        return 0;
+    }
+
+    // Block indexes and addresses are 32 bits
+    if (size >= OPTIMIZER_COMPUTED) {
+        errno = EFBIG;
+        return -1;
+    }
+
+    uint8_t* flags = malloc(size + 1);
+    uint32_t* new_addresses = malloc((size + 1) * sizeof(uint32_t));
+    uint8_t* seen = malloc(command_array->symbols.count + 1);
+    OptimizerBlock* blocks = malloc(size * sizeof(OptimizerBlock));
+    uint32_t* block_of = malloc(size * sizeof(uint32_t));
+    if (flags == NULL || new_addresses == NULL || seen == NULL || blocks == NULL || block_of == NULL) {
+        free(flags);
+        free(new_addresses);
+        free(seen);
+        free(blocks);
+        free(block_of);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    int error = 0;
+
+    // Dropping a dead write can make a load redundant and the other way around
+    size_t changes = 1;
+    while (changes > 0 && error == 0) {
+        changes = 0;
+
+        for (int backward = 0; backward < 2 && command_array->size > 0; backward++) {
+
+            uint8_t exit_taken = 0;
+            Optimizer_markInstructions(command_array, flags, seen);
+            if (Optimizer_markBlocks(command_array, flags, &exit_taken) != 0) {
+                changes = 0;
+                break;
+            }
+
+            uint32_t count = Optimizer_buildBlocks(command_array, flags, blocks, block_of);
+
+            if (backward) {
+                Optimizer_backward(command_array, blocks, count, exit_taken);
+                changes += Optimizer_dropDeadWrites(command_array, flags, blocks, count, exit_taken);
+            }
+            else {
+                Optimizer_forward(command_array, blocks, count);
+                changes += Optimizer_dropReloads(command_array, flags, blocks, count);
+            }
+
+            size_t dropped = Optimizer_compact(command_array, flags, new_addresses);
+            if (dropped > 0 && debug != NULL &&
+                DebugInfo_remap(debug, new_addresses) < 0) {
+                error = -1;
+                break;
+            }
+
+            *removed += dropped;
+        }
+    }
+
+    free(flags);
+    free(new_addresses);
+    free(seen);
+    free(blocks);
+    free(block_of);
+
+    // Done :)
+    return error;
+}
@@ -0,0 +1,77 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "util.h"
+#include "debug.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* This module shrinks a parsed program before its symbols are resolved.
+ * The instructions are rewritten in place in the command array, then the
+ * labels, and the source lines of the debug info when given, are moved to
+ * the address their instruction ends up at. A constant can't be moved, so a
+ * program jumping to one, like @8 0;JMP, is left as it is, and so is one with
+ * a computed jump that could land on a constant inside the program.
+ *
+ * The dataflow optimizer splits the program into basic blocks at the labels
+ * and after the jumps. A jump whose target isn't loaded in its own block, like
+ * the return of a VM function, is assumed to land on a label whose address is
+ * used as data somewhere, a taken label. A program jumping straight to a
+ * variable, a predefined symbol or a constant is left as it is, like the one
+ * where a computed jump could go to a constant used as data */
+
+/* How hard a program is optimized */
+enum OptimizerLevel {
+    OPTIMIZER_NONE,
+    OPTIMIZER_PEEPHOLE,         // Rewrite short runs of adjacent instructions
+    OPTIMIZER_DATAFLOW          // Also track A and D across basic blocks
+};
+
+/* Most instructions a peephole rule looks at */
+#define OPTIMIZER_WINDOW    4
+
+/* Edges of a basic block that aren't another block */
+#define OPTIMIZER_NO_BLOCK  UINT32_MAX          // No such edge
+#define OPTIMIZER_EXIT      (UINT32_MAX - 1)    // Leaves the program
+#define OPTIMIZER_COMPUTED  (UINT32_MAX - 2)    // Any taken label
+
+/* Registers in the liveness sets */
+#define OPTIMIZER_LIVE_A    0x1
+#define OPTIMIZER_LIVE_D    0x2
+
+/* What a register is known to hold, a constant or the address of a symbol plus an offset */
+struct StructOptimizerValue {
+    uint32_t symbol;            // COMMAND_NO_SYMBOL for a constant
+    uint16_t offset;            // The constant itself, or added to the symbol
+    uint8_t  known;             // 0 when the value could be anything
+};
+
+typedef struct StructOptimizerValue OptimizerValue;
+
+/* The registers at the start of a basic block */
+struct StructOptimizerRegisters {
+    OptimizerValue a;
+    OptimizerValue d;
+    uint8_t        reached;     // 0 until a path from the entry gets to the block
+};
+
+typedef struct StructOptimizerRegisters OptimizerRegisters;
+
+/* A run of instructions only entered at its first and left after its last */
+struct StructOptimizerBlock {
+    uint32_t start;             // First instruction
+    uint32_t end;               // Past the last instruction
+    uint32_t fall;              // Block run after the last instruction when it doesn't jump
+    uint32_t target;            // Block jumped to, OPTIMIZER_COMPUTED or OPTIMIZER_NO_BLOCK
+    uint8_t  taken;             // Starts at a taken label, a computed jump may land on it
+    uint8_t  live_in;           // Registers read before they are written, OPTIMIZER_LIVE_A...
+    OptimizerRegisters in;
+};
+
+typedef struct StructOptimizerBlock OptimizerBlock;
+
+extern int Optimizer_peephole (CommandArray*, DebugInfo*, size_t*);
+extern int Optimizer_dataflow (CommandArray*, DebugInfo*, size_t*);
+
+#endif
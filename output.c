@@ -0,0 +1,458 @@
+#include "output.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+#ifndef __SSE2__
+/* ASCII expansion of every byte value, 8 '0'/'1' characters most significant bit
+ * first, packed into a uint64_t so that storing it writes them in order */
+#define ASCII_BIT(b, n)     ((uint64_t) ('0' + (((b) >> (7 - (n))) & 1)))
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define ASCII_SHIFT(n)      (8 * (7 - (n)))
+#else
+#define ASCII_SHIFT(n)      (8 * (n))
+#endif
+
+#define ASCII_BYTE(b)       (ASCII_BIT(b, 0) << ASCII_SHIFT(0) | ASCII_BIT(b, 1) << ASCII_SHIFT(1) | \
+                             ASCII_BIT(b, 2) << ASCII_SHIFT(2) | ASCII_BIT(b, 3) << ASCII_SHIFT(3) | \
+                             ASCII_BIT(b, 4) << ASCII_SHIFT(4) | ASCII_BIT(b, 5) << ASCII_SHIFT(5) | \
+                             ASCII_BIT(b, 6) << ASCII_SHIFT(6) | ASCII_BIT(b, 7) << ASCII_SHIFT(7))
+
+#define ASCII_BYTES_4(n)    ASCII_BYTE(n), ASCII_BYTE(n + 1), ASCII_BYTE(n + 2), ASCII_BYTE(n + 3)
+#define ASCII_BYTES_16(n)   ASCII_BYTES_4(n), ASCII_BYTES_4(n + 4), ASCII_BYTES_4(n + 8), ASCII_BYTES_4(n + 12)
+#define ASCII_BYTES_64(n)   ASCII_BYTES_16(n), ASCII_BYTES_16(n + 16), ASCII_BYTES_16(n + 32), ASCII_BYTES_16(n + 48)
+
+static const uint64_t ASCII_BYTE_TABLE[256] =
+{
+    ASCII_BYTES_64(0), ASCII_BYTES_64(64), ASCII_BYTES_64(128), ASCII_BYTES_64(192)
+};
+#endif
+
+
+/* Expand a word into its 16 '0'/'1' characters followed by a newline
+ * out must have room for 17 characters */
+static inline void Output_expandWord(uint16_t word, char* out)
+{
+#ifdef __SSE2__
+    // Spread the high byte over lanes 0-7 and the low byte over lanes 8-15,
+    // isolate the bit each lane is responsible for and turn it into '0' or '1'
+    const __m128i bit_masks = _mm_set_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char) 0x80,
+                                           0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char) 0x80);
+
+    __m128i bytes = _mm_set_epi64x((int64_t) ((word & 0xff) * 0x0101010101010101ULL),
+                                   (int64_t) ((word >> 8) * 0x0101010101010101ULL));
+    __m128i set = _mm_cmpeq_epi8(_mm_and_si128(bytes, bit_masks), bit_masks);
+
+    // set lanes are -1, so subtracting them turns '0' into '1'
+    _mm_storeu_si128((__m128i*) out, _mm_sub_epi8(_mm_set1_epi8('0'), set));
+#else
+    memcpy(out, &ASCII_BYTE_TABLE[word >> 8], 8);
+    memcpy(out + 8, &ASCII_BYTE_TABLE[word & 0xff], 8);
+#endif
+
+    out[16] = '\n';
+}
+
+/* Number of bytes a single word takes in the given format */
+extern size_t Output_wordSize(const OutputOptions* options)
+{
+    return (options->format == OUTPUT_TEXT) ? 17 : 2;
+}
+
+/* Store a 16 bit value in the given byte order */
+static void Output_storeOrdered16(enum OutputByteOrder byte_order, char* out, uint16_t value)
+{
+    if (byte_order == OUTPUT_BIG_ENDIAN) {
+        out[0] = (char) (value >> 8);
+        out[1] = (char) (value & 0xff);
+    }
+    else {
+        out[0] = (char) (value & 0xff);
+        out[1] = (char) (value >> 8);
+    }
+}
+
+/* Store a 16 bit value in the configured byte order */
+static void Output_store16(const Output* output, char* out, uint16_t value)
+{
+    Output_storeOrdered16(output->options.byte_order, out, value);
+}
+
+/* Store a 32 bit value in the configured byte order */
+static void Output_store32(const Output* output, char* out, uint32_t value)
+{
+    if (output->options.byte_order == OUTPUT_BIG_ENDIAN) {
+        Output_store16(output, out, (uint16_t) (value >> 16));
+        Output_store16(output, out + 2, (uint16_t) (value & 0xffff));
+    }
+    else {
+        Output_store16(output, out, (uint16_t) (value & 0xffff));
+        Output_store16(output, out + 2, (uint16_t) (value >> 16));
+    }
+}
+
+
+/* Fill options with the defaults, text output */
+extern void Output_defaultOptions(OutputOptions* options)
+{
+    if (options != NULL) {
+        options->format = OUTPUT_TEXT;
+        options->byte_order = OUTPUT_LITTLE_ENDIAN;
+        options->header = 0;
+    }
+}
+
+/* Create an output writing to file with the given options
+ * file stays owned by the caller
+ * Return 0 on success
+ * Return -1 on failure, set errno */
+extern int Output_create(Output* output, FILE* file, const OutputOptions* options)
+{
+    if (output != NULL &&
+        file != NULL &&
+        options != NULL) {
+
+        output->file = file;
+        output->options = *options;
+        output->header_size = 0;
+        output->word_count = 0;
+        output->flushed_bytes = 0;
+        output->buffer_used = 0;
+
+        // Patching already flushed words needs to seek, pipes can't
+        output->start_offset = ftell(file);
+
+        // A file opened for appending writes every patch at its end
+        int flags = fcntl(fileno(file), F_GETFL);
+        if (flags >= 0 && (flags & O_APPEND) != 0) {
+            output->start_offset = -1;
+        }
+
+        return 0;
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/* Write the binary header announcing word_count words
+ * Does nothing for text output or if the header is disabled
+ * Return 0 on success
+ * Return -1 on failure, set errno */
+extern int Output_writeHeader(Output* output, size_t word_count)
+{
+    if (output != NULL &&
+        word_count <= UINT32_MAX) {
+
+        if (output->options.format != OUTPUT_BINARY ||
+            output->options.header == 0) {
+            return 0;
+        }
+
+        if (OUTPUT_BUFFER_SIZE - output->buffer_used < OUTPUT_HEADER_SIZE &&
+            Output_flush(output) < 0) {
+            return -1;
+        }
+
+        char* header = &output->buffer[output->buffer_used];
+        uint16_t flags = (output->options.byte_order == OUTPUT_BIG_ENDIAN) ? OUTPUT_HEADER_BIG_ENDIAN : 0;
+
+        memcpy(header, OUTPUT_HEADER_MAGIC, 4);
+        Output_store16(output, header + 4, OUTPUT_HEADER_VERSION);
+        Output_store16(output, header + 6, flags);
+        Output_store32(output, header + 8, (uint32_t) word_count);
+
+        output->buffer_used += OUTPUT_HEADER_SIZE;
+        output->header_size = OUTPUT_HEADER_SIZE;
+
+        return 0;
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/* Write one instruction word in the configured format
+ * Return 0 on success
+ * Return -1 on failure, set errno */
+extern int Output_writeWord(Output* output, uint16_t word)
+{
+    if (output != NULL) {
+
+        // Make room for the word
+        if (OUTPUT_BUFFER_SIZE - output->buffer_used < Output_wordSize(&output->options) &&
+            Output_flush(output) < 0) {
+            return -1;
+        }
+
+        char* out = &output->buffer[output->buffer_used];
+
+        if (output->options.format == OUTPUT_TEXT) {
+            Output_expandWord(word, out);
+        }
+        else {
+            Output_store16(output, out, word);
+        }
+
+        output->buffer_used += Output_wordSize(&output->options);
+        output->word_count += 1;
+
+        return 0;
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/* Format count words with the given options into out, without a header
+ * out must have room for count * Output_wordSize(options) bytes
+ * Return the number of bytes written to out */
+extern size_t Output_formatWords(const OutputOptions* options, const uint16_t* words, size_t count, char* out)
+{
+    const size_t word_size = Output_wordSize(options);
+
+    if (options->format == OUTPUT_TEXT) {
+        for (size_t index = 0; index < count; index++) {
+            Output_expandWord(words[index], out + index * word_size);
+        }
+    }
+    else {
+        for (size_t index = 0; index < count; index++) {
+            Output_storeOrdered16(options->byte_order, out + index * word_size, words[index]);
+        }
+    }
+
+    return count * word_size;
+}
+
+/* Write word_count words already formatted with Output_formatWords,
+ * bytes is the length of formatted
+ * Return 0 on success
+ * Return -1 on failure, set errno */
+extern int Output_writeFormatted(Output* output, const char* formatted, size_t bytes, size_t word_count)
+{
+    if (output != NULL &&
+        (formatted != NULL || bytes == 0)) {
+
+        // Small writes go through the buffer, large ones straight to the file
+        if (bytes <= OUTPUT_BUFFER_SIZE - output->buffer_used) {
+            memcpy(&output->buffer[output->buffer_used], formatted, bytes);
+            output->buffer_used += bytes;
+        }
+
+        else {
+            if (Output_flush(output) < 0) {
+                return -1;
+            }
+
+            size_t bytes_written = fwrite(formatted, sizeof(char), bytes, output->file);
+            output->flushed_bytes += bytes_written;
+
+            if (bytes_written != bytes) {
+                return -1;
+            }
+        }
+
+        output->word_count += word_count;
+
+        return 0;
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/* Write count instruction words in the configured format
+ * The words are expanded straight into the output buffer a block at a time
+ * Return 0 on success
+ * Return -1 on failure, set errno */
+extern int Output_writeWords(Output* output, const uint16_t* words, size_t count)
+{
+    if (output != NULL &&
+        (words != NULL || count == 0)) {
+
+        const size_t word_size = Output_wordSize(&output->options);
+
+        while (count > 0) {
+
+            // Fill as much of the buffer as possible
+            size_t block = (OUTPUT_BUFFER_SIZE - output->buffer_used) / word_size;
+
+            if (block == 0) {
+                if (Output_flush(output) < 0) {
+                    return -1;
+                }
+                continue;
+            }
+
+            if (block > count) {
+                block = count;
+            }
+
+            Output_formatWords(&output->options, words, block, &output->buffer[output->buffer_used]);
+
+            output->buffer_used += block * word_size;
+            output->word_count += block;
+            words += block;
+            count -= block;
+        }
+
+        return 0;
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/* Overwrite length bytes at position of the output, counted from its start
+ * The bytes are patched in the buffer if they haven't been flushed yet,
+ * otherwise the file is sought to, which fails with ESPIPE on a pipe
+ * Return 0 on success
+ * Return -1 on failure, set errno */
+static int Output_patchBytes(Output* output, size_t position, const char* bytes, size_t length)
+{
+    // Still in the buffer
+    if (position >= output->flushed_bytes) {
+        memcpy(&output->buffer[position - output->flushed_bytes], bytes, length);
+        return 0;
+    }
+
+    if (output->start_offset < 0) {
+        errno = ESPIPE;
+        return -1;
+    }
+
+    // Rewrite the bytes in the file and return to its end
+    if (fseek(output->file, output->start_offset + (long) position, SEEK_SET) != 0 ||
+        fwrite(bytes, sizeof(char), length, output->file) != length ||
+        fseek(output->file, output->start_offset + (long) output->flushed_bytes, SEEK_SET) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Replace an already written word, index counts the words from the first one
+ * Return 0 on success
+ * Return -1 on failure, set errno */
+extern int Output_patchWord(Output* output, size_t index, uint16_t word)
+{
+    if (output != NULL &&
+        index < output->word_count) {
+
+        char bytes[17];
+        const size_t word_size = Output_wordSize(&output->options);
+
+        if (output->options.format == OUTPUT_TEXT) {
+            Output_expandWord(word, &bytes[0]);
+        }
+        else {
+            Output_store16(output, &bytes[0], word);
+        }
+
+        return Output_patchBytes(output, output->header_size + index * word_size, &bytes[0], word_size);
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/* Replace the word count of an already written header
+ * Does nothing if no header was written
+ * Return 0 on success
+ * Return -1 on failure, set errno */
+extern int Output_patchHeader(Output* output, size_t word_count)
+{
+    if (output != NULL &&
+        word_count <= UINT32_MAX) {
+
+        if (output->header_size == 0) {
+            return 0;
+        }
+
+        char count[4];
+        Output_store32(output, &count[0], (uint32_t) word_count);
+
+        // The count is the last field of the header
+        return Output_patchBytes(output, OUTPUT_HEADER_SIZE - 4, &count[0], 4);
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/* Write the buffered bytes to the file
+ * Return 0 on success
+ * Return -1 on failure, set errno */
+extern int Output_flush(Output* output)
+{
+    if (output != NULL) {
+
+        size_t bytes_written = fwrite(&output->buffer[0], sizeof(char), output->buffer_used, output->file);
+
+        output->flushed_bytes += bytes_written;
+
+        // not enough bytes were written
+        if (bytes_written != output->buffer_used) {
+            output->buffer_used = 0;
+            return -1;
+        }
+
+        output->buffer_used = 0;
+
+        return 0;
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/* Make the default output path, the input path with
+ * its .asm extension replaced by .hack
+ * Return the newly allocated path on success
+ * Return NULL on failure, errno will be set */
+extern char* Output_makePath(const char* input_path)
+{
+    size_t length = strlen(input_path);
+
+    // Drop the .asm extension
+    if (length >= 4 && strcmp(&input_path[length - 4], ".asm") == 0) {
+        length -= 4;
+    }
+
+    char* output_path = malloc(length + sizeof(".hack"));
+    if (output_path == NULL) {
+        return NULL;
+    }
+
+    memcpy(output_path, input_path, length);
+    strcpy(&output_path[length], ".hack");
+
+    return output_path;
+}
@@ -0,0 +1,72 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* This module writes assembled instruction words to the output file */
+
+/* Output formats */
+enum OutputFormat {
+    OUTPUT_TEXT,        // 16 '0'/'1' characters and a newline per word, the .hack format
+    OUTPUT_BINARY       // Packed 16 bit words
+};
+
+/* Byte order of the words and header fields in binary output */
+enum OutputByteOrder {
+    OUTPUT_LITTLE_ENDIAN,
+    OUTPUT_BIG_ENDIAN
+};
+
+/* Binary output header, all fields are in the byte order of the words
+ *
+ * offset  size  field
+ * 0       4     magic "HACK"
+ * 4       2     version, OUTPUT_HEADER_VERSION
+ * 6       2     flags, OUTPUT_HEADER_BIG_ENDIAN if the words are big endian
+ * 8       4     number of words that follow
+ */
+#define OUTPUT_HEADER_MAGIC         "HACK"
+#define OUTPUT_HEADER_VERSION       1
+#define OUTPUT_HEADER_BIG_ENDIAN    0x1
+#define OUTPUT_HEADER_SIZE          12
+
+struct StructOutputOptions {
+    enum OutputFormat    format;
+    enum OutputByteOrder byte_order;   // Only used by OUTPUT_BINARY
+    int                  header;       // 1 to write the header, only used by OUTPUT_BINARY
+};
+
+typedef struct StructOutputOptions OutputOptions;
+
+#define OUTPUT_BUFFER_SIZE  (64 * 1024)
+
+struct StructOutput {
+    FILE*         file;
+    OutputOptions options;
+    long          start_offset;    // File offset the output started at, -1 if the file can't seek or appends
+    size_t        header_size;     // Bytes of header written before the first word
+    size_t        word_count;      // Words written so far
+    size_t        flushed_bytes;   // Bytes handed to the file so far
+    size_t        buffer_used;
+    char          buffer[OUTPUT_BUFFER_SIZE];
+};
+
+typedef struct StructOutput Output;
+
+extern void   Output_defaultOptions (OutputOptions*);
+extern int    Output_create         (Output*, FILE*, const OutputOptions*);
+extern int    Output_writeHeader    (Output*, size_t);
+extern int    Output_writeWord      (Output*, uint16_t);
+extern int    Output_writeWords     (Output*, const uint16_t*, size_t);
+extern size_t Output_wordSize       (const OutputOptions*);
+extern size_t Output_formatWords    (const OutputOptions*, const uint16_t*, size_t, char*);
+extern int    Output_writeFormatted (Output*, const char*, size_t, size_t);
+extern int    Output_patchWord      (Output*, size_t, uint16_t);
+extern int    Output_patchHeader    (Output*, size_t);
+extern int    Output_flush          (Output*);
+
+extern char*  Output_makePath       (const char*);
+
+#endif
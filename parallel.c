@@ -0,0 +1,460 @@
+#include "parallel.h"
+#include "parser.h"
+#include "util.h"
+#include "arena.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* A label defined in a chunk, at an address relative to the chunk */
+struct StructChunkLabel {
+    StringView name;            // View into the source
+    size_t     local_address;
+    size_t     local_line;      // Line of the label in the chunk, counting from 1
+};
+
+/* State of one chunk, every phase works on its chunks independently */
+struct StructChunk {
+    const char* source;
+    size_t      length;
+
+    Arena        arena;
+    CommandArray commands;      // Encoded instructions of the chunk
+
+    struct StructChunkLabel* labels;
+    size_t label_count;
+    size_t label_capacity;
+
+    uint32_t* unresolved;       // IDs of the symbols that aren't labels, in order of first use
+    size_t    unresolved_count;
+    size_t    line_count;               // Lines of the chunk, for statistics
+    size_t    reference_count;          // Distinct symbols looked up in phase 2
+
+    size_t base_address;        // Address of the first instruction of the chunk
+
+    const SymbolTable*   symbol_table; // Only read by the chunk threads
+    const OutputOptions* output_options;
+    char*                formatted;    // Chunk output formatted by Output_formatWords
+    size_t               formatted_size;
+
+    int         error;          // -1 if the phase failed
+    int         error_number;
+    const char* error_message;
+    size_t      error_line;     // Line of the failure in the chunk, 0 if not tied to a line
+};
+
+typedef void* (*ChunkPhase)(void*);
+
+
+/* Record a failure of a chunk phase at line of the chunk, 0 if it isn't tied to a line */
+static void* Parallel_fail(struct StructChunk* chunk, size_t line, const char* message)
+{
+    chunk->error = -1;
+    chunk->error_number = errno;
+    chunk->error_message = message;
+    chunk->error_line = line;
+    return NULL;
+}
+
+/* Return the line of source that is line of chunk, 0 stays 0.
+ * The lines before the chunk are only counted for an error */
+static size_t Parallel_sourceLine(const char* source, const struct StructChunk* chunk, size_t line)
+{
+    if (line == 0) {
+        return 0;
+    }
+
+    const char* end = chunk->source;
+    for (const char* newline = memchr(source, '\n', (size_t) (end - source));
+         newline != NULL;
+         newline = memchr(newline + 1, '\n', (size_t) (end - newline - 1))) {
+        line += 1;
+    }
+
+    return line;
+}
+
+/* Append a label on line of the chunk
+ * Return 0 on success
+ * Return -1 on failure, set errno */
+static int Parallel_addLabel(struct StructChunk* chunk, StringView name, size_t line)
+{
+    if (chunk->label_count == chunk->label_capacity) {
+
+        size_t new_capacity = (chunk->label_capacity > 0) ? chunk->label_capacity * 2 : 64;
+
+        errno = 0;
+        struct StructChunkLabel* new_labels = reallocarray(chunk->labels, new_capacity, sizeof(struct StructChunkLabel));
+        if (errno != 0) {
+            return -1;
+        }
+
+        chunk->labels = new_labels;
+        chunk->label_capacity = new_capacity;
+    }
+
+    chunk->labels[chunk->label_count].name = name;
+    chunk->labels[chunk->label_count].local_address = chunk->commands.size;
+    chunk->labels[chunk->label_count].local_line = line;
+    chunk->label_count += 1;
+
+    return 0;
+}
+
+/* Phase 1, parse the chunk into encoded instructions and chunk local labels */
+static void* Parallel_parseChunk(void* argument)
+{
+    struct StructChunk* chunk = argument;
+
+    Parser parser;
+    Parser_createFromBuffer(&parser, chunk->source, chunk->length);
+
+    while (Parser_hasMoreCommands(&parser)) {
+
+        int error = Parser_advance(&parser);
+
+        if (error < 0) {
+            Parser_free(&parser);
+            return Parallel_fail(chunk, Parser_lineNumber(&parser), "Failed to parse instruction");
+        }
+
+        // no new command read
+        else if (error == 1) {
+            break;
+        }
+
+        if (Parser_commandType(&parser) == L_COMMAND) {
+            error = Parallel_addLabel(chunk, Parser_symbolView(&parser), Parser_lineNumber(&parser));
+            if (error < 0) {
+                Parser_free(&parser);
+                return Parallel_fail(chunk, Parser_lineNumber(&parser), "Failed to add entry to symbol table");
+            }
+        }
+
+        else {
+            error = CommandArray_copyCommand(&chunk->commands, &parser);
+            if (error < 0) {
+                Parser_free(&parser);
+                return Parallel_fail(chunk, Parser_lineNumber(&parser), "Failed to copy command");
+            }
+        }
+    }
+
+    chunk->line_count = Parser_lineNumber(&parser);
+    Parser_free(&parser);
+
+    return NULL;
+}
+
+/* Phase 2, resolve the symbols that are labels or predefined, once per distinct symbol.
+ * The symbol table is only read, the others are variables and are collected */
+static void* Parallel_resolveLabels(void* argument)
+{
+    struct StructChunk* chunk = argument;
+    const Interner* symbols = &chunk->commands.symbols;
+    int* addresses = chunk->commands.addresses;
+
+    chunk->unresolved = malloc((symbols->count + 1) * sizeof(uint32_t));
+    if (chunk->unresolved == NULL) {
+        return Parallel_fail(chunk, 0, "Failed to allocate the unresolved references");
+    }
+
+    // The IDs count up in order of first use in the chunk
+    for (size_t id = 0; id < symbols->count; id++) {
+
+        StringView symbol = symbols->names[id];
+        int symbol_address = SymbolTable_readAddressN(chunk->symbol_table, symbol.data, symbol.length);
+        chunk->reference_count += 1;
+
+        if (symbol_address >= 0) {
+            addresses[id] = symbol_address;
+        }
+
+        else if (errno == 0) {
+            chunk->unresolved[chunk->unresolved_count] = (uint32_t) id;
+            chunk->unresolved_count += 1;
+        }
+
+        else {
+            return Parallel_fail(chunk, 0, "Failed generate A instruction");
+        }
+    }
+
+    return NULL;
+}
+
+/* Phase 3, format the resolved words of the chunk */
+static void* Parallel_formatChunk(void* argument)
+{
+    struct StructChunk* chunk = argument;
+    CommandArray* commands = &chunk->commands;
+
+    // Every symbol has an address by now, substitute them
+    for (size_t index = 0; index < commands->size; index++) {
+        if (commands->symbol_ids[index] != COMMAND_NO_SYMBOL) {
+            commands->words[index] = (uint16_t) commands->addresses[commands->symbol_ids[index]];
+        }
+    }
+
+    chunk->formatted = malloc(chunk->commands.size * Output_wordSize(chunk->output_options) + 1);
+    if (chunk->formatted == NULL) {
+        return Parallel_fail(chunk, 0, "Failed to allocate the output");
+    }
+
+    chunk->formatted_size = Output_formatWords(chunk->output_options,
+                                               chunk->commands.words,
+                                               chunk->commands.size,
+                                               chunk->formatted);
+
+    return NULL;
+}
+
+/* Run phase on every chunk, one thread per chunk, the first chunk on the calling thread
+ * Return 0 if every chunk succeeded
+ * Return -1 otherwise, errno, error_message and error_line describe the first failed chunk */
+static int Parallel_runPhase(const char* source, struct StructChunk* chunks, int chunk_count, ChunkPhase phase,
+                             const char** error_message, size_t* error_line)
+{
+    pthread_t threads[PARALLEL_MAX_THREADS];
+    int started[PARALLEL_MAX_THREADS];
+
+    for (int index = 1; index < chunk_count; index++) {
+        started[index] = (pthread_create(&threads[index], NULL, phase, &chunks[index]) == 0);
+
+        // Couldn't start a thread, do the work here instead
+        if (started[index] == 0) {
+            phase(&chunks[index]);
+        }
+    }
+
+    phase(&chunks[0]);
+
+    for (int index = 1; index < chunk_count; index++) {
+        if (started[index] != 0) {
+            pthread_join(threads[index], NULL);
+        }
+    }
+
+    // Report the first failure in source order
+    for (int index = 0; index < chunk_count; index++) {
+        if (chunks[index].error < 0) {
+            *error_message = chunks[index].error_message;
+            *error_line = Parallel_sourceLine(source, &chunks[index], chunks[index].error_line);
+            errno = chunks[index].error_number;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Free everything owned by the chunks */
+static void Parallel_freeChunks(struct StructChunk* chunks, int chunk_count)
+{
+    for (int index = 0; index < chunk_count; index++) {
+        CommandArray_free(&chunks[index].commands);
+        Arena_free(&chunks[index].arena);
+        free(chunks[index].labels);
+        free(chunks[index].unresolved);
+        free(chunks[index].formatted);
+    }
+}
+
+
+/* Assemble the length bytes at source on up to thread_count threads
+ * and write the program to output. symbol_table must only hold the predefined
+ * symbols, labels and variables are added to it.
+ * stats may be NULL, the phases are timed on the calling thread
+ * Return 0 on success
+ * Return -1 on failure, errno and error_message will be set, error_line
+ * to the line of the source that failed or 0 if it isn't tied to a line */
+extern int Parallel_assemble(const char* source,
+                             size_t length,
+                             int thread_count,
+                             SymbolTable* symbol_table,
+                             Output* output,
+                             Stats* stats,
+                             const char** error_message,
+                             size_t* error_line)
+{
+    if ((source == NULL && length > 0) ||
+        thread_count < 1 ||
+        symbol_table == NULL ||
+        output == NULL ||
+        error_message == NULL ||
+        error_line == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *error_line = 0;
+
+    if (thread_count > PARALLEL_MAX_THREADS) {
+        thread_count = PARALLEL_MAX_THREADS;
+    }
+
+    struct StructChunk chunks[PARALLEL_MAX_THREADS];
+    int chunk_count = 0;
+
+    // Split the source at line boundaries into chunks of about the same size
+    size_t chunk_start = 0;
+    for (int index = 0; index < thread_count && (chunk_start < length || index == 0); index++) {
+
+        size_t chunk_end = length;
+
+        if (index < thread_count - 1) {
+            size_t target = chunk_start + (length - chunk_start) / (size_t) (thread_count - index);
+            const char* newline = (target < length) ? memchr(source + target, '\n', length - target) : NULL;
+
+            chunk_end = (newline != NULL) ? (size_t) (newline - source) + 1 : length;
+        }
+
+        struct StructChunk* chunk = &chunks[index];
+        memset(chunk, 0, sizeof(struct StructChunk));
+
+        chunk->source = source + chunk_start;
+        chunk->length = chunk_end - chunk_start;
+        chunk->symbol_table = symbol_table;
+        chunk->output_options = &output->options;
+
+        Arena_create(&chunk->arena, 64 * 1024);
+        if (CommandArray_create(&chunk->commands, 128, &chunk->arena) < 0) {
+            Parallel_freeChunks(chunks, chunk_count);
+            *error_message = "Failed to create the command array";
+            return -1;
+        }
+
+        chunk_count += 1;
+        chunk_start = chunk_end;
+    }
+
+    // Phase 1, parse every chunk
+    Stats_begin(stats);
+    if (Parallel_runPhase(source, chunks, chunk_count, Parallel_parseChunk, error_message, error_line) < 0) {
+        Parallel_freeChunks(chunks, chunk_count);
+        return -1;
+    }
+    Stats_end(stats, STATS_PARSE);
+
+    Stats_begin(stats);
+
+    // Rebase the chunk labels with a prefix sum over the chunk sizes
+    // and merge them into the symbol table in source order
+    size_t base_address = 0;
+    for (int index = 0; index < chunk_count; index++) {
+
+        struct StructChunk* chunk = &chunks[index];
+        chunk->base_address = base_address;
+
+        for (size_t label = 0; label < chunk->label_count; label++) {
+
+            StringView name = chunk->labels[label].name;
+
+            // Defined already or a predefined symbol
+            int defined = SymbolTable_containsN(symbol_table, name.data, name.length);
+            if (defined != 0) {
+                if (defined > 0) {
+                    errno = EEXIST;
+                }
+                *error_message = "Duplicate or invalid symbol found";
+                *error_line = Parallel_sourceLine(source, chunk, chunk->labels[label].local_line);
+                Parallel_freeChunks(chunks, chunk_count);
+                return -1;
+            }
+
+            if (SymbolTable_addEntryN(symbol_table, name.data, name.length,
+                                      (int) (base_address + chunk->labels[label].local_address)) < 0) {
+                *error_message = "Failed to add entry to symbol table";
+                *error_line = Parallel_sourceLine(source, chunk, chunk->labels[label].local_line);
+                Parallel_freeChunks(chunks, chunk_count);
+                return -1;
+            }
+        }
+
+        base_address += chunk->commands.size;
+
+        if (stats != NULL) {
+            stats->lines += chunk->line_count;
+            stats->labels += chunk->label_count;
+        }
+    }
+
+    // Phase 2, resolve labels and predefined symbols
+    if (Parallel_runPhase(source, chunks, chunk_count, Parallel_resolveLabels, error_message, error_line) < 0) {
+        Parallel_freeChunks(chunks, chunk_count);
+        return -1;
+    }
+
+    // Allocate the variables in order of first use in the whole program,
+    // a variable may already have been allocated by an earlier chunk
+    int next_variable_address = 16;
+    for (int index = 0; index < chunk_count; index++) {
+
+        struct StructChunk* chunk = &chunks[index];
+
+        for (size_t reference = 0; reference < chunk->unresolved_count; reference++) {
+
+            uint32_t id = chunk->unresolved[reference];
+            StringView symbol = chunk->commands.symbols.names[id];
+
+            int symbol_address = SymbolTable_getAddressN(symbol_table, symbol.data, symbol.length);
+
+            // First use of the variable
+            if (symbol_address < 0 && errno == 0) {
+                if (SymbolTable_addEntryN(symbol_table, symbol.data, symbol.length, next_variable_address) < 0) {
+                    Parallel_freeChunks(chunks, chunk_count);
+                    *error_message = "Failed to create variable";
+                    return -1;
+                }
+
+                symbol_address = next_variable_address;
+                next_variable_address += 1;
+
+                if (stats != NULL) {
+                    stats->variables += 1;
+                }
+            }
+
+            else if (symbol_address < 0) {
+                Parallel_freeChunks(chunks, chunk_count);
+                *error_message = "Failed generate A instruction";
+                return -1;
+            }
+
+            chunk->commands.addresses[id] = symbol_address;
+        }
+
+        if (stats != NULL) {
+            // The shared table counts its own lookups, except the ones of phase 2
+            stats->symbol_lookups += chunk->reference_count + chunk->commands.symbols.lookups;
+        }
+    }
+    Stats_end(stats, STATS_RESOLVE);
+
+    // Phase 3, format the output of every chunk
+    Stats_begin(stats);
+    if (Parallel_runPhase(source, chunks, chunk_count, Parallel_formatChunk, error_message, error_line) < 0) {
+        Parallel_freeChunks(chunks, chunk_count);
+        return -1;
+    }
+
+    // Write the chunks in source order
+    int error = Output_writeHeader(output, base_address);
+    for (int index = 0; index < chunk_count && error == 0; index++) {
+        error = Output_writeFormatted(output, chunks[index].formatted, chunks[index].formatted_size, chunks[index].commands.size);
+    }
+
+    Stats_end(stats, STATS_WRITE);
+
+    if (error < 0) {
+        *error_message = "Failed to write to output file";
+    }
+
+    Parallel_freeChunks(chunks, chunk_count);
+
+    return error;
+}
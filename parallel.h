@@ -0,0 +1,29 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "symbol.h"
+#include "output.h"
+#include "stats.h"
+
+#include <stddef.h>
+
+/* This module assembles a single source buffer on several threads.
+ * The source is split into chunks at line boundaries, every chunk is parsed
+ * on its own thread with chunk local label addresses, the label addresses are
+ * rebased with a prefix sum over the chunk sizes and merged into the symbol table.
+ * Variables are allocated in order of first use in the whole program, so the
+ * output is byte identical to the sequential assembler */
+
+/* Most threads a single assembly will use */
+#define PARALLEL_MAX_THREADS    64
+
+extern int Parallel_assemble(const char* source,
+                             size_t length,
+                             int thread_count,
+                             SymbolTable* symbol_table,
+                             Output* output,
+                             Stats* stats,
+                             const char** error_message,
+                             size_t* error_line);
+
+#endif
@@ -1,62 +1,240 @@
 #include "parser.h"
 #include "util.h"
+#include "lexer.h"
+#include "code.h"
 #include <stdio.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 
 
 
-/* Free any allocated pointers in the ParsedCommand structure */
-extern void ParsedCommand_free(struct ParsedCommand* parsed_command)
+/* Reset the views of the current command */
+static void Parser_clearViews(Parser* parser)
 {
+    static const StringView empty_view = { NULL, 0 };
 
-    if (parsed_command != NULL) {
+    parser->symbol_view = empty_view;
+    parser->destination_view = empty_view;
+    parser->computation_view = empty_view;
+    parser->jump_view = empty_view;
+}
+
+/* Mark the parser as not streamed */
+static void Parser_clearStream(Parser* parser)
+{
+    parser->stream_fd = -1;
+    parser->stream_eof = 0;
+    parser->stream_buffer = NULL;
+    parser->stream_capacity = 0;
+    parser->stream_length = 0;
+    parser->stream_wait = NULL;
+    parser->stream_wait_context = NULL;
+}
 
-        if (parsed_command->symbol != NULL) {
-            free(parsed_command->symbol);
-            parsed_command->symbol = NULL;
+/* Read fd to its end into a buffer that grows to fit, for a pipe or a
+ * device whose size isn't known up front. The buffer is stored in buffer_out
+ * and its length in length_out, the caller frees it
+ * Return 0 on success
+ * Return -1 on failure and set errno
+ */
+static int Parser_readAll(int fd, char** buffer_out, size_t* length_out)
+{
+    size_t capacity = PARSER_STREAM_BUFFER_SIZE;
+    size_t length = 0;
+    char* buffer = malloc(capacity);
+    if (buffer == NULL) {
+        return -1;
+    }
+
+    while (1) {
+        if (length == capacity) {
+            char* new_buffer = realloc(buffer, capacity * 2);
+            if (new_buffer == NULL) {
+                free(buffer);
+                return -1;
+            }
+            buffer = new_buffer;
+            capacity *= 2;
         }
 
-        if (parsed_command->destination != NULL) {
-            free(parsed_command->destination);
-            parsed_command->destination = NULL;
+        ssize_t bytes_read = read(fd, buffer + length, capacity - length);
+        if (bytes_read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_read < 0) {
+            int saved_errno = errno;
+            free(buffer);
+            errno = saved_errno;
+            return -1;
         }
+        if (bytes_read == 0) {
+            break;
+        }
+
+        length += (size_t) bytes_read;
+    }
 
-        if (parsed_command->computation != NULL) {
-            free(parsed_command->computation);
-            parsed_command->computation = NULL;
+    *buffer_out = buffer;
+    *length_out = length;
+
+    return 0;
+}
+
+/* Creates a parser that reads the file at path through a memory mapping.
+ * Anything but a regular file, like a FIFO or <(cmd), has no size to map
+ * and is read to its end into a buffer instead, a directory is EINVAL.
+ * Commands are not copied, use the Parser_*View getters to read them,
+ * the views stay valid until the parser is freed.
+ * Whitespace around each field of a command is ignored, there is no limit
+ * on the length of a line.
+ * Return 0 on success
+ * Return -1 on failure and set errno
+ */
+extern int Parser_createFromPath(Parser* parser, const char* path)
+{
+    if (parser != NULL &&
+        path   != NULL) {
+
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            return -1;
+        }
+
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) < 0) {
+            close(fd);
+            return -1;
+        }
+
+        if (S_ISDIR(file_stat.st_mode)) {
+            close(fd);
+            errno = EINVAL;
+            return -1;
         }
 
-        if (parsed_command->jump != NULL) {
-            free(parsed_command->jump);
-            parsed_command->jump = NULL;
+        // Parsed like a mapping of the buffer, which Parser_free frees
+        if (S_ISREG(file_stat.st_mode) == 0) {
+            char* buffer = NULL;
+            size_t length = 0;
+            int error = Parser_readAll(fd, &buffer, &length);
+
+            int saved_errno = errno;
+            close(fd);
+            errno = saved_errno;
+
+            if (error < 0) {
+                return -1;
+            }
+
+            Parser_createFromBuffer(parser, buffer, length);
+            parser->stream_buffer = buffer;
+            parser->stream_capacity = length;
+            parser->stream_length = length;
+            parser->stream_eof = 1;
+
+            return 0;
         }
 
-        parsed_command->type = NONE_COMMAND;
+        const char* source = NULL;
+        size_t length = (size_t) file_stat.st_size;
+
+        // An empty file can't be mapped, it simply has no commands
+        if (length > 0) {
+            void* mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (mapping == MAP_FAILED) {
+                close(fd);
+                return -1;
+            }
+
+            // The file is read front to back
+            madvise(mapping, length, MADV_SEQUENTIAL);
+            source = mapping;
+        }
+
+        // The mapping keeps the file alive
+        close(fd);
+
+        Parser_createFromBuffer(parser, source, length);
+
+        // Unmapped by Parser_free
+        parser->mapped_owned = 1;
+
+        return 0;
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
     }
 }
 
+/* Creates a parser that reads the length bytes at source, which must outlive
+ * the parser. It behaves like a memory mapped parser, commands are handed out
+ * as views into source
+ * Return 0 on success
+ * Return -1 on failure and set errno
+ */
+extern int Parser_createFromBuffer(Parser* parser, const char* source, size_t length)
+{
+    if (parser != NULL &&
+        (source != NULL || length == 0)) {
+
+        parser->command_type = NONE_COMMAND;
+        parser->mapped = 1;
+        parser->mapped_owned = 0;
+        parser->mapped_source = source;
+        parser->mapped_length = length;
+        parser->mapped_position = 0;
+        parser->line_number = 0;
+        parser->newline_count = 0;
+        parser->word = 0;
+        parser->needs_symbol = 0;
+        Parser_clearStream(parser);
+        Parser_clearViews(parser);
 
+        return 0;
+    }
 
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
 
-/* Creates a parser structure
- * Expects the given parser to be unitialized & not NULL
- * Return 0 on success, parser will also be allocated
+/* Creates a parser that reads the file descriptor fd as it goes, for stdin or a pipe.
+ * The input is read into a buffer of PARSER_STREAM_BUFFER_SIZE bytes that is refilled
+ * once its complete lines are parsed, it only grows to fit a longer line, so memory
+ * doesn't depend on the length of the input. fd stays owned by the caller.
+ * Commands are views into the buffer like a memory mapped parser,
+ * but they are only valid until the next call to Parser_advance
+ * Return 0 on success
  * Return -1 on failure and set errno
  */
-extern int Parser_create(Parser* parser, FILE* file)
+extern int Parser_createFromStream(Parser* parser, int fd)
 {
     if (parser != NULL &&
-        file   != NULL) {
-        
-        parser->source_file = file;
-        parser->current_command.symbol = NULL;
-        parser->current_command.destination = NULL;
-        parser->current_command.computation = NULL;
-        parser->current_command.jump = NULL;
-        parser->current_command.type = NONE_COMMAND;
+        fd >= 0) {
+
+        // Nothing is read yet, the parser starts out like an empty mapping
+        Parser_createFromBuffer(parser, NULL, 0);
+
+        char* buffer = NULL;
+        buffer = malloc(PARSER_STREAM_BUFFER_SIZE);
+        if (buffer == NULL) {
+            return -1;
+        }
+
+        parser->mapped_source = buffer;
+        parser->stream_fd = fd;
+        parser->stream_buffer = buffer;
+        parser->stream_capacity = PARSER_STREAM_BUFFER_SIZE;
 
         return 0;
     }
@@ -67,19 +245,37 @@ extern int Parser_create(Parser* parser, FILE* file)
     }
 }
 
+/* Have wait called with context every time a streamed parser
+ * is about to block reading more input, to flush what is ready */
+extern void Parser_setStreamWait(Parser* parser, void (*wait)(void*), void* context)
+{
+    if (parser != NULL) {
+        parser->stream_wait = wait;
+        parser->stream_wait_context = context;
+    }
+}
+
 /* Free any memory allocated within the parser structure
- * and close the file */
+ * and close or unmap the file */
 extern void Parser_free(Parser* parser)
 {
-    if (parser != NULL && parser->source_file != NULL) {
+    if (parser != NULL && parser->mapped == 1) {
 
-        // close the file
-        fclose(parser->source_file);
-        parser->source_file = NULL;
+        // unmap the file, buffers belong to the caller
+        if (parser->mapped_owned == 1 && parser->mapped_source != NULL) {
+            munmap((void*) parser->mapped_source, parser->mapped_length);
+        }
 
-        // free any remaining memory in the ParsedCommand structure
+        // The stream buffer is the parser's own, the descriptor is the caller's
+        free(parser->stream_buffer);
+        Parser_clearStream(parser);
 
-        ParsedCommand_free(&parser->current_command);
+        parser->mapped = 0;
+        parser->mapped_owned = 0;
+        parser->mapped_source = NULL;
+        parser->mapped_length = 0;
+        parser->mapped_position = 0;
+        Parser_clearViews(parser);
     }
 }
 
@@ -90,13 +286,17 @@ extern int Parser_hasMoreCommands(Parser* parser)
 {
     if (parser != NULL) {
 
-        if (feof(parser->source_file) == 0) {
-            return 1;
-        }
+        if (parser->mapped == 1) {
+            // A stream has more until its end is read
+            if (parser->stream_fd >= 0 && parser->stream_eof == 0) {
+                return 1;
+            }
 
-        else {
-            return 0;
+            return (parser->mapped_position < parser->mapped_length) ? 1 : 0;
         }
+
+        // Freed
+        return 0;
     }
 
     else {
@@ -106,126 +306,144 @@ extern int Parser_hasMoreCommands(Parser* parser)
 }
 
 
-/* Internal function used to the heavy lifting of Parsing
- * Expects the given command to be trimmed and parser->current_command.type
- * to be assigned a valid value. Will disect the command into its various
- * fields and store them in the parser->current_command structure, note it will override the current values.
- * Pointers are dynamically allocated and freed as needed.
+/* Encode the current command into its machine word, a symbolic
+ * A command is left for the symbol table and gets the word 0
  * Return 0 on success
- * Return -1 on failure, errno will be set */
-static int Parser_parseCommand(Parser* parser, char* command)
+ * Return -1 on an invalid C command or a constant that doesn't fit, errno will be set */
+static int Parser_encodeCommand(Parser* parser)
 {
-    if (parser != NULL &&
-        command != NULL) {
+    parser->word = 0;
+    parser->needs_symbol = 0;
 
-        // Free the current parsed command to avoid leaks
-        ParsedCommand_free(&parser->current_command);
+    if (parser->command_type == A_COMMAND) {
 
-        // Determine the command type
-        parser->current_command.type = findCommandType(command);
+        int is_constant = parseAConstant(Parser_symbolView(parser), &parser->word);
+        if (is_constant < 0) {
+            return -1;
+        }
 
-        if (parser->current_command.type == A_COMMAND) {
+        parser->needs_symbol = (is_constant == 0) ? 1 : 0;
+    }
 
-           char* token = strtok(command, "@");
+    else if (parser->command_type == C_COMMAND) {
+        return encodeCInstructionView(Parser_destView(parser),
+                                      Parser_compView(parser),
+                                      Parser_jumpView(parser),
+                                      &parser->word);
+    }
 
-           // occurs if it command is malformed
-           if (token == NULL) {
-               errno = EINVAL;
-               return -1;
-           }
+    return 0;
+}
 
-           // copy the string into the datastructure
-           parser->current_command.symbol = strdup(token);
-           if (parser->current_command.symbol == NULL) {
-               return -1;
-           }
-        }
+/* Memory mapped counterpart of Parser_advance
+ * lexes the next command into views without copying it
+ * Return 0 = read a new command
+ * Return 1 = end of the mapping reached and no new command read
+ * Return -1 = Error, errno will be set */
+static int Parser_advanceMapped(Parser* parser)
+{
+    LexedCommand command;
+    int error = Lexer_next(parser->mapped_source, parser->mapped_length,
+                           &parser->mapped_position, &parser->newline_count, &command);
+
+    parser->line_number = command.line;
+    parser->command_type = command.type;
+    parser->symbol_view = command.symbol;
+    parser->destination_view = command.destination;
+    parser->computation_view = command.computation;
+    parser->jump_view = command.jump;
+
+    if (error == 0 && Parser_encodeCommand(parser) < 0) {
+        return -1;
+    }
 
-        else if (parser->current_command.type == C_COMMAND) {
+    return error;
+}
 
-            // Normal C command
-            char* c_dest_token = strtok(command, "=");
-            char* c_comp_token = strtok(NULL, "=");
+/* Read more of the input of a streamed parser.
+ * The unparsed tail, a partial line, is moved to the front of the buffer,
+ * which is doubled if it holds nothing else
+ * Return 0 = read more input or reached its end
+ * Return -1 = Error, errno will be set */
+static int Parser_fillStream(Parser* parser)
+{
+    size_t tail = parser->stream_length - parser->mapped_position;
 
-            // Jump C command
-            char* j_comp_token = strtok(command, ";");
-            char* j_jump_token = strtok(NULL, ";");
+    memmove(parser->stream_buffer, parser->stream_buffer + parser->mapped_position, tail);
+    parser->stream_length = tail;
+    parser->mapped_position = 0;
+    parser->mapped_length = 0;
 
+    // A line longer than the buffer
+    if (parser->stream_length == parser->stream_capacity) {
 
+        size_t new_capacity = parser->stream_capacity * 2;
+        char* new_buffer = realloc(parser->stream_buffer, new_capacity);
 
-            // Both cant be fufilled so its an error
-            if ((c_dest_token != NULL && c_comp_token != NULL) &&
-                (j_comp_token != NULL && j_jump_token != NULL)) {
-                errno = EINVAL;
-                return -1;
-            }
+        if (new_buffer == NULL) {
+            return -1;
+        }
 
-            // Normal C command
-            else if (c_dest_token != NULL && c_comp_token != NULL) {
+        parser->stream_buffer = new_buffer;
+        parser->stream_capacity = new_capacity;
+    }
 
-                // copy the tokens
-                parser->current_command.destination = strdup(c_dest_token);
-                parser->current_command.computation = strdup(c_comp_token);
+    parser->mapped_source = parser->stream_buffer;
 
-                // check for allocation errors, we dont care if we leave an allocated pointer
-                // because the main structure will be freed upon error, thus freeing it anyway
-                if (parser->current_command.destination == NULL ||
-                    parser->current_command.computation == NULL) {
-                    return -1;
-                }
-            }
+    if (parser->stream_wait != NULL) {
+        parser->stream_wait(parser->stream_wait_context);
+    }
 
-            // Jump C command
-            else if (j_comp_token != NULL && j_jump_token != NULL) {
+    ssize_t bytes_read = 0;
+    do {
+        bytes_read = read(parser->stream_fd,
+                          parser->stream_buffer + parser->stream_length,
+                          parser->stream_capacity - parser->stream_length);
+    } while (bytes_read < 0 && errno == EINTR);
 
-                // copy the tokens
-                parser->current_command.computation = strdup(j_comp_token);
-                parser->current_command.jump        = strdup(j_jump_token);
+    if (bytes_read < 0) {
+        return -1;
+    }
 
-                if (parser->current_command.computation == NULL ||
-                    parser->current_command.jump == NULL) {
-                    return -1;
-                }
-            }
+    // End of the input, the last line may have no newline
+    if (bytes_read == 0) {
+        parser->stream_eof = 1;
+        parser->mapped_length = parser->stream_length;
+        return 0;
+    }
 
-            // Malformed command
-            else {
-                errno = EINVAL;
-                return -1;
-        }
+    size_t old_length = parser->stream_length;
+    parser->stream_length += (size_t) bytes_read;
 
+    // Parse up to the last complete line, only the new bytes can hold it
+    for (size_t index = parser->stream_length; index > old_length; index--) {
+        if (parser->stream_buffer[index - 1] == '\n') {
+            parser->mapped_length = index;
+            break;
         }
+    }
 
-        // L Command
-        else if (parser->current_command.type == L_COMMAND) {
-
-            char* symbol_token = strtok(command, "()");
+    return 0;
+}
 
-            if (symbol_token == NULL) {
-                return -1;
-            }
+/* Streamed counterpart of Parser_advance, parses the complete lines
+ * in the buffer and reads more input when they hold no command
+ * Return 0 = read a new command
+ * Return 1 = end of the input reached and no new command read
+ * Return -1 = Error, errno will be set */
+static int Parser_advanceStream(Parser* parser)
+{
+    while (1) {
 
-            parser->current_command.symbol = strdup(symbol_token);
+        int error = Parser_advanceMapped(parser);
 
-            if (parser->current_command.symbol == NULL) {
-                return -1;
-            }
+        if (error != 1 || parser->stream_eof == 1) {
+            return error;
         }
 
-        // non valid command
-        else {
-            errno = EINVAL;
+        if (Parser_fillStream(parser) < 0) {
             return -1;
         }
-
-        // Success :)
-        return 0;
-
-    }
-
-    else {
-        errno = EINVAL;
-        return -1;
     }
 }
 
@@ -237,74 +455,12 @@ static int Parser_parseCommand(Parser* parser, char* command)
  */
 extern int Parser_advance(Parser* parser) 
 {
-    if (parser != NULL) {
-        /* Read line from the file
-         * If EOF is reached return 1
-         *
-         * if not EOF
-         * Trim whitespace
-         *
-         * If string was empty after trimming 
-         * read a new line ( step 0 )
-         *
-         * If string was not empty
-         * parse it into respective fields
-         *
-         */
-
-        size_t buffer_size = 129; // Hopefully there are no lines over 128 charaters 0_0
-        char* buffer = calloc(buffer_size, sizeof(char));
-
-        if (buffer == NULL) {
-            return -1;
-        }
-
-        while(1) {
-
-            if (fgets(buffer, buffer_size - 1, parser->source_file) == NULL) {
-
-                // Error occured while reading file
-                if (feof(parser->source_file) == 0) {
-                    free(buffer);
-                    return -1;
-                }
-
-                // Eof
-                else {
-                    free(buffer);
-                    return 1;
-                }
-            }
-
-            char* trimmed_command = strtrim(buffer);
-            if (trimmed_command == NULL) {
-                free(buffer);
-                return -1;
-            }
-            else if (trimmed_command[0] == '\0') {
-                free(trimmed_command);
-            }
-
-            // valid command
-            else {
-                free(buffer);
-                buffer = trimmed_command;
-                break;
-            }
-        }
-
-        // Parse the command
-        if (Parser_parseCommand(parser, buffer) < 0) {
-
-            free(buffer); // Not a double free
-            return -1;
-        }
-
-        free(buffer);
-
-        // Success
-        return 0;
+    if (parser != NULL && parser->mapped == 1 && parser->stream_fd >= 0) {
+        return Parser_advanceStream(parser);
+    }
 
+    else if (parser != NULL && parser->mapped == 1) {
+        return Parser_advanceMapped(parser);
     }
 
     else {
@@ -318,7 +474,7 @@ extern int Parser_advance(Parser* parser)
 extern enum Command Parser_commandType(Parser* parser)
 {
     if (parser != NULL) {
-        return parser->current_command.type;
+        return parser->command_type;
     }
 
     else {
@@ -327,62 +483,57 @@ extern enum Command Parser_commandType(Parser* parser)
     }
 }
 
-
-
-/* Getter functions for the various fields of the current command
- * Return NULL and set errno if the requested field isn't filled
+/* View getter functions for the various fields of the current command
+ * Return a view with data == NULL if the requested field isn't filled
  * or if parser is NULL */
-extern const char* Parser_symbol(Parser* parser)
+extern StringView Parser_symbolView(Parser* parser)
 {
-    if (parser != NULL &&
-        parser->current_command.symbol != NULL) {
-
-        return parser->current_command.symbol;
-    }
+    static const StringView empty_view = { NULL, 0 };
 
-    else {
-        errno = EINVAL;
-        return NULL;
-    }
+    return (parser != NULL) ? parser->symbol_view : empty_view;
 }
 
-extern const char* Parser_dest(Parser* parser)
+extern StringView Parser_destView(Parser* parser)
 {
-    if (parser != NULL &&
-        parser->current_command.destination != NULL) {
-
-        return parser->current_command.destination;
-    }
+    static const StringView empty_view = { NULL, 0 };
 
-    else {
-        errno = EINVAL;
-        return NULL;
-    }
+    return (parser != NULL) ? parser->destination_view : empty_view;
 }
-extern const char* Parser_comp(Parser* parser)
+
+extern StringView Parser_compView(Parser* parser)
 {
-    if (parser != NULL &&
-        parser->current_command.computation != NULL) {
+    static const StringView empty_view = { NULL, 0 };
 
-        return parser->current_command.computation;
-    }
+    return (parser != NULL) ? parser->computation_view : empty_view;
+}
 
-    else {
-        errno = EINVAL;
-        return NULL;
-    }
+extern StringView Parser_jumpView(Parser* parser)
+{
+    static const StringView empty_view = { NULL, 0 };
+
+    return (parser != NULL) ? parser->jump_view : empty_view;
 }
 
-extern const char* Parser_jump(Parser* parser)
+/* Return the machine word of the current command, encoded while parsing
+ * It is final unless Parser_needsSymbol returns 1
+ * Return 0 if parser is NULL */
+extern uint16_t Parser_word(Parser* parser)
 {
-    if (parser != NULL &&
-        parser->current_command.jump != NULL) {
+    return (parser != NULL) ? parser->word : 0;
+}
 
-        return parser->current_command.jump;
-    }
+/* Return 1 if the current command is an A command whose symbol
+ * must be looked up to complete its word
+ * Return 0 otherwise or if parser is NULL */
+extern int Parser_needsSymbol(Parser* parser)
+{
+    return (parser != NULL) ? parser->needs_symbol : 0;
+}
 
-    else {
-        errno = EINVAL;
-        return NULL;
-    }
+/* Return the line of the current command, counting from 1
+ * After a failed Parser_advance it is the line that failed
+ * Return 0 if no line was read yet or parser is NULL */
+extern size_t Parser_lineNumber(Parser* parser)
+{
+    return (parser != NULL) ? parser->line_number : 0;
 }
@@ -1,10 +1,14 @@
 #ifndef PARSER_H
 #define PARSER_H
 
-#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
 
 /* Parser header */
 
+/* Initial size of the buffer of a streamed parser, it only grows to fit a longer line */
+#define PARSER_STREAM_BUFFER_SIZE   (64 * 1024)
+
 /* command type enum */
 
 enum Command {
@@ -14,34 +18,68 @@ enum Command {
     NONE_COMMAND
 };
 
-struct ParsedCommand {
-    char* symbol;
-    char* destination;
-    char* computation;
-    char* jump;
-    enum Command type;
+/* A pointer and length into a string, it is not null terminated */
+struct StructStringView {
+    const char* data;   // NULL if the view is empty
+    size_t      length;
 };
 
-typedef struct ParsedCommand ParsedCommand;
-
-extern void ParsedCommand_free(struct ParsedCommand*);
+typedef struct StructStringView StringView;
 
 struct ParserStruct {
-    FILE* source_file;
-    struct ParsedCommand current_command;
+    enum Command command_type;     // Type of the current command
+    size_t       line_number;      // Line of the current command, counting from 1
+    size_t       newline_count;    // Newlines the lexer passed
+
+    /* Memory mapped mode, used when created with Parser_createFromPath or Parser_createFromBuffer.
+     * Commands are handed out as views into the mapping instead of copies */
+    int         mapped;            // 1 until the parser is freed
+    int         mapped_owned;      // 1 if the mapping is unmapped by Parser_free
+    const char* mapped_source;
+    size_t      mapped_length;
+    size_t      mapped_position;
+
+    /* Streamed mode, used when created with Parser_createFromStream.
+     * The input is read into stream_buffer, which is parsed like a mapping up to
+     * its last complete line, mapped is also 1. Parser_createFromPath reads a
+     * file that can't be mapped, like a FIFO, whole into stream_buffer, stream_fd stays -1 */
+    int         stream_fd;         // -1 unless streamed
+    int         stream_eof;        // 1 once read returned the end of the input
+    char*       stream_buffer;
+    size_t      stream_capacity;
+    size_t      stream_length;     // Bytes read into the buffer, mapped_length stops at the last newline
+    void      (*stream_wait)(void*);   // Called before blocking on more input, may be NULL
+    void*       stream_wait_context;
+
+    StringView  symbol_view;
+    StringView  destination_view;
+    StringView  computation_view;
+    StringView  jump_view;
+
+    /* Machine word of the current command, encoded as it is parsed.
+     * Final for C commands and constant A commands, only symbolic A commands
+     * wait for the symbol table */
+    uint16_t    word;
+    int         needs_symbol;      // 1 if the current command is an A command with a symbol
 };
 
 typedef struct ParserStruct Parser;
 
-extern int             Parser_create(Parser*, FILE*);
+extern int             Parser_createFromPath(Parser*, const char*);
+extern int             Parser_createFromBuffer(Parser*, const char*, size_t);
+extern int             Parser_createFromStream(Parser*, int);
+extern void            Parser_setStreamWait(Parser*, void (*)(void*), void*);
 extern void            Parser_free(Parser*);
 extern int             Parser_hasMoreCommands(Parser*); 
 extern int             Parser_advance(Parser*);
 extern enum Command    Parser_commandType(Parser*);
-extern const char*     Parser_symbol(Parser*);
-extern const char*     Parser_dest(Parser*);
-extern const char*     Parser_comp(Parser*);
-extern const char*     Parser_jump(Parser*);
+extern StringView      Parser_symbolView(Parser*);
+extern StringView      Parser_destView(Parser*);
+extern StringView      Parser_compView(Parser*);
+extern StringView      Parser_jumpView(Parser*);
+extern size_t          Parser_lineNumber(Parser*);
+extern uint16_t        Parser_word(Parser*);
+extern int             Parser_needsSymbol(Parser*);
 
 
 #endif
@@ -0,0 +1,164 @@
+#include "pool.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+
+
+/* The tasks a worker hasn't run yet, [front, back) */
+struct StructPoolQueue {
+    pthread_mutex_t lock;
+    size_t front;
+    size_t back;
+};
+
+struct StructPool {
+    struct StructPoolQueue queues[POOL_MAX_WORKERS];
+    int      worker_count;
+    PoolTask task;
+    void*    context;
+};
+
+/* What a worker thread is started with */
+struct StructPoolWorker {
+    struct StructPool* pool;
+    int worker;
+};
+
+
+/* Take the next task from the front of the queue of worker
+ * Return 1 and set task if one was taken
+ * Return 0 if the queue is empty */
+static int Pool_take(struct StructPool* pool, int worker, size_t* task)
+{
+    struct StructPoolQueue* queue = &pool->queues[worker];
+    int taken = 0;
+
+    pthread_mutex_lock(&queue->lock);
+
+    if (queue->front < queue->back) {
+        *task = queue->front;
+        queue->front += 1;
+        taken = 1;
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+
+    return taken;
+}
+
+/* Move the back half of the queue of another worker to the empty queue of worker
+ * Return 1 if tasks were stolen
+ * Return 0 if every other queue is empty */
+static int Pool_steal(struct StructPool* pool, int worker)
+{
+    for (int offset = 1; offset < pool->worker_count; offset++) {
+
+        struct StructPoolQueue* victim = &pool->queues[(worker + offset) % pool->worker_count];
+        size_t front = 0;
+        size_t back = 0;
+
+        pthread_mutex_lock(&victim->lock);
+
+        if (victim->front < victim->back) {
+            size_t stolen = (victim->back - victim->front + 1) / 2;
+
+            back = victim->back;
+            front = back - stolen;
+            victim->back = front;
+        }
+
+        pthread_mutex_unlock(&victim->lock);
+
+        if (front < back) {
+            struct StructPoolQueue* queue = &pool->queues[worker];
+
+            pthread_mutex_lock(&queue->lock);
+            queue->front = front;
+            queue->back = back;
+            pthread_mutex_unlock(&queue->lock);
+
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Run tasks until every queue is empty.
+ * No tasks are added once the pool runs, so finding every queue empty means
+ * the remaining tasks are already taken by other workers */
+static void* Pool_work(void* argument)
+{
+    struct StructPoolWorker* worker = argument;
+    struct StructPool* pool = worker->pool;
+    size_t task = 0;
+
+    do {
+        while (Pool_take(pool, worker->worker, &task)) {
+            pool->task(pool->context, worker->worker, task);
+        }
+    } while (Pool_steal(pool, worker->worker));
+
+    return NULL;
+}
+
+
+/* Run task_count tasks on up to worker_count workers, the calling thread is worker 0.
+ * Returns once every task has run
+ * Return 0 on success
+ * Return -1 on failure, errno will be set, no task was run */
+extern int Pool_run(size_t task_count, int worker_count, PoolTask task, void* context)
+{
+    if (worker_count < 1 ||
+        task == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (worker_count > POOL_MAX_WORKERS) {
+        worker_count = POOL_MAX_WORKERS;
+    }
+
+    if ((size_t) worker_count > task_count) {
+        worker_count = (task_count > 0) ? (int) task_count : 1;
+    }
+
+    struct StructPool pool;
+    pool.worker_count = worker_count;
+    pool.task = task;
+    pool.context = context;
+
+    // Hand every worker an equal contiguous range of the tasks
+    for (int index = 0; index < worker_count; index++) {
+        pthread_mutex_init(&pool.queues[index].lock, NULL);
+        pool.queues[index].front = task_count * (size_t) index / (size_t) worker_count;
+        pool.queues[index].back = task_count * (size_t) (index + 1) / (size_t) worker_count;
+    }
+
+    pthread_t threads[POOL_MAX_WORKERS];
+    int started[POOL_MAX_WORKERS];
+    struct StructPoolWorker workers[POOL_MAX_WORKERS];
+
+    // A worker that fails to start has its tasks stolen by the others
+    for (int index = 1; index < worker_count; index++) {
+        workers[index].pool = &pool;
+        workers[index].worker = index;
+        started[index] = (pthread_create(&threads[index], NULL, Pool_work, &workers[index]) == 0);
+    }
+
+    workers[0].pool = &pool;
+    workers[0].worker = 0;
+    Pool_work(&workers[0]);
+
+    for (int index = 1; index < worker_count; index++) {
+        if (started[index] != 0) {
+            pthread_join(threads[index], NULL);
+        }
+    }
+
+    for (int index = 0; index < worker_count; index++) {
+        pthread_mutex_destroy(&pool.queues[index].lock);
+    }
+
+    return 0;
+}
@@ -0,0 +1,20 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+/* This module runs a fixed set of tasks on a work stealing thread pool.
+ * Every worker starts with an equal contiguous range of the tasks and takes
+ * them from the front, a worker that runs out steals the back half
+ * of the range of another worker */
+
+/* Most workers a pool will start */
+#define POOL_MAX_WORKERS    64
+
+/* Run task number task on worker number worker, context is shared by every task.
+ * A worker runs one task at a time, so state indexed by worker needs no locking */
+typedef void (*PoolTask)(void* context, int worker, size_t task);
+
+extern int Pool_run(size_t task_count, int worker_count, PoolTask task, void* context);
+
+#endif
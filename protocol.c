@@ -0,0 +1,69 @@
+#include "protocol.h"
+#include <errno.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+
+/* Read exactly length bytes from socket into buffer
+ * Return 1 once every byte is read
+ * Return 0 if the peer closed the connection before the first byte
+ * Return -1 on failure or a connection closed part way, errno will be set */
+extern int Protocol_readFull(int socket, void* buffer, size_t length)
+{
+    char* data = buffer;
+    size_t received = 0;
+
+    while (received < length) {
+
+        ssize_t bytes = read(socket, &data[received], length - received);
+
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (bytes < 0) {
+            return -1;
+        }
+
+        if (bytes == 0) {
+            if (received == 0) {
+                return 0;
+            }
+
+            errno = ECONNRESET;
+            return -1;
+        }
+
+        received += (size_t) bytes;
+    }
+
+    return 1;
+}
+
+/* Write exactly length bytes of buffer to socket, a closed peer doesn't raise SIGPIPE
+ * Return 0 on success
+ * Return -1 on failure, errno will be set */
+extern int Protocol_writeFull(int socket, const void* buffer, size_t length)
+{
+    const char* data = buffer;
+    size_t sent = 0;
+
+    while (sent < length) {
+
+        ssize_t bytes = send(socket, &data[sent], length - sent, MSG_NOSIGNAL);
+
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (bytes < 0) {
+            return -1;
+        }
+
+        sent += (size_t) bytes;
+    }
+
+    return 0;
+}
@@ -0,0 +1,55 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* This module holds the messages the assembler server and its client exchange
+ * over a Unix socket. Both ends run on the same machine, so the fields are in
+ * native byte order. A connection carries any number of requests, each answered
+ * by one reply before the next request is read */
+
+/* Socket the server listens on when none is given */
+#define PROTOCOL_DEFAULT_SOCKET     "/tmp/hack-assembler.sock"
+
+#define PROTOCOL_REQUEST_MAGIC      0x51524b48      // "HKRQ"
+#define PROTOCOL_REPLY_MAGIC        0x50524b48      // "HKRP"
+
+/* Largest source the server accepts */
+#define PROTOCOL_MAX_INPUT          (64 * 1024 * 1024)
+
+/* Request flags */
+#define PROTOCOL_INLINE_INPUT       0x1     // The source follows the request, otherwise its path does
+#define PROTOCOL_INLINE_OUTPUT      0x2     // The output follows the reply, otherwise it is written to the output path
+#define PROTOCOL_SINGLE_PASS        0x4     // Assemble in a single pass
+
+/* Followed by input_length bytes of source or input path,
+ * then output_length bytes of output path */
+struct StructProtocolRequest {
+    uint32_t magic;
+    uint32_t flags;
+    uint8_t  format;            // enum OutputFormat
+    uint8_t  byte_order;        // enum OutputByteOrder
+    uint8_t  header;            // 1 to write the binary header
+    uint8_t  reserved;
+    uint32_t input_length;
+    uint32_t output_length;     // 0 with PROTOCOL_INLINE_OUTPUT
+};
+
+typedef struct StructProtocolRequest ProtocolRequest;
+
+/* Followed by message_length bytes of error message, then output_length bytes of output */
+struct StructProtocolReply {
+    uint32_t magic;
+    int32_t  error;             // 0 on success, -1 on failure
+    int32_t  error_number;      // errno of the failure
+    uint32_t message_length;
+    uint32_t output_length;
+};
+
+typedef struct StructProtocolReply ProtocolReply;
+
+extern int Protocol_readFull  (int, void*, size_t);
+extern int Protocol_writeFull (int, const void*, size_t);
+
+#endif
@@ -0,0 +1,408 @@
+#include "cpu.h"
+#include "assembler.h"
+#include "disassembler.h"
+#include "parser.h"
+#include "stats.h"
+
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+
+/* This program runs a Hack program on the CPU of cpu.c. An .asm source is
+ * assembled in memory first, anything else is read as machine code */
+
+/* Most RAM words that can be set before running */
+#define RUN_MAX_SETS    64
+
+/* A RAM word set before running */
+struct StructRamSet {
+    uint16_t address;
+    uint16_t value;
+};
+
+/* Command line options */
+struct StructOptions {
+    const char*   input_path;
+    uint64_t      limit;           // Most instructions to execute
+    uint16_t      keyboard;
+    struct StructRamSet sets[RUN_MAX_SETS];
+    size_t        set_count;
+    long          print_address;   // First RAM word printed once stopped, -1 for none
+    long          print_count;
+    const char*   screen_path;     // Write the screen here once stopped, NULL for none
+    enum DisassemblerFormat format;
+    enum OutputByteOrder    byte_order;
+};
+
+typedef struct StructOptions Options;
+
+static void printUsage(FILE* stream, const char* program);
+static int  parseArguments(int argc, char** argv, Options* options);
+static int  parseNumber(const char* text, long minimum, long maximum, long* value_out);
+static int  loadProgram(Cpu* cpu, const Options* options);
+static int  writeScreen(const Cpu* cpu, const char* path);
+
+int main(int argc, char** argv) {
+    /* Parse the command line
+     * Load the program, assembling it if it is a source
+     * Run it until it halts or the limit is reached
+     * Print what was asked for */
+
+
+    Options options;
+    int error = parseArguments(argc, argv, &options);
+    if (error != 0) {
+        return (error > 0) ? 0 : -1;
+    }
+
+    Cpu cpu;
+    if (Cpu_create(&cpu) < 0) {
+        fprintf(stderr, "ERROR: %s\nMessage: Failed to create the CPU\n", strerror(errno));
+        return -1;
+    }
+
+    if (loadProgram(&cpu, &options) < 0) {
+        Cpu_free(&cpu);
+        return -1;
+    }
+
+    for (size_t index = 0; index < options.set_count; index++) {
+        cpu.ram[options.sets[index].address] = options.sets[index].value;
+    }
+    Cpu_setKeyboard(&cpu, options.keyboard);
+
+    double start = Stats_wallTime();
+    enum CpuStatus status = Cpu_run(&cpu, options.limit);
+    double elapsed = Stats_wallTime() - start;
+
+    fprintf(stderr, "%s after %llu instructions at PC %u, %.3f s, %.1f million instructions per second\n",
+            (status == CPU_HALTED) ? "Halted" : "Stopped",
+            (unsigned long long) cpu.instructions, (unsigned) cpu.pc, elapsed,
+            (elapsed > 0) ? (double) cpu.instructions / elapsed / 1e6 : 0.0);
+
+    for (long index = 0; options.print_address >= 0 && index < options.print_count; index++) {
+        long address = options.print_address + index;
+        printf("RAM[%ld] = %d\n", address, (int16_t) cpu.ram[address]);
+    }
+
+    if (options.screen_path != NULL && writeScreen(&cpu, options.screen_path) < 0) {
+        fprintf(stderr, "ERROR: %s\nFile: %s\nMessage: Failed to write the screen\n", strerror(errno), options.screen_path);
+        error = -1;
+    }
+
+    Cpu_free(&cpu);
+
+    return (error < 0) ? -1 : 0;
+}
+
+static void printUsage(FILE* stream, const char* program)
+{
+    fprintf(stream,
+            "Usage: %s [options] program.asm|program.hack\n"
+            "Runs a Hack program until it halts, reaching @X 0;JMP at address X,\n"
+            "or has executed the instruction limit. A .asm source is assembled first\n"
+            "\n"
+            "Options:\n"
+            "  -n N                stop after N instructions, default 1000000000\n"
+            "  -s ADDRESS=VALUE    set a RAM word before running, can be repeated\n"
+            "  -k CODE             value of the keyboard register, default 0\n"
+            "  -p ADDRESS[:COUNT]  print COUNT RAM words from ADDRESS once stopped, default 1\n"
+            "  -P FILE             write the screen to FILE as a 512x256 PBM image once stopped\n"
+            "  -f text|binary      format of machine code, detected by default\n"
+            "  -e little|big       byte order of binary machine code without a header,\n"
+            "                      default little\n"
+            "  -h                  show this message\n",
+            program);
+}
+
+/* Parse a decimal number between minimum and maximum
+ * Return 0 on success
+ * Return -1 if it isn't one */
+static int parseNumber(const char* text, long minimum, long maximum, long* value_out)
+{
+    char* end = NULL;
+
+    errno = 0;
+    long value = strtol(text, &end, 10);
+    if (*text == '\0' || *end != '\0' || errno != 0 || value < minimum || value > maximum) {
+        return -1;
+    }
+
+    *value_out = value;
+    return 0;
+}
+
+/* Parse the command line into options
+ * Return 0 on success
+ * Return 1 if the program should exit successfully, usage was printed
+ * Return -1 on invalid arguments, an error was printed */
+static int parseArguments(int argc, char** argv, Options* options)
+{
+    options->input_path = NULL;
+    options->limit = 1000000000;
+    options->keyboard = 0;
+    options->set_count = 0;
+    options->print_address = -1;
+    options->print_count = 0;
+    options->screen_path = NULL;
+    options->format = DISASSEMBLER_DETECT;
+    options->byte_order = OUTPUT_LITTLE_ENDIAN;
+
+    int option = 0;
+    while ((option = getopt(argc, argv, "n:s:k:p:P:f:e:h")) != -1) {
+
+        switch (option) {
+
+            case 'n': {
+                char* end = NULL;
+                errno = 0;
+                unsigned long long limit = strtoull(optarg, &end, 10);
+                if (*optarg == '\0' || *optarg == '-' || *end != '\0' || errno != 0) {
+                    fprintf(stderr, "Invalid instruction limit: %s\n", optarg);
+                    return -1;
+                }
+                options->limit = limit;
+                break;
+            }
+
+            case 's': {
+                char* separator = strchr(optarg, '=');
+                long address = 0;
+                long value = 0;
+
+                if (separator == NULL || options->set_count == RUN_MAX_SETS) {
+                    fprintf(stderr, "Invalid RAM word: %s\n", optarg);
+                    return -1;
+                }
+
+                *separator = '\0';
+                if (parseNumber(optarg, 0, CPU_RAM_SIZE - 1, &address) < 0 ||
+                    parseNumber(separator + 1, INT16_MIN, UINT16_MAX, &value) < 0) {
+                    *separator = '=';
+                    fprintf(stderr, "Invalid RAM word: %s\n", optarg);
+                    return -1;
+                }
+
+                options->sets[options->set_count].address = (uint16_t) address;
+                options->sets[options->set_count].value = (uint16_t) value;
+                options->set_count += 1;
+                break;
+            }
+
+            case 'k': {
+                long key = 0;
+                if (parseNumber(optarg, 0, UINT16_MAX, &key) < 0) {
+                    fprintf(stderr, "Invalid key code: %s\n", optarg);
+                    return -1;
+                }
+                options->keyboard = (uint16_t) key;
+                break;
+            }
+
+            case 'p': {
+                char* separator = strchr(optarg, ':');
+                long count = 1;
+
+                if (separator != NULL) {
+                    *separator = '\0';
+                }
+
+                if (parseNumber(optarg, 0, CPU_RAM_SIZE - 1, &options->print_address) < 0 ||
+                    (separator != NULL && parseNumber(separator + 1, 1, CPU_RAM_SIZE, &count) < 0) ||
+                    options->print_address + count > CPU_RAM_SIZE) {
+                    if (separator != NULL) {
+                        *separator = ':';
+                    }
+                    fprintf(stderr, "Invalid RAM range: %s\n", optarg);
+                    return -1;
+                }
+
+                options->print_count = count;
+                break;
+            }
+
+            case 'P':
+                options->screen_path = optarg;
+                break;
+
+            case 'f':
+                if (strcmp(optarg, "text") == 0) {
+                    options->format = DISASSEMBLER_TEXT;
+                }
+                else if (strcmp(optarg, "binary") == 0) {
+                    options->format = DISASSEMBLER_BINARY;
+                }
+                else {
+                    fprintf(stderr, "Unknown input format: %s\n", optarg);
+                    return -1;
+                }
+                break;
+
+            case 'e':
+                if (strcmp(optarg, "little") == 0) {
+                    options->byte_order = OUTPUT_LITTLE_ENDIAN;
+                }
+                else if (strcmp(optarg, "big") == 0) {
+                    options->byte_order = OUTPUT_BIG_ENDIAN;
+                }
+                else {
+                    fprintf(stderr, "Unknown byte order: %s\n", optarg);
+                    return -1;
+                }
+                break;
+
+            case 'h':
+                printUsage(stdout, argv[0]);
+                return 1;
+
+            default:
+                printUsage(stderr, argv[0]);
+                return -1;
+        }
+    }
+
+    if (argc - optind != 1) {
+        printUsage(stderr, argv[0]);
+        return -1;
+    }
+
+    options->input_path = argv[optind];
+
+    return 0;
+}
+
+/* Load the program at the input path into the CPU. A source ending in .asm
+ * is assembled, anything else is decoded as machine code
+ * Return 0 on success
+ * Return -1 on failure, the error was printed */
+static int loadProgram(Cpu* cpu, const Options* options)
+{
+    const char* path = options->input_path;
+    size_t length = strlen(path);
+    int error = 0;
+
+    Parser parser;
+    if (Parser_createFromPath(&parser, path) < 0) {
+        fprintf(stderr, "ERROR: %s\nFile: %s\nMessage: Failed to open source file\n", strerror(errno), path);
+        return -1;
+    }
+
+    // The words the assembler generated, without writing them anywhere
+    if (length >= 4 && strcmp(&path[length - 4], ".asm") == 0) {
+
+        Assembler assembler;
+        AssemblerReport report;
+        Assembler_clearReport(&report);
+
+        if (Assembler_create(&assembler) < 0) {
+            fprintf(stderr, "ERROR: %s\nMessage: Failed to create the assembler\n", strerror(errno));
+            Parser_free(&parser);
+            return -1;
+        }
+
+        error = Assembler_assembleWords(&assembler, &parser, &report);
+        if (error == 0) {
+            error = Cpu_load(cpu, assembler.command_array.words, assembler.command_array.size);
+            if (error < 0) {
+                Assembler_logError(&report, errno, "The program doesn't fit in the ROM");
+            }
+        }
+
+        if (error < 0) {
+            fprintf(stderr, "ERROR: %s\nFile: %s\n", strerror(report.error_number), path);
+            if (report.line > 0) {
+                fprintf(stderr, "Line: %zu\n", report.line);
+            }
+            fprintf(stderr, "Message: %s\n", report.message);
+        }
+
+        Assembler_free(&assembler);
+        Parser_free(&parser);
+
+        return error;
+    }
+
+    // A word takes at least 2 bytes in either format
+    uint16_t* words = malloc((parser.mapped_length / 2 + 1) * sizeof(uint16_t));
+    if (words == NULL) {
+        fprintf(stderr, "ERROR: %s\nMessage: Failed to allocate the words\n", strerror(errno));
+        Parser_free(&parser);
+        return -1;
+    }
+
+    size_t word_count = 0;
+    size_t line = 0;
+    const char* message = NULL;
+
+    if (Disassembler_decode((const uint8_t*) parser.mapped_source, parser.mapped_length, options->format,
+                            options->byte_order, words, &word_count, &line) < 0) {
+        message = "Not Hack machine code";
+    }
+    else if (Cpu_load(cpu, words, word_count) < 0) {
+        message = "The program doesn't fit in the ROM";
+    }
+
+    if (message != NULL) {
+        fprintf(stderr, "ERROR: %s\nFile: %s\n", strerror(errno), path);
+        if (line > 0) {
+            fprintf(stderr, "Line: %zu\n", line);
+        }
+        fprintf(stderr, "Message: %s\n", message);
+        error = -1;
+    }
+
+    free(words);
+    Parser_free(&parser);
+
+    return error;
+}
+
+/* Write the screen as a binary PBM image, a set bit is a black pixel
+ * Return 0 on success
+ * Return -1 on failure, errno will be set */
+static int writeScreen(const Cpu* cpu, const char* path)
+{
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        return -1;
+    }
+
+    const uint16_t* screen = Cpu_screen(cpu);
+
+    // PBM rows start with their leftmost pixel in the highest bit, the screen in the lowest
+    uint8_t row[64];
+    int error = (fprintf(file, "P4\n512 256\n") < 0) ? -1 : 0;
+
+    for (size_t y = 0; y < 256 && error == 0; y++) {
+
+        for (size_t word = 0; word < 32; word++) {
+            uint16_t pixels = screen[y * 32 + word];
+            uint8_t low = 0;
+            uint8_t high = 0;
+
+            for (int bit = 0; bit < 8; bit++) {
+                low = (uint8_t) (low | (((pixels >> bit) & 1) << (7 - bit)));
+                high = (uint8_t) (high | (((pixels >> (bit + 8)) & 1) << (7 - bit)));
+            }
+
+            row[2 * word] = low;
+            row[2 * word + 1] = high;
+        }
+
+        if (fwrite(row, 1, sizeof(row), file) != sizeof(row)) {
+            error = -1;
+        }
+    }
+
+    int saved_errno = errno;
+    if (fclose(file) != 0 && error == 0) {
+        return -1;
+    }
+    errno = saved_errno;
+
+    return error;
+}
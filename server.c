@@ -0,0 +1,381 @@
+#include "server.h"
+#include "assembler.h"
+#include "parser.h"
+#include "protocol.h"
+#include "pool.h"
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+struct StructServer {
+    int listen_socket;
+    int worker_count;
+
+    pthread_mutex_t lock;                       // Guards stopping and connections
+    int stopping;                               // 1 once the server is shutting down
+    int connections[POOL_MAX_WORKERS];          // Connection each worker serves, -1 if none
+};
+
+/* A worker serves one connection at a time */
+struct StructServerWorker {
+    struct StructServer* server;
+    int       index;
+    Assembler assembler;
+
+    char*  request_data;                        // Source or paths of the current request
+    size_t request_capacity;
+};
+
+
+/* Send a reply and, on success of an inline request, the output
+ * Return 0 on success
+ * Return -1 on failure, errno will be set */
+static int Server_reply(int connection, const AssemblerReport* report, const char* output, size_t output_length)
+{
+    ProtocolReply reply;
+    memset(&reply, 0, sizeof(reply));
+
+    const char* message = (report->error < 0 && report->message != NULL) ? report->message : "";
+
+    reply.magic = PROTOCOL_REPLY_MAGIC;
+    reply.error = report->error;
+    reply.error_number = report->error_number;
+    reply.message_length = (uint32_t) strlen(message);
+    reply.output_length = (report->error < 0) ? 0 : (uint32_t) output_length;
+
+    if (Protocol_writeFull(connection, &reply, sizeof(reply)) < 0 ||
+        Protocol_writeFull(connection, message, reply.message_length) < 0 ||
+        Protocol_writeFull(connection, output, reply.output_length) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Read the payload of request into the buffer of worker, each part null terminated
+ * Return 0 on success
+ * Return -1 on failure, errno will be set */
+static int Server_readPayload(struct StructServerWorker* worker, int connection, const ProtocolRequest* request)
+{
+    size_t needed = (size_t) request->input_length + request->output_length + 2;
+
+    if (needed > worker->request_capacity) {
+        char* new_data = realloc(worker->request_data, needed);
+        if (new_data == NULL) {
+            return -1;
+        }
+
+        worker->request_data = new_data;
+        worker->request_capacity = needed;
+    }
+
+    char* input = worker->request_data;
+    char* output_path = &worker->request_data[request->input_length + 1];
+
+    if (Protocol_readFull(connection, input, request->input_length) < 0 ||
+        Protocol_readFull(connection, output_path, request->output_length) < 0) {
+        return -1;
+    }
+
+    input[request->input_length] = '\0';
+    output_path[request->output_length] = '\0';
+
+    return 0;
+}
+
+/* Read one request from connection, assemble it and reply
+ * Return 0 if the connection can carry another request
+ * Return -1 once the connection is closed or broken */
+static int Server_serveRequest(struct StructServerWorker* worker, int connection)
+{
+    ProtocolRequest request;
+    AssemblerReport report;
+    Assembler_clearReport(&report);
+
+    if (Protocol_readFull(connection, &request, sizeof(request)) <= 0) {
+        return -1;
+    }
+
+    int inline_input = (request.flags & PROTOCOL_INLINE_INPUT) != 0;
+    int inline_output = (request.flags & PROTOCOL_INLINE_OUTPUT) != 0;
+
+    // The stream can't be trusted past a malformed request
+    if (request.magic != PROTOCOL_REQUEST_MAGIC ||
+        request.input_length > (inline_input ? PROTOCOL_MAX_INPUT : PATH_MAX) ||
+        request.output_length > (inline_output ? 0 : PATH_MAX) ||
+        request.format > OUTPUT_BINARY ||
+        request.byte_order > OUTPUT_BIG_ENDIAN) {
+        Assembler_logError(&report, EPROTO, "Invalid request");
+        Server_reply(connection, &report, NULL, 0);
+        return -1;
+    }
+
+    if (Server_readPayload(worker, connection, &request) < 0) {
+        return -1;
+    }
+
+    const char* input = worker->request_data;
+    const char* output_path = &worker->request_data[request.input_length + 1];
+
+    AssemblerOptions options;
+    Assembler_defaultOptions(&options);
+    options.output.format = request.format;
+    options.output.byte_order = request.byte_order;
+    options.output.header = (request.header != 0);
+    options.single_pass = (request.flags & PROTOCOL_SINGLE_PASS) != 0;
+
+    Parser parser;
+    int error = 0;
+
+    if (inline_input) {
+        error = Parser_createFromBuffer(&parser, input, request.input_length);
+    }
+    else {
+        error = Parser_createFromPath(&parser, input);
+    }
+
+    if (error < 0) {
+        Assembler_logError(&report, errno, "Failed to open source file");
+        return Server_reply(connection, &report, NULL, 0);
+    }
+
+    // An inline output is assembled into memory
+    char* output = NULL;
+    size_t output_length = 0;
+    FILE* output_file = NULL;
+
+    if (inline_output) {
+        output_file = open_memstream(&output, &output_length);
+    }
+    else {
+        output_file = fopen(output_path, "wb");
+    }
+
+    if (output_file == NULL) {
+        Assembler_logError(&report, errno, "Failed to open destination file");
+        Parser_free(&parser);
+        return Server_reply(connection, &report, NULL, 0);
+    }
+
+    Assembler_assemble(&worker->assembler, &parser, output_file, &options, &report);
+
+    Parser_free(&parser);
+    fclose(output_file);
+
+    error = Server_reply(connection, &report, output, output_length);
+
+    free(output);
+
+    return error;
+}
+
+/* Accept connections and serve their requests until the server stops */
+static void* Server_work(void* argument)
+{
+    struct StructServerWorker* worker = argument;
+    struct StructServer* server = worker->server;
+
+    while (1) {
+
+        int connection = accept(server->listen_socket, NULL, NULL);
+
+        if (connection < 0 && (errno == EINTR || errno == ECONNABORTED)) {
+            continue;
+        }
+
+        // The listening socket was shut down
+        if (connection < 0) {
+            break;
+        }
+
+        pthread_mutex_lock(&server->lock);
+        int stopping = server->stopping;
+        if (stopping == 0) {
+            server->connections[worker->index] = connection;
+        }
+        pthread_mutex_unlock(&server->lock);
+
+        if (stopping != 0) {
+            close(connection);
+            break;
+        }
+
+        while (Server_serveRequest(worker, connection) == 0) {
+        }
+
+        pthread_mutex_lock(&server->lock);
+        server->connections[worker->index] = -1;
+        pthread_mutex_unlock(&server->lock);
+
+        close(connection);
+    }
+
+    return NULL;
+}
+
+/* Return 1 if nothing listens on the socket at address, the server that made it is gone */
+static int Server_isStale(const struct sockaddr_un* address)
+{
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe < 0) {
+        return 0;
+    }
+
+    int stale = (connect(probe, (const struct sockaddr*) address, sizeof(*address)) < 0 &&
+                 errno == ECONNREFUSED);
+    close(probe);
+
+    return stale;
+}
+
+/* Create the socket the server listens on, replacing a stale one at socket_path.
+ * Anything else at the path, a live socket or a file, is left alone
+ * Return the socket on success
+ * Return -1 on failure, errno will be set, EADDRINUSE if the path is taken */
+static int Server_listen(const char* socket_path)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    strcpy(address.sun_path, socket_path);
+
+    struct stat status;
+    if (lstat(socket_path, &status) == 0) {
+        if (S_ISSOCK(status.st_mode) == 0 || Server_isStale(&address) == 0) {
+            errno = EADDRINUSE;
+            return -1;
+        }
+        unlink(socket_path);
+    }
+
+    int listen_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_socket < 0) {
+        return -1;
+    }
+
+    if (bind(listen_socket, (struct sockaddr*) &address, sizeof(address)) < 0 ||
+        listen(listen_socket, SOMAXCONN) < 0) {
+        int saved_errno = errno;
+        close(listen_socket);
+        errno = saved_errno;
+        return -1;
+    }
+
+    return listen_socket;
+}
+
+
+/* Serve assemble requests on the Unix socket at socket_path with worker_count workers.
+ * Returns once the process receives SIGINT or SIGTERM, the socket is removed
+ * Return 0 on success
+ * Return -1 on failure, errno will be set */
+extern int Server_run(const char* socket_path, int worker_count)
+{
+    if (socket_path == NULL ||
+        worker_count < 1) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (worker_count > POOL_MAX_WORKERS) {
+        worker_count = POOL_MAX_WORKERS;
+    }
+
+    // Only this thread takes the stop signals, the workers inherit the mask
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+
+    struct StructServer server;
+    server.worker_count = worker_count;
+    server.stopping = 0;
+    pthread_mutex_init(&server.lock, NULL);
+
+    server.listen_socket = Server_listen(socket_path);
+    if (server.listen_socket < 0) {
+        pthread_mutex_destroy(&server.lock);
+        return -1;
+    }
+
+    struct StructServerWorker* workers = calloc((size_t) worker_count, sizeof(struct StructServerWorker));
+    pthread_t threads[POOL_MAX_WORKERS];
+    int started = 0;
+
+    for (int index = 0; workers != NULL && index < worker_count; index++) {
+
+        server.connections[index] = -1;
+        workers[index].server = &server;
+        workers[index].index = index;
+
+        if (Assembler_create(&workers[index].assembler) < 0) {
+            break;
+        }
+
+        int create_error = pthread_create(&threads[index], NULL, Server_work, &workers[index]);
+        if (create_error != 0) {
+            Assembler_free(&workers[index].assembler);
+            errno = create_error;
+            break;
+        }
+
+        started += 1;
+    }
+
+    int error = 0;
+
+    if (started == 0) {
+        error = -1;
+    }
+
+    else {
+        int signal_number = 0;
+        sigwait(&stop_signals, &signal_number);
+    }
+
+    int saved_errno = errno;
+
+    // Wake the workers waiting in accept and the ones waiting on a connection
+    pthread_mutex_lock(&server.lock);
+    server.stopping = 1;
+    shutdown(server.listen_socket, SHUT_RDWR);
+    for (int index = 0; index < started; index++) {
+        if (server.connections[index] >= 0) {
+            shutdown(server.connections[index], SHUT_RDWR);
+        }
+    }
+    pthread_mutex_unlock(&server.lock);
+
+    for (int index = 0; index < started; index++) {
+        pthread_join(threads[index], NULL);
+        Assembler_free(&workers[index].assembler);
+        free(workers[index].request_data);
+    }
+
+    free(workers);
+    close(server.listen_socket);
+    unlink(socket_path);
+    pthread_mutex_destroy(&server.lock);
+
+    errno = saved_errno;
+
+    return error;
+}
@@ -0,0 +1,10 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+/* This module serves assemble requests over a Unix socket.
+ * Every worker keeps a warm Assembler, so a request only pays for
+ * resetting it instead of starting a process and creating the symbol table */
+
+extern int Server_run(const char*, int);
+
+#endif
@@ -0,0 +1,138 @@
+#include "stats.h"
+#ifdef STATS_COUNT_ALLOCATIONS
+#include "allocation.h"
+#endif
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+
+static const char* PHASE_NAMES[STATS_PHASE_COUNT] = { "parse", "optimize", "resolve", "write" };
+
+
+/* Seconds on the monotonic clock */
+extern double Stats_wallTime(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double) time.tv_sec + (double) time.tv_nsec / 1e9;
+}
+
+/* CPU seconds used by the calling thread */
+extern double Stats_cpuTime(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return (double) time.tv_sec + (double) time.tv_nsec / 1e9;
+}
+
+/* Zero every time and counter */
+extern void Stats_clear(Stats* stats)
+{
+    if (stats != NULL) {
+        memset(stats, 0, sizeof(Stats));
+    }
+}
+
+/* Start timing a phase */
+extern void Stats_begin(Stats* stats)
+{
+    if (stats != NULL) {
+        stats->start_wall = Stats_wallTime();
+        stats->start_cpu = Stats_cpuTime();
+    }
+}
+
+/* Add the time since Stats_begin to phase */
+extern void Stats_end(Stats* stats, enum StatsPhase phase)
+{
+    if (stats != NULL) {
+        stats->phase_wall[phase] += Stats_wallTime() - stats->start_wall;
+        stats->phase_cpu[phase] += Stats_cpuTime() - stats->start_cpu;
+    }
+}
+
+/* Add the times and counters of from to stats */
+extern void Stats_merge(Stats* stats, const Stats* from)
+{
+    if (stats != NULL && from != NULL) {
+
+        for (int phase = 0; phase < STATS_PHASE_COUNT; phase++) {
+            stats->phase_wall[phase] += from->phase_wall[phase];
+            stats->phase_cpu[phase] += from->phase_cpu[phase];
+        }
+
+        stats->files += from->files;
+        stats->lines += from->lines;
+        stats->instructions += from->instructions;
+        stats->instructions_removed += from->instructions_removed;
+        stats->labels += from->labels;
+        stats->variables += from->variables;
+        stats->symbol_lookups += from->symbol_lookups;
+        stats->bytes_written += from->bytes_written;
+    }
+}
+
+/* Print the statistics to stream with the total wall and CPU time of the run,
+ * the allocation counters and the peak RSS of the process */
+extern void Stats_print(const Stats* stats, FILE* stream, enum StatsFormat format,
+                        double total_wall, double total_cpu)
+{
+    if (stats == NULL || stream == NULL) {
+        return;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    // Only counted when the allocation wrappers are linked in
+#ifdef STATS_COUNT_ALLOCATIONS
+    unsigned long long allocations = Allocation_count();
+    unsigned long long allocation_bytes = Allocation_bytes();
+#else
+    unsigned long long allocations = 0;
+    unsigned long long allocation_bytes = 0;
+#endif
+
+    if (format == STATS_JSON) {
+
+        fprintf(stream, "{\"phases\": {");
+        for (int phase = 0; phase < STATS_PHASE_COUNT; phase++) {
+            fprintf(stream, "%s\"%s\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f}",
+                    (phase > 0) ? ", " : "", PHASE_NAMES[phase],
+                    stats->phase_wall[phase] * 1e3, stats->phase_cpu[phase] * 1e3);
+        }
+        fprintf(stream, "}, \"total\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f}, ", total_wall * 1e3, total_cpu * 1e3);
+
+        fprintf(stream,
+                "\"files\": %llu, \"lines\": %llu, \"instructions\": %llu, \"instructions_removed\": %llu, \"labels\": %llu, "
+                "\"variables\": %llu, \"symbol_lookups\": %llu, \"bytes_written\": %llu, "
+                "\"allocations\": %llu, \"bytes_allocated\": %llu, \"peak_rss_kb\": %ld}\n",
+                stats->files, stats->lines, stats->instructions, stats->instructions_removed, stats->labels,
+                stats->variables, stats->symbol_lookups, stats->bytes_written,
+                allocations, allocation_bytes, usage.ru_maxrss);
+        return;
+    }
+
+    fprintf(stream, "%-20s %12s %12s\n", "Phase", "Wall ms", "CPU ms");
+    for (int phase = 0; phase < STATS_PHASE_COUNT; phase++) {
+        fprintf(stream, "%-20s %12.3f %12.3f\n", PHASE_NAMES[phase],
+                stats->phase_wall[phase] * 1e3, stats->phase_cpu[phase] * 1e3);
+    }
+    fprintf(stream, "%-20s %12.3f %12.3f\n", "total", total_wall * 1e3, total_cpu * 1e3);
+
+    fprintf(stream, "\n");
+    fprintf(stream, "%-20s %12llu\n", "Files", stats->files);
+    fprintf(stream, "%-20s %12llu\n", "Lines", stats->lines);
+    fprintf(stream, "%-20s %12llu\n", "Instructions", stats->instructions);
+    fprintf(stream, "%-20s %12llu\n", "Removed", stats->instructions_removed);
+    fprintf(stream, "%-20s %12llu\n", "Labels", stats->labels);
+    fprintf(stream, "%-20s %12llu\n", "Variables", stats->variables);
+    fprintf(stream, "%-20s %12llu\n", "Symbol lookups", stats->symbol_lookups);
+    fprintf(stream, "%-20s %12llu\n", "Bytes written", stats->bytes_written);
+    fprintf(stream, "%-20s %12llu\n", "Allocations", allocations);
+    fprintf(stream, "%-20s %12llu\n", "Bytes allocated", allocation_bytes);
+    fprintf(stream, "%-20s %12ld\n", "Peak RSS KB", usage.ru_maxrss);
+}
@@ -0,0 +1,50 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+
+/* This module collects the statistics printed by --stats: the wall and CPU time
+ * of each phase of the assembly and counters of the work done.
+ * Every function ignores a NULL Stats, so collection costs a NULL check per phase when off */
+
+/* Phases of an assembly */
+enum StatsPhase {
+    STATS_PARSE,            // Reading the source and encoding the instructions, collecting labels
+    STATS_OPTIMIZE,         // Rewriting the parsed instructions, only with -O
+    STATS_RESOLVE,          // Substituting symbol addresses and allocating variables
+    STATS_WRITE,            // Formatting the words and writing them to the output
+    STATS_PHASE_COUNT
+};
+
+enum StatsFormat {
+    STATS_HUMAN,
+    STATS_JSON
+};
+
+struct StructStats {
+    double phase_wall[STATS_PHASE_COUNT];    // Seconds spent in each phase
+    double phase_cpu[STATS_PHASE_COUNT];     // CPU seconds of the thread in each phase
+    double start_wall;                       // Start of the running phase
+    double start_cpu;
+
+    unsigned long long files;
+    unsigned long long lines;
+    unsigned long long instructions;
+    unsigned long long instructions_removed; // By the optimizer
+    unsigned long long labels;
+    unsigned long long variables;
+    unsigned long long symbol_lookups;       // Searches of the symbol tables and the interner, as counted by them
+    unsigned long long bytes_written;
+};
+
+typedef struct StructStats Stats;
+
+extern void Stats_clear       (Stats*);
+extern void Stats_begin       (Stats*);
+extern void Stats_end         (Stats*, enum StatsPhase);
+extern void Stats_merge       (Stats*, const Stats*);
+extern void Stats_print       (const Stats*, FILE*, enum StatsFormat, double, double);
+extern double Stats_wallTime  (void);
+extern double Stats_cpuTime   (void);
+
+#endif
@@ -3,73 +3,241 @@
 #include <errno.h>
 #include <stddef.h>
 #include <string.h>
+#include <stdint.h>
 #include <sys/types.h>
 
-// Mapping of the predefined symbols and their values
-static const char* const PREDEFINED_SYMBOLS[23] = { 
-    "SP",  "LCL", "ARG", "THIS", "THAT", "R0",     "R1", "R2", "R3", "R4", "R5", "R6", "R7", "R8", "R9", "R10",
-    "R11", "R12", "R13", "R14",  "R15",  "SCREEN", "KBD" };
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Perfect hash over the predefined symbols.
+ * A predefined symbol is at most 6 characters, so it is packed into an integer key
+ * and a multiplicative hash maps each of the 23 keys to its own slot of a
+ * 32 entry table, the multiplier was found by a brute force search.
+ * The table is consulted before the slots, so it is never copied into a symbol table */
+#define PREDEFINED_KEY(a, b, c, d, e, f)    ((uint64_t) (uint8_t) (a)         | \
+                                             ((uint64_t) (uint8_t) (b) << 8)  | \
+                                             ((uint64_t) (uint8_t) (c) << 16) | \
+                                             ((uint64_t) (uint8_t) (d) << 24) | \
+                                             ((uint64_t) (uint8_t) (e) << 32) | \
+                                             ((uint64_t) (uint8_t) (f) << 40))
+#define PREDEFINED_SLOT(key)                ((uint32_t) (((uint64_t) (key) * 0x389c1ccfafef1ac1ULL) >> 59))
+#define PREDEFINED_TABLE_SIZE               32
+#define PREDEFINED_MAX_LENGTH               6
+
+struct PredefinedEntry {
+    uint64_t key;       // 0 for an unused slot, no symbol packs to 0
+    int      address;
+};
+
+#define PREDEFINED_ENTRY(a, b, c, d, e, f, address) \
+    [PREDEFINED_SLOT(PREDEFINED_KEY(a, b, c, d, e, f))] = { PREDEFINED_KEY(a, b, c, d, e, f), (address) }
+
+static const struct PredefinedEntry PREDEFINED_TABLE[PREDEFINED_TABLE_SIZE] =
+{
+    // Virtual machine pointers
+    PREDEFINED_ENTRY('S', 'P', 0,   0,   0,   0,   SYMBOL_SP),
+    PREDEFINED_ENTRY('L', 'C', 'L', 0,   0,   0,   SYMBOL_LCL),
+    PREDEFINED_ENTRY('A', 'R', 'G', 0,   0,   0,   SYMBOL_ARG),
+    PREDEFINED_ENTRY('T', 'H', 'I', 'S', 0,   0,   SYMBOL_THIS),
+    PREDEFINED_ENTRY('T', 'H', 'A', 'T', 0,   0,   SYMBOL_THAT),
+
+    // Registers
+    PREDEFINED_ENTRY('R', '0', 0,   0,   0,   0,   SYMBOL_R0),
+    PREDEFINED_ENTRY('R', '1', 0,   0,   0,   0,   SYMBOL_R1),
+    PREDEFINED_ENTRY('R', '2', 0,   0,   0,   0,   SYMBOL_R2),
+    PREDEFINED_ENTRY('R', '3', 0,   0,   0,   0,   SYMBOL_R3),
+    PREDEFINED_ENTRY('R', '4', 0,   0,   0,   0,   SYMBOL_R4),
+    PREDEFINED_ENTRY('R', '5', 0,   0,   0,   0,   SYMBOL_R5),
+    PREDEFINED_ENTRY('R', '6', 0,   0,   0,   0,   SYMBOL_R6),
+    PREDEFINED_ENTRY('R', '7', 0,   0,   0,   0,   SYMBOL_R7),
+    PREDEFINED_ENTRY('R', '8', 0,   0,   0,   0,   SYMBOL_R8),
+    PREDEFINED_ENTRY('R', '9', 0,   0,   0,   0,   SYMBOL_R9),
+    PREDEFINED_ENTRY('R', '1', '0', 0,   0,   0,   SYMBOL_R10),
+    PREDEFINED_ENTRY('R', '1', '1', 0,   0,   0,   SYMBOL_R11),
+    PREDEFINED_ENTRY('R', '1', '2', 0,   0,   0,   SYMBOL_R12),
+    PREDEFINED_ENTRY('R', '1', '3', 0,   0,   0,   SYMBOL_R13),
+    PREDEFINED_ENTRY('R', '1', '4', 0,   0,   0,   SYMBOL_R14),
+    PREDEFINED_ENTRY('R', '1', '5', 0,   0,   0,   SYMBOL_R15),
+
+    // Memory mapped IO
+    PREDEFINED_ENTRY('S', 'C', 'R', 'E', 'E', 'N', SYMBOL_SCREEN),
+    PREDEFINED_ENTRY('K', 'B', 'D', 0,   0,   0,   SYMBOL_KBD)
+};
 
-static const int PREDEFINED_SYMBOL_VALUES[23] = {
-    SYMBOL_SP,  SYMBOL_LCL, SYMBOL_ARG, SYMBOL_THIS,   SYMBOL_THAT, SYMBOL_R0, SYMBOL_R1,  SYMBOL_R2,  SYMBOL_R3,
-    SYMBOL_R4,  SYMBOL_R5,  SYMBOL_R6,  SYMBOL_R7,     SYMBOL_R8,   SYMBOL_R9, SYMBOL_R10, SYMBOL_R11, SYMBOL_R12, 
-    SYMBOL_R13, SYMBOL_R14, SYMBOL_R15, SYMBOL_SCREEN, SYMBOL_KBD };
+/* Locally needed function(s) */
 
-static const size_t TOTAL_PREDEFINED_SYMBOLS = 23;
 
-/* Locally needed function(s) */
+/* Look up a predefined symbol of the given length
+ * Return its address if it is one
+ * Return -1 otherwise */
+static int SymbolTable_findPredefined(const char* symbol, size_t length)
+{
+    uint64_t key = 0;
 
+    if (length == 0 || length > PREDEFINED_MAX_LENGTH) {
+        return -1;
+    }
 
-/* Add the predefined symbols to the given symbol table, it assumes
- * they don't already exist within the table
- * Return 0 on success
- * return -1 on failure */
-static int SymbolTable_addPredefinedSymbols(SymbolTable* st)
+    for (size_t index = 0; index < length; index++) {
+
+        // A null character would alias a shorter symbol
+        if (symbol[index] == '\0') {
+            return -1;
+        }
+
+        key |= (uint64_t) (uint8_t) symbol[index] << (8 * index);
+    }
+
+    const struct PredefinedEntry* entry = &PREDEFINED_TABLE[PREDEFINED_SLOT(key)];
+
+    if (entry->key == key) {
+        return entry->address;
+    }
+
+    return -1;
+}
+
+/* Control byte marking a slot that has never been used,
+ * full slots hold the low 7 bits of the hash so the high bit is never set */
+#define CONTROL_EMPTY   ((uint8_t) 0x80)
+
+/* Number of control bytes probed at once */
+#define GROUP_WIDTH     16
+
+/* Hash a string of the given length, 64 bit FNV-1a */
+static uint64_t SymbolTable_hash(const char* symbol, size_t length)
 {
-    if (st != NULL) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (size_t index = 0; index < length; index++) {
+        hash ^= (uint8_t) symbol[index];
+        hash *= 0x100000001b3ULL;
+    }
 
-        // Add all the predefined symbols
-        for (size_t index = 0; index < TOTAL_PREDEFINED_SYMBOLS; index++) {
+    return hash;
+}
 
-            if (SymbolTable_addEntry(st, PREDEFINED_SYMBOLS[index], PREDEFINED_SYMBOL_VALUES[index]) == -1) {
-                return -1;
+/* Returns a bitmask of the slots in the group starting at control
+ * whose control byte equals value, bit n corresponds to slot n */
+static uint32_t SymbolTable_matchGroup(const uint8_t* control, uint8_t value)
+{
+#ifdef __SSE2__
+    __m128i group = _mm_load_si128((const __m128i*) control);
+    __m128i match = _mm_cmpeq_epi8(group, _mm_set1_epi8((char) value));
+
+    return (uint32_t) _mm_movemask_epi8(match);
+#else
+    uint32_t mask = 0;
+
+    for (int index = 0; index < GROUP_WIDTH; index++) {
+        if (control[index] == value) {
+            mask |= (uint32_t) 1 << index;
+        }
+    }
+
+    return mask;
+#endif
+}
+
+/* Find the slot for the given key
+ * if one is found return the index of it
+ * if it doesn't exist return -1 and store the index of the first
+ * empty slot on its probe sequence in empty_out if it isn't NULL */
+static ssize_t SymbolTable_findSlot(const SymbolTable* st, const char* symbol, size_t length,
+                                    uint64_t hash, size_t* empty_out)
+{
+    const uint8_t h2 = (uint8_t) (hash & 0x7f);
+    const size_t  group_mask = (st->capacity / GROUP_WIDTH) - 1;
+
+    size_t group = (size_t) (hash >> 7) & group_mask;
+
+    // Triangular probing over the groups visits every group once
+    for (size_t step = 1; ; step++) {
+
+        const uint8_t* control = &st->control[group * GROUP_WIDTH];
+
+        // Check every slot whose control byte matches
+        uint32_t matches = SymbolTable_matchGroup(control, h2);
+        while (matches != 0) {
+
+            size_t index = group * GROUP_WIDTH + (size_t) __builtin_ctz(matches);
+            const struct StructSymbolSlot* slot = &st->slots[index];
+
+            if (slot->hash == hash &&
+                slot->key_length == length &&
+                memcmp(&st->keys[slot->key_offset], symbol, length) == 0) {
+
+                // match found return its place
+                return (ssize_t) index;
             }
+
+            matches &= matches - 1;
         }
 
-        // Done :)
-        return 0;
-    }
+        // An empty slot ends the probe sequence, there is no deletion so no tombstones
+        uint32_t empties = SymbolTable_matchGroup(control, CONTROL_EMPTY);
+        if (empties != 0) {
 
-    else {
-        errno = EINVAL;
-        return -1;
+            if (empty_out != NULL) {
+                *empty_out = group * GROUP_WIDTH + (size_t) __builtin_ctz(empties);
+            }
+
+            return -1;
+        }
+
+        group = (group + step) & group_mask;
     }
 }
 
-/* Function used to resize the array of Symbol Address tuples
+/* Function used to resize the slot arrays, every entry is rehashed
+ * using its cached hash, new_capacity must be a power of 2 >= GROUP_WIDTH
  * Return 0 on success
  * Return -1 on error, st is left untouched */
-static int SymbolTable_resize(SymbolTable* st, size_t new_size)
+static int SymbolTable_resize(SymbolTable* st, size_t new_capacity)
 {
     if (st != NULL &&
-        st->capacity < new_size)
+        st->capacity < new_capacity)
     {
-        errno = 0;
-        struct StructTuple* new_array = reallocarray(st->values, new_size, sizeof(struct StructTuple));
+        uint8_t* new_control = aligned_alloc(GROUP_WIDTH, new_capacity);
+        struct StructSymbolSlot* new_slots = calloc(new_capacity, sizeof(struct StructSymbolSlot));
+
         // Error occurred
-        if (errno != 0) {
+        if (new_control == NULL || new_slots == NULL) {
+            free(new_control);
+            free(new_slots);
             return -1;
         }
 
-        // initialize the values of the new nodes
-        for (size_t index = st->capacity; index < new_size; index++) {
-            new_array[index].symbol = NULL;
-            new_array[index].address = 0;
+        memset(new_control, CONTROL_EMPTY, new_capacity);
+
+        // Move every entry into the new arrays
+        SymbolTable resized = *st;
+        resized.capacity = new_capacity;
+        resized.control  = new_control;
+        resized.slots    = new_slots;
+
+        for (size_t index = 0; index < st->capacity; index++) {
+
+            if (st->control[index] != CONTROL_EMPTY) {
+
+                const struct StructSymbolSlot* slot = &st->slots[index];
+                size_t empty = 0;
+
+                SymbolTable_findSlot(&resized, &st->keys[slot->key_offset], slot->key_length, slot->hash, &empty);
+
+                new_control[empty] = st->control[index];
+                new_slots[empty] = *slot;
+            }
         }
 
+        free(st->control);
+        free(st->slots);
+
         // update the values
-        st->capacity = new_size;
-        st->values = new_array;
+        st->capacity = new_capacity;
+        st->control  = new_control;
+        st->slots    = new_slots;
 
         // Done :)
         return 0;
@@ -81,29 +249,65 @@ static int SymbolTable_resize(SymbolTable* st, size_t new_size)
     }
 }
 
-/* Linearly search through the symbol table for a matching symbol
+/* Copy a key into the key arena, growing it as needed
+ * Return the offset of the copied key on success
+ * Return -1 on error, set errno */
+static ssize_t SymbolTable_storeKey(SymbolTable* st, const char* symbol, size_t length)
+{
+    // Keep offsets representable in a slot
+    if (length >= UINT32_MAX || st->keys_size + length + 1 > UINT32_MAX) {
+        errno = ERANGE;
+        return -1;
+    }
+
+    if (st->keys_size + length + 1 > st->keys_capacity) {
+
+        size_t new_capacity = (st->keys_capacity == 0) ? 256 : st->keys_capacity * 2;
+        while (new_capacity < st->keys_size + length + 1) {
+            new_capacity *= 2;
+        }
+
+        char* new_keys = realloc(st->keys, new_capacity);
+        if (new_keys == NULL) {
+            return -1;
+        }
+
+        st->keys = new_keys;
+        st->keys_capacity = new_capacity;
+    }
+
+    ssize_t offset = (ssize_t) st->keys_size;
+
+    memcpy(&st->keys[offset], symbol, length);
+    st->keys[offset + length] = '\0';
+    st->keys_size += length + 1;
+
+    return offset;
+}
+
+/* Search the symbol table for a matching symbol of the given length
  * if one is found return the index of it
  * if it does't exist return -1 and errno will be 0
  * if an error occurred return -1 and errno will be set */
-static ssize_t SymbolTable_getValueIndex(SymbolTable* st, const char* symbol)
+static ssize_t SymbolTable_getValueIndex(const SymbolTable* st, const char* symbol, size_t length)
 {
     if (st != NULL &&
         symbol != NULL) {
 
-        for (size_t index = 0; index < st->size; index++) {
+        // Nothing was added yet
+        if (st->capacity == 0) {
+            errno = 0;
+            return -1;
+        }
 
-            // check if we have a match
-            if (st->values[index].symbol != NULL &&
-                strcmp(st->values[index].symbol, symbol) == 0) {
+        ssize_t index = SymbolTable_findSlot(st, symbol, length, SymbolTable_hash(symbol, length), NULL);
 
-                // match found return its place
-                return index;
-            }
+        // No value found
+        if (index < 0) {
+            errno = 0;
         }
 
-        // No value found
-        errno = 0;
-        return -1;
+        return index;
     }
 
     else {
@@ -116,7 +320,9 @@ static ssize_t SymbolTable_getValueIndex(SymbolTable* st, const char* symbol)
 /* Create / Initialze A symbol table
  * If given an already initialized symbol table memory leaks will occurr
  * this function assumes that the given table is not allocated.
- * capacity is the initial size of the symbol table
+ * capacity is the initial number of entries the table can hold without growing,
+ * nothing is allocated until the first entry is added, the predefined symbols
+ * are always known without being added
  * Return 0 on success, st will also be populated
  * Return -1 on failure, errno will be set */
 extern int SymbolTable_create(SymbolTable* st, size_t capacity)
@@ -127,24 +333,20 @@ extern int SymbolTable_create(SymbolTable* st, size_t capacity)
         // Initialize the values
         st->size = 0;
         st->capacity = 0;
-        st->values = NULL;
-
-        // Allocate the table
-        int error = SymbolTable_resize(st, capacity + TOTAL_PREDEFINED_SYMBOLS);
-
-        // Failed to allocate the table
-        if (error < 0) {
-            return -1;
+        st->control = NULL;
+        st->slots = NULL;
+        st->keys = NULL;
+        st->keys_size = 0;
+        st->keys_capacity = 0;
+        st->lookups = 0;
+
+        // Size the table so the entries stay under the 7/8 load factor
+        size_t slots = GROUP_WIDTH;
+        while (slots - slots / 8 < capacity) {
+            slots *= 2;
         }
 
-        // Add the predefined symbols
-        error = SymbolTable_addPredefinedSymbols(st);
-
-        // Failed to add the predefined symbols
-        if (error < 0) {
-            SymbolTable_free(st);
-            return -1;
-        }
+        st->initial_capacity = slots;
 
         return 0;
     }
@@ -160,84 +362,129 @@ extern void SymbolTable_free(SymbolTable* st)
 {
     if (st != NULL) {
 
-        // Free all memory alloacted within the tuples
-        for (size_t index = 0; index < st->size; index++) {
-            
-            if (st->values[index].symbol != NULL) {
-                free(st->values[index].symbol);
-            }
-        }
-
-        // Free the tuple array
-        free(st->values);
+        // Free the slots and the key arena
+        free(st->control);
+        free(st->slots);
+        free(st->keys);
 
         // Clear the values
         st->size = 0;
         st->capacity = 0;
-        st->values = NULL;
+        st->control = NULL;
+        st->slots = NULL;
+        st->keys = NULL;
+        st->keys_size = 0;
+        st->keys_capacity = 0;
+        st->lookups = 0;
+    }
+}
+
+/* Empty a symbol table so it only holds the predefined symbols
+ * The slots and the key arena are kept for the next program
+ * Return 0 on success
+ * Return -1 on failure, errno will be set */
+extern int SymbolTable_reset(SymbolTable* st)
+{
+    if (st != NULL) {
+
+        if (st->control != NULL) {
+            memset(st->control, CONTROL_EMPTY, st->capacity);
+        }
+
+        st->size = 0;
+        st->keys_size = 0;
+        st->lookups = 0;
+
+        return 0;
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
     }
 }
 
 /* Add an entry to the symbol table
  * If the entry already exists, it will be updated
  * if the entry doesn't exist it will be added
+ * the predefined symbols can't be changed, errno is EEXIST
  * the symbol table is resized as needed
  * Return 0 on success
  * Return -1 on error, set errno */
 extern int SymbolTable_addEntry(SymbolTable* st, const char* symbol, int address)
 {
-    // A constant to dictate how much the symbol table
-    // should grow on a resize
-    static const size_t expansion_value = 10;
+    if (symbol != NULL) {
+        return SymbolTable_addEntryN(st, symbol, strlen(symbol), address);
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/* Same as SymbolTable_addEntry, symbol is length characters long
+ * and doesn't need to be null terminated */
+extern int SymbolTable_addEntryN(SymbolTable* st, const char* symbol, size_t length, int address)
+{
     if (st != NULL &&
-        address < 32766 && // max value a symbol could have given the ram size, 2^15 - 1
+        address >= 0 && address <= 32767 && // largest value a 15 bit A instruction can load, 2^15 - 1
         symbol != NULL)
     {
-        ssize_t error = 0;
+        st->lookups += 1;
 
-        // Check if the symbol already exists
-        error = SymbolTable_getValueIndex(st, symbol);
+        // The predefined symbols are fixed
+        if (SymbolTable_findPredefined(symbol, length) >= 0) {
+            errno = EEXIST;
+            return -1;
+        }
 
-        // Value doesn't exist already
-        if (error == -1 && errno == 0) {
+        // The first entry allocates the table
+        if (st->capacity == 0 && SymbolTable_resize(st, st->initial_capacity) < 0) {
+            return -1;
+        }
 
-            // If the table is full resize
-            if (st->capacity == st->size) {
-                error = SymbolTable_resize(st, st->capacity + expansion_value);
+        uint64_t hash = SymbolTable_hash(symbol, length);
+        size_t   empty = 0;
 
-                // Failed to resize
-                if (error < 0) {
-                    return -1;
-                }
-            }
+        // Check if the symbol already exists
+        ssize_t index = SymbolTable_findSlot(st, symbol, length, hash, &empty);
+
+        // Value exists already, assign the new value
+        if (index >= 0) {
+            st->slots[index].address = address;
+            return 0;
+        }
 
-            // Copy the symbol string
-            st->values[st->size].symbol = strdup(symbol);
+        // If the table is over the 7/8 load factor double it
+        if (st->size + 1 > st->capacity - st->capacity / 8) {
 
-            // Allocation error
-            if(st->values[st->size].symbol == NULL) {
+            if (SymbolTable_resize(st, st->capacity * 2) < 0) {
                 return -1;
             }
 
-            // Insert the address
-            st->values[st->size].address = address;
-
-            // Add one to the size
-            st->size += 1;
+            // The empty slot moved
+            SymbolTable_findSlot(st, symbol, length, hash, &empty);
         }
 
-        // Value exists already and is in range
-        else if (error > 0 && error < st->size) {
+        // Copy the symbol string
+        ssize_t key_offset = SymbolTable_storeKey(st, symbol, length);
 
-            // Assign the new value
-            st->values[error].address = address;
-        }
-
-        // Error occurred
-        else {
+        // Allocation error
+        if (key_offset < 0) {
             return -1;
         }
 
+        // Fill the slot
+        st->control[empty] = (uint8_t) (hash & 0x7f);
+        st->slots[empty].hash = hash;
+        st->slots[empty].key_offset = (uint32_t) key_offset;
+        st->slots[empty].key_length = (uint32_t) length;
+        st->slots[empty].address = address;
+
+        // Add one to the size
+        st->size += 1;
+
         // Done :)
         return 0;
     }
@@ -253,15 +500,36 @@ extern int SymbolTable_addEntry(SymbolTable* st, const char* symbol, int address
  * return 0 if it doesn't
  * return -1 on error, errno will be set */
 extern int SymbolTable_contains (SymbolTable* st, const char* symbol)
+{
+    if (symbol != NULL) {
+        return SymbolTable_containsN(st, symbol, strlen(symbol));
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/* Same as SymbolTable_contains, symbol is length characters long
+ * and doesn't need to be null terminated */
+extern int SymbolTable_containsN(SymbolTable* st, const char* symbol, size_t length)
 {
     if (st != NULL &&
         symbol != NULL) {
 
+        st->lookups += 1;
+
+        // Predefined symbols are known without a search
+        if (SymbolTable_findPredefined(symbol, length) >= 0) {
+            return 1;
+        }
+
         // search for the value in the table
-        ssize_t index = SymbolTable_getValueIndex(st, symbol);
+        ssize_t index = SymbolTable_getValueIndex(st, symbol, length);
 
         // Value exists
-        if (index > 0) {
+        if (index >= 0) {
             return 1;
         }
 
@@ -288,16 +556,46 @@ extern int SymbolTable_contains (SymbolTable* st, const char* symbol)
  * return -1 if the requested symbol doesn't exist
  * return -1 and set errno if an error occured */
 extern int SymbolTable_getAddress(SymbolTable* st, const char* symbol)
+{
+    if (symbol != NULL) {
+        return SymbolTable_getAddressN(st, symbol, strlen(symbol));
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/* Same as SymbolTable_getAddress, symbol is length characters long
+ * and doesn't need to be null terminated */
+extern int SymbolTable_getAddressN(SymbolTable* st, const char* symbol, size_t length)
+{
+    if (st != NULL) {
+        st->lookups += 1;
+    }
+
+    return SymbolTable_readAddressN(st, symbol, length);
+}
+
+/* Same as SymbolTable_getAddressN, the table is only read */
+extern int SymbolTable_readAddressN(const SymbolTable* st, const char* symbol, size_t length)
 {
     if (st != NULL &&
-        st->size > 0 &&
         symbol != NULL) {
 
-        ssize_t index = SymbolTable_getValueIndex(st, symbol);
+        // Predefined symbols are resolved before the table
+        int address = SymbolTable_findPredefined(symbol, length);
+        if (address >= 0) {
+            errno = 0;
+            return address;
+        }
 
-        // Value exists and is in range
-        if (index > 0 && index < st->size) {
-            return st->values[index].address;
+        ssize_t index = SymbolTable_getValueIndex(st, symbol, length);
+
+        // Value exists
+        if (index >= 0) {
+            return st->slots[index].address;
         }
 
         // value doesn't exist
@@ -2,6 +2,7 @@
 #define SYMBOL_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 /* This module contains the symbol table data structure and definitions for the predefined symbols*/
 
@@ -31,15 +32,30 @@
 #define SYMBOL_SCREEN   16384
 #define SYMBOL_KBD      24576
 
-struct StructTuple {
-    char* symbol;
-    int   address;
+/* One slot of the hash table, the key itself lives in the key arena */
+struct StructSymbolSlot {
+    uint64_t hash;         // Cached hash of the key, used for rehashing and fast rejection
+    uint32_t key_offset;   // Offset of the key in the key arena
+    uint32_t key_length;   // Length of the key, excluding the null terminator
+    int      address;
 };
 
+/* Swiss table style open addressing hash map.
+ * Every slot has a control byte, EMPTY or the low 7 bits of the hash,
+ * the control bytes are probed 16 at a time.
+ * The predefined symbols live in a constant table, not in the slots */
 struct StructSymbolTable {
-    size_t size;           // How much entries are in the table
-    size_t capacity;       // How many entries the table can hold
-    struct StructTuple* values;
+    size_t size;           // How much entries were added to the table
+    size_t capacity;       // How many slots the table has, a power of 2 and >= 16, 0 until the first entry
+    size_t initial_capacity; // How many slots the first entry allocates
+    uint8_t* control;      // One control byte per slot
+    struct StructSymbolSlot* slots;
+
+    char*  keys;           // Contiguous arena holding the null terminated keys
+    size_t keys_size;      // How many bytes of the arena are used
+    size_t keys_capacity;  // How many bytes the arena can hold
+
+    size_t lookups;        // Searches made by the functions below since the table was created or reset
 };
 
 typedef struct StructSymbolTable SymbolTable;
@@ -47,8 +63,18 @@ typedef struct StructSymbolTable SymbolTable;
 
 extern int  SymbolTable_create      (SymbolTable*, size_t);
 extern void SymbolTable_free        (SymbolTable*);
+extern int  SymbolTable_reset       (SymbolTable*);
 extern int  SymbolTable_addEntry    (SymbolTable*, const char*, int);
 extern int  SymbolTable_contains    (SymbolTable*, const char*);
 extern int  SymbolTable_getAddress  (SymbolTable*, const char*);
 
+/* Variants taking a symbol that isn't null terminated */
+extern int  SymbolTable_addEntryN   (SymbolTable*, const char*, size_t, int);
+extern int  SymbolTable_containsN   (SymbolTable*, const char*, size_t);
+extern int  SymbolTable_getAddressN (SymbolTable*, const char*, size_t);
+
+/* Same as SymbolTable_getAddressN but the lookup isn't counted, so any number
+ * of threads can call it on a table that no thread modifies */
+extern int  SymbolTable_readAddressN(const SymbolTable*, const char*, size_t);
+
 #endif
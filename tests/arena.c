@@ -0,0 +1,143 @@
+#include "test.h"
+#include "../arena.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+
+/* A block size of 0 is refused and nothing is allocated before the first allocation */
+static void testCreate(void)
+{
+    Arena arena;
+
+    errno = 0;
+    TEST_EQUAL(Arena_create(&arena, 0), -1);
+    TEST_EQUAL(errno, EINVAL);
+
+    TEST_EQUAL(Arena_create(&arena, 64), 0);
+    TEST_CHECK(arena.head == NULL);
+
+    Arena_free(&arena);
+}
+
+/* Allocations are aligned for any type and never overlap, across many blocks */
+static void testAlignment(void)
+{
+    Arena arena;
+    TEST_EQUAL(Arena_create(&arena, 256), 0);
+
+    unsigned char* allocations[200];
+    for (size_t index = 0; index < 200; index++) {
+        allocations[index] = Arena_alloc(&arena, index + 1);
+        TEST_CHECK(allocations[index] != NULL);
+        if (allocations[index] == NULL) {
+            Arena_free(&arena);
+            return;
+        }
+
+        TEST_EQUAL((uintptr_t) allocations[index] % _Alignof(max_align_t), 0);
+        memset(allocations[index], (int) index, index + 1);
+    }
+
+    size_t intact = 0;
+    for (size_t index = 0; index < 200; index++) {
+        size_t byte = 0;
+        while (byte <= index && allocations[index][byte] == (unsigned char) index) {
+            byte += 1;
+        }
+        intact += (byte == index + 1);
+    }
+    TEST_EQUAL(intact, 200);
+
+    Arena_free(&arena);
+    TEST_CHECK(arena.head == NULL);
+}
+
+/* Copies are null terminated and packed without padding */
+static void testStrndup(void)
+{
+    Arena arena;
+    TEST_EQUAL(Arena_create(&arena, 1024), 0);
+
+    char* first = Arena_strndup(&arena, "LOOP;JMP", 4);
+    char* second = Arena_strndup(&arena, "END", 3);
+
+    TEST_CHECK(first != NULL && second != NULL);
+    if (first != NULL && second != NULL) {
+        TEST_EQUAL(strcmp(first, "LOOP"), 0);
+        TEST_EQUAL(strcmp(second, "END"), 0);
+        TEST_CHECK(second == first + 5);
+    }
+
+    char* empty = Arena_strndup(&arena, "", 0);
+    TEST_CHECK(empty != NULL && empty[0] == '\0');
+
+    errno = 0;
+    TEST_CHECK(Arena_strndup(&arena, NULL, 0) == NULL);
+    TEST_EQUAL(errno, EINVAL);
+
+    Arena_free(&arena);
+}
+
+/* An allocation larger than a block gets a block of its own */
+static void testOversized(void)
+{
+    Arena arena;
+    TEST_EQUAL(Arena_create(&arena, 64), 0);
+
+    char* small = Arena_alloc(&arena, 8);
+    char* large = Arena_alloc(&arena, 10000);
+    TEST_CHECK(small != NULL && large != NULL);
+    if (small != NULL && large != NULL) {
+        memset(large, 'x', 10000);
+        TEST_CHECK(arena.head->capacity >= 10000);
+    }
+
+    TEST_CHECK(Arena_alloc(&arena, 8) != NULL);
+
+    errno = 0;
+    TEST_CHECK(Arena_alloc(&arena, SIZE_MAX) == NULL);
+    TEST_EQUAL(errno, ENOMEM);
+
+    Arena_free(&arena);
+}
+
+/* A reset arena keeps its last block and hands out the same memory again */
+static void testReset(void)
+{
+    Arena arena;
+    TEST_EQUAL(Arena_create(&arena, 128), 0);
+
+    // Nothing to keep yet
+    Arena_reset(&arena);
+    TEST_CHECK(arena.head == NULL);
+
+    for (int index = 0; index < 20; index++) {
+        TEST_CHECK(Arena_alloc(&arena, 48) != NULL);
+    }
+    TEST_CHECK(arena.head != NULL && arena.head->next != NULL);
+
+    void* block = arena.head;
+    Arena_reset(&arena);
+    TEST_CHECK(arena.head == block);
+    TEST_CHECK(arena.head->next == NULL);
+    TEST_EQUAL(arena.head->used, 0);
+
+    char* first = Arena_alloc(&arena, 48);
+    TEST_CHECK(first != NULL && (void*) first < (void*) (arena.head->data + arena.head->capacity));
+    TEST_CHECK(arena.head == block);
+
+    Arena_free(&arena);
+}
+
+int main(void)
+{
+    TEST_RUN(testCreate);
+    TEST_RUN(testAlignment);
+    TEST_RUN(testStrndup);
+    TEST_RUN(testOversized);
+    TEST_RUN(testReset);
+
+    return TEST_EXIT();
+}
@@ -0,0 +1,398 @@
+#include "test.h"
+#include "../assembler.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+/* Ways a program can be assembled, they must all agree */
+enum TestMode {
+    TEST_TWO_PASS,
+    TEST_SINGLE_PASS,
+    TEST_THREADS,
+    TEST_OPTIMIZED,
+    TEST_STREAM,
+    TEST_MODE_COUNT
+};
+
+static const char* TEST_MODE_NAMES[TEST_MODE_COUNT] = { "two pass", "single pass", "threads", "optimized", "stream" };
+
+/* Most words a test program assembles to */
+#define TEST_MAX_WORDS  65536
+
+/* Threads of TEST_THREADS */
+static int test_thread_count = 4;
+
+/* Assemble the length bytes at source in mode, the words are stored in words
+ * and their number in count, the first error in report
+ * Return 0 on success
+ * Return -1 on failure */
+static int assembleIn(enum TestMode mode, const char* source, size_t length,
+                      uint16_t* words, size_t* count, AssemblerReport* report)
+{
+    Assembler assembler;
+    TEST_EQUAL(Assembler_create(&assembler), 0);
+
+    AssemblerOptions options;
+    Assembler_defaultOptions(&options);
+    options.output.format = OUTPUT_BINARY;
+    options.output.byte_order = OUTPUT_LITTLE_ENDIAN;
+    options.output.header = 0;
+    options.single_pass = (mode == TEST_SINGLE_PASS);
+    options.thread_count = (mode == TEST_THREADS) ? test_thread_count : 1;
+    options.optimize = (mode == TEST_OPTIMIZED) ? OPTIMIZER_PEEPHOLE : OPTIMIZER_NONE;
+
+    // A stream is read from a file descriptor as it goes, like standard input
+    FILE* input = NULL;
+    Parser parser;
+    if (mode == TEST_STREAM) {
+        input = tmpfile();
+        TEST_CHECK(input != NULL && fwrite(source, 1, length, input) == length && fflush(input) == 0);
+        rewind(input);
+        TEST_EQUAL(Parser_createFromStream(&parser, fileno(input)), 0);
+    }
+    else {
+        Parser_createFromBuffer(&parser, source, length);
+    }
+
+    FILE* output = tmpfile();
+    TEST_CHECK(output != NULL);
+
+    Assembler_clearReport(report);
+    int error = Assembler_assemble(&assembler, &parser, output, &options, report);
+
+    *count = 0;
+    if (error == 0) {
+        uint8_t bytes[2];
+        rewind(output);
+        while (*count < TEST_MAX_WORDS && fread(bytes, 1, 2, output) == 2) {
+            words[*count] = (uint16_t) (bytes[0] | (bytes[1] << 8));
+            *count += 1;
+        }
+    }
+
+    fclose(output);
+    if (input != NULL) {
+        fclose(input);
+    }
+    Parser_free(&parser);
+    Assembler_free(&assembler);
+
+    return error;
+}
+
+/* Append count instructions @0 to source at length
+ * Return the new length */
+static size_t appendInstructions(char* source, size_t length, size_t count)
+{
+    for (size_t index = 0; index < count; index++) {
+        memcpy(source + length, "@0\n", 3);
+        length += 3;
+    }
+
+    return length;
+}
+
+/* Assemble source in every mode, each must fail on line with error_number and message */
+static void checkError(const char* source, size_t length, size_t line, int error_number, const char* message)
+{
+    static uint16_t words[TEST_MAX_WORDS];
+    size_t count = 0;
+    AssemblerReport report;
+
+    for (int mode = 0; mode < TEST_MODE_COUNT; mode++) {
+        int error = assembleIn(mode, source, length, words, &count, &report);
+
+        if (error != -1 || report.line != line || report.error_number != error_number ||
+            report.message == NULL || strcmp(report.message, message) != 0) {
+            fprintf(stderr, "%s: expected \"%s: %s\" on line %zu, got %d \"%s: %s\" on line %zu\n",
+                    TEST_MODE_NAMES[mode], message, strerror(error_number), line, error,
+                    (report.message != NULL) ? report.message : "", strerror(report.error_number), report.line);
+            test_failures += 1;
+        }
+    }
+}
+
+/* Errors are reported on the line of the source that failed,
+ * also when it is far into the last chunk of a threaded assembly */
+static void testErrorLines(void)
+{
+    char* source = malloc(3000 * 3 + 64);
+    TEST_CHECK(source != NULL);
+    if (source == NULL) {
+        return;
+    }
+
+    size_t length = appendInstructions(source, 0, 2900);
+    length += (size_t) sprintf(source + length, "D=D+X\n@0\n");
+    checkError(source, length, 2901, EINVAL, "Failed to parse instruction");
+
+    length = appendInstructions(source, 0, 10);
+    length += (size_t) sprintf(source + length, "(LOOP)\n");
+    length = appendInstructions(source, length, 2900);
+    length += (size_t) sprintf(source + length, "(LOOP)\n@LOOP\n0;JMP\n");
+    checkError(source, length, 2912, EEXIST, "Duplicate or invalid symbol found");
+
+    free(source);
+}
+
+/* A label defined twice, or named like a predefined symbol, is an existing symbol */
+static void testDuplicateLabels(void)
+{
+    static const char* twice = "(LOOP)\n@LOOP\n(LOOP)\n0;JMP\n";
+    static const char* predefined = "@1\nD=A\n(SCREEN)\n@SCREEN\n0;JMP\n";
+    static const char* register_label = "(R15)\n@R15\n";
+
+    checkError(twice, strlen(twice), 3, EEXIST, "Duplicate or invalid symbol found");
+    checkError(predefined, strlen(predefined), 3, EEXIST, "Duplicate or invalid symbol found");
+    checkError(register_label, strlen(register_label), 1, EEXIST, "Duplicate or invalid symbol found");
+}
+
+/* A label past the last address an A instruction can hold is refused in every mode */
+static void testLabelOutOfRange(void)
+{
+    static uint16_t words[TEST_MAX_WORDS];
+    size_t count = 0;
+    AssemblerReport report;
+
+    char* source = malloc(40000 * 3 + 64);
+    TEST_CHECK(source != NULL);
+    if (source == NULL) {
+        return;
+    }
+
+    // The last label an A instruction can load, the optimizer merges the loads before it
+    size_t length = appendInstructions(source, 0, 32767);
+    length += (size_t) sprintf(source + length, "(LAST)\n@LAST\n0;JMP\n");
+
+    for (int mode = 0; mode < TEST_MODE_COUNT; mode++) {
+        int error = assembleIn(mode, source, length, words, &count, &report);
+        if (error != 0 || (mode != TEST_OPTIMIZED && (count != 32769 || words[32767] != 32767))) {
+            fprintf(stderr, "%s: label at 32767 failed: %s\n", TEST_MODE_NAMES[mode],
+                    (report.message != NULL) ? report.message : "");
+            test_failures += 1;
+        }
+    }
+
+    length = appendInstructions(source, 0, 40000);
+    length += (size_t) sprintf(source + length, "(END)\n@END\n0;JMP\n");
+    checkError(source, length, 40001, EINVAL, "Failed to add entry to symbol table");
+
+    free(source);
+}
+
+/* A single pass into a file opened for appending can't patch by seeking,
+ * the words wait for their labels instead and land after what was there.
+ * Text words are long enough that the reference is flushed before its label */
+static void testAppendOutput(void)
+{
+    char* source = malloc(5000 * 3 + 64);
+    TEST_CHECK(source != NULL);
+    if (source == NULL) {
+        return;
+    }
+
+    size_t length = (size_t) sprintf(source, "@END\n");
+    length = appendInstructions(source, length, 5000);
+    length += (size_t) sprintf(source + length, "(END)\n@END\n0;JMP\n");
+
+    char path[] = "/tmp/hack-test-XXXXXX";
+    int fd = mkstemp(path);
+    TEST_CHECK(fd >= 0);
+    if (fd < 0) {
+        free(source);
+        return;
+    }
+    TEST_EQUAL(write(fd, "HI", 2), 2);
+    close(fd);
+
+    FILE* output = fopen(path, "a+");
+    unlink(path);
+    TEST_CHECK(output != NULL);
+    if (output == NULL) {
+        free(source);
+        return;
+    }
+
+    Assembler assembler;
+    TEST_EQUAL(Assembler_create(&assembler), 0);
+
+    AssemblerOptions options;
+    Assembler_defaultOptions(&options);
+    options.single_pass = 1;
+
+    Parser parser;
+    Parser_createFromBuffer(&parser, source, length);
+
+    AssemblerReport report;
+    Assembler_clearReport(&report);
+    TEST_EQUAL(Assembler_assemble(&assembler, &parser, output, &options, &report), 0);
+
+    // The old contents, then every word once
+    char line[32];
+    size_t count = 0;
+    rewind(output);
+    TEST_CHECK(fread(line, 1, 2, output) == 2 && memcmp(line, "HI", 2) == 0);
+    while (fgets(line, sizeof(line), output) != NULL) {
+        if (count == 0 || count == 5001) {
+            TEST_BYTES(line, strlen(line), "0001001110001001\n");
+        }
+        count += 1;
+    }
+    TEST_EQUAL(count, 5003);
+
+    fclose(output);
+    Parser_free(&parser);
+    Assembler_free(&assembler);
+    free(source);
+}
+
+/* Return a random number below bound */
+static uint32_t randomBelow(uint64_t* state, uint32_t bound)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+
+    return (uint32_t) (*state % bound);
+}
+
+/* Write a random program to source: labels referenced before and after
+ * their definition, variables, predefined symbols, comments and blank lines
+ * Return its length */
+static size_t generateProgram(uint64_t seed, char* source)
+{
+    static const char* lines[] = {
+        "D=A", "M=D+M", "AM=M-1", "0;JMP", "D;JGT", "  MD = M+1 ; JNE  ", "A=!D",
+        "@SP", "@R13", "@SCREEN", "@KBD", "@17", "@32767", "", "   ", "// comment", "\t@0 // zero"
+    };
+
+    uint64_t state = seed * 0x9e3779b97f4a7c15ULL + 1;
+    size_t length = 0;
+    int label_count = 0;
+
+    uint32_t line_count = 1 + randomBelow(&state, 400);
+    for (uint32_t index = 0; index < line_count; index++) {
+
+        uint32_t choice = randomBelow(&state, 100);
+
+        if (choice < 10) {
+            length += (size_t) sprintf(source + length, "(L%d)\n", label_count);
+            label_count += 1;
+        }
+        else if (choice < 30) {
+            length += (size_t) sprintf(source + length, "@L%u\n", randomBelow(&state, 40));
+        }
+        else if (choice < 40) {
+            length += (size_t) sprintf(source + length, "@v%u\n", randomBelow(&state, 12));
+        }
+        else {
+            length += (size_t) sprintf(source + length, "%s\n", lines[randomBelow(&state, 17)]);
+        }
+    }
+
+    // Define every label a reference may have used, the last line has no newline
+    while (label_count < 40) {
+        length += (size_t) sprintf(source + length, "(L%d)\n", label_count);
+        label_count += 1;
+    }
+    length += (size_t) sprintf(source + length, "@L0");
+
+    return length;
+}
+
+/* Two pass, single pass, threaded and streamed assembly give the same words,
+ * the optimized program is no longer */
+static void testModesAgree(void)
+{
+    static char source[16 * 1024];
+    static uint16_t expected[TEST_MAX_WORDS];
+    static uint16_t words[TEST_MAX_WORDS];
+
+    int failed = 0;
+    for (uint64_t seed = 1; seed <= 300 && failed < 3; seed++) {
+        size_t length = generateProgram(seed, source);
+
+        size_t expected_count = 0;
+        AssemblerReport report;
+        TEST_EQUAL(assembleIn(TEST_TWO_PASS, source, length, expected, &expected_count, &report), 0);
+
+        for (int mode = TEST_SINGLE_PASS; mode < TEST_MODE_COUNT; mode++) {
+            size_t count = 0;
+            int error = assembleIn(mode, source, length, words, &count, &report);
+
+            int same = (mode == TEST_OPTIMIZED)
+                     ? (count <= expected_count)
+                     : (count == expected_count && memcmp(words, expected, count * sizeof(uint16_t)) == 0);
+
+            if (error != 0 || same == 0) {
+                fprintf(stderr, "seed %llu, %s differs\n", (unsigned long long) seed, TEST_MODE_NAMES[mode]);
+                failed += 1;
+            }
+        }
+    }
+
+    TEST_EQUAL(failed, 0);
+}
+
+/* Any number of threads gives the same words, also with more threads
+ * than lines and with chunks cut in the middle of a line */
+static void testThreadCounts(void)
+{
+    static const int thread_counts[] = { 2, 3, 5, 8, 13, 64, 100 };
+    static char source[16 * 1024];
+    static uint16_t expected[TEST_MAX_WORDS];
+    static uint16_t words[TEST_MAX_WORDS];
+    AssemblerReport report;
+
+    int failed = 0;
+    for (uint64_t seed = 1000; seed <= 1040; seed++) {
+        size_t length = generateProgram(seed, source);
+
+        size_t expected_count = 0;
+        TEST_EQUAL(assembleIn(TEST_TWO_PASS, source, length, expected, &expected_count, &report), 0);
+
+        for (size_t index = 0; index < sizeof(thread_counts) / sizeof(thread_counts[0]); index++) {
+            test_thread_count = thread_counts[index];
+
+            size_t count = 0;
+            if (assembleIn(TEST_THREADS, source, length, words, &count, &report) != 0 ||
+                count != expected_count || memcmp(words, expected, count * sizeof(uint16_t)) != 0) {
+                fprintf(stderr, "seed %llu differs on %d threads\n", (unsigned long long) seed, test_thread_count);
+                failed += 1;
+            }
+        }
+    }
+    TEST_EQUAL(failed, 0);
+
+    // Fewer bytes than threads
+    static const char* tiny[] = { "", "\n", "@1", "(A)\n@A", "D=A\r\n@x\r\n" };
+    for (size_t index = 0; index < sizeof(tiny) / sizeof(tiny[0]); index++) {
+        size_t expected_count = 0;
+        size_t count = 0;
+        test_thread_count = 64;
+
+        TEST_EQUAL(assembleIn(TEST_TWO_PASS, tiny[index], strlen(tiny[index]), expected, &expected_count, &report), 0);
+        TEST_EQUAL(assembleIn(TEST_THREADS, tiny[index], strlen(tiny[index]), words, &count, &report), 0);
+        TEST_EQUAL(count, expected_count);
+        TEST_EQUAL(memcmp(words, expected, count * sizeof(uint16_t)), 0);
+    }
+
+    test_thread_count = 4;
+}
+
+int main(void)
+{
+    TEST_RUN(testErrorLines);
+    TEST_RUN(testDuplicateLabels);
+    TEST_RUN(testLabelOutOfRange);
+    TEST_RUN(testAppendOutput);
+    TEST_RUN(testModesAgree);
+    TEST_RUN(testThreadCounts);
+
+    return TEST_EXIT();
+}
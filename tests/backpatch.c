@@ -0,0 +1,286 @@
+#include "test.h"
+#include "../backpatch.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+
+/* Create output as little endian binary words without a header in a new temporary file
+ * Return the file, NULL on failure */
+static FILE* createOutput(Output* output)
+{
+    FILE* file = tmpfile();
+    TEST_CHECK(file != NULL);
+    if (file == NULL) {
+        return NULL;
+    }
+
+    OutputOptions options;
+    Output_defaultOptions(&options);
+    options.format = OUTPUT_BINARY;
+    TEST_EQUAL(Output_create(output, file, &options), 0);
+
+    return file;
+}
+
+/* Flush output and read its words back into words, which holds capacity words
+ * Return the number of words */
+static size_t readWords(Output* output, uint16_t* words, size_t capacity)
+{
+    TEST_EQUAL(Output_flush(output), 0);
+    rewind(output->file);
+
+    size_t count = 0;
+    unsigned char bytes[2];
+    while (count < capacity && fread(bytes, 1, 2, output->file) == 2) {
+        words[count] = (uint16_t) (bytes[0] | (bytes[1] << 8));
+        count += 1;
+    }
+
+    return count;
+}
+
+/* Write a word that references symbol, it waits in the output for its address */
+static void writeReference(Backpatch* backpatch, Output* output, const char* symbol)
+{
+    TEST_EQUAL(Backpatch_addReference(backpatch, symbol, strlen(symbol), output->word_count), 0);
+    TEST_EQUAL(Output_writeWord(output, 0), 0);
+}
+
+/* Every word that referenced a label is patched once it is defined,
+ * the remaining symbols become variables in order of first use */
+static void testResolve(void)
+{
+    static Output output;
+    FILE* file = createOutput(&output);
+    if (file == NULL) {
+        return;
+    }
+
+    Arena arena;
+    TEST_EQUAL(Arena_create(&arena, 1024), 0);
+    Backpatch backpatch;
+    TEST_EQUAL(Backpatch_create(&backpatch, &arena), 0);
+    SymbolTable symbol_table;
+    TEST_EQUAL(SymbolTable_create(&symbol_table, 16), 0);
+
+    writeReference(&backpatch, &output, "LOOP");
+    writeReference(&backpatch, &output, "b");
+    writeReference(&backpatch, &output, "LOOP");
+    writeReference(&backpatch, &output, "a");
+    writeReference(&backpatch, &output, "b");
+    TEST_EQUAL(Output_writeWord(&output, 0xea87), 0);
+
+    TEST_EQUAL(Backpatch_resolveLabel(&backpatch, "LOOP", 4, 6, &output), 0);
+
+    // Never referenced
+    TEST_EQUAL(Backpatch_resolveLabel(&backpatch, "END", 3, 7, &output), 0);
+
+    TEST_EQUAL(Backpatch_resolveVariables(&backpatch, &symbol_table, 16, &output), 0);
+    TEST_EQUAL(SymbolTable_getAddress(&symbol_table, "b"), 16);
+    TEST_EQUAL(SymbolTable_getAddress(&symbol_table, "a"), 17);
+    TEST_EQUAL(SymbolTable_contains(&symbol_table, "LOOP"), 0);
+
+    static const uint16_t expected[] = { 6, 16, 6, 17, 16, 0xea87 };
+    uint16_t words[8];
+    TEST_EQUAL(readWords(&output, words, 8), 6);
+    TEST_EQUAL(memcmp(words, expected, sizeof(expected)), 0);
+
+    SymbolTable_free(&symbol_table);
+    Backpatch_free(&backpatch);
+    Arena_free(&arena);
+    fclose(file);
+}
+
+/* The fixups of a resolved label are reused by the next ones */
+static void testFixupReuse(void)
+{
+    static Output output;
+    FILE* file = createOutput(&output);
+    if (file == NULL) {
+        return;
+    }
+
+    Arena arena;
+    TEST_EQUAL(Arena_create(&arena, 1024), 0);
+    Backpatch backpatch;
+    TEST_EQUAL(Backpatch_create(&backpatch, &arena), 0);
+
+    char label[16];
+    for (int round = 0; round < 100; round++) {
+        snprintf(label, sizeof(label), "L%d", round);
+        for (int reference = 0; reference < 10; reference++) {
+            writeReference(&backpatch, &output, label);
+        }
+        TEST_EQUAL(Backpatch_resolveLabel(&backpatch, label, strlen(label), round, &output), 0);
+    }
+
+    TEST_EQUAL(backpatch.fixup_count, 10);
+    TEST_EQUAL(backpatch.pending_count, 100);
+
+    static uint16_t words[1000];
+    TEST_EQUAL(readWords(&output, words, 1000), 1000);
+    int patched = 0;
+    for (int index = 0; index < 1000; index++) {
+        patched += (words[index] == index / 10);
+    }
+    TEST_EQUAL(patched, 1000);
+
+    Backpatch_free(&backpatch);
+    Arena_free(&arena);
+    fclose(file);
+}
+
+/* Words are held from the oldest one that waits for a symbol,
+ * and are written in order once it is patched */
+static void testWindow(void)
+{
+    static Output output;
+    FILE* file = createOutput(&output);
+    if (file == NULL) {
+        return;
+    }
+
+    Window window;
+    Window_create(&window);
+
+    TEST_EQUAL(Window_push(&window, &output, 10, 0), 0);
+    TEST_EQUAL(Window_push(&window, &output, 0, 1), 0);
+    TEST_EQUAL(Window_push(&window, &output, 12, 0), 0);
+    TEST_EQUAL(Window_push(&window, &output, 0, 1), 0);
+    TEST_EQUAL(Window_push(&window, &output, 14, 0), 0);
+
+    TEST_EQUAL(output.word_count, 1);
+    TEST_EQUAL(window.count, 4);
+    TEST_EQUAL(window.pending_count, 2);
+
+    // The oldest is still waiting
+    TEST_EQUAL(Window_patch(&window, 3, 13), 0);
+    TEST_EQUAL(Window_release(&window, &output), 0);
+    TEST_EQUAL(output.word_count, 1);
+
+    TEST_EQUAL(Window_patch(&window, 1, 11), 0);
+    TEST_EQUAL(Window_release(&window, &output), 0);
+    TEST_EQUAL(output.word_count, 5);
+    TEST_EQUAL(window.count, 0);
+    TEST_EQUAL(window.peak_count, 4);
+
+    // Released words can't be patched
+    errno = 0;
+    TEST_EQUAL(Window_patch(&window, 1, 0), -1);
+    TEST_EQUAL(errno, EINVAL);
+
+    // Nothing held, straight to the output
+    TEST_EQUAL(Window_push(&window, &output, 15, 0), 0);
+    TEST_EQUAL(output.word_count, 6);
+
+    static const uint16_t expected[] = { 10, 11, 12, 13, 14, 15 };
+    uint16_t words[8];
+    TEST_EQUAL(readWords(&output, words, 8), 6);
+    TEST_EQUAL(memcmp(words, expected, sizeof(expected)), 0);
+
+    Window_free(&window);
+    fclose(file);
+}
+
+/* The ring grows past its first size and keeps the words in order when it wraps */
+static void testWindowGrowth(void)
+{
+    static Output output;
+    FILE* file = createOutput(&output);
+    if (file == NULL) {
+        return;
+    }
+
+    Window window;
+    Window_create(&window);
+
+    // Wrap the ring a few times, then grow it while it is wrapped
+    uint16_t next = 0;
+    for (int round = 0; round < 5; round++) {
+        TEST_EQUAL(Window_push(&window, &output, 0, 1), 0);
+        size_t pending = window.first_index;
+        next += 1;
+        for (int index = 0; index < 200; index++) {
+            TEST_EQUAL(Window_push(&window, &output, next, 0), 0);
+            next += 1;
+        }
+        TEST_EQUAL(Window_patch(&window, pending, (uint16_t) pending), 0);
+        TEST_EQUAL(Window_release(&window, &output), 0);
+    }
+
+    TEST_EQUAL(Window_push(&window, &output, 0, 1), 0);
+    size_t pending = window.first_index;
+    next += 1;
+    for (int index = 0; index < 1000; index++) {
+        TEST_EQUAL(Window_push(&window, &output, next, 0), 0);
+        next += 1;
+    }
+    TEST_CHECK(window.capacity >= 1001);
+    TEST_EQUAL(Window_patch(&window, pending, (uint16_t) pending), 0);
+    TEST_EQUAL(Window_release(&window, &output), 0);
+
+    static uint16_t words[4096];
+    size_t count = readWords(&output, words, 4096);
+    TEST_EQUAL(count, next);
+
+    size_t ordered = 0;
+    for (size_t index = 0; index < count; index++) {
+        ordered += (words[index] == index);
+    }
+    TEST_EQUAL(ordered, count);
+
+    Window_free(&window);
+    fclose(file);
+}
+
+/* With a window the patches go to the held words, the output is never sought */
+static void testBackpatchWindow(void)
+{
+    static Output output;
+    FILE* file = createOutput(&output);
+    if (file == NULL) {
+        return;
+    }
+
+    Arena arena;
+    TEST_EQUAL(Arena_create(&arena, 1024), 0);
+    Backpatch backpatch;
+    TEST_EQUAL(Backpatch_create(&backpatch, &arena), 0);
+    Window window;
+    Window_create(&window);
+    Backpatch_setWindow(&backpatch, &window);
+
+    TEST_EQUAL(Window_push(&window, &output, 1, 0), 0);
+    TEST_EQUAL(Backpatch_addReference(&backpatch, "END", 3, 1), 0);
+    TEST_EQUAL(Window_push(&window, &output, 0, 1), 0);
+    TEST_EQUAL(Window_push(&window, &output, 2, 0), 0);
+    TEST_EQUAL(output.word_count, 1);
+
+    TEST_EQUAL(Backpatch_resolveLabel(&backpatch, "END", 3, 3, &output), 0);
+    TEST_EQUAL(window.pending_count, 0);
+    TEST_EQUAL(Window_release(&window, &output), 0);
+
+    static const uint16_t expected[] = { 1, 3, 2 };
+    uint16_t words[4];
+    TEST_EQUAL(readWords(&output, words, 4), 3);
+    TEST_EQUAL(memcmp(words, expected, sizeof(expected)), 0);
+
+    Window_free(&window);
+    Backpatch_free(&backpatch);
+    Arena_free(&arena);
+    fclose(file);
+}
+
+int main(void)
+{
+    TEST_RUN(testResolve);
+    TEST_RUN(testFixupReuse);
+    TEST_RUN(testWindow);
+    TEST_RUN(testWindowGrowth);
+    TEST_RUN(testBackpatchWindow);
+
+    return TEST_EXIT();
+}
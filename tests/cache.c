@@ -0,0 +1,199 @@
+#include "test.h"
+#include "../cache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/* Return 1 if the two keys are the same */
+static int sameKey(const CacheKey* first, const CacheKey* second)
+{
+    return first->high == second->high && first->low == second->low;
+}
+
+/* Remove every file in directory and the directory itself
+ * Return the number of files that were in it */
+static int removeDirectory(const char* directory)
+{
+    DIR* handle = opendir(directory);
+    if (handle == NULL) {
+        return 0;
+    }
+
+    int count = 0;
+    struct dirent* entry = NULL;
+    char path[PATH_MAX];
+
+    while ((entry = readdir(handle)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+        unlink(path);
+        count += 1;
+    }
+
+    closedir(handle);
+    rmdir(directory);
+
+    return count;
+}
+
+/* The key changes with every byte of the source and every option the output
+ * depends on, text ignores the binary options */
+static void testKeys(void)
+{
+    static const char* source = "@2\nD=A\n@3\nD=D+A\n@0\nM=D\n";
+    size_t length = strlen(source);
+
+    OutputOptions text;
+    Output_defaultOptions(&text);
+    OutputOptions binary = text;
+    binary.format = OUTPUT_BINARY;
+
+    CacheKey key;
+    CacheKey other;
+    Cache_computeKey(source, length, &text, 0, &key);
+    Cache_computeKey(source, length, &text, 0, &other);
+    TEST_CHECK(sameKey(&key, &other));
+
+    // Every single bit flip
+    static char changed[64];
+    int collisions = 0;
+    for (size_t index = 0; index < length; index++) {
+        for (int bit = 0; bit < 8; bit++) {
+            memcpy(changed, source, length);
+            changed[index] = (char) (changed[index] ^ (1 << bit));
+            Cache_computeKey(changed, length, &text, 0, &other);
+            collisions += sameKey(&key, &other);
+        }
+    }
+    TEST_EQUAL(collisions, 0);
+
+    // A prefix, the optimization level and the format
+    Cache_computeKey(source, length - 1, &text, 0, &other);
+    TEST_CHECK(!sameKey(&key, &other));
+    Cache_computeKey(source, length, &text, 1, &other);
+    TEST_CHECK(!sameKey(&key, &other));
+    Cache_computeKey(source, length, &binary, 0, &other);
+    TEST_CHECK(!sameKey(&key, &other));
+
+    // Byte order and header only matter to binary output
+    CacheKey binary_key;
+    Cache_computeKey(source, length, &binary, 0, &binary_key);
+    binary.byte_order = OUTPUT_BIG_ENDIAN;
+    Cache_computeKey(source, length, &binary, 0, &other);
+    TEST_CHECK(!sameKey(&binary_key, &other));
+    binary.byte_order = OUTPUT_LITTLE_ENDIAN;
+    binary.header = 1;
+    Cache_computeKey(source, length, &binary, 0, &other);
+    TEST_CHECK(!sameKey(&binary_key, &other));
+
+    text.byte_order = OUTPUT_BIG_ENDIAN;
+    text.header = 1;
+    Cache_computeKey(source, length, &text, 0, &other);
+    TEST_CHECK(sameKey(&key, &other));
+}
+
+/* A stored entry is fetched back exactly, another key misses and writes nothing */
+static void testStoreFetch(void)
+{
+    char directory[] = "/tmp/hack-cache-XXXXXX";
+    TEST_CHECK(mkdtemp(directory) != NULL);
+
+    char cache[64];
+    snprintf(cache, sizeof(cache), "%s/cache", directory);
+    TEST_EQUAL(Cache_createDirectory(cache), 0);
+    TEST_EQUAL(Cache_createDirectory(cache), 0);
+
+    char output_path[64];
+    snprintf(output_path, sizeof(output_path), "%s/Prog.hack", directory);
+    FILE* output = fopen(output_path, "w");
+    TEST_CHECK(output != NULL);
+    if (output == NULL) {
+        return;
+    }
+    for (int index = 0; index < 10000; index++) {
+        fprintf(output, "%016d\n", index);
+    }
+    fclose(output);
+
+    OutputOptions options;
+    Output_defaultOptions(&options);
+    CacheKey key;
+    CacheKey other;
+    Cache_computeKey("@1\n", 3, &options, 0, &key);
+    Cache_computeKey("@2\n", 3, &options, 0, &other);
+
+    FILE* fetched = tmpfile();
+    TEST_CHECK(fetched != NULL);
+    if (fetched == NULL) {
+        return;
+    }
+
+    TEST_EQUAL(Cache_fetch(cache, &key, fetched), 0);
+    TEST_EQUAL(Cache_store(cache, &key, output_path), 0);
+    TEST_EQUAL(Cache_fetch(cache, &other, fetched), 0);
+    TEST_EQUAL(ftell(fetched), 0);
+
+    TEST_EQUAL(Cache_fetch(cache, &key, fetched), 1);
+    TEST_EQUAL(ftell(fetched), 10000 * 17);
+
+    rewind(fetched);
+    char line[32];
+    int same = 0;
+    for (int index = 0; index < 10000 && fgets(line, sizeof(line), fetched) != NULL; index++) {
+        same += (atoi(line) == index && strlen(line) == 17);
+    }
+    TEST_EQUAL(same, 10000);
+    fclose(fetched);
+
+    // Published entries are read only
+    char entry[128];
+    snprintf(entry, sizeof(entry), "%s/%016llx%016llx", cache, (unsigned long long) key.high, (unsigned long long) key.low);
+    struct stat entry_stat;
+    TEST_EQUAL(stat(entry, &entry_stat), 0);
+    TEST_EQUAL(entry_stat.st_mode & 0222, 0);
+
+    unlink(output_path);
+    TEST_EQUAL(removeDirectory(cache), 1);
+    rmdir(directory);
+}
+
+/* A failed store leaves nothing behind */
+static void testFailedStore(void)
+{
+    char directory[] = "/tmp/hack-cache-XXXXXX";
+    TEST_CHECK(mkdtemp(directory) != NULL);
+
+    OutputOptions options;
+    Output_defaultOptions(&options);
+    CacheKey key;
+    Cache_computeKey("@1\n", 3, &options, 0, &key);
+
+    errno = 0;
+    TEST_EQUAL(Cache_store(directory, &key, "/nonexistent/Prog.hack"), -1);
+    TEST_EQUAL(errno, ENOENT);
+
+    errno = 0;
+    TEST_EQUAL(Cache_fetch(NULL, &key, stdout), -1);
+    TEST_EQUAL(errno, EINVAL);
+
+    TEST_EQUAL(removeDirectory(directory), 0);
+}
+
+int main(void)
+{
+    TEST_RUN(testKeys);
+    TEST_RUN(testStoreFetch);
+    TEST_RUN(testFailedStore);
+
+    return TEST_EXIT();
+}
@@ -0,0 +1,169 @@
+#include "test.h"
+#include "../code.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+
+/* Make a view of the length bytes at data */
+static StringView makeView(const char* data, size_t length)
+{
+    StringView view = { data, length };
+    return view;
+}
+
+/* Every one of the 128 comp fields either isn't a computation
+ * or decodes to the mneumonic that encodes back to it */
+static void testCompRoundTrip(void)
+{
+    int known = 0;
+
+    for (int bits = 0; bits < 128; bits++) {
+        char name[3];
+        int length = decodeComp((uint8_t) bits, name);
+
+        if (length < 0) {
+            continue;
+        }
+
+        known += 1;
+
+        uint16_t word = 0;
+        TEST_EQUAL(encodeCInstructionView(makeView("D", 1), makeView(name, (size_t) length), makeView(NULL, 0), &word), 0);
+        TEST_EQUAL((word >> COMP_SHIFT) & 0x7f, bits);
+    }
+
+    TEST_EQUAL(known, 28);
+}
+
+/* Every dest and jump field decodes to the mneumonic that encodes back to it,
+ * the null fields decode to nothing */
+static void testDestJumpRoundTrip(void)
+{
+    for (int bits = 0; bits < 8; bits++) {
+        char dest[3];
+        char jump[3];
+        int dest_length = decodeDest((uint8_t) bits, dest);
+        int jump_length = decodeJump((uint8_t) bits, jump);
+
+        TEST_CHECK(dest_length >= 0 && jump_length >= 0);
+        TEST_EQUAL(dest_length == 0, bits == 0);
+        TEST_EQUAL(jump_length == 0, bits == 0);
+        if (bits == 0 || dest_length < 0 || jump_length < 0) {
+            continue;
+        }
+
+        uint16_t word = 0;
+        TEST_EQUAL(encodeCInstructionView(makeView(dest, (size_t) dest_length), makeView("0", 1),
+                                          makeView(jump, (size_t) jump_length), &word), 0);
+        TEST_EQUAL(word, C_INSTRUCTION_PREFIX | (COMP_BITS_0 << COMP_SHIFT) |
+                         (bits << DEST_SHIFT) | (bits << JUMP_SHIFT));
+    }
+}
+
+/* Of every string of up to 3 printable characters only the mneumonics of a field
+ * are accepted for it, whatever slot of the perfect hash they land in */
+static void testOnlyMneumonics(void)
+{
+    int comps = 0;
+    int dests = 0;
+    int jumps = 0;
+    char name[3];
+
+    for (size_t length = 1; length <= 3; length++) {
+        size_t count = 1;
+        for (size_t index = 0; index < length; index++) {
+            count *= 95;
+        }
+
+        for (size_t value = 0; value < count; value++) {
+            size_t rest = value;
+            for (size_t index = 0; index < length; index++) {
+                name[index] = (char) (' ' + rest % 95);
+                rest /= 95;
+            }
+
+            uint16_t word = 0;
+            StringView view = makeView(name, length);
+            comps += (encodeCInstructionView(makeView("D", 1), view, makeView(NULL, 0), &word) == 0);
+            dests += (encodeCInstructionView(view, makeView("0", 1), makeView(NULL, 0), &word) == 0);
+            jumps += (encodeCInstructionView(makeView(NULL, 0), makeView("0", 1), view, &word) == 0);
+        }
+    }
+
+    TEST_EQUAL(comps, 28);
+    TEST_EQUAL(dests, 7);
+    TEST_EQUAL(jumps, 7);
+}
+
+/* Near misses are refused with EINVAL */
+static void testInvalid(void)
+{
+    static const char* computations[] = { "JMP", "MD", "1+D", "A+D", "d", "D+", "M+1 ", "D\0" };
+
+    uint16_t word = 0xffff;
+    for (size_t index = 0; index < sizeof(computations) / sizeof(computations[0]); index++) {
+        size_t length = (index == 7) ? 2 : strlen(computations[index]);
+
+        errno = 0;
+        TEST_EQUAL(encodeCInstructionView(makeView("D", 1), makeView(computations[index], length),
+                                          makeView(NULL, 0), &word), -1);
+        TEST_EQUAL(errno, EINVAL);
+    }
+
+    // A view only counts its own length
+    TEST_EQUAL(encodeCInstructionView(makeView("AMDX", 3), makeView("D+1;", 3), makeView("JMPX", 3), &word), 0);
+    TEST_EQUAL(word, 0xe7ff);
+    TEST_EQUAL(encodeCInstructionView(makeView("AMDX", 4), makeView("0", 1), makeView(NULL, 0), &word), -1);
+
+    // The computation and a destination or a jump are required
+    TEST_EQUAL(encodeCInstructionView(makeView("D", 1), makeView(NULL, 0), makeView(NULL, 0), &word), -1);
+    TEST_EQUAL(encodeCInstructionView(makeView(NULL, 0), makeView("0", 1), makeView(NULL, 0), &word), -1);
+
+    // A present destination or jump can't be empty, like "=M" or "D;"
+    errno = 0;
+    TEST_EQUAL(encodeCInstructionView(makeView("", 0), makeView("M", 1), makeView(NULL, 0), &word), -1);
+    TEST_EQUAL(errno, EINVAL);
+    errno = 0;
+    TEST_EQUAL(encodeCInstructionView(makeView(NULL, 0), makeView("D", 1), makeView("", 0), &word), -1);
+    TEST_EQUAL(errno, EINVAL);
+    TEST_EQUAL(encodeCInstructionView(makeView("D", 1), makeView("M", 1), makeView("", 0), &word), -1);
+    TEST_EQUAL(encodeCInstructionView(makeView("", 0), makeView("0", 1), makeView("JMP", 3), &word), -1);
+
+    TEST_EQUAL(word, 0xe7ff);
+}
+
+/* Decimal constants up to 32767 are constants, anything else with a digit
+ * missing is a symbol */
+static void testAConstant(void)
+{
+    uint16_t value = 0;
+
+    TEST_EQUAL(parseAConstant(makeView("0", 1), &value), 1);
+    TEST_EQUAL(value, 0);
+    TEST_EQUAL(parseAConstant(makeView("32767", 5), &value), 1);
+    TEST_EQUAL(value, 32767);
+    TEST_EQUAL(parseAConstant(makeView("000017", 6), &value), 1);
+    TEST_EQUAL(value, 17);
+
+    TEST_EQUAL(parseAConstant(makeView("1x", 2), &value), 0);
+    TEST_EQUAL(parseAConstant(makeView("R1", 2), &value), 0);
+    TEST_EQUAL(parseAConstant(makeView("-1", 2), &value), 0);
+
+    errno = 0;
+    TEST_EQUAL(parseAConstant(makeView("32768", 5), &value), -1);
+    TEST_EQUAL(errno, EINVAL);
+    TEST_EQUAL(parseAConstant(makeView("4294967297", 10), &value), -1);
+}
+
+int main(void)
+{
+    TEST_RUN(testCompRoundTrip);
+    TEST_RUN(testDestJumpRoundTrip);
+    TEST_RUN(testOnlyMneumonics);
+    TEST_RUN(testInvalid);
+    TEST_RUN(testAConstant);
+
+    return TEST_EXIT();
+}
@@ -0,0 +1,273 @@
+#include "test.h"
+#include "../cpu.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* Registers and memory of the reference machine */
+struct Machine {
+    uint16_t a;
+    uint16_t d;
+    uint16_t pc;
+    uint16_t ram[65536];
+};
+
+/* Execute one instruction of rom the way the Hack CPU is specified:
+ * bit 15 selects a C instruction, bit 12 selects M over A, bits 11-6 drive
+ * the ALU, bits 5-3 are A, D and M, bits 2-0 jump on less, equal and greater */
+static void step(struct Machine* machine, const uint16_t* rom)
+{
+    uint16_t word = rom[machine->pc];
+
+    if ((word & 0x8000) == 0) {
+        machine->a = word;
+        machine->pc = (uint16_t) ((machine->pc + 1) & 0x7fff);
+        return;
+    }
+
+    uint16_t x = machine->d;
+    uint16_t y = (word & 0x1000) ? machine->ram[machine->a] : machine->a;
+
+    if (word & 0x0800) x = 0;
+    if (word & 0x0400) x = (uint16_t) ~x;
+    if (word & 0x0200) y = 0;
+    if (word & 0x0100) y = (uint16_t) ~y;
+    uint16_t out = (word & 0x0080) ? (uint16_t) (x + y) : (uint16_t) (x & y);
+    if (word & 0x0040) out = (uint16_t) ~out;
+
+    uint16_t address = machine->a;
+    int16_t result = (int16_t) out;
+    int jump = ((word & 0x4) && result < 0) || ((word & 0x2) && result == 0) || ((word & 0x1) && result > 0);
+
+    if (word & 0x0008) machine->ram[address] = out;
+    if (word & 0x0010) machine->d = out;
+    if (word & 0x0020) machine->a = out;
+
+    machine->pc = (jump) ? (uint16_t) (address & 0x7fff) : (uint16_t) ((machine->pc + 1) & 0x7fff);
+}
+
+/* Step an xorshift generator
+ * Return a number below bound */
+static uint64_t randomBelow(uint64_t* state, uint64_t bound)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+
+    return *state % bound;
+}
+
+/* The C instructions fused with the @X before them, and other common ones */
+static const uint16_t common[] = {
+    0xfc10, 0xec10, 0xe308, 0xfc20, 0xfdc8, 0xfca8, 0xe090, 0xf090, 0xf4d0,
+    0xea87, 0xe301, 0xe302, 0xe303, 0xe304, 0xe305, 0xe306,
+    0xe7c8, 0xfc88, 0xec70, 0xf1c8, 0xe4d0, 0xf550, 0xe032, 0xe3aa
+};
+
+/* Fill count ROM words with a random program. Constants are mostly small so they
+ * address the same RAM and jump inside the program, C words are common ones,
+ * any valid one, or any word with bit 15 set */
+static void randomProgram(uint64_t* state, uint16_t* rom, size_t count)
+{
+    for (size_t address = 0; address < count; address++) {
+        switch (randomBelow(state, 8)) {
+        case 0:
+        case 1:
+            rom[address] = (uint16_t) randomBelow(state, count);
+            break;
+        case 2:
+            rom[address] = (randomBelow(state, 4) == 0) ? (uint16_t) address : (uint16_t) randomBelow(state, 0x8000);
+            break;
+        case 3:
+        case 4:
+            rom[address] = common[randomBelow(state, sizeof(common) / sizeof(common[0]))];
+            break;
+        case 5:
+        case 6:
+            rom[address] = (uint16_t) (0xe000 | randomBelow(state, 0x2000));
+            break;
+        default:
+            rom[address] = (uint16_t) (0x8000 | randomBelow(state, 0x8000));
+            break;
+        }
+    }
+}
+
+/* Random programs, resumed after random limits, match the reference
+ * instruction for instruction: fused pairs, jumps into their middle,
+ * the generic ALU path and the unused bits of C words */
+static void testRandomPrograms(void)
+{
+    static uint16_t rom[CPU_ROM_SIZE];
+    static struct Machine machine;
+
+    Cpu cpu;
+    TEST_EQUAL(Cpu_create(&cpu), 0);
+
+    int wrong = 0;
+
+    for (uint64_t seed = 1; seed <= 400 && wrong == 0; seed++) {
+        uint64_t state = seed * 0x9e3779b97f4a7c15ULL + 1;
+
+        memset(rom, 0, sizeof(rom));
+        size_t count = 8 + (size_t) randomBelow(&state, 120);
+        randomProgram(&state, rom, count);
+
+        TEST_EQUAL(Cpu_load(&cpu, rom, count), 0);
+
+        // Start both from the same random registers and memory
+        memset(&machine, 0, sizeof(machine));
+        machine.a = cpu.a = (uint16_t) randomBelow(&state, 0x10000);
+        machine.d = cpu.d = (uint16_t) randomBelow(&state, 0x10000);
+        for (size_t address = 0; address < 256; address++) {
+            machine.ram[address] = cpu.ram[address] = (uint16_t) randomBelow(&state, 0x10000);
+        }
+
+        uint64_t stepped = 0;
+        for (int run = 0; run < 40 && wrong == 0; run++) {
+            enum CpuStatus status = Cpu_run(&cpu, 1 + randomBelow(&state, 60));
+
+            while (stepped < cpu.instructions) {
+                step(&machine, rom);
+                stepped += 1;
+            }
+
+            wrong += (cpu.a != machine.a || cpu.d != machine.d || cpu.pc != machine.pc ||
+                      memcmp(cpu.ram, machine.ram, sizeof(machine.ram)) != 0);
+
+            // A halted program stays on its last loop
+            if (status == CPU_HALTED) {
+                wrong += (rom[cpu.pc] != cpu.pc || rom[cpu.pc + 1] != 0xea87);
+                break;
+            }
+        }
+
+        if (wrong != 0) {
+            fprintf(stderr, "%s:%d: seed %llu differs after %llu instructions\n", __FILE__, __LINE__,
+                    (unsigned long long) seed, (unsigned long long) stepped);
+        }
+    }
+
+    TEST_EQUAL(wrong, 0);
+
+    Cpu_free(&cpu);
+}
+
+/* @X 0;JMP at address X halts, the PC is left on it and both instructions count */
+static void testHalt(void)
+{
+    // D=1, then loop at 2
+    static const uint16_t words[] = { 0xefd0, 0x0002, 0x0002, 0xea87 };
+
+    Cpu cpu;
+    TEST_EQUAL(Cpu_create(&cpu), 0);
+    TEST_EQUAL(Cpu_load(&cpu, words, 4), 0);
+
+    TEST_EQUAL(Cpu_run(&cpu, 1000), CPU_HALTED);
+    TEST_EQUAL(cpu.pc, 2);
+    TEST_EQUAL(cpu.a, 2);
+    TEST_EQUAL(cpu.d, 1);
+    TEST_EQUAL(cpu.instructions, 4);
+
+    // A loop that isn't @X 0;JMP at X runs to the limit
+    static const uint16_t loop[] = { 0x0000, 0xe307 };
+    TEST_EQUAL(Cpu_load(&cpu, loop, 2), 0);
+    TEST_EQUAL(cpu.instructions, 0);
+    TEST_EQUAL(Cpu_run(&cpu, 1001), CPU_LIMIT);
+    TEST_CHECK(cpu.instructions >= 1001 && cpu.instructions <= 1002);
+    TEST_EQUAL(Cpu_run(&cpu, 0), CPU_LIMIT);
+
+    Cpu_free(&cpu);
+}
+
+/* Falling off the end of the ROM wraps to address 0 */
+static void testWrap(void)
+{
+    static uint16_t rom[CPU_ROM_SIZE];
+    memset(rom, 0, sizeof(rom));
+
+    // M=M+1 at the last address, then the program at 0 halts on its second pass
+    rom[0] = 0x0001;
+    rom[1] = 0xfc10;            // D=M
+    rom[2] = 0x0008;
+    rom[3] = 0xe302;            // D;JEQ to 8
+    rom[4] = 0x0004;
+    rom[5] = 0xea87;            // 0;JMP at 4, halt
+    rom[8] = 0x0100;            // @256, runs into the @0s
+    rom[CPU_ROM_SIZE - 2] = 0x0001;
+    rom[CPU_ROM_SIZE - 1] = 0xfdc8;  // M=M+1
+
+    Cpu cpu;
+    TEST_EQUAL(Cpu_create(&cpu), 0);
+    TEST_EQUAL(Cpu_load(&cpu, rom, CPU_ROM_SIZE), 0);
+
+    TEST_EQUAL(Cpu_run(&cpu, 1000000), CPU_HALTED);
+    TEST_EQUAL(cpu.pc, 4);
+    TEST_EQUAL(cpu.ram[1], 1);
+    TEST_EQUAL(cpu.instructions, 4 + 1 + (CPU_ROM_SIZE - 9) + 6);
+
+    Cpu_free(&cpu);
+}
+
+/* The keyboard is read through KBD, the screen is the memory from SCREEN */
+static void testDevices(void)
+{
+    // @KBD D=M @SCREEN M=D @32767 D=A @SCREEN A=A+1 M=D, then @9 0;JMP at 9
+    static const uint16_t words[] = {
+        0x6000, 0xfc10, 0x4000, 0xe308, 0x7fff, 0xec10, 0x4000, 0xede0, 0xe308, 0x0009, 0xea87
+    };
+
+    Cpu cpu;
+    TEST_EQUAL(Cpu_create(&cpu), 0);
+    TEST_EQUAL(Cpu_load(&cpu, words, sizeof(words) / sizeof(words[0])), 0);
+
+    Cpu_setKeyboard(&cpu, 'K');
+    TEST_EQUAL(Cpu_run(&cpu, 1000), CPU_HALTED);
+
+    const uint16_t* screen = Cpu_screen(&cpu);
+    TEST_EQUAL(screen[0], 'K');
+    TEST_EQUAL(screen[1], 32767);
+
+    // Loading keeps the program apart from the memory, which is cleared
+    TEST_EQUAL(Cpu_load(&cpu, words, 2), 0);
+    TEST_EQUAL(screen[0], 0);
+
+    Cpu_free(&cpu);
+}
+
+/* A program larger than the ROM is refused */
+static void testLoad(void)
+{
+    static uint16_t words[CPU_ROM_SIZE + 1];
+
+    Cpu cpu;
+    TEST_EQUAL(Cpu_create(&cpu), 0);
+
+    errno = 0;
+    TEST_EQUAL(Cpu_load(&cpu, words, CPU_ROM_SIZE + 1), -1);
+    TEST_EQUAL(errno, EFBIG);
+
+    errno = 0;
+    TEST_EQUAL(Cpu_load(&cpu, NULL, 1), -1);
+    TEST_EQUAL(errno, EINVAL);
+
+    // An empty ROM is all @0, which runs forever
+    TEST_EQUAL(Cpu_load(&cpu, NULL, 0), 0);
+    TEST_EQUAL(Cpu_run(&cpu, 100), CPU_LIMIT);
+
+    Cpu_free(&cpu);
+}
+
+int main(void)
+{
+    TEST_RUN(testRandomPrograms);
+    TEST_RUN(testHalt);
+    TEST_RUN(testWrap);
+    TEST_RUN(testDevices);
+    TEST_RUN(testLoad);
+
+    return TEST_EXIT();
+}
@@ -0,0 +1,255 @@
+#include "test.h"
+#include "../debug.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+/* Make a view of a null terminated name */
+static StringView makeName(const char* name)
+{
+    StringView view = { name, strlen(name) };
+    return view;
+}
+
+/* Write debug to a new temporary file, its path is stored in path
+ * Return 0 on success
+ * Return -1 on failure */
+static int writeDebug(DebugInfo* debug, const char* source_name, char* path)
+{
+    strcpy(path, "/tmp/hack-debug-XXXXXX");
+
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return -1;
+    }
+
+    FILE* file = fdopen(fd, "w");
+    if (file == NULL) {
+        close(fd);
+        return -1;
+    }
+
+    int result = DebugInfo_write(debug, file, source_name);
+
+    return (fclose(file) == 0) ? result : -1;
+}
+
+/* Every symbol, label and line written is found in the mapped file */
+static void testRoundTrip(void)
+{
+    DebugInfo debug;
+    DebugInfo_create(&debug);
+
+    TEST_EQUAL(DebugInfo_addLabel(&debug, makeName("START"), 0), 0);
+    TEST_EQUAL(DebugInfo_addLabel(&debug, makeName("LOOP"), 3), 0);
+    TEST_EQUAL(DebugInfo_addLabel(&debug, makeName("END"), 3), 0);
+    TEST_EQUAL(DebugInfo_addLabel(&debug, makeName("ZED"), 7), 0);
+    TEST_EQUAL(DebugInfo_addVariable(&debug, makeName("sum"), 17), 0);
+    TEST_EQUAL(DebugInfo_addVariable(&debug, makeName("i"), 16), 0);
+
+    static const size_t lines[] = { 2, 3, 5, 6, 8, 9, 10, 14 };
+    for (size_t index = 0; index < 8; index++) {
+        TEST_EQUAL(DebugInfo_addLine(&debug, lines[index]), 0);
+    }
+
+    char path[32];
+    TEST_EQUAL(writeDebug(&debug, "Prog.asm", path), 0);
+    DebugInfo_free(&debug);
+
+    DebugMap map;
+    TEST_EQUAL(DebugMap_open(&map, path), 0);
+    unlink(path);
+
+    TEST_EQUAL(DebugMap_findSymbol(&map, "START", 5), 0);
+    TEST_EQUAL(DebugMap_findSymbol(&map, "LOOP", 4), 3);
+    TEST_EQUAL(DebugMap_findSymbol(&map, "END", 3), 3);
+    TEST_EQUAL(DebugMap_findSymbol(&map, "ZED", 3), 7);
+    TEST_EQUAL(DebugMap_findSymbol(&map, "i", 1), 16);
+    TEST_EQUAL(DebugMap_findSymbol(&map, "sum", 3), 17);
+    TEST_EQUAL(DebugMap_findSymbol(&map, "LOO", 3), -1);
+    TEST_EQUAL(DebugMap_findSymbol(&map, "sums", 4), -1);
+    TEST_EQUAL(DebugMap_findSymbol(&map, "", 0), -1);
+
+    // Labels in order of address, the last one defined wins at a shared address
+    StringView name;
+    TEST_EQUAL(DebugMap_findLabel(&map, 2, &name), 0);
+    TEST_BYTES(name.data, name.length, "START");
+    TEST_EQUAL(DebugMap_findLabel(&map, 3, &name), 3);
+    TEST_BYTES(name.data, name.length, "END");
+    TEST_EQUAL(DebugMap_findLabel(&map, 100, &name), 7);
+    TEST_BYTES(name.data, name.length, "ZED");
+
+    TEST_EQUAL(DebugMap_labelAt(&map, 1, &name), 3);
+    TEST_BYTES(name.data, name.length, "LOOP");
+    TEST_EQUAL(DebugMap_labelAt(&map, 3, NULL), 7);
+    TEST_EQUAL(DebugMap_labelAt(&map, 4, NULL), -1);
+
+    StringView file;
+    for (uint32_t address = 0; address < 8; address++) {
+        TEST_EQUAL(DebugMap_findLine(&map, address, &file), (long) lines[address]);
+    }
+    TEST_BYTES(file.data, file.length, "Prog.asm");
+    TEST_EQUAL(DebugMap_findLine(&map, 8, &file), -1);
+
+    DebugMap_close(&map);
+    TEST_CHECK(map.data == NULL);
+}
+
+/* Many symbols are sorted by name for the binary search */
+static void testManySymbols(void)
+{
+    static char names[3000][16];
+
+    DebugInfo debug;
+    DebugInfo_create(&debug);
+
+    for (int index = 0; index < 3000; index++) {
+        snprintf(names[index], sizeof(names[index]), "L%d_%d", (index * 7919) % 3000, index);
+        TEST_EQUAL(DebugInfo_addLabel(&debug, makeName(names[index]), index * 2), 0);
+        TEST_EQUAL(DebugInfo_addLine(&debug, (size_t) index + 1), 0);
+        TEST_EQUAL(DebugInfo_addLine(&debug, (size_t) index + 1), 0);
+    }
+
+    char path[32];
+    TEST_EQUAL(writeDebug(&debug, "Big.asm", path), 0);
+    DebugInfo_free(&debug);
+
+    DebugMap map;
+    TEST_EQUAL(DebugMap_open(&map, path), 0);
+    unlink(path);
+
+    int wrong = 0;
+    for (int index = 0; index < 3000; index++) {
+        StringView name;
+        wrong += (DebugMap_findSymbol(&map, names[index], strlen(names[index])) != index * 2);
+        wrong += (DebugMap_findLabel(&map, (uint32_t) index * 2 + 1, &name) != index * 2);
+        wrong += (name.length != strlen(names[index]) || memcmp(name.data, names[index], name.length) != 0);
+        wrong += (DebugMap_findLine(&map, (uint32_t) index * 2 + 1, NULL) != index + 1);
+    }
+    TEST_EQUAL(wrong, 0);
+
+    DebugMap_close(&map);
+}
+
+/* Removed instructions take their lines and labels with them */
+static void testRemap(void)
+{
+    DebugInfo debug;
+    DebugInfo_create(&debug);
+
+    for (size_t line = 10; line < 16; line++) {
+        TEST_EQUAL(DebugInfo_addLine(&debug, line), 0);
+    }
+    TEST_EQUAL(DebugInfo_addLabel(&debug, makeName("A"), 1), 0);
+    TEST_EQUAL(DebugInfo_addLabel(&debug, makeName("B"), 4), 0);
+    TEST_EQUAL(DebugInfo_addLabel(&debug, makeName("C"), 6), 0);
+
+    // Instructions 1 and 3 are removed
+    static const uint32_t new_addresses[] = { 0, 1, 1, 2, 2, 3, 4 };
+    TEST_EQUAL(DebugInfo_remap(&debug, new_addresses), 0);
+
+    TEST_EQUAL(debug.line_count, 4);
+    TEST_EQUAL(debug.lines[0], 10);
+    TEST_EQUAL(debug.lines[1], 12);
+    TEST_EQUAL(debug.lines[2], 14);
+    TEST_EQUAL(debug.lines[3], 15);
+    TEST_EQUAL(debug.labels[0].address, 1);
+    TEST_EQUAL(debug.labels[1].address, 2);
+    TEST_EQUAL(debug.labels[2].address, 4);
+
+    TEST_EQUAL(DebugInfo_remap(&debug, NULL), -1);
+
+    DebugInfo_free(&debug);
+}
+
+/* A program without symbols or instructions still has a valid file,
+ * a reset debug info forgets the previous program */
+static void testEmpty(void)
+{
+    DebugInfo debug;
+    DebugInfo_create(&debug);
+
+    TEST_EQUAL(DebugInfo_addLabel(&debug, makeName("OLD"), 0), 0);
+    TEST_EQUAL(DebugInfo_addLine(&debug, 1), 0);
+    DebugInfo_reset(&debug);
+
+    char path[32];
+    TEST_EQUAL(writeDebug(&debug, "", path), 0);
+    DebugInfo_free(&debug);
+
+    DebugMap map;
+    TEST_EQUAL(DebugMap_open(&map, path), 0);
+    unlink(path);
+
+    TEST_EQUAL(map.header->instruction_count, 0);
+    TEST_EQUAL(DebugMap_findSymbol(&map, "OLD", 3), -1);
+    TEST_EQUAL(DebugMap_findLabel(&map, 0, NULL), -1);
+    TEST_EQUAL(DebugMap_findLine(&map, 0, NULL), -1);
+
+    DebugMap_close(&map);
+}
+
+/* Files that aren't debug info or are cut short are refused with EINVAL */
+static void testInvalidFile(void)
+{
+    DebugInfo debug;
+    DebugInfo_create(&debug);
+    TEST_EQUAL(DebugInfo_addLabel(&debug, makeName("LOOP"), 0), 0);
+    TEST_EQUAL(DebugInfo_addLine(&debug, 1), 0);
+
+    char path[32];
+    TEST_EQUAL(writeDebug(&debug, "Prog.asm", path), 0);
+    DebugInfo_free(&debug);
+
+    DebugMap map;
+    long size;
+    FILE* file = fopen(path, "r+");
+    TEST_CHECK(file != NULL);
+    if (file == NULL) {
+        return;
+    }
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+
+    // Every cut removes part of a table or of the names
+    int accepted = 0;
+    for (long length = size - 1; length >= 0; length--) {
+        TEST_EQUAL(ftruncate(fileno(file), length), 0);
+        errno = 0;
+        accepted += (DebugMap_open(&map, path) == 0 || errno != EINVAL);
+    }
+    TEST_EQUAL(accepted, 0);
+
+    // Not a debug info file
+    TEST_EQUAL(ftruncate(fileno(file), 0), 0);
+    fseek(file, 0, SEEK_SET);
+    for (int index = 0; index < 256; index++) {
+        fputc('x', file);
+    }
+    fclose(file);
+
+    errno = 0;
+    TEST_EQUAL(DebugMap_open(&map, path), -1);
+    TEST_EQUAL(errno, EINVAL);
+
+    unlink(path);
+    errno = 0;
+    TEST_EQUAL(DebugMap_open(&map, path), -1);
+    TEST_EQUAL(errno, ENOENT);
+}
+
+int main(void)
+{
+    TEST_RUN(testRoundTrip);
+    TEST_RUN(testManySymbols);
+    TEST_RUN(testRemap);
+    TEST_RUN(testEmpty);
+    TEST_RUN(testInvalidFile);
+
+    return TEST_EXIT();
+}
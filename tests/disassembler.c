@@ -0,0 +1,233 @@
+#include "test.h"
+#include "../disassembler.h"
+#include "../debug.h"
+#include "../parser.h"
+#include "../code.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+/* Disassemble count words into a new string, debug may be NULL
+ * Return the text, its length is stored in length, NULL on failure */
+static char* disassemble(const uint16_t* words, size_t count, const DebugMap* debug, size_t* length)
+{
+    char* text = NULL;
+    FILE* file = open_memstream(&text, length);
+    if (file == NULL) {
+        return NULL;
+    }
+
+    static Disassembler disassembler;
+    int result = -1;
+    if (Disassembler_create(&disassembler, file, debug) == 0) {
+        result = (Disassembler_writeProgram(&disassembler, words, count) == 0 &&
+                  Disassembler_flush(&disassembler) == 0) ? 0 : -1;
+        Disassembler_free(&disassembler);
+    }
+
+    fclose(file);
+
+    if (result < 0) {
+        free(text);
+        return NULL;
+    }
+
+    return text;
+}
+
+/* Every word the assembler can produce assembles back from its text,
+ * every other word becomes a comment holding its value */
+static void testRoundTrip(void)
+{
+    static uint16_t words[65536];
+    for (uint32_t word = 0; word < 65536; word++) {
+        words[word] = (uint16_t) word;
+    }
+
+    size_t length = 0;
+    char* text = disassemble(words, 65536, NULL, &length);
+    TEST_CHECK(text != NULL);
+    if (text == NULL) {
+        return;
+    }
+
+    Parser parser;
+    TEST_EQUAL(Parser_createFromBuffer(&parser, text, length), 0);
+
+    // Comments are skipped by the parser, read the lines next to it
+    const char* line = text;
+    int wrong = 0;
+    int instructions = 0;
+
+    for (uint32_t word = 0; word < 65536; word++) {
+        const char* newline = memchr(line, '\n', length - (size_t) (line - text));
+        if (newline == NULL) {
+            wrong += 1;
+            break;
+        }
+
+        if (line[0] == '/') {
+            char expected[16];
+            snprintf(expected, sizeof(expected), "// 0x%04X", word);
+            wrong += ((size_t) (newline - line) != strlen(expected) || memcmp(line, expected, strlen(expected)) != 0);
+
+            // Only words without a known computation, a destination or a jump, or the two bits set
+            char name[3];
+            int known = ((word & 0xe000) == 0xe000 &&
+                         decodeComp((uint8_t) ((word >> COMP_SHIFT) & 0x7f), name) >= 0 &&
+                         (word & 0x3f) != 0);
+            wrong += known;
+        }
+
+        else {
+            instructions += 1;
+            wrong += (Parser_advance(&parser) != 0 ||
+                      Parser_lineNumber(&parser) != word + 1 ||
+                      Parser_word(&parser) != word);
+        }
+
+        line = newline + 1;
+    }
+
+    TEST_EQUAL(wrong, 0);
+    TEST_EQUAL(line, text + length);
+    TEST_EQUAL(Parser_advance(&parser), 1);
+
+    // Every A word, and 28 computations with 63 destination and jump pairs
+    TEST_EQUAL(instructions, 32768 + 28 * 63);
+
+    Parser_free(&parser);
+    free(text);
+}
+
+/* With debug info labels are defined at their address and a jump target is loaded by name */
+static void testLabels(void)
+{
+    DebugInfo debug;
+    DebugInfo_create(&debug);
+
+    StringView loop = { "LOOP", 4 };
+    StringView end = { "END", 3 };
+    TEST_EQUAL(DebugInfo_addLabel(&debug, loop, 0), 0);
+    TEST_EQUAL(DebugInfo_addLabel(&debug, end, 4), 0);
+
+    char path[] = "/tmp/hack-debug-XXXXXX";
+    int fd = mkstemp(path);
+    TEST_CHECK(fd >= 0);
+    FILE* file = fdopen(fd, "w");
+    TEST_CHECK(file != NULL);
+    if (file == NULL) {
+        return;
+    }
+    TEST_EQUAL(DebugInfo_write(&debug, file, "Prog.asm"), 0);
+    fclose(file);
+    DebugInfo_free(&debug);
+
+    DebugMap map;
+    TEST_EQUAL(DebugMap_open(&map, path), 0);
+    unlink(path);
+
+    // @0 before a jump is the label, @0 before D=A and @4 at the end stay numbers
+    static const uint16_t words[] = { 0x0000, 0xec10, 0x0000, 0xea87, 0x0004 };
+    size_t length = 0;
+    char* text = disassemble(words, 5, &map, &length);
+    TEST_CHECK(text != NULL);
+    if (text != NULL) {
+        TEST_BYTES(text, length, "(LOOP)\n@0\nD=A\n@LOOP\n0;JMP\n(END)\n@4\n");
+        free(text);
+    }
+
+    DebugMap_close(&map);
+}
+
+/* Text decodes a word per line with or without \r, and reports the first bad line */
+static void testDecodeText(void)
+{
+    static const char source[] = "0000000000000111\r\n1110110000010000\n1110001100001000";
+    uint16_t words[8];
+    size_t count = 0;
+    size_t line = 0;
+
+    TEST_EQUAL(Disassembler_decodeText(source, strlen(source), words, &count, &line), 0);
+    TEST_EQUAL(count, 3);
+    TEST_EQUAL(words[0], 7);
+    TEST_EQUAL(words[1], 0xec10);
+    TEST_EQUAL(words[2], 0xe308);
+
+    static const char* invalid[] = {
+        "0000000000000111\n000000000000011\n",
+        "0000000000000111\n00000000000001112\n",
+        "0000000000000111\n0000000000000121\n",
+        "0000000000000111\n 000000000000011\n",
+        "0000000000000111\n\n"
+    };
+
+    for (size_t index = 0; index < sizeof(invalid) / sizeof(invalid[0]); index++) {
+        errno = 0;
+        line = 0;
+        TEST_EQUAL(Disassembler_decodeText(invalid[index], strlen(invalid[index]), words, &count, &line), -1);
+        TEST_EQUAL(errno, EINVAL);
+        TEST_EQUAL(line, 2);
+    }
+}
+
+/* Packed words are read in the byte order of their header, or the one given without it */
+static void testDecodeBinary(void)
+{
+    static const uint8_t big[] = { 'H', 'A', 'C', 'K', 0, 1, 0, 1, 0, 0, 0, 2, 0x00, 0x07, 0xec, 0x10 };
+    static const uint8_t little[] = { 'H', 'A', 'C', 'K', 1, 0, 0, 0, 2, 0, 0, 0, 0x07, 0x00, 0x10, 0xec };
+    uint16_t words[8];
+    size_t count = 0;
+    size_t line = 0;
+
+    TEST_EQUAL(Disassembler_decodeBinary(big, sizeof(big), OUTPUT_LITTLE_ENDIAN, words, &count), 0);
+    TEST_EQUAL(count, 2);
+    TEST_EQUAL(words[0], 7);
+    TEST_EQUAL(words[1], 0xec10);
+
+    TEST_EQUAL(Disassembler_decode(little, sizeof(little), DISASSEMBLER_DETECT, OUTPUT_BIG_ENDIAN, words, &count, &line), 0);
+    TEST_EQUAL(count, 2);
+    TEST_EQUAL(words[0], 7);
+    TEST_EQUAL(words[1], 0xec10);
+
+    // Without a header
+    TEST_EQUAL(Disassembler_decodeBinary(big + 12, 4, OUTPUT_BIG_ENDIAN, words, &count), 0);
+    TEST_EQUAL(words[1], 0xec10);
+    TEST_EQUAL(Disassembler_decodeBinary(big + 12, 4, OUTPUT_LITTLE_ENDIAN, words, &count), 0);
+    TEST_EQUAL(words[1], 0x10ec);
+
+    // A count that doesn't match, an odd length, and flags of the other byte order
+    uint8_t damaged[sizeof(big)];
+    memcpy(damaged, big, sizeof(big));
+    damaged[11] = 3;
+    errno = 0;
+    TEST_EQUAL(Disassembler_decodeBinary(damaged, sizeof(damaged), OUTPUT_BIG_ENDIAN, words, &count), -1);
+    TEST_EQUAL(errno, EINVAL);
+    TEST_EQUAL(Disassembler_decodeBinary(big, sizeof(big) - 1, OUTPUT_BIG_ENDIAN, words, &count), -1);
+    memcpy(damaged, big, sizeof(big));
+    damaged[7] = 0;
+    TEST_EQUAL(Disassembler_decodeBinary(damaged, sizeof(damaged), OUTPUT_BIG_ENDIAN, words, &count), -1);
+
+    // Text is detected by its first line, an empty input is an empty program
+    static const char text[] = "0000000000000111\n";
+    TEST_EQUAL(Disassembler_decode((const uint8_t*) text, strlen(text), DISASSEMBLER_DETECT, OUTPUT_BIG_ENDIAN, words, &count, &line), 0);
+    TEST_EQUAL(count, 1);
+    TEST_EQUAL(words[0], 7);
+    TEST_EQUAL(Disassembler_decode(NULL, 0, DISASSEMBLER_DETECT, OUTPUT_BIG_ENDIAN, words, &count, &line), 0);
+    TEST_EQUAL(count, 0);
+}
+
+int main(void)
+{
+    TEST_RUN(testRoundTrip);
+    TEST_RUN(testLabels);
+    TEST_RUN(testDecodeText);
+    TEST_RUN(testDecodeBinary);
+
+    return TEST_EXIT();
+}
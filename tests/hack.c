@@ -0,0 +1,154 @@
+#include "test.h"
+#include "../hack.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+
+/* A program is assembled into the caller's words */
+static void testAssemble(void)
+{
+    static const char source[] = "// Store 2\n@2\nD=A\n@SCREEN\nM=D\n(END)\n@END\n0;JMP\n";
+    static const uint16_t expected[] = { 0x0002, 0xec10, 0x4000, 0xe308, 0x0004, 0xea87 };
+
+    uint16_t words[16];
+    size_t word_count = 0;
+    HackError error;
+
+    TEST_EQUAL(assemble(source, strlen(source), words, 16, &word_count, &error), 0);
+    TEST_EQUAL(error.status, HACK_OK);
+    TEST_EQUAL(word_count, 6);
+    for (size_t index = 0; index < word_count && index < 6; index++) {
+        TEST_EQUAL(words[index], expected[index]);
+    }
+
+    // An empty source has no words
+    TEST_EQUAL(assemble("", 0, NULL, 0, &word_count, &error), 0);
+    TEST_EQUAL(word_count, 0);
+}
+
+/* A short buffer is refused with the number of words needed */
+static void testShortBuffer(void)
+{
+    static const char source[] = "@1\n@2\n@3\n";
+
+    uint16_t words[3] = { 0, 0, 0 };
+    size_t word_count = 0;
+    HackError error;
+
+    TEST_EQUAL(assemble(source, strlen(source), words, 2, &word_count, &error), -1);
+    TEST_EQUAL(error.status, HACK_ERROR_BUFFER);
+    TEST_EQUAL(error.error_number, ERANGE);
+    TEST_EQUAL(word_count, 3);
+    TEST_EQUAL(words[0], 0);
+
+    TEST_EQUAL(assemble(source, strlen(source), NULL, 0, &word_count, &error), -1);
+    TEST_EQUAL(error.status, HACK_ERROR_BUFFER);
+    TEST_EQUAL(word_count, 3);
+}
+
+/* An invalid program reports its line and a message */
+static void testSourceError(void)
+{
+    static const char source[] = "@1\nD=A\nD=X\n";
+
+    uint16_t words[8];
+    size_t word_count = 0;
+    HackError error;
+
+    TEST_EQUAL(assemble(source, strlen(source), words, 8, &word_count, &error), -1);
+    TEST_EQUAL(error.status, HACK_ERROR_SOURCE);
+    TEST_EQUAL(error.error_number, EINVAL);
+    TEST_EQUAL(error.line, 3);
+    TEST_CHECK(error.message != NULL && error.message[0] != '\0');
+
+    // The error can be left out
+    TEST_EQUAL(assemble(source, strlen(source), words, 8, &word_count, NULL), -1);
+}
+
+/* Invalid arguments are refused without assembling */
+static void testArguments(void)
+{
+    uint16_t words[4];
+    size_t word_count = 0;
+    const uint16_t* view = NULL;
+    HackError error;
+
+    TEST_EQUAL(HackAssembler_assemble(NULL, "@1\n", 3, words, 4, &word_count, &error), -1);
+    TEST_EQUAL(error.status, HACK_ERROR_ARGUMENT);
+    TEST_EQUAL(error.error_number, EINVAL);
+
+    TEST_EQUAL(assemble(NULL, 3, words, 4, &word_count, &error), -1);
+    TEST_EQUAL(error.status, HACK_ERROR_ARGUMENT);
+
+    TEST_EQUAL(assemble("@1\n", 3, NULL, 4, &word_count, &error), -1);
+    TEST_EQUAL(error.status, HACK_ERROR_ARGUMENT);
+
+    TEST_EQUAL(assemble("@1\n", 3, words, 4, NULL, &error), -1);
+    TEST_EQUAL(error.status, HACK_ERROR_ARGUMENT);
+
+    HackAssembler* hack_assembler = HackAssembler_create();
+    TEST_CHECK(hack_assembler != NULL);
+    TEST_EQUAL(HackAssembler_assembleView(hack_assembler, "@1\n", 3, NULL, &word_count, &error), -1);
+    TEST_EQUAL(error.status, HACK_ERROR_ARGUMENT);
+    TEST_EQUAL(HackAssembler_assembleView(hack_assembler, "@1\n", 3, &view, NULL, &error), -1);
+    TEST_EQUAL(error.status, HACK_ERROR_ARGUMENT);
+    HackAssembler_free(hack_assembler);
+
+    HackAssembler_free(NULL);
+}
+
+/* One assembler is reused, nothing of a program is seen by the next one */
+static void testReuse(void)
+{
+    HackAssembler* hack_assembler = HackAssembler_create();
+    TEST_CHECK(hack_assembler != NULL);
+    if (hack_assembler == NULL) {
+        return;
+    }
+
+    static const char labels[] = "@1\n(SKIP)\n@SKIP\n";
+    static const char variables[] = "@SKIP\n@x\n@SKIP\n";
+    static const char invalid[] = "@1\n(SKIP\n";
+
+    const uint16_t* words = NULL;
+    size_t word_count = 0;
+    HackError error;
+
+    TEST_EQUAL(HackAssembler_assembleView(hack_assembler, labels, strlen(labels), &words, &word_count, &error), 0);
+    TEST_EQUAL(word_count, 2);
+    TEST_EQUAL(words[1], 1);
+
+    // SKIP is a variable now, the label was forgotten
+    TEST_EQUAL(HackAssembler_assembleView(hack_assembler, variables, strlen(variables), &words, &word_count, &error), 0);
+    TEST_EQUAL(word_count, 3);
+    TEST_EQUAL(words[0], 16);
+    TEST_EQUAL(words[1], 17);
+    TEST_EQUAL(words[2], 16);
+
+    // A failure leaves the assembler usable
+    TEST_EQUAL(HackAssembler_assembleView(hack_assembler, invalid, strlen(invalid), &words, &word_count, &error), -1);
+    TEST_EQUAL(error.status, HACK_ERROR_SOURCE);
+    TEST_EQUAL(error.line, 2);
+
+    uint16_t copied[4];
+    TEST_EQUAL(HackAssembler_assemble(hack_assembler, labels, strlen(labels), copied, 4, &word_count, &error), 0);
+    TEST_EQUAL(word_count, 2);
+    TEST_EQUAL(copied[0], 1);
+    TEST_EQUAL(copied[1], 1);
+
+    HackAssembler_free(hack_assembler);
+}
+
+int main(void)
+{
+    TEST_RUN(testAssemble);
+    TEST_RUN(testShortBuffer);
+    TEST_RUN(testSourceError);
+    TEST_RUN(testArguments);
+    TEST_RUN(testReuse);
+
+    return TEST_EXIT();
+}
@@ -0,0 +1,99 @@
+#include "test.h"
+#include "../hack.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#if __cplusplus >= 202002L && !defined(HACK_HAS_SPAN)
+#error "assembleView is missing from the C++20 build"
+#endif
+
+
+/* A program is assembled into a vector of its words */
+static void testAssemble(void)
+{
+    static const std::uint16_t expected[] = { 0x0002, 0xec10, 0x4000, 0xe308, 0x0004, 0xea87 };
+
+    hack::Assembler assembler;
+    std::vector<std::uint16_t> words =
+        assembler.assemble("// Store 2\n@2\nD=A\n@SCREEN\nM=D\n(END)\n@END\n0;JMP\n");
+
+    TEST_EQUAL(words.size(), 6);
+    for (std::size_t index = 0; index < words.size() && index < 6; index++) {
+        TEST_EQUAL(words[index], expected[index]);
+    }
+
+    TEST_EQUAL(assembler.assemble("").size(), 0);
+}
+
+/* An invalid program throws hack::Error with its line, the assembler stays usable */
+static void testError(void)
+{
+    hack::Assembler assembler;
+
+    int thrown = 0;
+    try {
+        assembler.assemble("@1\nD=A\nD=X\n");
+    }
+    catch (const hack::Error& error) {
+        thrown = 1;
+        TEST_EQUAL(error.status(), HACK_ERROR_SOURCE);
+        TEST_EQUAL(error.errorNumber(), EINVAL);
+        TEST_EQUAL(error.line(), 3);
+        TEST_CHECK(error.what()[0] != '\0');
+    }
+    TEST_CHECK(thrown);
+
+    TEST_EQUAL(assembler.assemble("@7\n").size(), 1);
+}
+
+/* A moved assembler keeps assembling, the one it was moved from is empty */
+static void testMove(void)
+{
+    hack::Assembler first;
+    hack::Assembler second(std::move(first));
+    TEST_EQUAL(second.assemble("@1\n@2\n").size(), 2);
+
+    hack::Assembler third;
+    third = std::move(second);
+    TEST_EQUAL(third.assemble("@1\n").size(), 1);
+}
+
+#ifdef HACK_HAS_SPAN
+/* The view is the assembler's own words, valid until the next program */
+static void testAssembleView(void)
+{
+    hack::Assembler assembler;
+    std::span<const std::uint16_t> words = assembler.assembleView("@LOOP\n(LOOP)\n@x\n");
+
+    TEST_EQUAL(words.size(), 2);
+    if (words.size() == 2) {
+        TEST_EQUAL(words[0], 1);
+        TEST_EQUAL(words[1], 16);
+    }
+
+    int thrown = 0;
+    try {
+        assembler.assembleView("(LOOP\n");
+    }
+    catch (const hack::Error& error) {
+        thrown = 1;
+        TEST_EQUAL(error.line(), 1);
+    }
+    TEST_CHECK(thrown);
+}
+#endif
+
+int main(void)
+{
+    TEST_RUN(testAssemble);
+    TEST_RUN(testError);
+    TEST_RUN(testMove);
+#ifdef HACK_HAS_SPAN
+    TEST_RUN(testAssembleView);
+#endif
+
+    return TEST_EXIT();
+}
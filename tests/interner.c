@@ -0,0 +1,167 @@
+#include "test.h"
+#include "../interner.h"
+#include "../arena.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+
+/* IDs are dense in order of first appearance, a name seen again keeps its ID */
+static void testOrder(void)
+{
+    Arena arena;
+    TEST_EQUAL(Arena_create(&arena, 4096), 0);
+
+    Interner interner;
+    Interner_create(&interner, &arena);
+    TEST_CHECK(interner.index == NULL);
+
+    TEST_EQUAL(Interner_intern(&interner, "LOOP", 4), 0);
+    TEST_EQUAL(Interner_intern(&interner, "i", 1), 1);
+    TEST_EQUAL(Interner_intern(&interner, "END", 3), 2);
+    TEST_EQUAL(Interner_intern(&interner, "i", 1), 1);
+    TEST_EQUAL(Interner_intern(&interner, "LOOP", 4), 0);
+    TEST_EQUAL(interner.count, 3);
+
+    // Only length characters are the name, prefixes are names of their own
+    const char* line = "LOOPER";
+    TEST_EQUAL(Interner_intern(&interner, line, 4), 0);
+    TEST_EQUAL(Interner_intern(&interner, line, 6), 3);
+    TEST_EQUAL(Interner_intern(&interner, line, 3), 4);
+    TEST_EQUAL(Interner_intern(&interner, line, 0), 5);
+    TEST_EQUAL(Interner_intern(&interner, "", 0), 5);
+
+    TEST_BYTES(interner.names[3].data, interner.names[3].length, "LOOPER");
+    TEST_BYTES(interner.names[4].data, interner.names[4].length, "LOO");
+
+    Interner_free(&interner);
+    Arena_free(&arena);
+}
+
+/* Names are copied, the caller's buffer can be reused */
+static void testCopies(void)
+{
+    Arena arena;
+    TEST_EQUAL(Arena_create(&arena, 4096), 0);
+
+    Interner interner;
+    Interner_create(&interner, &arena);
+
+    char name[16];
+    strcpy(name, "first");
+    TEST_EQUAL(Interner_intern(&interner, name, 5), 0);
+    strcpy(name, "other");
+    TEST_EQUAL(Interner_intern(&interner, name, 5), 1);
+
+    TEST_CHECK(interner.names[0].data != name);
+    TEST_BYTES(interner.names[0].data, interner.names[0].length, "first");
+
+    Interner_free(&interner);
+    Arena_free(&arena);
+}
+
+/* Both arrays grow, the index stays at most half full and every ID survives */
+static void testGrowth(void)
+{
+    Arena arena;
+    TEST_EQUAL(Arena_create(&arena, 4096), 0);
+
+    Interner interner;
+    Interner_create(&interner, &arena);
+
+    char name[32];
+    int wrong = 0;
+    for (int index = 0; index < 50000; index++) {
+        snprintf(name, sizeof(name), "LABEL_%d", index);
+        wrong += (Interner_intern(&interner, name, strlen(name)) != index);
+    }
+    TEST_EQUAL(wrong, 0);
+
+    TEST_EQUAL(interner.count, 50000);
+    TEST_CHECK(interner.capacity >= interner.count);
+    TEST_CHECK(interner.count * 2 <= interner.index_capacity);
+    TEST_EQUAL(interner.index_capacity & (interner.index_capacity - 1), 0);
+
+    for (int index = 49999; index >= 0; index--) {
+        snprintf(name, sizeof(name), "LABEL_%d", index);
+        wrong += (Interner_intern(&interner, name, strlen(name)) != index);
+    }
+    TEST_EQUAL(wrong, 0);
+    TEST_EQUAL(interner.count, 50000);
+
+    Interner_free(&interner);
+    TEST_CHECK(interner.names == NULL);
+    TEST_CHECK(interner.arena == &arena);
+    Arena_free(&arena);
+}
+
+/* A reset interner starts its IDs again and keeps its arrays,
+ * every search of the index is counted */
+static void testReset(void)
+{
+    Arena arena;
+    TEST_EQUAL(Arena_create(&arena, 4096), 0);
+
+    Interner interner;
+    Interner_create(&interner, &arena);
+
+    TEST_EQUAL(Interner_intern(&interner, "a", 1), 0);
+    TEST_EQUAL(Interner_intern(&interner, "b", 1), 1);
+    TEST_EQUAL(Interner_intern(&interner, "a", 1), 0);
+    TEST_EQUAL(interner.lookups, 3);
+
+    size_t capacity = interner.capacity;
+    size_t index_capacity = interner.index_capacity;
+
+    Interner_reset(&interner);
+    Arena_reset(&arena);
+    TEST_EQUAL(interner.count, 0);
+    TEST_EQUAL(interner.lookups, 0);
+    TEST_EQUAL(interner.capacity, capacity);
+    TEST_EQUAL(interner.index_capacity, index_capacity);
+
+    TEST_EQUAL(Interner_intern(&interner, "b", 1), 0);
+    TEST_EQUAL(Interner_intern(&interner, "a", 1), 1);
+    TEST_EQUAL(interner.lookups, 2);
+
+    Interner_free(&interner);
+    Arena_free(&arena);
+}
+
+/* An interner without an arena or a NULL name is refused */
+static void testInvalid(void)
+{
+    Arena arena;
+    TEST_EQUAL(Arena_create(&arena, 4096), 0);
+
+    Interner interner;
+    Interner_create(&interner, &arena);
+
+    errno = 0;
+    TEST_EQUAL(Interner_intern(&interner, NULL, 0), -1);
+    TEST_EQUAL(errno, EINVAL);
+    TEST_EQUAL(Interner_intern(NULL, "a", 1), -1);
+
+    Interner_create(&interner, NULL);
+    errno = 0;
+    TEST_EQUAL(Interner_intern(&interner, "a", 1), -1);
+    TEST_EQUAL(errno, EINVAL);
+    TEST_EQUAL(interner.count, 0);
+
+    Interner_free(&interner);
+    Interner_free(NULL);
+    Arena_free(&arena);
+}
+
+int main(void)
+{
+    TEST_RUN(testOrder);
+    TEST_RUN(testCopies);
+    TEST_RUN(testGrowth);
+    TEST_RUN(testReset);
+    TEST_RUN(testInvalid);
+
+    return TEST_EXIT();
+}
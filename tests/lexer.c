@@ -0,0 +1,205 @@
+#include "test.h"
+#include "../lexer.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+
+/* Lex the first command of source
+ * Return what Lexer_next returned */
+static int lexFirst(const char* source, LexedCommand* command)
+{
+    size_t position = 0;
+    size_t newlines = 0;
+
+    return Lexer_next(source, strlen(source), &position, &newlines, command);
+}
+
+/* Fields come without the whitespace or comment around them */
+static void testFields(void)
+{
+    LexedCommand command;
+
+    TEST_EQUAL(lexFirst("  @17 // x\r\n", &command), 0);
+    TEST_EQUAL(command.type, A_COMMAND);
+    TEST_BYTES(command.symbol.data, command.symbol.length, "17");
+
+    TEST_EQUAL(lexFirst("\t(LOOP)\t\r\n", &command), 0);
+    TEST_EQUAL(command.type, L_COMMAND);
+    TEST_BYTES(command.symbol.data, command.symbol.length, "LOOP");
+
+    TEST_EQUAL(lexFirst(" AM = D+1 ; JGT//c\n", &command), 0);
+    TEST_EQUAL(command.type, C_COMMAND);
+    TEST_BYTES(command.destination.data, command.destination.length, "AM");
+    TEST_BYTES(command.computation.data, command.computation.length, "D+1");
+    TEST_BYTES(command.jump.data, command.jump.length, "JGT");
+
+    // Absent fields are NULL, a separator with nothing next to it is an error
+    TEST_EQUAL(lexFirst("0;JMP", &command), 0);
+    TEST_CHECK(command.destination.data == NULL);
+    TEST_BYTES(command.computation.data, command.computation.length, "0");
+
+    TEST_EQUAL(lexFirst("D=M;\n", &command), -1);
+    TEST_EQUAL(lexFirst("=M\n", &command), -1);
+
+    // Separators in a comment aren't fields
+    TEST_EQUAL(lexFirst("D // =A;JMP\n", &command), -1);
+    TEST_EQUAL(lexFirst("M=1 // ;JMP (X) @Y\n", &command), 0);
+    TEST_CHECK(command.jump.data == NULL);
+}
+
+/* Malformed commands fail with EINVAL on their own line */
+static void testErrors(void)
+{
+    static const char* sources[] = {
+        "\n\n/\n",
+        "\n\n/ comment\n",
+        "\n\n@\n",
+        "\n\n@ // nothing\n",
+        "\n\n(LOOP\n",
+        "\n\n(LOOP)x\n",
+        "\n\n(LOOP) /\n",
+        "\n\n()\n",
+        "\n\nD\n",
+        "\n\nD+1 // no separator\n",
+        "\n\nD=\n",
+        "\n\n;JMP\n",
+        "\n\n=M\n",
+        "\n\nD;\n",
+        "\n\n@1 /x\n",
+        "\n\n(A))\n",
+        "\n\n(LOOP"
+    };
+
+    for (size_t index = 0; index < sizeof(sources) / sizeof(sources[0]); index++) {
+        LexedCommand command;
+        errno = 0;
+        int result = lexFirst(sources[index], &command);
+        if (result != -1 || errno != EINVAL || command.line != 3) {
+            fprintf(stderr, "%s:%d: \"%s\" is %d on line %zu\n", __FILE__, __LINE__,
+                    sources[index], result, command.line);
+            test_failures++;
+        }
+    }
+
+    size_t position = 0;
+    size_t newlines = 0;
+    LexedCommand command;
+    errno = 0;
+    TEST_EQUAL(Lexer_next(NULL, 1, &position, &newlines, &command), -1);
+    TEST_EQUAL(errno, EINVAL);
+    TEST_EQUAL(Lexer_next("@1", 2, NULL, &newlines, &command), -1);
+    TEST_EQUAL(Lexer_next("@1", 2, &position, NULL, &command), -1);
+    TEST_EQUAL(Lexer_next("@1", 2, &position, &newlines, NULL), -1);
+}
+
+/* The end of the source ends the last line, even inside a comment */
+static void testEnd(void)
+{
+    static const char source[] = "@1 // tail";
+    size_t position = 0;
+    size_t newlines = 0;
+    LexedCommand command;
+
+    TEST_EQUAL(Lexer_next(source, strlen(source), &position, &newlines, &command), 0);
+    TEST_BYTES(command.symbol.data, command.symbol.length, "1");
+    TEST_EQUAL(position, strlen(source));
+    TEST_EQUAL(Lexer_next(source, strlen(source), &position, &newlines, &command), 1);
+    TEST_EQUAL(command.type, NONE_COMMAND);
+    TEST_EQUAL(command.line, 1);
+
+    static const char comment[] = "@1\n// last";
+    position = 0;
+    newlines = 0;
+    TEST_EQUAL(Lexer_next(comment, strlen(comment), &position, &newlines, &command), 0);
+    TEST_EQUAL(Lexer_next(comment, strlen(comment), &position, &newlines, &command), 1);
+    TEST_EQUAL(command.line, 2);
+    TEST_EQUAL(position, strlen(comment));
+
+    position = 0;
+    newlines = 0;
+    TEST_EQUAL(Lexer_next("", 0, &position, &newlines, &command), 1);
+    TEST_EQUAL(command.line, 0);
+    TEST_EQUAL(Lexer_next(NULL, 0, &position, &newlines, &command), 1);
+
+    // Only the length is read
+    static const char cut[] = "@12@";
+    position = 0;
+    TEST_EQUAL(Lexer_next(cut, 3, &position, &newlines, &command), 0);
+    TEST_BYTES(command.symbol.data, command.symbol.length, "12");
+}
+
+/* Step an xorshift generator
+ * Return a number below bound */
+static uint64_t randomBelow(uint64_t* state, uint64_t bound)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+
+    return *state % bound;
+}
+
+/* Blank runs of every length, longer than a vector or not, are skipped
+ * and their newlines are counted, wherever they fall in the source */
+static void testBlankRuns(void)
+{
+    static const char blanks[] = { ' ', '\t', '\r', '\n', '\n', '\v', '\f' };
+    static char source[1 << 16];
+
+    for (uint64_t seed = 1; seed <= 200; seed++) {
+        uint64_t state = seed * 0x9e3779b97f4a7c15ULL + 1;
+
+        size_t length = 0;
+        size_t lines[512];
+        size_t count = 0;
+        size_t line = 1;
+
+        while (count < 512 && length + 200 < sizeof(source)) {
+            size_t run = (size_t) randomBelow(&state, 70);
+            for (size_t index = 0; index < run; index++) {
+                char blank = blanks[randomBelow(&state, sizeof(blanks))];
+                line += (blank == '\n');
+                source[length++] = blank;
+            }
+
+            if (randomBelow(&state, 4) == 0) {
+                length += (size_t) sprintf(source + length, "// comment %zu\n", count);
+                line += 1;
+                continue;
+            }
+
+            lines[count++] = line;
+            length += (size_t) sprintf(source + length, "@%zu\n", count);
+            line += 1;
+        }
+
+        size_t position = 0;
+        size_t newlines = 0;
+        size_t lexed = 0;
+        int wrong = 0;
+        LexedCommand command;
+
+        while (Lexer_next(source, length, &position, &newlines, &command) == 0) {
+            wrong += (lexed >= count || command.line != lines[lexed]);
+            lexed += 1;
+        }
+
+        TEST_EQUAL(wrong, 0);
+        TEST_EQUAL(lexed, count);
+        TEST_EQUAL(position, length);
+        TEST_EQUAL(newlines, line - 1);
+    }
+}
+
+int main(void)
+{
+    TEST_RUN(testFields);
+    TEST_RUN(testErrors);
+    TEST_RUN(testEnd);
+    TEST_RUN(testBlankRuns);
+
+    return TEST_EXIT();
+}
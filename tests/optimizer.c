@@ -0,0 +1,530 @@
+#include "test.h"
+#include "../assembler.h"
+#include "../cpu.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* Most instructions a test program runs before it must have halted */
+#define TEST_LIMIT          1000000
+
+/* Size of the source buffer of a generated program */
+#define TEST_SOURCE_SIZE    (16 * 1024)
+
+/* Return the address of the label name in debug, -1 if it isn't there */
+static long findLabel(const DebugInfo* debug, const char* name)
+{
+    for (size_t index = 0; index < debug->label_count; index++) {
+        StringView label = debug->labels[index].name;
+
+        if (label.length == strlen(name) && memcmp(label.data, name, label.length) == 0) {
+            return debug->labels[index].address;
+        }
+    }
+
+    return -1;
+}
+
+/* Assemble source at the optimization level optimize into words, which holds CPU_ROM_SIZE.
+ * When label isn't NULL its final address is stored in label_address
+ * Return the number of words, 0 if the source didn't assemble */
+static size_t assembleProgram(const char* source, int optimize, uint16_t* words,
+                              const char* label, long* label_address)
+{
+    Assembler assembler;
+    TEST_EQUAL(Assembler_create(&assembler), 0);
+
+    // The names of the labels belong to the assembler
+    DebugInfo debug;
+    DebugInfo_create(&debug);
+    if (label != NULL) {
+        assembler.debug = &debug;
+    }
+
+    AssemblerOptions options;
+    Assembler_defaultOptions(&options);
+    options.output.format = OUTPUT_BINARY;
+    options.output.byte_order = OUTPUT_LITTLE_ENDIAN;
+    options.output.header = 0;
+    options.optimize = optimize;
+
+    Parser parser;
+    Parser_createFromBuffer(&parser, source, strlen(source));
+
+    AssemblerReport report;
+    Assembler_clearReport(&report);
+
+    FILE* file = tmpfile();
+    TEST_CHECK(file != NULL);
+
+    size_t count = 0;
+    if (file != NULL && Assembler_assemble(&assembler, &parser, file, &options, &report) == 0) {
+
+        uint8_t bytes[2];
+        rewind(file);
+        while (count < CPU_ROM_SIZE && fread(bytes, 1, 2, file) == 2) {
+            words[count] = (uint16_t) (bytes[0] | (bytes[1] << 8));
+            count += 1;
+        }
+    }
+
+    else {
+        fprintf(stderr, "failed to assemble at -O%d: %s, line %zu\n%s", optimize, report.message, report.line, source);
+        test_failures += 1;
+    }
+
+    if (label != NULL) {
+        *label_address = findLabel(&debug, label);
+    }
+
+    if (file != NULL) {
+        fclose(file);
+    }
+    DebugInfo_free(&debug);
+    Parser_free(&parser);
+    Assembler_free(&assembler);
+
+    return count;
+}
+
+/* Run count words from a cleared RAM until they halt, the RAM is left in cpu */
+static void runProgram(Cpu* cpu, const uint16_t* words, size_t count)
+{
+    TEST_EQUAL(Cpu_load(cpu, words, count), 0);
+    TEST_EQUAL(Cpu_run(cpu, TEST_LIMIT), CPU_HALTED);
+}
+
+/* Assemble source unoptimized and at every level, the optimized programs must
+ * leave the same RAM and be no longer
+ * Return 1 if they all agree */
+static int compareLevels(const char* source)
+{
+    static uint16_t words[CPU_ROM_SIZE];
+    static uint16_t expected[CPU_RAM_SIZE];
+
+    Cpu cpu;
+    TEST_EQUAL(Cpu_create(&cpu), 0);
+
+    size_t count = assembleProgram(source, OPTIMIZER_NONE, words, NULL, NULL);
+    runProgram(&cpu, words, count);
+    memcpy(expected, cpu.ram, sizeof(expected));
+
+    int same = 1;
+    for (int level = OPTIMIZER_PEEPHOLE; level <= OPTIMIZER_DATAFLOW; level++) {
+
+        size_t optimized = assembleProgram(source, level, words, NULL, NULL);
+        TEST_CHECK(optimized <= count);
+
+        runProgram(&cpu, words, optimized);
+        if (memcmp(expected, cpu.ram, sizeof(expected)) != 0) {
+            fprintf(stderr, "RAM differs at -O%d\n", level);
+            same = 0;
+        }
+    }
+
+    Cpu_free(&cpu);
+
+    return same;
+}
+
+/* A constant jump target doesn't move with the code it points at,
+ * so a program with one is left as it is */
+static void testConstantJumpTarget(void)
+{
+    static const char* source =
+        "@1\n" "D=A\n" "D=D\n" "@6\n" "0;JMP\n"
+        "@R2\n" "@R1\n" "M=D\n" "@8\n" "0;JMP\n";
+
+    static uint16_t original[CPU_ROM_SIZE];
+    static uint16_t words[CPU_ROM_SIZE];
+
+    size_t count = assembleProgram(source, OPTIMIZER_NONE, original, NULL, NULL);
+
+    Cpu cpu;
+    TEST_EQUAL(Cpu_create(&cpu), 0);
+
+    for (int level = OPTIMIZER_PEEPHOLE; level <= OPTIMIZER_DATAFLOW; level++) {
+
+        size_t optimized = assembleProgram(source, level, words, NULL, NULL);
+        TEST_EQUAL(optimized, count);
+        TEST_CHECK(memcmp(words, original, count * sizeof(uint16_t)) == 0);
+
+        runProgram(&cpu, words, optimized);
+        TEST_EQUAL(cpu.ram[1], 1);
+    }
+
+    Cpu_free(&cpu);
+}
+
+/* The constant 9 is stored and jumped to through R13, the dataflow
+ * optimizer can't tell it from data and leaves the program as it is */
+static void testTakenConstant(void)
+{
+    static const char* source =
+        "@9\n" "D=A\n" "@R13\n" "M=D\n" "@R13\n" "A=M\n" "0;JMP\n"
+        "@R2\n" "0;JMP\n"
+        "@R1\n" "M=1\n"
+        "(END)\n" "@END\n" "0;JMP\n";
+
+    static uint16_t original[CPU_ROM_SIZE];
+    static uint16_t words[CPU_ROM_SIZE];
+
+    size_t count = assembleProgram(source, OPTIMIZER_NONE, original, NULL, NULL);
+    size_t optimized = assembleProgram(source, OPTIMIZER_DATAFLOW, words, NULL, NULL);
+
+    TEST_EQUAL(optimized, count);
+    TEST_CHECK(memcmp(words, original, count * sizeof(uint16_t)) == 0);
+
+    Cpu cpu;
+    TEST_EQUAL(Cpu_create(&cpu), 0);
+    runProgram(&cpu, words, optimized);
+    TEST_EQUAL(cpu.ram[1], 1);
+    Cpu_free(&cpu);
+}
+
+/* A jump to the next instruction is dropped, but the label it loaded
+ * is still read afterwards, so the load must stay */
+static void testJumpToNextKeepsLiveAddress(void)
+{
+    static const char* source =
+        "@5\n"
+        "D=A\n"
+        "@L\n"
+        "D;JGT\n"
+        "(L)\n"
+        "D=D+1\n"
+        "M=D\n"
+        "(END)\n"
+        "@END\n"
+        "0;JMP\n";
+
+    static uint16_t words[CPU_ROM_SIZE];
+
+    Cpu cpu;
+    TEST_EQUAL(Cpu_create(&cpu), 0);
+
+    for (int level = OPTIMIZER_NONE; level <= OPTIMIZER_DATAFLOW; level++) {
+
+        long label = -1;
+        size_t count = assembleProgram(source, level, words, "L", &label);
+        runProgram(&cpu, words, count);
+
+        // The label moves with the code, the store follows it
+        TEST_CHECK(label >= 0);
+
+        size_t written = 0;
+        for (size_t address = 0; address < CPU_RAM_SIZE; address++) {
+            written += (cpu.ram[address] != 0);
+        }
+        TEST_EQUAL(written, 1);
+        TEST_EQUAL(cpu.ram[(label >= 0) ? label : 0], 6);
+
+        // Only the jump goes
+        if (level != OPTIMIZER_NONE) {
+            TEST_EQUAL(count, 7);
+        }
+    }
+
+    Cpu_free(&cpu);
+}
+
+/* R2 = R0 * R1 by repeated addition */
+static void testMultiply(void)
+{
+    TEST_CHECK(compareLevels(
+        "@7\n" "D=A\n" "@R0\n" "M=D\n"
+        "@6\n" "D=A\n" "@R1\n" "M=D\n"
+        "@R2\n" "M=0\n"
+        "(LOOP)\n"
+        "@R1\n" "D=M\n" "@END\n" "D;JEQ\n"
+        "@R0\n" "D=M\n" "@R2\n" "M=D+M\n"
+        "@R1\n" "M=M-1\n"
+        "@LOOP\n" "0;JMP\n"
+        "(END)\n" "@END\n" "0;JMP\n"));
+}
+
+/* Calls through a return address kept in R13, the return is a computed jump
+ * and the return labels are only ever used as its targets */
+static void testCallReturn(void)
+{
+    TEST_CHECK(compareLevels(
+        "@3\n" "D=A\n" "@x\n" "M=D\n"
+        "@RETURN_1\n" "D=A\n" "@R13\n" "M=D\n" "@DOUBLE\n" "0;JMP\n"
+        "(RETURN_1)\n"
+        "@RETURN_2\n" "D=A\n" "@R13\n" "M=D\n" "@DOUBLE\n" "0;JMP\n"
+        "(RETURN_2)\n"
+        "@x\n" "D=M\n" "@y\n" "M=D\n"
+        "(END)\n" "@END\n" "0;JMP\n"
+        "(DOUBLE)\n"
+        "@x\n" "D=M\n" "M=D+M\n"
+        "@x\n" "D=M\n" "D=D\n"
+        "@R13\n" "A=M\n" "0;JMP\n"));
+}
+
+/* Fill the screen words through a pointer, A is loaded from memory */
+static void testPointerLoop(void)
+{
+    TEST_CHECK(compareLevels(
+        "@SCREEN\n" "D=A\n" "@pointer\n" "M=D\n"
+        "@32\n" "D=A\n" "@count\n" "M=D\n"
+        "(FILL)\n"
+        "@pointer\n" "A=M\n" "M=-1\n"
+        "@pointer\n" "M=M+1\n"
+        "@count\n" "MD=M-1\n"
+        "@FILL\n" "D;JGT\n"
+        "(END)\n" "@END\n" "0;JMP\n"));
+}
+
+/* A value loaded before a loop is changed by its body, the reload at the top
+ * of the loop stays because the back edge brings another value */
+static void testLoopKeepsReload(void)
+{
+    TEST_CHECK(compareLevels(
+        "@3\n" "D=A\n" "@n\n" "M=D\n"
+        "@7\n" "D=A\n"
+        "(LOOP)\n"
+        "@7\n" "D=A\n"
+        "@acc\n" "M=D+M\n"
+        "@n\n" "MD=M-1\n"
+        "@LOOP\n" "D;JGT\n"
+        "@acc\n" "D=M\n" "@result\n" "M=D\n"
+        "(END)\n" "@END\n" "0;JMP\n"));
+}
+
+/* A write to D is only read around the back edge, it isn't dead */
+static void testBackEdgeKeepsWrite(void)
+{
+    TEST_CHECK(compareLevels(
+        "@4\n" "D=A\n" "@n\n" "M=D\n"
+        "D=0\n"
+        "(LOOP)\n"
+        "@sum\n" "M=D+M\n"
+        "@n\n" "M=M-1\n" "D=M\n"
+        "@EXIT\n" "D;JEQ\n"
+        "@n\n" "D=M\n" "@3\n" "D=D+A\n"
+        "@LOOP\n" "0;JMP\n"
+        "(EXIT)\n"
+        "(END)\n" "@END\n" "0;JMP\n"));
+}
+
+/* Where two paths join with different values, neither is assumed,
+ * whichever path the program takes */
+static void testJoinKeepsValues(void)
+{
+    static char source[TEST_SOURCE_SIZE];
+
+    for (int value = 0; value <= 1; value++) {
+        snprintf(source, sizeof(source),
+                 "@%d\n" "D=A\n" "@x\n" "M=D\n"
+                 "@x\n" "D=M\n"
+                 "@SKIP\n" "D;JEQ\n"
+                 "@5\n" "D=A\n"
+                 "(SKIP)\n"
+                 "@y\n" "M=D\n"
+                 "@5\n" "D=A\n"
+                 "@z\n" "M=D\n"
+                 "(END)\n" "@END\n" "0;JMP\n", value);
+
+        TEST_CHECK(compareLevels(source));
+    }
+}
+
+/* Known values carried across blocks remove reloads the peephole rules can't see */
+static void testDataflowShrinks(void)
+{
+    static const char* source =
+        "@5\n" "D=A\n" "@x\n" "M=D\n"
+        "@x\n" "D=M\n" "@L\n" "D;JGT\n"
+        "@7\n" "D=A\n"
+        "(L)\n"
+        "@5\n" "D=A\n" "@y\n" "M=D\n"
+        "(END)\n" "@END\n" "0;JMP\n";
+
+    static uint16_t words[CPU_ROM_SIZE];
+
+    size_t original = assembleProgram(source, OPTIMIZER_NONE, words, NULL, NULL);
+    size_t peephole = assembleProgram(source, OPTIMIZER_PEEPHOLE, words, NULL, NULL);
+    size_t dataflow = assembleProgram(source, OPTIMIZER_DATAFLOW, words, NULL, NULL);
+
+    TEST_CHECK(peephole <= original);
+    TEST_CHECK(dataflow < peephole);
+    TEST_CHECK(compareLevels(source));
+}
+
+/* Return a random number below bound, the generator is seeded for every program */
+static uint32_t randomBelow(uint64_t* state, uint32_t bound)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+
+    return (uint32_t) (*state % bound);
+}
+
+/* Write random straight line code and forward jumps to labels named prefix
+ * and a number at source, every label a jump goes to is defined at its end
+ * Return the number of characters written */
+static size_t generateCode(uint64_t* state, char* source, const char* prefix)
+{
+    static const char* addresses[] = { "@SP", "@LCL", "@R13", "@5", "@17", "@x", "@y", "@SP" };
+    static const char* computations[] = {
+        "M=M+1", "M=M-1", "D=M", "M=D", "D=D", "M=M", "D=D+1", "D=0", "D=A", "M=0", "D=D+M",
+        "A=M", "AM=M-1", "A=A", "AD=M", "A=D", "AM=M+1", "A=A+1"
+    };
+    static const char* conditions[] = { "D=D", "D=D+1", "D=-1" };
+    static const char* jumps[] = { "0;JMP", "D;JGT", "D;JEQ", "D;JNE", "D;JMP" };
+
+    size_t length = 0;
+    int label_count = 0;
+    int last_target = -1;
+
+    uint32_t instruction_count = 5 + randomBelow(state, 56);
+    for (uint32_t index = 0; index < instruction_count; index++) {
+
+        uint32_t choice = randomBelow(state, 100);
+
+        // Forward jump to a label defined later, then an address so A isn't read at the label
+        if (choice < 12) {
+            int target = label_count + (int) randomBelow(state, 4);
+            last_target = (target > last_target) ? target : last_target;
+
+            length += (size_t) sprintf(source + length, "@%s%d\n", prefix, target);
+            if (randomBelow(state, 10) < 3) {
+                length += (size_t) sprintf(source + length, "%s\n", conditions[randomBelow(state, 3)]);
+            }
+            length += (size_t) sprintf(source + length, "%s\n", jumps[randomBelow(state, 5)]);
+
+            if (randomBelow(state, 2) == 0) {
+                length += (size_t) sprintf(source + length, "(%s%d)\n", prefix, label_count);
+                label_count += 1;
+            }
+            length += (size_t) sprintf(source + length, "%s\n", addresses[randomBelow(state, 8)]);
+        }
+
+        else if (choice < 22) {
+            length += (size_t) sprintf(source + length, "(%s%d)\n%s\n", prefix, label_count, addresses[randomBelow(state, 8)]);
+            label_count += 1;
+        }
+
+        else if (choice < 55) {
+            length += (size_t) sprintf(source + length, "%s\n", addresses[randomBelow(state, 8)]);
+        }
+
+        else {
+            length += (size_t) sprintf(source + length, "%s\n", computations[randomBelow(state, 18)]);
+        }
+    }
+
+    // Define every label a jump went to
+    while (label_count <= last_target) {
+        length += (size_t) sprintf(source + length, "(%s%d)\n", prefix, label_count);
+        label_count += 1;
+    }
+
+    return length;
+}
+
+/* Write a random program of straight line code and forward jumps to source,
+ * so it always halts. A label is only ever used as a jump target */
+static void generateProgram(uint64_t seed, char* source)
+{
+    uint64_t state = seed * 0x9e3779b97f4a7c15ULL + 1;
+    size_t length = 0;
+
+    length += (size_t) sprintf(source + length, "@256\nD=A\n@SP\nM=D\n");
+    length += generateCode(&state, source + length, "L");
+
+    sprintf(source + length, "@7000\nM=D\n(END)\n@END\n0;JMP\n");
+}
+
+/* Write a random program of counted loops, possibly nested, around random code
+ * to source. The counters are far from the memory the code writes, so it halts */
+static void generateLoopProgram(uint64_t seed, char* source)
+{
+    uint64_t state = seed * 0x9e3779b97f4a7c15ULL + 1;
+    size_t length = 0;
+    char prefix[16];
+
+    length += (size_t) sprintf(source + length, "@256\nD=A\n@SP\nM=D\n");
+
+    uint32_t loop_count = 1 + randomBelow(&state, 3);
+    uint32_t nested = randomBelow(&state, 2);
+
+    for (uint32_t loop = 0; loop < loop_count; loop++) {
+        // A holds the address of the loop on the back edge, it is loaded again
+        length += (size_t) sprintf(source + length, "@%u\nD=A\n@%u\nM=D\n(LOOP%u)\n@SP\n",
+                                   2 + randomBelow(&state, 4), 30000 + loop, loop);
+
+        sprintf(prefix, "B%u_", loop);
+        length += generateCode(&state, source + length, prefix);
+
+        if (nested == 0) {
+            length += (size_t) sprintf(source + length, "@%u\nMD=M-1\n@LOOP%u\nD;JGT\n", 30000 + loop, loop);
+        }
+    }
+
+    // Nested loops close from the innermost
+    for (uint32_t loop = loop_count; nested != 0 && loop-- > 0;) {
+        length += (size_t) sprintf(source + length, "@%u\nMD=M-1\n@LOOP%u\nD;JGT\n", 30000 + loop, loop);
+    }
+
+    sprintf(source + length, "@7000\nM=D\n(END)\n@END\n0;JMP\n");
+}
+
+/* Optimized random programs leave the same RAM as the original */
+static void testRandomPrograms(void)
+{
+    static char source[TEST_SOURCE_SIZE];
+
+    int failed = 0;
+    for (uint64_t seed = 1; seed <= 500 && failed < 3; seed++) {
+        generateProgram(seed, source);
+
+        if (compareLevels(source) == 0) {
+            fprintf(stderr, "seed %llu:\n%s", (unsigned long long) seed, source);
+            failed += 1;
+        }
+    }
+
+    TEST_EQUAL(failed, 0);
+}
+
+/* Optimized random programs with loops, where values flow around back edges,
+ * leave the same RAM as the original */
+static void testRandomLoops(void)
+{
+    static char source[TEST_SOURCE_SIZE];
+
+    int failed = 0;
+    for (uint64_t seed = 1; seed <= 300 && failed < 3; seed++) {
+        generateLoopProgram(seed, source);
+
+        if (compareLevels(source) == 0) {
+            fprintf(stderr, "seed %llu:\n%s", (unsigned long long) seed, source);
+            failed += 1;
+        }
+    }
+
+    TEST_EQUAL(failed, 0);
+}
+
+int main(void)
+{
+    TEST_RUN(testJumpToNextKeepsLiveAddress);
+    TEST_RUN(testConstantJumpTarget);
+    TEST_RUN(testTakenConstant);
+    TEST_RUN(testMultiply);
+    TEST_RUN(testCallReturn);
+    TEST_RUN(testPointerLoop);
+    TEST_RUN(testLoopKeepsReload);
+    TEST_RUN(testBackEdgeKeepsWrite);
+    TEST_RUN(testJoinKeepsValues);
+    TEST_RUN(testDataflowShrinks);
+    TEST_RUN(testRandomPrograms);
+    TEST_RUN(testRandomLoops);
+
+    return TEST_EXIT();
+}
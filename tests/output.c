@@ -0,0 +1,270 @@
+#include "test.h"
+#include "../output.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+/* Read the whole of file into buffer, which holds size bytes
+ * Return the number of bytes read */
+static size_t readAll(FILE* file, unsigned char* buffer, size_t size)
+{
+    rewind(file);
+    return fread(buffer, 1, size, file);
+}
+
+
+/* The .asm extension is replaced by .hack, any other name gets .hack appended */
+static void testMakePath(void)
+{
+    static const struct { const char* input; const char* output; } paths[] = {
+        { "Prog.asm", "Prog.hack" },
+        { "dir/Prog.asm", "dir/Prog.hack" },
+        { ".asm", ".hack" },
+        { "Prog", "Prog.hack" },
+        { "Prog.ASM", "Prog.ASM.hack" },
+        { "Prog.asm.bak", "Prog.asm.bak.hack" },
+        { "asm", "asm.hack" },
+        { "", ".hack" }
+    };
+
+    for (size_t index = 0; index < sizeof(paths) / sizeof(paths[0]); index++) {
+        char* path = Output_makePath(paths[index].input);
+        TEST_CHECK(path != NULL);
+        if (path != NULL) {
+            TEST_BYTES(path, strlen(path), paths[index].output);
+        }
+        free(path);
+    }
+}
+
+/* Binary words are packed in the requested byte order */
+static void testBinaryWords(void)
+{
+    static const uint16_t words[] = { 0x1234, 0xea87, 0x0001 };
+    static const unsigned char little[] = { 0x34, 0x12, 0x87, 0xea, 0x01, 0x00 };
+    static const unsigned char big[] = { 0x12, 0x34, 0xea, 0x87, 0x00, 0x01 };
+
+    for (int order = OUTPUT_LITTLE_ENDIAN; order <= OUTPUT_BIG_ENDIAN; order++) {
+        FILE* file = tmpfile();
+        TEST_CHECK(file != NULL);
+        if (file == NULL) {
+            return;
+        }
+
+        OutputOptions options;
+        Output_defaultOptions(&options);
+        options.format = OUTPUT_BINARY;
+        options.byte_order = order;
+
+        static Output output;
+        TEST_EQUAL(Output_create(&output, file, &options), 0);
+        TEST_EQUAL(Output_writeWord(&output, words[0]), 0);
+        TEST_EQUAL(Output_writeWords(&output, &words[1], 2), 0);
+        TEST_EQUAL(Output_flush(&output), 0);
+
+        unsigned char bytes[16];
+        TEST_EQUAL(readAll(file, bytes, sizeof(bytes)), 6);
+        TEST_EQUAL(memcmp(bytes, (order == OUTPUT_LITTLE_ENDIAN) ? little : big, 6), 0);
+
+        fclose(file);
+    }
+}
+
+/* The header holds the magic, version, byte order and the word count,
+ * which can be patched once the words are written */
+static void testHeader(void)
+{
+    static const unsigned char expected[] = {
+        'H', 'A', 'C', 'K', 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x02, 0xea, 0x87, 0x00, 0x05
+    };
+
+    FILE* file = tmpfile();
+    TEST_CHECK(file != NULL);
+    if (file == NULL) {
+        return;
+    }
+
+    OutputOptions options;
+    Output_defaultOptions(&options);
+    options.format = OUTPUT_BINARY;
+    options.byte_order = OUTPUT_BIG_ENDIAN;
+    options.header = 1;
+
+    static Output output;
+    TEST_EQUAL(Output_create(&output, file, &options), 0);
+    TEST_EQUAL(Output_writeHeader(&output, 0), 0);
+    TEST_EQUAL(Output_writeWord(&output, 0xea87), 0);
+    TEST_EQUAL(Output_writeWord(&output, 5), 0);
+    TEST_EQUAL(Output_patchHeader(&output, 2), 0);
+    TEST_EQUAL(Output_flush(&output), 0);
+
+    unsigned char bytes[32];
+    TEST_EQUAL(readAll(file, bytes, sizeof(bytes)), sizeof(expected));
+    TEST_EQUAL(memcmp(bytes, expected, sizeof(expected)), 0);
+    fclose(file);
+
+    // Text has no header
+    file = tmpfile();
+    TEST_CHECK(file != NULL);
+    if (file == NULL) {
+        return;
+    }
+
+    options.format = OUTPUT_TEXT;
+    TEST_EQUAL(Output_create(&output, file, &options), 0);
+    TEST_EQUAL(Output_writeHeader(&output, 1), 0);
+    TEST_EQUAL(Output_writeWord(&output, 1), 0);
+    TEST_EQUAL(Output_patchHeader(&output, 1), 0);
+    TEST_EQUAL(Output_flush(&output), 0);
+    TEST_EQUAL(readAll(file, bytes, sizeof(bytes)), 17);
+
+    fclose(file);
+}
+
+/* Words are patched in the buffer or, once flushed, in the file, the
+ * output carries on at its end. A pipe can't take a patch of flushed words */
+static void testPatchWord(void)
+{
+    const size_t count = 40000;
+
+    FILE* file = tmpfile();
+    TEST_CHECK(file != NULL);
+    if (file == NULL) {
+        return;
+    }
+
+    OutputOptions options;
+    Output_defaultOptions(&options);
+    options.format = OUTPUT_BINARY;
+
+    static Output output;
+    TEST_EQUAL(Output_create(&output, file, &options), 0);
+    for (size_t index = 0; index < count; index++) {
+        TEST_EQUAL(Output_writeWord(&output, 0), 0);
+    }
+
+    TEST_CHECK(output.flushed_bytes > 0);
+    TEST_EQUAL(Output_patchWord(&output, 0, 0x1111), 0);
+    TEST_EQUAL(Output_patchWord(&output, count - 1, 0x2222), 0);
+    TEST_EQUAL(Output_writeWord(&output, 0x3333), 0);
+
+    errno = 0;
+    TEST_EQUAL(Output_patchWord(&output, count + 1, 0), -1);
+    TEST_EQUAL(errno, EINVAL);
+    TEST_EQUAL(Output_flush(&output), 0);
+
+    static unsigned char bytes[2 * 40000 + 16];
+    TEST_EQUAL(readAll(file, bytes, sizeof(bytes)), 2 * (count + 1));
+    TEST_EQUAL(bytes[0] | (bytes[1] << 8), 0x1111);
+    TEST_EQUAL(bytes[2] | (bytes[3] << 8), 0);
+    TEST_EQUAL(bytes[2 * (count - 1)] | (bytes[2 * (count - 1) + 1] << 8), 0x2222);
+    TEST_EQUAL(bytes[2 * count] | (bytes[2 * count + 1] << 8), 0x3333);
+    fclose(file);
+
+    int pipe_fds[2];
+    TEST_EQUAL(pipe(pipe_fds), 0);
+    file = fdopen(pipe_fds[1], "w");
+    TEST_CHECK(file != NULL);
+    if (file == NULL) {
+        return;
+    }
+
+    TEST_EQUAL(Output_create(&output, file, &options), 0);
+    TEST_EQUAL(output.start_offset, -1);
+    TEST_EQUAL(Output_writeWord(&output, 0), 0);
+    TEST_EQUAL(Output_patchWord(&output, 0, 1), 0);
+    TEST_EQUAL(Output_flush(&output), 0);
+
+    errno = 0;
+    TEST_EQUAL(Output_patchWord(&output, 0, 2), -1);
+    TEST_EQUAL(errno, ESPIPE);
+
+    fclose(file);
+    close(pipe_fds[0]);
+}
+
+/* Every word expands to its 16 bits, most significant first, and a newline */
+static void testTextWords(void)
+{
+    static uint16_t words[65536];
+    static char text[65536 * 17];
+
+    for (size_t word = 0; word < 65536; word++) {
+        words[word] = (uint16_t) word;
+    }
+
+    OutputOptions options;
+    Output_defaultOptions(&options);
+    TEST_EQUAL(Output_formatWords(&options, words, 65536, text), sizeof(text));
+
+    size_t correct = 0;
+    for (size_t word = 0; word < 65536; word++) {
+        char expected[17];
+        for (int bit = 0; bit < 16; bit++) {
+            expected[bit] = ((word >> (15 - bit)) & 1) ? '1' : '0';
+        }
+        expected[16] = '\n';
+
+        correct += (memcmp(&text[word * 17], expected, 17) == 0);
+    }
+    TEST_EQUAL(correct, 65536);
+}
+
+/* Single words, blocks and preformatted text can be mixed,
+ * across any number of buffer flushes */
+static void testTextBlocks(void)
+{
+    static uint16_t words[20000];
+    static char formatted[20000 * 17];
+    static char text[3 * 20000 * 17 + 16];
+
+    for (size_t index = 0; index < 20000; index++) {
+        words[index] = (uint16_t) (index * 7919);
+    }
+
+    FILE* file = tmpfile();
+    TEST_CHECK(file != NULL);
+    if (file == NULL) {
+        return;
+    }
+
+    OutputOptions options;
+    Output_defaultOptions(&options);
+
+    static Output output;
+    TEST_EQUAL(Output_create(&output, file, &options), 0);
+
+    for (size_t index = 0; index < 20000; index++) {
+        TEST_EQUAL(Output_writeWord(&output, words[index]), 0);
+    }
+    TEST_EQUAL(Output_writeWords(&output, words, 20000), 0);
+
+    size_t bytes = Output_formatWords(&options, words, 20000, formatted);
+    TEST_EQUAL(Output_writeFormatted(&output, formatted, bytes, 20000), 0);
+    TEST_EQUAL(output.word_count, 60000);
+    TEST_EQUAL(Output_flush(&output), 0);
+
+    TEST_EQUAL(readAll(file, (unsigned char*) text, sizeof(text)), 3 * bytes);
+    TEST_EQUAL(memcmp(text, formatted, bytes), 0);
+    TEST_EQUAL(memcmp(text + bytes, formatted, bytes), 0);
+    TEST_EQUAL(memcmp(text + 2 * bytes, formatted, bytes), 0);
+
+    fclose(file);
+}
+
+int main(void)
+{
+    TEST_RUN(testMakePath);
+    TEST_RUN(testBinaryWords);
+    TEST_RUN(testHeader);
+    TEST_RUN(testPatchWord);
+    TEST_RUN(testTextWords);
+    TEST_RUN(testTextBlocks);
+
+    return TEST_EXIT();
+}
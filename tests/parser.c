@@ -0,0 +1,535 @@
+#include "test.h"
+#include "../parser.h"
+#include "../code.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+/* Write the length bytes at source to a new temporary file, its path is stored in path
+ * Return 0 on success
+ * Return -1 on failure */
+static int writeSource(const char* source, size_t length, char* path)
+{
+    strcpy(path, "/tmp/hack-test-XXXXXX");
+
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return -1;
+    }
+
+    ssize_t written = write(fd, source, length);
+    close(fd);
+
+    return (written == (ssize_t) length) ? 0 : -1;
+}
+
+
+/* Feed the length bytes at source to a pipe from a child process, chunk bytes per write
+ * Return the read end of the pipe on success, the child is stored in child
+ * Return -1 on failure */
+static int pipeSource(const char* source, size_t length, size_t chunk, pid_t* child)
+{
+    int pipe_fds[2];
+    if (pipe(pipe_fds) < 0) {
+        return -1;
+    }
+
+    *child = fork();
+    if (*child < 0) {
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        return -1;
+    }
+
+    if (*child == 0) {
+        close(pipe_fds[0]);
+        for (size_t offset = 0; offset < length; offset += chunk) {
+            size_t size = (length - offset < chunk) ? length - offset : chunk;
+            if (write(pipe_fds[1], source + offset, size) != (ssize_t) size) {
+                _exit(1);
+            }
+        }
+        _exit(0);
+    }
+
+    close(pipe_fds[1]);
+
+    return pipe_fds[0];
+}
+
+/* Parse the length bytes at source from a buffer and compare with stream
+ * Return the number of commands that differ, -1 if the stream failed */
+static int compareParsers(const char* source, size_t length, Parser* stream)
+{
+    Parser parser;
+    if (Parser_createFromBuffer(&parser, source, length) < 0) {
+        return -1;
+    }
+
+    int differences = 0;
+    while (1) {
+        int expected = Parser_advance(&parser);
+        int result = Parser_advance(stream);
+        if (result < 0) {
+            differences = -1;
+            break;
+        }
+
+        StringView expected_symbol = Parser_symbolView(&parser);
+        StringView symbol = Parser_symbolView(stream);
+
+        differences += (result != expected ||
+                        Parser_commandType(stream) != Parser_commandType(&parser) ||
+                        Parser_lineNumber(stream) != Parser_lineNumber(&parser) ||
+                        Parser_word(stream) != Parser_word(&parser) ||
+                        symbol.length != expected_symbol.length ||
+                        (symbol.length > 0 && memcmp(symbol.data, expected_symbol.data, symbol.length) != 0));
+
+        if (expected != 0 || result != 0) {
+            break;
+        }
+    }
+
+    Parser_free(&parser);
+
+    return differences;
+}
+
+/* Parse the length bytes at source both from a buffer and from the stream fd
+ * Return the number of commands that differ, -1 if the stream failed */
+static int compareStream(const char* source, size_t length, int fd, Parser* stream)
+{
+    if (Parser_createFromStream(stream, fd) < 0) {
+        return -1;
+    }
+
+    return compareParsers(source, length, stream);
+}
+
+/* Write a program of count commands mixing every kind of line
+ * Return the source, its length is stored in length, NULL on failure */
+static char* makeProgram(size_t count, size_t* length)
+{
+    char* source = malloc(count * 32);
+    if (source == NULL) {
+        return NULL;
+    }
+
+    size_t offset = 0;
+    for (size_t index = 0; index < count; index++) {
+        switch (index % 5) {
+        case 0:  offset += (size_t) sprintf(source + offset, "@value%zu\n", index % 700); break;
+        case 1:  offset += (size_t) sprintf(source + offset, "  D=D+M // step %zu\n", index); break;
+        case 2:  offset += (size_t) sprintf(source + offset, "(LABEL%zu)\r\n", index); break;
+        case 3:  offset += (size_t) sprintf(source + offset, "\n\t@%zu\n", index % 32768); break;
+        default: offset += (size_t) sprintf(source + offset, "0;JMP"); break;
+        }
+
+        // The last command ends the input without a newline
+        if (index % 5 == 4 && index + 1 < count) {
+            source[offset++] = '\n';
+        }
+    }
+
+    *length = offset;
+
+    return source;
+}
+
+
+/* C instructions are encoded to their final word as they are parsed */
+static void testEncodeC(void)
+{
+    static const struct { const char* line; uint16_t word; } commands[] = {
+        { "0;JMP", 0xea87 },
+        { "D=A", 0xec10 },
+        { "M=D+M", 0xf088 },
+        { "AMD=!M;JLE", 0xfc7e },
+        { "D;JGT", 0xe301 },
+        { "MD=M-1", 0xfc98 },
+        { "A=D|A;JNE", 0xe565 },
+        { "D=D&M", 0xf010 },
+        { "M=-1", 0xee88 }
+    };
+
+    for (size_t index = 0; index < sizeof(commands) / sizeof(commands[0]); index++) {
+        Parser parser;
+        TEST_EQUAL(Parser_createFromBuffer(&parser, commands[index].line, strlen(commands[index].line)), 0);
+
+        TEST_EQUAL(Parser_advance(&parser), 0);
+        TEST_EQUAL(Parser_commandType(&parser), C_COMMAND);
+        TEST_EQUAL(Parser_word(&parser), commands[index].word);
+        TEST_EQUAL(Parser_needsSymbol(&parser), 0);
+
+        Parser_free(&parser);
+    }
+}
+
+/* A constant A instruction is final, a symbolic one waits for the symbol table */
+static void testEncodeA(void)
+{
+    static const char* source = "@0\n@32767\n@LOOP\n@R0\n(LOOP)\n";
+
+    Parser parser;
+    TEST_EQUAL(Parser_createFromBuffer(&parser, source, strlen(source)), 0);
+
+    TEST_EQUAL(Parser_advance(&parser), 0);
+    TEST_EQUAL(Parser_word(&parser), 0);
+    TEST_EQUAL(Parser_needsSymbol(&parser), 0);
+
+    TEST_EQUAL(Parser_advance(&parser), 0);
+    TEST_EQUAL(Parser_word(&parser), 32767);
+    TEST_EQUAL(Parser_needsSymbol(&parser), 0);
+
+    TEST_EQUAL(Parser_advance(&parser), 0);
+    TEST_EQUAL(Parser_needsSymbol(&parser), 1);
+    StringView symbol = Parser_symbolView(&parser);
+    TEST_BYTES(symbol.data, symbol.length, "LOOP");
+
+    // Predefined symbols are resolved by the symbol table too
+    TEST_EQUAL(Parser_advance(&parser), 0);
+    TEST_EQUAL(Parser_needsSymbol(&parser), 1);
+
+    TEST_EQUAL(Parser_advance(&parser), 0);
+    TEST_EQUAL(Parser_commandType(&parser), L_COMMAND);
+    TEST_EQUAL(Parser_needsSymbol(&parser), 0);
+    symbol = Parser_symbolView(&parser);
+    TEST_BYTES(symbol.data, symbol.length, "LOOP");
+
+    TEST_EQUAL(Parser_advance(&parser), 1);
+    TEST_EQUAL(Parser_hasMoreCommands(&parser), 0);
+
+    Parser_free(&parser);
+}
+
+/* An invalid command fails as it is parsed, on its own line */
+static void testEncodeErrors(void)
+{
+    static const char* sources[] = {
+        "@1\nD=D+X\n",
+        "@1\nD=A;JMPS\n",
+        "@1\nQ=A\n",
+        "@1\n@32768\n",
+        "@1\n@99999999999\n"
+    };
+
+    for (size_t index = 0; index < sizeof(sources) / sizeof(sources[0]); index++) {
+        Parser parser;
+        TEST_EQUAL(Parser_createFromBuffer(&parser, sources[index], strlen(sources[index])), 0);
+
+        TEST_EQUAL(Parser_advance(&parser), 0);
+
+        errno = 0;
+        TEST_EQUAL(Parser_advance(&parser), -1);
+        TEST_EQUAL(errno, EINVAL);
+        TEST_EQUAL(Parser_lineNumber(&parser), 2);
+
+        Parser_free(&parser);
+    }
+}
+
+/* Every computation encodes to the field the disassembler decodes back */
+static void testComputations(void)
+{
+    static const char* computations[] = {
+        "0", "1", "-1", "D", "A", "!D", "!A", "-D", "-A", "D+1", "A+1", "D-1", "A-1",
+        "D+A", "D-A", "A-D", "D&A", "D|A", "M", "!M", "-M", "M+1", "M-1", "D+M", "D-M",
+        "M-D", "D&M", "D|M"
+    };
+
+    for (size_t index = 0; index < sizeof(computations) / sizeof(computations[0]); index++) {
+        char line[16];
+        int length = snprintf(line, sizeof(line), "D=%s", computations[index]);
+
+        Parser parser;
+        TEST_EQUAL(Parser_createFromBuffer(&parser, line, (size_t) length), 0);
+        TEST_EQUAL(Parser_advance(&parser), 0);
+
+        char name[3];
+        int name_length = decodeComp((uint8_t) ((Parser_word(&parser) >> COMP_SHIFT) & 0x7f), name);
+        TEST_CHECK(name_length > 0);
+        if (name_length > 0) {
+            TEST_BYTES(name, (size_t) name_length, computations[index]);
+        }
+
+        Parser_free(&parser);
+    }
+}
+
+/* A mapped file is lexed in place, fields come without the whitespace around them,
+ * comments and blank lines are skipped and the last line needs no newline */
+static void testFromPath(void)
+{
+    static const char* source =
+        "   @17 \n"
+        "\n"
+        "// comment\n"
+        "\t D = M ; JGT   // tail\n"
+        "(END)\n"
+        "@END\n"
+        "0;JMP";
+
+    char path[32];
+    TEST_EQUAL(writeSource(source, strlen(source), path), 0);
+
+    Parser parser;
+    TEST_EQUAL(Parser_createFromPath(&parser, path), 0);
+    unlink(path);
+
+    TEST_EQUAL(Parser_hasMoreCommands(&parser), 1);
+    TEST_EQUAL(Parser_advance(&parser), 0);
+    TEST_EQUAL(Parser_lineNumber(&parser), 1);
+    StringView first = Parser_symbolView(&parser);
+    TEST_BYTES(first.data, first.length, "17");
+
+    TEST_EQUAL(Parser_advance(&parser), 0);
+    TEST_EQUAL(Parser_lineNumber(&parser), 4);
+    StringView field = Parser_destView(&parser);
+    TEST_BYTES(field.data, field.length, "D");
+    field = Parser_compView(&parser);
+    TEST_BYTES(field.data, field.length, "M");
+    field = Parser_jumpView(&parser);
+    TEST_BYTES(field.data, field.length, "JGT");
+    TEST_EQUAL(Parser_word(&parser), 0xfc11);
+
+    TEST_EQUAL(Parser_advance(&parser), 0);
+    TEST_EQUAL(Parser_commandType(&parser), L_COMMAND);
+    TEST_EQUAL(Parser_advance(&parser), 0);
+    TEST_EQUAL(Parser_commandType(&parser), A_COMMAND);
+
+    TEST_EQUAL(Parser_advance(&parser), 0);
+    TEST_EQUAL(Parser_lineNumber(&parser), 7);
+    TEST_EQUAL(Parser_word(&parser), 0xea87);
+    TEST_EQUAL(Parser_hasMoreCommands(&parser), 0);
+    TEST_EQUAL(Parser_advance(&parser), 1);
+
+    // Views stay valid until the parser is freed
+    TEST_BYTES(first.data, first.length, "17");
+
+    Parser_free(&parser);
+}
+
+/* An empty file can't be mapped, it has no commands */
+static void testEmptyFile(void)
+{
+    char path[32];
+    TEST_EQUAL(writeSource("", 0, path), 0);
+
+    Parser parser;
+    TEST_EQUAL(Parser_createFromPath(&parser, path), 0);
+    unlink(path);
+
+    TEST_EQUAL(Parser_hasMoreCommands(&parser), 0);
+    TEST_EQUAL(Parser_advance(&parser), 1);
+
+    Parser_free(&parser);
+
+    errno = 0;
+    TEST_EQUAL(Parser_createFromPath(&parser, path), -1);
+    TEST_EQUAL(errno, ENOENT);
+}
+
+/* A pipe named by a path, like <(cmd), can't be mapped and is read whole,
+ * a directory isn't a source */
+static void testFromPipePath(void)
+{
+    size_t length = 0;
+    char* source = makeProgram(20000, &length);
+    TEST_CHECK(source != NULL);
+    if (source == NULL) {
+        return;
+    }
+
+    pid_t child;
+    int fd = pipeSource(source, length, 4099, &child);
+    TEST_CHECK(fd >= 0);
+
+    if (fd >= 0) {
+        char path[32];
+        snprintf(path, sizeof(path), "/dev/fd/%d", fd);
+
+        Parser parser;
+        TEST_EQUAL(Parser_createFromPath(&parser, path), 0);
+        TEST_EQUAL(compareParsers(source, length, &parser), 0);
+        Parser_free(&parser);
+
+        close(fd);
+        waitpid(child, NULL, 0);
+    }
+
+    free(source);
+
+    Parser parser;
+    errno = 0;
+    TEST_EQUAL(Parser_createFromPath(&parser, "/tmp"), -1);
+    TEST_EQUAL(errno, EINVAL);
+}
+
+/* There is no limit on the length of a line */
+static void testLongLine(void)
+{
+    size_t name_length = 100000;
+    char* source = malloc(name_length + 16);
+    TEST_CHECK(source != NULL);
+    if (source == NULL) {
+        return;
+    }
+
+    source[0] = '(';
+    memset(source + 1, 'x', name_length);
+    memcpy(source + 1 + name_length, ")\n@1\n", 6);
+
+    Parser parser;
+    TEST_EQUAL(Parser_createFromBuffer(&parser, source, name_length + 7), 0);
+
+    TEST_EQUAL(Parser_advance(&parser), 0);
+    TEST_EQUAL(Parser_commandType(&parser), L_COMMAND);
+    TEST_EQUAL(Parser_symbolView(&parser).length, name_length);
+    TEST_CHECK(Parser_symbolView(&parser).data == source + 1);
+
+    TEST_EQUAL(Parser_advance(&parser), 0);
+    TEST_EQUAL(Parser_lineNumber(&parser), 2);
+    TEST_EQUAL(Parser_word(&parser), 1);
+
+    Parser_free(&parser);
+    free(source);
+}
+
+/* A buffer is only read up to its length, it needn't be null terminated */
+static void testBufferLength(void)
+{
+    static const char source[] = { '@', '1', '\n', '@', '2' };
+
+    Parser parser;
+    TEST_EQUAL(Parser_createFromBuffer(&parser, source, 3), 0);
+
+    TEST_EQUAL(Parser_advance(&parser), 0);
+    TEST_EQUAL(Parser_word(&parser), 1);
+    TEST_EQUAL(Parser_advance(&parser), 1);
+
+    Parser_free(&parser);
+
+    TEST_EQUAL(Parser_createFromBuffer(&parser, source, sizeof(source)), 0);
+    TEST_EQUAL(Parser_advance(&parser), 0);
+    TEST_EQUAL(Parser_advance(&parser), 0);
+    TEST_EQUAL(Parser_word(&parser), 2);
+    TEST_EQUAL(Parser_advance(&parser), 1);
+
+    Parser_free(&parser);
+}
+
+/* A stream read in chunks that split lines parses like the whole input,
+ * its buffer is refilled without growing */
+static void testStream(void)
+{
+    size_t length = 0;
+    char* source = makeProgram(100000, &length);
+    TEST_CHECK(source != NULL);
+    if (source == NULL) {
+        return;
+    }
+    TEST_CHECK(length > 4 * PARSER_STREAM_BUFFER_SIZE);
+
+    // Large writes, writes that split most lines, and a trickle over part of the input
+    const struct { size_t chunk; size_t length; } feeds[] = {
+        { 1000003, length }, { 4099, length }, { 7, 20000 }
+    };
+
+    for (size_t index = 0; index < sizeof(feeds) / sizeof(feeds[0]); index++) {
+        pid_t child;
+        int fd = pipeSource(source, feeds[index].length, feeds[index].chunk, &child);
+        TEST_CHECK(fd >= 0);
+        if (fd < 0) {
+            break;
+        }
+
+        Parser stream;
+        TEST_EQUAL(compareStream(source, feeds[index].length, fd, &stream), 0);
+        TEST_EQUAL(stream.stream_capacity, PARSER_STREAM_BUFFER_SIZE);
+        TEST_EQUAL(Parser_hasMoreCommands(&stream), 0);
+        Parser_free(&stream);
+
+        close(fd);
+        waitpid(child, NULL, 0);
+    }
+
+    free(source);
+}
+
+/* Count the calls of the stream wait function */
+static void countWait(void* context)
+{
+    (*(int*) context)++;
+}
+
+/* A line longer than the buffer grows it, the wait function runs before every read */
+static void testStreamLongLine(void)
+{
+    size_t name_length = 3 * PARSER_STREAM_BUFFER_SIZE;
+    char* source = malloc(name_length + 16);
+    TEST_CHECK(source != NULL);
+    if (source == NULL) {
+        return;
+    }
+
+    source[0] = '@';
+    memset(source + 1, 'y', name_length);
+    memcpy(source + 1 + name_length, "\nD=A\n", 6);
+
+    char path[32];
+    TEST_EQUAL(writeSource(source, name_length + 6, path), 0);
+    FILE* file = fopen(path, "r");
+    unlink(path);
+    TEST_CHECK(file != NULL);
+    if (file == NULL) {
+        free(source);
+        return;
+    }
+
+    Parser stream;
+    int waits = 0;
+    TEST_EQUAL(Parser_createFromStream(&stream, fileno(file)), 0);
+    Parser_setStreamWait(&stream, countWait, &waits);
+
+    TEST_EQUAL(Parser_advance(&stream), 0);
+    TEST_EQUAL(Parser_needsSymbol(&stream), 1);
+    TEST_EQUAL(Parser_symbolView(&stream).length, name_length);
+    TEST_CHECK(stream.stream_capacity >= name_length + 1);
+
+    TEST_EQUAL(Parser_advance(&stream), 0);
+    TEST_EQUAL(Parser_lineNumber(&stream), 2);
+    TEST_EQUAL(Parser_word(&stream), 0xec10);
+    TEST_EQUAL(Parser_advance(&stream), 1);
+    TEST_CHECK(waits >= 4);
+
+    Parser_free(&stream);
+    fclose(file);
+    free(source);
+
+    errno = 0;
+    TEST_EQUAL(Parser_createFromStream(&stream, -1), -1);
+    TEST_EQUAL(errno, EINVAL);
+}
+
+int main(void)
+{
+    TEST_RUN(testEncodeC);
+    TEST_RUN(testEncodeA);
+    TEST_RUN(testEncodeErrors);
+    TEST_RUN(testComputations);
+    TEST_RUN(testFromPath);
+    TEST_RUN(testEmptyFile);
+    TEST_RUN(testFromPipePath);
+    TEST_RUN(testLongLine);
+    TEST_RUN(testBufferLength);
+    TEST_RUN(testStream);
+    TEST_RUN(testStreamLongLine);
+
+    return TEST_EXIT();
+}
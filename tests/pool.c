@@ -0,0 +1,114 @@
+#include "test.h"
+#include "../pool.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+/* Record of what ran where, shared by the tasks of a run */
+struct StructRecord {
+    atomic_int* runs;          // Times every task ran
+    int*        workers;       // Worker that ran every task
+    size_t      slow_count;    // The first tasks take a millisecond
+    atomic_int  bad_worker;    // Set if a worker number was out of range
+    int         worker_count;
+};
+
+/* Task that records its run */
+static void recordTask(void* context, int worker, size_t task)
+{
+    struct StructRecord* record = context;
+
+    if (worker < 0 || worker >= record->worker_count) {
+        atomic_store(&record->bad_worker, 1);
+    }
+
+    if (task < record->slow_count) {
+        struct timespec delay = { 0, 1000000 };
+        nanosleep(&delay, NULL);
+    }
+
+    atomic_fetch_add(&record->runs[task], 1);
+    record->workers[task] = worker;
+}
+
+/* Run task_count tasks on worker_count workers, the first slow_count are slow
+ * Return the number of tasks of the first worker's range that ran on another worker,
+ * -1 if a task didn't run exactly once */
+static long runRecorded(size_t task_count, int worker_count, size_t slow_count)
+{
+    struct StructRecord record;
+    record.runs = calloc(task_count + 1, sizeof(atomic_int));
+    record.workers = calloc(task_count + 1, sizeof(int));
+    record.slow_count = slow_count;
+    atomic_init(&record.bad_worker, 0);
+    record.worker_count = worker_count;
+
+    TEST_CHECK(record.runs != NULL && record.workers != NULL);
+    if (record.runs == NULL || record.workers == NULL) {
+        free(record.runs);
+        free(record.workers);
+        return -1;
+    }
+
+    TEST_EQUAL(Pool_run(task_count, worker_count, recordTask, &record), 0);
+    TEST_EQUAL(atomic_load(&record.bad_worker), 0);
+
+    long stolen = 0;
+    size_t first_range = (worker_count > 0) ? task_count / (size_t) worker_count : 0;
+    for (size_t task = 0; task < task_count; task++) {
+        if (atomic_load(&record.runs[task]) != 1) {
+            stolen = -1;
+            break;
+        }
+        stolen += (task < first_range && record.workers[task] != 0);
+    }
+
+    free(record.runs);
+    free(record.workers);
+
+    return stolen;
+}
+
+/* Every task runs exactly once, whatever the number of tasks and workers */
+static void testEveryTaskOnce(void)
+{
+    static const size_t task_counts[] = { 0, 1, 2, 7, 64, 1000, 10007 };
+    static const int worker_counts[] = { 1, 2, 3, 8, 64, 200 };
+
+    for (size_t tasks = 0; tasks < sizeof(task_counts) / sizeof(task_counts[0]); tasks++) {
+        for (size_t workers = 0; workers < sizeof(worker_counts) / sizeof(worker_counts[0]); workers++) {
+            TEST_CHECK(runRecorded(task_counts[tasks], worker_counts[workers], 0) >= 0);
+        }
+    }
+}
+
+/* A worker with slow tasks has them stolen by the others */
+static void testStealing(void)
+{
+    long stolen = runRecorded(400, 4, 100);
+    TEST_CHECK(stolen > 0);
+}
+
+/* At least one worker is needed */
+static void testInvalid(void)
+{
+    errno = 0;
+    TEST_EQUAL(Pool_run(10, 0, recordTask, NULL), -1);
+    TEST_EQUAL(errno, EINVAL);
+
+    errno = 0;
+    TEST_EQUAL(Pool_run(10, 2, NULL, NULL), -1);
+    TEST_EQUAL(errno, EINVAL);
+}
+
+int main(void)
+{
+    TEST_RUN(testEveryTaskOnce);
+    TEST_RUN(testStealing);
+    TEST_RUN(testInvalid);
+
+    return TEST_EXIT();
+}
@@ -0,0 +1,262 @@
+#include "test.h"
+#include "../server.h"
+#include "../protocol.h"
+#include "../output.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+
+/* Socket of the server under test */
+static char socket_path[64];
+
+/* Run the server until it is sent SIGTERM */
+static void* runServer(void* argument)
+{
+    (void) argument;
+    TEST_EQUAL(Server_run(socket_path, 2), 0);
+    return NULL;
+}
+
+/* Connect to the server, waiting for it to listen
+ * Return the connection, -1 on failure */
+static int connectServer(void)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_path);
+
+    for (int attempt = 0; attempt < 500; attempt++) {
+        int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (connection < 0) {
+            return -1;
+        }
+
+        if (connect(connection, (struct sockaddr*) &address, sizeof(address)) == 0) {
+            return connection;
+        }
+        close(connection);
+
+        struct timespec delay = { 0, 10000000 };
+        nanosleep(&delay, NULL);
+    }
+
+    return -1;
+}
+
+/* Send a request with flags for input, output_path may be NULL for an inline output.
+ * The reply is stored in reply, its message and output in message and output
+ * Return 0 if a reply was received
+ * Return -1 otherwise */
+static int request(int connection, uint32_t flags, const char* input, const char* output_path,
+                   ProtocolReply* reply, char* message, char* output, size_t output_capacity)
+{
+    ProtocolRequest header;
+    memset(&header, 0, sizeof(header));
+    header.magic = PROTOCOL_REQUEST_MAGIC;
+    header.flags = flags;
+    header.format = OUTPUT_TEXT;
+    header.input_length = (uint32_t) strlen(input);
+    header.output_length = (output_path != NULL) ? (uint32_t) strlen(output_path) : 0;
+
+    if (Protocol_writeFull(connection, &header, sizeof(header)) < 0 ||
+        Protocol_writeFull(connection, input, header.input_length) < 0 ||
+        Protocol_writeFull(connection, output_path, header.output_length) < 0 ||
+        Protocol_readFull(connection, reply, sizeof(*reply)) <= 0 ||
+        reply->magic != PROTOCOL_REPLY_MAGIC ||
+        reply->message_length >= 256 ||
+        reply->output_length > output_capacity ||
+        Protocol_readFull(connection, message, reply->message_length) < 0 ||
+        Protocol_readFull(connection, output, reply->output_length) < 0) {
+        return -1;
+    }
+
+    message[reply->message_length] = '\0';
+
+    return 0;
+}
+
+/* One connection carries several requests, a failed one doesn't end it */
+static void testInlineRequests(void)
+{
+    int connection = connectServer();
+    TEST_CHECK(connection >= 0);
+    if (connection < 0) {
+        return;
+    }
+
+    static const uint32_t flags = PROTOCOL_INLINE_INPUT | PROTOCOL_INLINE_OUTPUT;
+    ProtocolReply reply;
+    char message[256];
+    char output[256];
+
+    TEST_EQUAL(request(connection, flags, "@2\nD=A\n", NULL, &reply, message, output, sizeof(output)), 0);
+    TEST_EQUAL(reply.error, 0);
+    TEST_BYTES(output, reply.output_length, "0000000000000010\n1110110000010000\n");
+
+    TEST_EQUAL(request(connection, flags, "@1\nD=X\n", NULL, &reply, message, output, sizeof(output)), 0);
+    TEST_EQUAL(reply.error, -1);
+    TEST_EQUAL(reply.error_number, EINVAL);
+    TEST_EQUAL(reply.output_length, 0);
+    TEST_CHECK(reply.message_length > 0);
+
+    TEST_EQUAL(request(connection, flags | PROTOCOL_SINGLE_PASS, "@END\n(END)\n", NULL, &reply, message, output, sizeof(output)), 0);
+    TEST_EQUAL(reply.error, 0);
+    TEST_BYTES(output, reply.output_length, "0000000000000001\n");
+
+    close(connection);
+}
+
+/* A request can name the source and output files instead */
+static void testPathRequest(void)
+{
+    char directory[] = "/tmp/hack-server-XXXXXX";
+    TEST_CHECK(mkdtemp(directory) != NULL);
+
+    char input_path[64];
+    char output_path[64];
+    snprintf(input_path, sizeof(input_path), "%s/Prog.asm", directory);
+    snprintf(output_path, sizeof(output_path), "%s/Prog.hack", directory);
+
+    FILE* input = fopen(input_path, "w");
+    TEST_CHECK(input != NULL);
+    if (input == NULL) {
+        return;
+    }
+    fputs("(LOOP)\n@LOOP\n0;JMP\n", input);
+    fclose(input);
+
+    int connection = connectServer();
+    TEST_CHECK(connection >= 0);
+
+    ProtocolReply reply;
+    char message[256];
+    char output[256];
+    TEST_EQUAL(request(connection, 0, input_path, output_path, &reply, message, output, sizeof(output)), 0);
+    TEST_EQUAL(reply.error, 0);
+    TEST_EQUAL(reply.output_length, 0);
+
+    FILE* written = fopen(output_path, "r");
+    TEST_CHECK(written != NULL);
+    if (written != NULL) {
+        size_t length = fread(output, 1, sizeof(output), written);
+        TEST_BYTES(output, length, "0000000000000000\n1110101010000111\n");
+        fclose(written);
+    }
+
+    // A missing source is reported, the connection goes on
+    unlink(input_path);
+    TEST_EQUAL(request(connection, 0, input_path, output_path, &reply, message, output, sizeof(output)), 0);
+    TEST_EQUAL(reply.error, -1);
+    TEST_EQUAL(reply.error_number, ENOENT);
+
+    close(connection);
+    unlink(output_path);
+    rmdir(directory);
+}
+
+/* A malformed request is answered with EPROTO and the connection is closed */
+static void testInvalidRequest(void)
+{
+    int connection = connectServer();
+    TEST_CHECK(connection >= 0);
+    if (connection < 0) {
+        return;
+    }
+
+    ProtocolRequest header;
+    memset(&header, 0, sizeof(header));
+    header.magic = 0x12345678;
+
+    ProtocolReply reply;
+    TEST_EQUAL(Protocol_writeFull(connection, &header, sizeof(header)), 0);
+    TEST_EQUAL(Protocol_readFull(connection, &reply, sizeof(reply)), 1);
+    TEST_EQUAL(reply.error, -1);
+    TEST_EQUAL(reply.error_number, EPROTO);
+
+    char rest[256];
+    TEST_EQUAL(Protocol_readFull(connection, rest, reply.message_length), 1);
+    TEST_EQUAL(Protocol_readFull(connection, rest, 1), 0);
+
+    close(connection);
+}
+
+/* A second server doesn't take over a live socket or replace a file */
+static void testAddressInUse(void)
+{
+    int connection = connectServer();
+    TEST_CHECK(connection >= 0);
+
+    errno = 0;
+    TEST_EQUAL(Server_run(socket_path, 1), -1);
+    TEST_EQUAL(errno, EADDRINUSE);
+
+    // The first server still answers
+    if (connection >= 0) {
+        ProtocolReply reply;
+        char message[256];
+        char output[64];
+        TEST_EQUAL(request(connection, PROTOCOL_INLINE_INPUT | PROTOCOL_INLINE_OUTPUT, "@1\n", NULL,
+                           &reply, message, output, sizeof(output)), 0);
+        TEST_EQUAL(reply.error, 0);
+        TEST_BYTES(output, reply.output_length, "0000000000000001\n");
+        close(connection);
+    }
+
+    char file_path[64];
+    snprintf(file_path, sizeof(file_path), "/tmp/hack-test-%d.file", (int) getpid());
+    FILE* file = fopen(file_path, "w");
+    TEST_CHECK(file != NULL);
+    if (file != NULL) {
+        fclose(file);
+    }
+
+    errno = 0;
+    TEST_EQUAL(Server_run(file_path, 1), -1);
+    TEST_EQUAL(errno, EADDRINUSE);
+
+    struct stat file_stat;
+    TEST_EQUAL(stat(file_path, &file_stat), 0);
+    unlink(file_path);
+}
+
+int main(void)
+{
+    snprintf(socket_path, sizeof(socket_path), "/tmp/hack-test-%d.sock", (int) getpid());
+
+    // The server thread takes the stop signal
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+
+    pthread_t server;
+    if (pthread_create(&server, NULL, runServer, NULL) != 0) {
+        return 1;
+    }
+
+    TEST_RUN(testInlineRequests);
+    TEST_RUN(testPathRequest);
+    TEST_RUN(testInvalidRequest);
+    TEST_RUN(testAddressInUse);
+
+    kill(getpid(), SIGTERM);
+    pthread_join(server, NULL);
+
+    // The socket is removed once the server stops
+    struct stat socket_stat;
+    TEST_EQUAL(stat(socket_path, &socket_stat), -1);
+
+    return TEST_EXIT();
+}
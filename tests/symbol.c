@@ -0,0 +1,282 @@
+#include "test.h"
+#include "../symbol.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+
+/* The predefined symbols and their addresses */
+static const struct { const char* name; int address; } predefined[] = {
+    { "SP", 0 }, { "LCL", 1 }, { "ARG", 2 }, { "THIS", 3 }, { "THAT", 4 },
+    { "R0", 0 }, { "R1", 1 }, { "R2", 2 }, { "R3", 3 }, { "R4", 4 }, { "R5", 5 },
+    { "R6", 6 }, { "R7", 7 }, { "R8", 8 }, { "R9", 9 }, { "R10", 10 }, { "R11", 11 },
+    { "R12", 12 }, { "R13", 13 }, { "R14", 14 }, { "R15", 15 },
+    { "SCREEN", 16384 }, { "KBD", 24576 }
+};
+
+/* Find the length characters at name in the predefined symbols
+ * Return the address, -1 if it isn't one of them */
+static int predefinedAddress(const char* name, size_t length)
+{
+    for (size_t index = 0; index < sizeof(predefined) / sizeof(predefined[0]); index++) {
+        if (strlen(predefined[index].name) == length &&
+            memcmp(predefined[index].name, name, length) == 0) {
+            return predefined[index].address;
+        }
+    }
+
+    return -1;
+}
+
+/* Every predefined symbol resolves without being added */
+static void testPredefined(void)
+{
+    SymbolTable st;
+    TEST_EQUAL(SymbolTable_create(&st, 16), 0);
+
+    for (size_t index = 0; index < sizeof(predefined) / sizeof(predefined[0]); index++) {
+        TEST_EQUAL(SymbolTable_getAddress(&st, predefined[index].name), predefined[index].address);
+        TEST_EQUAL(SymbolTable_contains(&st, predefined[index].name), 1);
+    }
+
+    // Close to a predefined symbol but not one
+    errno = 0;
+    TEST_EQUAL(SymbolTable_getAddress(&st, "R16"), -1);
+    TEST_EQUAL(errno, 0);
+    TEST_EQUAL(SymbolTable_contains(&st, "SCREENS"), 0);
+    TEST_EQUAL(SymbolTable_contains(&st, "sp"), 0);
+    TEST_EQUAL(SymbolTable_containsN(&st, "SP\0", 3), 0);
+
+    // The predefined symbols can't be redefined
+    errno = 0;
+    TEST_EQUAL(SymbolTable_addEntry(&st, "KBD", 100), -1);
+    TEST_EQUAL(errno, EEXIST);
+    TEST_EQUAL(SymbolTable_getAddress(&st, "KBD"), 24576);
+
+    // Nothing was allocated by the lookups
+    TEST_EQUAL(st.capacity, 0);
+
+    SymbolTable_free(&st);
+}
+
+/* No other name lands on a predefined symbol through the perfect hash: every short
+ * name, and every name one edit away from a predefined one */
+static void testPredefinedMisses(void)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789_.$:";
+    size_t letters = strlen(alphabet);
+
+    SymbolTable st;
+    TEST_EQUAL(SymbolTable_create(&st, 16), 0);
+
+    int wrong = 0;
+    char name[8];
+
+    for (size_t length = 1; length <= 3; length++) {
+        size_t count = 1;
+        for (size_t position = 0; position < length; position++) {
+            count *= letters;
+        }
+
+        for (size_t number = 0; number < count; number++) {
+            size_t digits = number;
+            for (size_t position = 0; position < length; position++) {
+                name[position] = alphabet[digits % letters];
+                digits /= letters;
+            }
+            wrong += (SymbolTable_getAddressN(&st, name, length) != predefinedAddress(name, length));
+        }
+    }
+
+    for (size_t index = 0; index < sizeof(predefined) / sizeof(predefined[0]); index++) {
+        size_t length = strlen(predefined[index].name);
+
+        for (size_t position = 0; position <= length; position++) {
+            // Cut, changed at position, and grown by a character at position
+            wrong += (SymbolTable_getAddressN(&st, predefined[index].name, position) !=
+                      predefinedAddress(predefined[index].name, position));
+
+            for (size_t letter = 0; letter < letters; letter++) {
+                memcpy(name, predefined[index].name, length);
+                if (position < length) {
+                    name[position] = alphabet[letter];
+                    wrong += (SymbolTable_getAddressN(&st, name, length) != predefinedAddress(name, length));
+                }
+
+                memcpy(name, predefined[index].name, position);
+                name[position] = alphabet[letter];
+                memcpy(name + position + 1, predefined[index].name + position, length - position);
+                wrong += (SymbolTable_getAddressN(&st, name, length + 1) != predefinedAddress(name, length + 1));
+            }
+        }
+    }
+
+    TEST_EQUAL(wrong, 0);
+    TEST_EQUAL(st.capacity, 0);
+
+    SymbolTable_free(&st);
+}
+
+/* Added entries are found, updated, and a missing one isn't an error */
+static void testEntries(void)
+{
+    SymbolTable st;
+    TEST_EQUAL(SymbolTable_create(&st, 16), 0);
+
+    TEST_EQUAL(SymbolTable_addEntry(&st, "LOOP", 10), 0);
+    TEST_EQUAL(SymbolTable_addEntry(&st, "i", 16), 0);
+    TEST_EQUAL(st.size, 2);
+
+    TEST_EQUAL(SymbolTable_getAddress(&st, "LOOP"), 10);
+    TEST_EQUAL(SymbolTable_getAddress(&st, "i"), 16);
+
+    // Updating keeps a single entry
+    TEST_EQUAL(SymbolTable_addEntry(&st, "LOOP", 12), 0);
+    TEST_EQUAL(SymbolTable_getAddress(&st, "LOOP"), 12);
+    TEST_EQUAL(st.size, 2);
+
+    // A view into a longer string only matches its own length
+    const char* line = "LOOPER";
+    TEST_EQUAL(SymbolTable_getAddressN(&st, line, 4), 12);
+    TEST_EQUAL(SymbolTable_containsN(&st, line, 6), 0);
+    TEST_EQUAL(SymbolTable_containsN(&st, line, 3), 0);
+
+    errno = 0;
+    TEST_EQUAL(SymbolTable_getAddress(&st, "END"), -1);
+    TEST_EQUAL(errno, 0);
+
+    SymbolTable_free(&st);
+}
+
+/* Addresses a 15 bit A instruction can't load are refused */
+static void testAddressRange(void)
+{
+    SymbolTable st;
+    TEST_EQUAL(SymbolTable_create(&st, 16), 0);
+
+    TEST_EQUAL(SymbolTable_addEntry(&st, "LAST", 32767), 0);
+    TEST_EQUAL(SymbolTable_getAddress(&st, "LAST"), 32767);
+
+    errno = 0;
+    TEST_EQUAL(SymbolTable_addEntry(&st, "FAR", 32768), -1);
+    TEST_EQUAL(errno, EINVAL);
+    TEST_EQUAL(SymbolTable_contains(&st, "FAR"), 0);
+
+    SymbolTable_free(&st);
+}
+
+/* The table doubles past its load factor and every entry survives the rehash,
+ * the keys are copied so the caller's buffer can be reused */
+static void testGrowth(void)
+{
+    SymbolTable st;
+    TEST_EQUAL(SymbolTable_create(&st, 1), 0);
+
+    char name[32];
+    for (int index = 0; index < 20000; index++) {
+        snprintf(name, sizeof(name), "symbol_%d", index);
+        TEST_EQUAL(SymbolTable_addEntry(&st, name, index % 32000), 0);
+    }
+
+    TEST_EQUAL(st.size, 20000);
+    TEST_CHECK(st.size <= st.capacity - st.capacity / 8);
+    TEST_EQUAL(st.capacity & (st.capacity - 1), 0);
+
+    int found = 0;
+    for (int index = 0; index < 20000; index++) {
+        snprintf(name, sizeof(name), "symbol_%d", index);
+        found += (SymbolTable_getAddress(&st, name) == index % 32000);
+    }
+    TEST_EQUAL(found, 20000);
+
+    SymbolTable_free(&st);
+}
+
+/* Names that differ only past the probed control bytes still
+ * resolve to their own slot, many share their low hash bits */
+static void testProbing(void)
+{
+    SymbolTable st;
+    TEST_EQUAL(SymbolTable_create(&st, 4096), 0);
+
+    char name[32];
+    for (int index = 0; index < 3000; index++) {
+        snprintf(name, sizeof(name), "x%d", index);
+        TEST_EQUAL(SymbolTable_addEntry(&st, name, index), 0);
+    }
+
+    // No resize, every collision was resolved by probing
+    TEST_EQUAL(st.capacity, st.initial_capacity);
+
+    int found = 0;
+    int missing = 0;
+    for (int index = 0; index < 3000; index++) {
+        snprintf(name, sizeof(name), "x%d", index);
+        found += (SymbolTable_getAddress(&st, name) == index);
+
+        snprintf(name, sizeof(name), "y%d", index);
+        missing += (SymbolTable_contains(&st, name) == 0);
+    }
+    TEST_EQUAL(found, 3000);
+    TEST_EQUAL(missing, 3000);
+
+    SymbolTable_free(&st);
+}
+
+/* A reset table only knows the predefined symbols and keeps its slots */
+static void testReset(void)
+{
+    SymbolTable st;
+    TEST_EQUAL(SymbolTable_create(&st, 16), 0);
+
+    TEST_EQUAL(SymbolTable_addEntry(&st, "LOOP", 10), 0);
+    size_t capacity = st.capacity;
+
+    TEST_EQUAL(SymbolTable_reset(&st), 0);
+    TEST_EQUAL(st.size, 0);
+    TEST_EQUAL(st.capacity, capacity);
+    TEST_EQUAL(SymbolTable_contains(&st, "LOOP"), 0);
+    TEST_EQUAL(SymbolTable_getAddress(&st, "SCREEN"), 16384);
+
+    TEST_EQUAL(SymbolTable_addEntry(&st, "LOOP", 20), 0);
+    TEST_EQUAL(SymbolTable_getAddress(&st, "LOOP"), 20);
+
+    SymbolTable_free(&st);
+}
+
+/* Every search through the table is counted, except the read only lookup */
+static void testLookups(void)
+{
+    SymbolTable st;
+    TEST_EQUAL(SymbolTable_create(&st, 16), 0);
+    TEST_EQUAL(st.lookups, 0);
+
+    TEST_EQUAL(SymbolTable_contains(&st, "LOOP"), 0);
+    TEST_EQUAL(SymbolTable_addEntry(&st, "LOOP", 4), 0);
+    TEST_EQUAL(SymbolTable_getAddress(&st, "LOOP"), 4);
+    TEST_EQUAL(SymbolTable_getAddress(&st, "SP"), 0);
+    TEST_EQUAL(st.lookups, 4);
+
+    TEST_EQUAL(SymbolTable_readAddressN(&st, "LOOP", 4), 4);
+    TEST_EQUAL(st.lookups, 4);
+
+    TEST_EQUAL(SymbolTable_reset(&st), 0);
+    TEST_EQUAL(st.lookups, 0);
+
+    SymbolTable_free(&st);
+}
+
+int main(void)
+{
+    TEST_RUN(testPredefined);
+    TEST_RUN(testPredefinedMisses);
+    TEST_RUN(testEntries);
+    TEST_RUN(testAddressRange);
+    TEST_RUN(testGrowth);
+    TEST_RUN(testProbing);
+    TEST_RUN(testReset);
+    TEST_RUN(testLookups);
+
+    return TEST_EXIT();
+}
@@ -0,0 +1,58 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <string.h>
+
+/* A minimal harness for the unit tests, every test file is a program of its own.
+ * A failed check prints where it failed and the test goes on with the next check,
+ * TEST_EXIT makes the program fail if any check did */
+
+static int test_failures = 0;
+
+/* Fail the running test unless condition holds */
+#define TEST_CHECK(condition)                                                   \
+    do {                                                                        \
+        if (!(condition)) {                                                     \
+            fprintf(stderr, "%s:%d: check failed: %s\n",                        \
+                    __FILE__, __LINE__, #condition);                            \
+            test_failures += 1;                                                 \
+        }                                                                       \
+    } while (0)
+
+/* Fail the running test unless the two integers are equal */
+#define TEST_EQUAL(actual, expected)                                            \
+    do {                                                                        \
+        long long test_actual = (long long) (actual);                           \
+        long long test_expected = (long long) (expected);                       \
+        if (test_actual != test_expected) {                                     \
+            fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n",               \
+                    __FILE__, __LINE__, #actual, test_actual, test_expected);   \
+            test_failures += 1;                                                 \
+        }                                                                       \
+    } while (0)
+
+/* Fail the running test unless the length bytes at actual are the string expected */
+#define TEST_BYTES(actual, length, expected)                                    \
+    do {                                                                        \
+        if ((length) != strlen(expected) ||                                     \
+            memcmp((actual), (expected), (length)) != 0) {                      \
+            fprintf(stderr, "%s:%d: %s is \"%.*s\", expected \"%s\"\n",         \
+                    __FILE__, __LINE__, #actual, (int) (length),                \
+                    (const char*) (actual), (expected));                        \
+            test_failures += 1;                                                 \
+        }                                                                       \
+    } while (0)
+
+/* Run a test function, a void function of no arguments */
+#define TEST_RUN(function)                                                      \
+    do {                                                                        \
+        int test_before = test_failures;                                        \
+        function();                                                             \
+        printf("%-40s %s\n", #function, (test_failures == test_before) ? "ok" : "FAILED"); \
+    } while (0)
+
+/* Exit status of the test program */
+#define TEST_EXIT()     ((test_failures == 0) ? 0 : 1)
+
+#endif
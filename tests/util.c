@@ -0,0 +1,178 @@
+#include "test.h"
+#include "../util.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+
+/* Make a view of a null terminated name */
+static StringView makeView(const char* name)
+{
+    StringView view = { name, strlen(name) };
+    return view;
+}
+
+/* Append every A and C command of source to command_array, labels are defined at
+ * the address of the next instruction
+ * Return 0 on success
+ * Return -1 on failure */
+static int appendSource(CommandArray* command_array, const char* source)
+{
+    Parser parser;
+    Parser_createFromBuffer(&parser, source, strlen(source));
+
+    int error = 0;
+    while (error == 0 && (error = Parser_advance(&parser)) == 0) {
+        if (Parser_commandType(&parser) == L_COMMAND) {
+            error = (CommandArray_addLabel(command_array, Parser_symbolView(&parser), (int) command_array->size) < 0) ? -1 : 0;
+        }
+        else {
+            error = CommandArray_copyCommand(command_array, &parser);
+        }
+    }
+
+    Parser_free(&parser);
+
+    return (error < 0) ? -1 : 0;
+}
+
+/* Final words are stored as they are, symbolic A commands as the ID of their
+ * symbol, shared by every reference and the label */
+static void testCopyCommands(void)
+{
+    Arena arena;
+    TEST_EQUAL(Arena_create(&arena, 1024), 0);
+
+    CommandArray commands;
+    TEST_EQUAL(CommandArray_create(&commands, 4, &arena), 0);
+
+    TEST_EQUAL(appendSource(&commands, "@5\nD=A\n@LOOP\n@x\n(LOOP)\n@LOOP\n0;JMP\n"), 0);
+    TEST_EQUAL(commands.size, 6);
+
+    static const uint16_t words[] = { 5, 0xec10, 0, 0, 0, 0xea87 };
+    static const uint32_t ids[] = { COMMAND_NO_SYMBOL, COMMAND_NO_SYMBOL, 0, 1, 0, COMMAND_NO_SYMBOL };
+    for (size_t index = 0; index < 6; index++) {
+        TEST_EQUAL(commands.words[index], words[index]);
+        TEST_EQUAL(commands.symbol_ids[index], ids[index]);
+    }
+
+    TEST_EQUAL(commands.symbols.count, 2);
+    TEST_EQUAL(commands.addresses[0], 4);
+    TEST_EQUAL(commands.addresses[1], COMMAND_UNASSIGNED);
+    TEST_BYTES(commands.symbols.names[1].data, commands.symbols.names[1].length, "x");
+
+    CommandArray_free(&commands);
+    Arena_free(&arena);
+}
+
+/* The arrays double as commands are added and keep every command */
+static void testGrowth(void)
+{
+    Arena arena;
+    TEST_EQUAL(Arena_create(&arena, 1024), 0);
+
+    CommandArray commands;
+    TEST_EQUAL(CommandArray_create(&commands, 1, &arena), 0);
+
+    char line[32];
+    for (int index = 0; index < 10000; index++) {
+        snprintf(line, sizeof(line), (index % 2 == 0) ? "@%d\n" : "@s%d\n", index / 2);
+        TEST_EQUAL(appendSource(&commands, line), 0);
+    }
+
+    TEST_EQUAL(commands.size, 10000);
+    TEST_CHECK(commands.capacity >= 10000);
+    TEST_EQUAL(commands.symbols.count, 5000);
+
+    int intact = 0;
+    for (uint32_t index = 0; index < 10000; index++) {
+        if (index % 2 == 0) {
+            intact += (commands.words[index] == index / 2 && commands.symbol_ids[index] == COMMAND_NO_SYMBOL);
+        }
+        else {
+            intact += (commands.symbol_ids[index] == index / 2 && commands.addresses[index / 2] == COMMAND_UNASSIGNED);
+        }
+    }
+    TEST_EQUAL(intact, 10000);
+
+    CommandArray_free(&commands);
+    Arena_free(&arena);
+}
+
+/* A label is defined once, at an address an A instruction can load */
+static void testAddLabel(void)
+{
+    Arena arena;
+    TEST_EQUAL(Arena_create(&arena, 1024), 0);
+
+    CommandArray commands;
+    TEST_EQUAL(CommandArray_create(&commands, 16, &arena), 0);
+
+    TEST_EQUAL(CommandArray_addLabel(&commands, makeView("LOOP"), 3), 0);
+    TEST_EQUAL(CommandArray_addLabel(&commands, makeView("NEAR"), 32765), 1);
+    TEST_EQUAL(CommandArray_addLabel(&commands, makeView("LAST"), 32767), 2);
+    TEST_EQUAL(commands.addresses[2], 32767);
+
+    errno = 0;
+    TEST_EQUAL(CommandArray_addLabel(&commands, makeView("LOOP"), 7), -1);
+    TEST_EQUAL(errno, EEXIST);
+    TEST_EQUAL(commands.addresses[0], 3);
+
+    errno = 0;
+    TEST_EQUAL(CommandArray_addLabel(&commands, makeView("FAR"), 32768), -1);
+    TEST_EQUAL(errno, EINVAL);
+    errno = 0;
+    TEST_EQUAL(CommandArray_addLabel(&commands, makeView("BACK"), -1), -1);
+    TEST_EQUAL(errno, EINVAL);
+
+    // Labels aren't instructions
+    Parser parser;
+    Parser_createFromBuffer(&parser, "(END)\n", 6);
+    TEST_EQUAL(Parser_advance(&parser), 0);
+    errno = 0;
+    TEST_EQUAL(CommandArray_copyCommand(&commands, &parser), -1);
+    TEST_EQUAL(errno, EINVAL);
+    TEST_EQUAL(commands.size, 0);
+    Parser_free(&parser);
+
+    CommandArray_free(&commands);
+    Arena_free(&arena);
+}
+
+/* A reset array starts over with the first ID and keeps its arrays */
+static void testReset(void)
+{
+    Arena arena;
+    TEST_EQUAL(Arena_create(&arena, 1024), 0);
+
+    CommandArray commands;
+    TEST_EQUAL(CommandArray_create(&commands, 4, &arena), 0);
+
+    TEST_EQUAL(appendSource(&commands, "@a\n@b\n@c\n@d\n@e\n(a)\n"), 0);
+    size_t capacity = commands.capacity;
+
+    CommandArray_reset(&commands);
+    Arena_reset(&arena);
+    TEST_EQUAL(commands.size, 0);
+    TEST_EQUAL(commands.symbols.count, 0);
+    TEST_EQUAL(commands.capacity, capacity);
+
+    TEST_EQUAL(appendSource(&commands, "@e\n(e)\n"), 0);
+    TEST_EQUAL(commands.symbol_ids[0], 0);
+    TEST_EQUAL(commands.addresses[0], 1);
+
+    CommandArray_free(&commands);
+    Arena_free(&arena);
+}
+
+int main(void)
+{
+    TEST_RUN(testCopyCommands);
+    TEST_RUN(testGrowth);
+    TEST_RUN(testAddLabel);
+    TEST_RUN(testReset);
+
+    return TEST_EXIT();
+}
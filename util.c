@@ -4,116 +4,7 @@
 #include <string.h>
 #include <errno.h>
 #include <stdlib.h>
-
-
-/* Trims the whitespace out of a string
- * and returns a newly allocated string that
- * has been trimmed.
- * Return NULL = error, errno will be set
- * Return valid pointer on success. 
- * NOTE if str is just whitespace an empty string will be returned */
-extern char* strtrim(const char* str)
-{
-    if (str != NULL) {
-        size_t length = strlen(str);
-
-        char*  trimmed_str = calloc(length + 1, sizeof(char));
-        size_t trimmed_str_index = 0;
-
-        // failed memory allocation
-        if (trimmed_str == NULL) {
-            return NULL;
-        }
-
-        for (size_t index = 0; index < length; index++) {
-
-            // if the current character isn't a space add it to the trimmed str
-            if (isspace(str[index]) == 0) {
-
-               trimmed_str[trimmed_str_index] = str[index]; 
-
-               trimmed_str_index += 1;
-            }
-        }
-
-        // the trimmed_str is set to NULL when allocated so
-        // no need for a NULL terminator to be placed
-
-        return trimmed_str;
-    }
-
-    else {
-        errno = EINVAL;
-        return NULL;
-    }
-}
-
-
-/* Returns the command type if instruction holds a valid command
- * Returns NONE_COMMAND if an error occurred or if the instruction
- * is invalid 
- * NOTE: it is assumed that the instruction has been trimmed and
- * contains no whitespace */
-extern enum Command findCommandType(const char* instruction)
-{
-    /* The function does some simple string checks and can
-     * be fooled but truly invalid commands will be caught later */
-
-    if (instruction != NULL) {
-
-        // A commands always start with @
-        if (instruction[0] == '@') {
-            return A_COMMAND;
-        }
-
-        // Labels always start with a '(' and will contain another ')'
-        else if (instruction[0] == '(' && strchr(instruction, ')') != NULL) {
-            return L_COMMAND;
-        }
-
-        else if (strchr(instruction, '=') != NULL || strchr(instruction, ';') != NULL) {
-            return C_COMMAND;
-        }
-
-        else {
-            errno = EINVAL;
-            return NONE_COMMAND;
-        }
-    }
-
-    else {
-        errno = EINVAL;
-        return NONE_COMMAND;
-    }
-}
-
-
-/* Check if a string is a valid number
- * return 1 = yes valid positive number
- * return 0 = not valid number */
-extern int isNum(const char* num_str)
-{
-    if (num_str != NULL) {
-
-        size_t length = strlen(num_str);
-
-        // test if every character is a number
-        for (size_t str_index = 0; str_index < length; str_index++) {
-
-            if (isdigit(num_str[str_index]) == 0) {
-                return 0;
-            }
-        }
-
-        // if we get here all characters must be a digit
-        return 1;
-    }
-
-    else {
-        return 0;
-    }
-}
-
+#include <stdint.h>
 
 
 /* resize the given command array to the new capacity
@@ -126,24 +17,24 @@ static int CommandArray_resize(CommandArray* command_array, size_t new_capacity)
         command_array->capacity < new_capacity) {
 
         errno =  0;
-        ParsedCommand* new_array = reallocarray(command_array->commands, new_capacity, sizeof(ParsedCommand));
+        uint16_t* new_words = reallocarray(command_array->words, new_capacity, sizeof(uint16_t));
 
         // error occurred while allocating
         if (errno != 0) {
             return -1;
         }
 
-        // initialize the new entries
-        for (size_t index = command_array->size; index < new_capacity; index++) {
-            new_array[index].symbol = NULL;
-            new_array[index].destination = NULL;
-            new_array[index].computation = NULL;
-            new_array[index].jump = NULL;
-            new_array[index].type = NONE_COMMAND;
+        command_array->words = new_words;
+
+        uint32_t* new_symbol_ids = reallocarray(command_array->symbol_ids, new_capacity, sizeof(uint32_t));
+
+        // error occurred while allocating, the larger words array is harmless
+        if (errno != 0) {
+            return -1;
         }
 
         // set the new values in the structure
-        command_array->commands = new_array;
+        command_array->symbol_ids = new_symbol_ids;
         command_array->capacity = new_capacity;
 
         // Done :)
@@ -155,17 +46,23 @@ static int CommandArray_resize(CommandArray* command_array, size_t new_capacity)
     }
 }
 
-/* Create a dynamic array of parsed commands
+/* Create a dynamic array of encoded commands
+ * The symbol names are carved from arena, which must outlive the array
  * return 0 on successful creation, will overwrite command_array's values
  * return -1 on error */
-extern int CommandArray_create(CommandArray* command_array, size_t capacity)
+extern int CommandArray_create(CommandArray* command_array, size_t capacity, Arena* arena)
 {
-    if (command_array != NULL) {
+    if (command_array != NULL &&
+        arena != NULL) {
 
         // Initialize
-        command_array->commands = NULL;
+        command_array->words = NULL;
+        command_array->symbol_ids = NULL;
         command_array->size = 0;
         command_array->capacity = 0;
+        command_array->addresses = NULL;
+        command_array->address_capacity = 0;
+        Interner_create(&command_array->symbols, arena);
 
         if (CommandArray_resize(command_array, capacity) == -1) {
             // Failed to make the array
@@ -183,117 +80,160 @@ extern int CommandArray_create(CommandArray* command_array, size_t capacity)
 }
 
 /* Free an allocated CommandArray
+ * The symbol names are released with the arena
  */
 extern void CommandArray_free(CommandArray* command_array)
 {
-    if (command_array != NULL &&
-        command_array->commands != NULL &&
-        command_array->capacity > 0) {
-
-        // Free all the parsed commands
-        for (size_t index = 0; index < command_array->size; index++) {
-            ParsedCommand_free(&command_array->commands[index]);
-        }
+    if (command_array != NULL) {
 
-        // free the array
-        free(command_array->commands);
+        // free the arrays
+        free(command_array->words);
+        free(command_array->symbol_ids);
+        free(command_array->addresses);
+        Interner_free(&command_array->symbols);
 
         // reset the values
-        command_array->commands = NULL;
+        command_array->words = NULL;
+        command_array->symbol_ids = NULL;
+        command_array->addresses = NULL;
         command_array->size = 0;
         command_array->capacity = 0;
+        command_array->address_capacity = 0;
+    }
+}
+
+/* Empty a CommandArray so it can hold the next program
+ * The arrays are kept, the symbol names must be released by resetting the arena
+ */
+extern void CommandArray_reset(CommandArray* command_array)
+{
+    if (command_array != NULL) {
+        command_array->size = 0;
+        Interner_reset(&command_array->symbols);
     }
 }
 
-/* Copy the current parsed command from the parser into
- * the commandArray.
+/* Get the ID of a symbol, a new symbol has no address yet
+ * Return the symbol ID on success
+ * Return -1 on failure, errno will be set */
+static int64_t CommandArray_internSymbol(CommandArray* command_array, StringView symbol)
+{
+    size_t symbol_count = command_array->symbols.count;
+
+    // Keep room in the address table for a new symbol
+    if (symbol_count == command_array->address_capacity) {
+
+        size_t new_capacity = (command_array->address_capacity > 0) ? command_array->address_capacity * 2 : 16;
+
+        errno = 0;
+        int* new_addresses = reallocarray(command_array->addresses, new_capacity, sizeof(int));
+        if (errno != 0) {
+            return -1;
+        }
+
+        command_array->addresses = new_addresses;
+        command_array->address_capacity = new_capacity;
+    }
+
+    int64_t id = Interner_intern(&command_array->symbols, symbol.data, symbol.length);
+
+    // A new symbol has no address yet
+    if (id >= 0 && (size_t) id == symbol_count) {
+        command_array->addresses[id] = COMMAND_UNASSIGNED;
+    }
+
+    return id;
+}
+
+/* Encode the current command of the parser and append it to
+ * the commandArray. C commands and constant A commands are stored
+ * as their final word, symbolic A commands as a symbol ID.
+ * Only A and C commands can be appended, labels aren't instructions.
  * return 0 on success
  * return -1 on failure */
 extern int CommandArray_copyCommand(CommandArray* command_array, Parser* parser)
 {
-
-    // How much entries to add if the command array is full
-    static const size_t expansion_value = 10;
-
     if (command_array != NULL &&
         parser != NULL) {
 
         // Check if theres space
         if (command_array->size == command_array->capacity) {
 
-            if (CommandArray_resize(command_array, command_array->capacity + expansion_value) == -1) {
+            // Double the capacity so appending stays amortized O(1)
+            size_t new_capacity = (command_array->capacity > 0) ? command_array->capacity * 2 : 16;
+
+            if (CommandArray_resize(command_array, new_capacity) == -1) {
                 // Failed to resize the array
                 return -1;
             }
         }
 
-        // the current working ParsedCommand structure
-        ParsedCommand* current_command = &command_array->commands[command_array->size];
+        uint16_t word = 0;
+        uint32_t symbol_id = COMMAND_NO_SYMBOL;
 
         // Get the command type
         enum Command command_type = Parser_commandType(parser);
 
-        if (command_type == A_COMMAND || command_type == L_COMMAND) {
-
-            // copy the field
-            current_command->symbol = strdup(Parser_symbol(parser));
+        // The parser already encoded the word, only symbols are left for code generation
+        if (command_type == A_COMMAND && Parser_needsSymbol(parser) == 1) {
 
-            // check for memory error
-            if (current_command->symbol == NULL) {
+            int64_t id = CommandArray_internSymbol(command_array, Parser_symbolView(parser));
+            if (id < 0) {
                 return -1;
             }
-        }
 
-        else if (command_type == C_COMMAND) {
+            symbol_id = (uint32_t) id;
+        }
 
-            // copy the computation field, it will always be filled out 
-            current_command->computation = strdup(Parser_comp(parser));
+        else if (command_type == A_COMMAND || command_type == C_COMMAND) {
+            word = Parser_word(parser);
+        }
 
-            // check for memory error
-            if (current_command->computation == NULL) {
-                return -1;
-            }
+        // Unknown command type
+        else {
+            errno = EINVAL;
+            return -1;
+        }
 
-            // Copy the jump field if it exists
-            if (Parser_jump(parser) != NULL) {
+        command_array->words[command_array->size] = word;
+        command_array->symbol_ids[command_array->size] = symbol_id;
 
-                current_command->jump = strdup(Parser_jump(parser));
+        command_array->size += 1;
 
-                // check for memory error
-                if (current_command->jump == NULL) {
-                    free(current_command->computation);
-                    current_command->computation = NULL;
-                    return -1;
-                }
-            }
+        // Successful copy :)
+        return 0;
 
-            // Copy the destination field exists, the dest and jump fields should never exist together
-            else if (Parser_dest(parser) != NULL) {
+    }
 
-                current_command->destination = strdup(Parser_dest(parser));
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
 
-                // check for memory error
-                if (current_command->destination == NULL) {
-                    free(current_command->computation);
-                    current_command->computation = NULL;
-                    return -1;
-                }
-            }
+/* Define the label symbol at address
+ * return the symbol ID of the label on success
+ * return -1 on failure, errno is EEXIST if the label was already defined
+ * and EINVAL if address doesn't fit in an A instruction */
+extern int64_t CommandArray_addLabel(CommandArray* command_array, StringView symbol, int address)
+{
+    if (command_array != NULL &&
+        address >= 0 && address <= 32767 && // largest value a 15 bit A instruction can load, 2^15 - 1
+        symbol.data != NULL) {
 
+        int64_t id = CommandArray_internSymbol(command_array, symbol);
+        if (id < 0) {
+            return -1;
         }
 
-        // Unknown command type
-        else {
+        if (command_array->addresses[id] != COMMAND_UNASSIGNED) {
+            errno = EEXIST;
             return -1;
         }
 
-        current_command->type = command_type;
-
-        command_array->size += 1;
-
-        // Successful copy :)
-        return 0;
+        command_array->addresses[id] = address;
 
+        return id;
     }
 
     else {
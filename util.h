@@ -2,31 +2,43 @@
 #define UTIL_H
 
 #include "parser.h"
+#include "arena.h"
+#include "interner.h"
 
-/* This file contains micelaneous utility functions that cant be provided 
- * by libc */
+#include <stdint.h>
 
+/* This file contains the array the parsed program is encoded into */
 
-// trim whitespace in a string
-extern char* strtrim(const char*);
 
-// Finds what type of command is contained in the given string
-extern enum Command findCommandType(const char*);
-
-// Determines if the current string is a postive number
-extern int isNum(const char*);
+/* symbol_ids entry of an instruction that doesn't reference a symbol */
+#define COMMAND_NO_SYMBOL   UINT32_MAX
 
+/* addresses entry of a symbol that isn't resolved yet */
+#define COMMAND_UNASSIGNED  (-1)
 
+/* Encoded instructions, stored as a struct of arrays.
+ * C instructions and constant A instructions hold their final word,
+ * symbolic A instructions hold the interned ID of the referenced symbol.
+ * Labels and references to the same name share one ID, the address of
+ * every symbol is kept in a table indexed by it */
 struct StructCommandArray {
     size_t size;
     size_t capacity;
-    ParsedCommand* commands;
+    uint16_t* words;        // Final instruction word, 0 for symbolic A instructions
+    uint32_t* symbol_ids;   // Referenced symbol or COMMAND_NO_SYMBOL
+
+    Interner symbols;       // Names of the referenced symbols, indexed by symbol ID
+
+    int*   addresses;       // Address of every symbol or COMMAND_UNASSIGNED, indexed by symbol ID
+    size_t address_capacity;
 };
 
 typedef struct StructCommandArray CommandArray;
 
-extern int CommandArray_create(CommandArray*, size_t);
+extern int CommandArray_create(CommandArray*, size_t, Arena*);
 extern void CommandArray_free(CommandArray*);
+extern void CommandArray_reset(CommandArray*);
 extern int CommandArray_copyCommand(CommandArray*, Parser*);
+extern int64_t CommandArray_addLabel(CommandArray*, StringView, int);
 
 #endif
@@ -0,0 +1,151 @@
+#include "window.h"
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* Double the ring, the held words are moved to the start of the new one
+ * Return 0 on success
+ * Return -1 on failure, set errno */
+static int Window_grow(Window* window)
+{
+    size_t new_capacity = (window->capacity > 0) ? window->capacity * 2 : 256;
+
+    uint16_t* new_words = malloc(new_capacity * sizeof(uint16_t));
+    uint8_t* new_pending = malloc(new_capacity * sizeof(uint8_t));
+
+    if (new_words == NULL || new_pending == NULL) {
+        free(new_words);
+        free(new_pending);
+        return -1;
+    }
+
+    // Unroll the ring
+    for (size_t index = 0; index < window->count; index++) {
+        size_t slot = (window->head + index) & (window->capacity - 1);
+        new_words[index] = window->words[slot];
+        new_pending[index] = window->pending[slot];
+    }
+
+    free(window->words);
+    free(window->pending);
+
+    window->words = new_words;
+    window->pending = new_pending;
+    window->capacity = new_capacity;
+    window->head = 0;
+
+    return 0;
+}
+
+
+/* Create an empty window, nothing is allocated until a word is held */
+extern void Window_create(Window* window)
+{
+    if (window != NULL) {
+        memset(window, 0, sizeof(Window));
+    }
+}
+
+/* Free the held words */
+extern void Window_free(Window* window)
+{
+    if (window != NULL) {
+        free(window->words);
+        free(window->pending);
+        memset(window, 0, sizeof(Window));
+    }
+}
+
+/* Add the next word of the program, pending is 1 if it waits for a symbol.
+ * The word is written straight to output if nothing is held
+ * Return 0 on success
+ * Return -1 on failure, set errno */
+extern int Window_push(Window* window, Output* output, uint16_t word, int pending)
+{
+    if (window != NULL &&
+        output != NULL) {
+
+        // Nothing to wait for
+        if (window->count == 0 && pending == 0) {
+            window->first_index += 1;
+            return Output_writeWord(output, word);
+        }
+
+        if (window->count == window->capacity && Window_grow(window) < 0) {
+            return -1;
+        }
+
+        size_t slot = (window->head + window->count) & (window->capacity - 1);
+        window->words[slot] = word;
+        window->pending[slot] = (pending != 0) ? 1 : 0;
+
+        window->count += 1;
+        window->pending_count += window->pending[slot];
+
+        if (window->count > window->peak_count) {
+            window->peak_count = window->count;
+        }
+
+        return 0;
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/* Fill in the held word at output index with word, it no longer waits
+ * Return 0 on success
+ * Return -1 on failure, set errno */
+extern int Window_patch(Window* window, size_t index, uint16_t word)
+{
+    if (window != NULL &&
+        index >= window->first_index &&
+        index - window->first_index < window->count) {
+
+        size_t slot = (window->head + (index - window->first_index)) & (window->capacity - 1);
+
+        window->words[slot] = word;
+        window->pending_count -= window->pending[slot];
+        window->pending[slot] = 0;
+
+        return 0;
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/* Write the held words up to the oldest one that still waits
+ * Return 0 on success
+ * Return -1 on failure, set errno */
+extern int Window_release(Window* window, Output* output)
+{
+    if (window != NULL &&
+        output != NULL) {
+
+        while (window->count > 0 && window->pending[window->head] == 0) {
+
+            if (Output_writeWord(output, window->words[window->head]) < 0) {
+                return -1;
+            }
+
+            window->head = (window->head + 1) & (window->capacity - 1);
+            window->count -= 1;
+            window->first_index += 1;
+        }
+
+        return 0;
+    }
+
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+}
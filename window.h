@@ -0,0 +1,34 @@
+#ifndef WINDOW_H
+#define WINDOW_H
+
+#include "output.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* This module holds back the words of a single pass assembly that can't be
+ * written yet, so the output never has to be sought and can be a pipe.
+ * A word that references an undefined symbol is held until the symbol gets an
+ * address, and every word after it is held behind it so the output stays in order.
+ * Only the words from the oldest unresolved reference on are kept in memory */
+
+struct StructWindow {
+    uint16_t* words;           // Ring buffer of the held words
+    uint8_t*  pending;         // 1 while the word at the same place waits for a symbol
+    size_t    capacity;        // Size of the ring, a power of two, 0 until a word is held
+    size_t    head;            // Ring index of the oldest held word
+    size_t    count;           // Words held
+    size_t    first_index;     // Output index of the oldest held word, or of the next word if none are held
+    size_t    pending_count;   // Held words still waiting for a symbol
+    size_t    peak_count;      // Most words held at once
+};
+
+typedef struct StructWindow Window;
+
+extern void Window_create   (Window*);
+extern void Window_free     (Window*);
+extern int  Window_push     (Window*, Output*, uint16_t, int);
+extern int  Window_patch    (Window*, size_t, uint16_t);
+extern int  Window_release  (Window*, Output*);
+
+#endif